@@ -41,7 +41,13 @@ TEST_COMMON_SRC_FILES := \
 	runtime/dex_method_iterator_test.cc \
 	runtime/entrypoints/math_entrypoints_test.cc \
 	runtime/exception_test.cc \
+	runtime/gc/accounting/allocation_site_table_test.cc \
+	runtime/gc/accounting/card_table_test.cc \
 	runtime/gc/accounting/space_bitmap_test.cc \
+	runtime/gc/accounting/work_stealing_deque_test.cc \
+	runtime/gc/allocation_profiler_test.cc \
+	runtime/gc/collector/compactor_test.cc \
+	runtime/gc/gc_event_log_test.cc \
 	runtime/gc/heap_test.cc \
 	runtime/gc/space/space_test.cc \
 	runtime/gtest_test.cc \
@@ -116,8 +116,8 @@ bool ImageWriter::Write(const std::string& image_filename,
   heap->CollectGarbage(false);  // Remove garbage.
   // Trim size of alloc spaces.
   for (const auto& space : heap->GetContinuousSpaces()) {
-    if (space->IsDlMallocSpace()) {
-      space->AsDlMallocSpace()->Trim();
+    if (space->IsMallocSpace()) {
+      space->AsMallocSpace()->Trim();
     }
   }
 
@@ -185,7 +185,7 @@ void ImageWriter::RecordImageAllocations() {
 bool ImageWriter::AllocMemory() {
   size_t size = 0;
   for (const auto& space : Runtime::Current()->GetHeap()->GetContinuousSpaces()) {
-    if (space->IsDlMallocSpace()) {
+    if (space->IsMallocSpace()) {
       size += space->Size();
     }
   }
@@ -373,6 +373,13 @@ ObjectArray<Object>* ImageWriter::CreateImageRoots() const {
   Class* object_array_class = class_linker->FindSystemClass("[Ljava/lang/Object;");
   Thread* self = Thread::Current();
 
+  // build the table of the strong interns, the dex cache strings among them
+  SirtRef<ObjectArray<String> > interned_strings(self,
+                                                 runtime->GetInternTable()->CreateImageTable(self));
+
+  // build the table of the classes, which have all been loaded by the boot class loader
+  SirtRef<ObjectArray<Class> > class_table(self, class_linker->class_table_.CreateImageTable(self));
+
   // build an Object[] of all the DexCaches used in the source_space_
   ObjectArray<Object>* dex_caches = ObjectArray<Object>::Alloc(self, object_array_class,
                                                                dex_caches_.size());
@@ -399,6 +406,10 @@ ObjectArray<Object>* ImageWriter::CreateImageRoots() const {
                    dex_caches);
   image_roots->Set(ImageHeader::kClassRoots,
                    class_linker->GetClassRoots());
+  image_roots->Set(ImageHeader::kInternedStrings,
+                   interned_strings.get());
+  image_roots->Set(ImageHeader::kClassTable,
+                   class_table.get());
   for (int i = 0; i < ImageHeader::kImageRootsMax; i++) {
     CHECK(image_roots->Get(i) != NULL);
   }
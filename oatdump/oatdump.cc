@@ -92,6 +92,8 @@ const char* image_roots_descriptions_[] = {
   "kOatLocation",
   "kDexCaches",
   "kClassRoots",
+  "kInternedStrings",
+  "kClassTable",
 };
 
 class OatDumper {
@@ -33,6 +33,7 @@ LIBART_COMMON_SRC_FILES := \
 	base/unix_file/string_file.cc \
 	check_jni.cc \
 	class_linker.cc \
+	class_table.cc \
 	common_throws.cc \
 	debugger.cc \
 	dex_file.cc \
@@ -44,19 +45,26 @@ LIBART_COMMON_SRC_FILES := \
 	disassembler_x86.cc \
 	elf_file.cc \
 	gc/allocator/dlmalloc.cc \
+	gc/allocator/rosalloc.cc \
+	gc/accounting/allocation_site_table.cc \
 	gc/accounting/card_table.cc \
 	gc/accounting/gc_allocator.cc \
 	gc/accounting/heap_bitmap.cc \
 	gc/accounting/mod_union_table.cc \
 	gc/accounting/space_bitmap.cc \
+	gc/allocation_profiler.cc \
+	gc/collector/compactor.cc \
 	gc/collector/garbage_collector.cc \
 	gc/collector/mark_sweep.cc \
 	gc/collector/partial_mark_sweep.cc \
 	gc/collector/sticky_mark_sweep.cc \
+	gc/gc_event_log.cc \
 	gc/heap.cc \
 	gc/space/dlmalloc_space.cc \
 	gc/space/image_space.cc \
 	gc/space/large_object_space.cc \
+	gc/space/malloc_space.cc \
+	gc/space/rosalloc_space.cc \
 	gc/space/space.cc \
 	hprof/hprof.cc \
 	image.cc \
@@ -100,6 +108,7 @@ LIBART_COMMON_SRC_FILES := \
 	native/java_lang_Thread.cc \
 	native/java_lang_Throwable.cc \
 	native/java_lang_VMClassLoader.cc \
+	native/java_lang_ref_Reference.cc \
 	native/java_lang_reflect_Array.cc \
 	native/java_lang_reflect_Constructor.cc \
 	native/java_lang_reflect_Field.cc \
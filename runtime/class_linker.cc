@@ -187,8 +187,6 @@ ClassLinker* ClassLinker::CreateFromImage(InternTable* intern_table) {
 ClassLinker::ClassLinker(InternTable* intern_table)
     // dex_lock_ is recursive as it may be used in stack dumping.
     : dex_lock_("ClassLinker dex lock", kDefaultMutexLevel),
-      dex_cache_image_class_lookup_required_(false),
-      failed_dex_cache_class_lookups_(0),
       class_roots_(NULL),
       array_iftable_(NULL),
       init_done_(false),
@@ -1015,7 +1013,6 @@ void ClassLinker::InitFromImage() {
 
   gc::Heap* heap = Runtime::Current()->GetHeap();
   gc::space::ImageSpace* space = heap->GetImageSpace();
-  dex_cache_image_class_lookup_required_ = true;
   CHECK(space != NULL);
   OatFile& oat_file = GetImageOatFile(space);
   CHECK_EQ(oat_file.GetOatHeader().GetImageFileLocationOatChecksum(), 0U);
@@ -1031,6 +1028,12 @@ void ClassLinker::InitFromImage() {
       space->GetImageHeader().GetImageRoot(ImageHeader::kClassRoots)->AsObjectArray<mirror::Class>();
   class_roots_ = class_roots;
 
+  class_table_.SetImageTable(space->GetImageHeader().GetImageRoot(ImageHeader::kClassTable)
+                                 ->AsObjectArray<mirror::Class>());
+
+  intern_table_->SetImageTable(space->GetImageHeader().GetImageRoot(ImageHeader::kInternedStrings)
+                                   ->AsObjectArray<mirror::String>());
+
   // Special case of setting up the String class early so that we can test arbitrary objects
   // as being Strings or not
   mirror::String::SetClass(GetClassRoot(kJavaLangString));
@@ -1111,9 +1114,7 @@ void ClassLinker::VisitRoots(RootVisitor* visitor, void* arg, bool only_dirty, b
   {
     ReaderMutexLock mu(self, *Locks::classlinker_classes_lock_);
     if (!only_dirty || class_table_dirty_) {
-      for (const std::pair<size_t, mirror::Class*>& it : class_table_) {
-        visitor(it.second, arg);
-      }
+      class_table_.VisitRoots(visitor, arg);
       if (clean_dirty) {
         class_table_dirty_ = false;
       }
@@ -1127,15 +1128,8 @@ void ClassLinker::VisitRoots(RootVisitor* visitor, void* arg, bool only_dirty, b
 }
 
 void ClassLinker::VisitClasses(ClassVisitor* visitor, void* arg) {
-  if (dex_cache_image_class_lookup_required_) {
-    MoveImageClassesToClassTable();
-  }
   ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  for (const std::pair<size_t, mirror::Class*>& it : class_table_) {
-    if (!visitor(it.second, arg)) {
-      return;
-    }
-  }
+  class_table_.Visit(visitor, arg);
 }
 
 static bool GetClassesVisitor(mirror::Class* c, void* arg) {
@@ -2202,21 +2196,13 @@ mirror::Class* ClassLinker::InsertClass(const char* descriptor, mirror::Class* k
     LOG(INFO) << "Loaded class " << descriptor << source;
   }
   WriterMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  mirror::Class* existing =
-      LookupClassFromTableLocked(descriptor, klass->GetClassLoader(), hash);
+  // Also finds the class in the image if it was loaded with the system class loader.
+  mirror::Class* existing = class_table_.Lookup(descriptor, klass->GetClassLoader(), hash);
   if (existing != NULL) {
     return existing;
   }
-  if (kIsDebugBuild && klass->GetClassLoader() == NULL && dex_cache_image_class_lookup_required_) {
-    // Check a class loaded with the system class loader matches one in the image if the class
-    // is in the image.
-    existing = LookupClassFromImage(descriptor);
-    if (existing != NULL) {
-      CHECK(klass == existing);
-    }
-  }
   Runtime::Current()->GetHeap()->VerifyObject(klass);
-  class_table_.insert(std::make_pair(hash, klass));
+  class_table_.Insert(klass, hash);
   class_table_dirty_ = true;
   return NULL;
 }
@@ -2224,175 +2210,19 @@ mirror::Class* ClassLinker::InsertClass(const char* descriptor, mirror::Class* k
 bool ClassLinker::RemoveClass(const char* descriptor, const mirror::ClassLoader* class_loader) {
   size_t hash = Hash(descriptor);
   WriterMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  ClassHelper kh;
-  for (auto it = class_table_.lower_bound(hash), end = class_table_.end(); it != end && it->first == hash;
-       ++it) {
-    mirror::Class* klass = it->second;
-    kh.ChangeClass(klass);
-    if (strcmp(kh.GetDescriptor(), descriptor) == 0 && klass->GetClassLoader() == class_loader) {
-      class_table_.erase(it);
-      return true;
-    }
-  }
-  return false;
+  return class_table_.Remove(descriptor, class_loader, hash);
 }
 
 mirror::Class* ClassLinker::LookupClass(const char* descriptor,
                                         const mirror::ClassLoader* class_loader) {
-  size_t hash = Hash(descriptor);
-  {
-    ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-    mirror::Class* result = LookupClassFromTableLocked(descriptor, class_loader, hash);
-    if (result != NULL) {
-      return result;
-    }
-  }
-  if (class_loader != NULL || !dex_cache_image_class_lookup_required_) {
-    return NULL;
-  } else {
-    // Lookup failed but need to search dex_caches_.
-    mirror::Class* result = LookupClassFromImage(descriptor);
-    if (result != NULL) {
-      InsertClass(descriptor, result, hash);
-    } else {
-      // Searching the image dex files/caches failed, we don't want to get into this situation
-      // often as map searches are faster, so after kMaxFailedDexCacheLookups move all image
-      // classes into the class table.
-      const int32_t kMaxFailedDexCacheLookups = 1000;
-      if (++failed_dex_cache_class_lookups_ > kMaxFailedDexCacheLookups) {
-        MoveImageClassesToClassTable();
-      }
-    }
-    return result;
-  }
-}
-
-mirror::Class* ClassLinker::LookupClassFromTableLocked(const char* descriptor,
-                                                       const mirror::ClassLoader* class_loader,
-                                                       size_t hash) {
-  ClassHelper kh(NULL, this);
-  auto end = class_table_.end();
-  for (auto it = class_table_.lower_bound(hash); it != end && it->first == hash; ++it) {
-    mirror::Class* klass = it->second;
-    kh.ChangeClass(klass);
-    if (klass->GetClassLoader() == class_loader && strcmp(descriptor, kh.GetDescriptor()) == 0) {
-      if (kIsDebugBuild) {
-        // Check for duplicates in the table.
-        for (++it; it != end && it->first == hash; ++it) {
-          mirror::Class* klass2 = it->second;
-          kh.ChangeClass(klass2);
-          CHECK(!(strcmp(descriptor, kh.GetDescriptor()) == 0 && klass2->GetClassLoader() == class_loader))
-          << PrettyClass(klass) << " " << klass << " " << klass->GetClassLoader() << " "
-          << PrettyClass(klass2) << " " << klass2 << " " << klass2->GetClassLoader();
-        }
-      }
-      return klass;
-    }
-  }
-  return NULL;
-}
-
-static mirror::ObjectArray<mirror::DexCache>* GetImageDexCaches()
-    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  gc::space::ImageSpace* image = Runtime::Current()->GetHeap()->GetImageSpace();
-  CHECK(image != NULL);
-  mirror::Object* root = image->GetImageHeader().GetImageRoot(ImageHeader::kDexCaches);
-  return root->AsObjectArray<mirror::DexCache>();
-}
-
-void ClassLinker::MoveImageClassesToClassTable() {
-  Thread* self = Thread::Current();
-  WriterMutexLock mu(self, *Locks::classlinker_classes_lock_);
-  if (!dex_cache_image_class_lookup_required_) {
-    return;  // All dex cache classes are already in the class table.
-  }
-  const char* old_no_suspend_cause =
-      self->StartAssertNoThreadSuspension("Moving image classes to class table");
-  mirror::ObjectArray<mirror::DexCache>* dex_caches = GetImageDexCaches();
-  ClassHelper kh(NULL, this);
-  for (int32_t i = 0; i < dex_caches->GetLength(); i++) {
-    mirror::DexCache* dex_cache = dex_caches->Get(i);
-    mirror::ObjectArray<mirror::Class>* types = dex_cache->GetResolvedTypes();
-    for (int32_t j = 0; j < types->GetLength(); j++) {
-      mirror::Class* klass = types->Get(j);
-      if (klass != NULL) {
-        kh.ChangeClass(klass);
-        DCHECK(klass->GetClassLoader() == NULL);
-        const char* descriptor = kh.GetDescriptor();
-        size_t hash = Hash(descriptor);
-        mirror::Class* existing = LookupClassFromTableLocked(descriptor, NULL, hash);
-        if (existing != NULL) {
-          CHECK(existing == klass) << PrettyClassAndClassLoader(existing) << " != "
-              << PrettyClassAndClassLoader(klass);
-        } else {
-          class_table_.insert(std::make_pair(hash, klass));
-        }
-      }
-    }
-  }
-  class_table_dirty_ = true;
-  dex_cache_image_class_lookup_required_ = false;
-  self->EndAssertNoThreadSuspension(old_no_suspend_cause);
-}
-
-mirror::Class* ClassLinker::LookupClassFromImage(const char* descriptor) {
-  Thread* self = Thread::Current();
-  const char* old_no_suspend_cause =
-      self->StartAssertNoThreadSuspension("Image class lookup");
-  mirror::ObjectArray<mirror::DexCache>* dex_caches = GetImageDexCaches();
-  for (int32_t i = 0; i < dex_caches->GetLength(); ++i) {
-    mirror::DexCache* dex_cache = dex_caches->Get(i);
-    const DexFile* dex_file = dex_cache->GetDexFile();
-    // First search using the class def map, but don't bother for non-class types.
-    if (descriptor[0] == 'L') {
-      const DexFile::StringId* descriptor_string_id = dex_file->FindStringId(descriptor);
-      if (descriptor_string_id != NULL) {
-        const DexFile::TypeId* type_id =
-            dex_file->FindTypeId(dex_file->GetIndexForStringId(*descriptor_string_id));
-        if (type_id != NULL) {
-          mirror::Class* klass = dex_cache->GetResolvedType(dex_file->GetIndexForTypeId(*type_id));
-          if (klass != NULL) {
-            self->EndAssertNoThreadSuspension(old_no_suspend_cause);
-            return klass;
-          }
-        }
-      }
-    }
-    // Now try binary searching the string/type index.
-    const DexFile::StringId* string_id = dex_file->FindStringId(descriptor);
-    if (string_id != NULL) {
-      const DexFile::TypeId* type_id =
-          dex_file->FindTypeId(dex_file->GetIndexForStringId(*string_id));
-      if (type_id != NULL) {
-        uint16_t type_idx = dex_file->GetIndexForTypeId(*type_id);
-        mirror::Class* klass = dex_cache->GetResolvedType(type_idx);
-        if (klass != NULL) {
-          self->EndAssertNoThreadSuspension(old_no_suspend_cause);
-          return klass;
-        }
-      }
-    }
-  }
-  self->EndAssertNoThreadSuspension(old_no_suspend_cause);
-  return NULL;
+  // Doesn't take the classlinker_classes_lock_, classes are never removed from the image and
+  // only removed from the class table while writing the image.
+  return class_table_.Lookup(descriptor, class_loader, Hash(descriptor));
 }
 
 void ClassLinker::LookupClasses(const char* descriptor, std::vector<mirror::Class*>& result) {
   result.clear();
-  if (dex_cache_image_class_lookup_required_) {
-    MoveImageClassesToClassTable();
-  }
-  size_t hash = Hash(descriptor);
-  ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  ClassHelper kh(NULL, this);
-  for (auto it = class_table_.lower_bound(hash), end = class_table_.end();
-      it != end && it->first == hash; ++it) {
-    mirror::Class* klass = it->second;
-    kh.ChangeClass(klass);
-    if (strcmp(descriptor, kh.GetDescriptor()) == 0) {
-      result.push_back(klass);
-    }
-  }
+  class_table_.LookupAll(descriptor, Hash(descriptor), &result);
 }
 
 void ClassLinker::VerifyClass(mirror::Class* klass) {
@@ -3254,6 +3084,9 @@ bool ClassLinker::LinkClass(SirtRef<mirror::Class>& klass,
   if (!LinkSuperClass(klass)) {
     return false;
   }
+  if (!klass->IsInterface()) {
+    klass->SetSubtypeCheckPath();
+  }
   if (!LinkMethods(klass, interfaces)) {
     return false;
   }
@@ -4224,18 +4057,18 @@ const char* ClassLinker::MethodShorty(uint32_t method_idx, mirror::ArtMethod* re
   return dex_file.GetMethodShorty(method_id, length);
 }
 
+static bool GetAllClassesVisitor(mirror::Class* c, void* arg) {
+  reinterpret_cast<std::vector<mirror::Class*>*>(arg)->push_back(c);
+  return true;
+}
+
 void ClassLinker::DumpAllClasses(int flags) {
-  if (dex_cache_image_class_lookup_required_) {
-    MoveImageClassesToClassTable();
-  }
   // TODO: at the time this was written, it wasn't safe to call PrettyField with the ClassLinker
   // lock held, because it might need to resolve a field's type, which would try to take the lock.
   std::vector<mirror::Class*> all_classes;
   {
     ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-    for (const std::pair<size_t, mirror::Class*>& it : class_table_) {
-      all_classes.push_back(it.second);
-    }
+    class_table_.Visit(GetAllClassesVisitor, &all_classes);
   }
 
   for (size_t i = 0; i < all_classes.size(); ++i) {
@@ -4244,19 +4077,17 @@ void ClassLinker::DumpAllClasses(int flags) {
 }
 
 void ClassLinker::DumpForSigQuit(std::ostream& os) {
-  if (dex_cache_image_class_lookup_required_) {
-    MoveImageClassesToClassTable();
-  }
   ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  os << "Loaded classes: " << class_table_.size() << " allocated classes\n";
+  os << "Loaded classes: " << class_table_.Size() << " allocated classes\n";
 }
 
 size_t ClassLinker::NumLoadedClasses() {
-  if (dex_cache_image_class_lookup_required_) {
-    MoveImageClassesToClassTable();
-  }
   ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  return class_table_.size();
+  return class_table_.Size();
+}
+
+void ClassLinker::FreeRetiredClassTableSlots() {
+  class_table_.FreeRetiredSlots();
 }
 
 pid_t ClassLinker::GetClassesLockOwner() {
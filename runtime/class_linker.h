@@ -23,6 +23,7 @@
 
 #include "base/macros.h"
 #include "base/mutex.h"
+#include "class_table.h"
 #include "dex_file.h"
 #include "gtest/gtest.h"
 #include "root_visitor.h"
@@ -108,6 +109,9 @@ class ClassLinker {
       LOCKS_EXCLUDED(Locks::classlinker_classes_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Frees the class table slots replaced when it grew, which lookups may have still been reading.
+  void FreeRetiredClassTableSlots() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
+
   // Resolve a String with the given index from the DexFile, storing the
   // result in the DexCache. The referrer is used to identify the
   // target DexCache and ClassLoader to use for resolution.
@@ -527,28 +531,9 @@ class ClassLinker {
   std::vector<mirror::DexCache*> dex_caches_ GUARDED_BY(dex_lock_);
   std::vector<const OatFile*> oat_files_ GUARDED_BY(dex_lock_);
 
-
-  // multimap from a string hash code of a class descriptor to
-  // mirror::Class* instances. Results should be compared for a matching
-  // Class::descriptor_ and Class::class_loader_.
-  typedef std::multimap<size_t, mirror::Class*> Table;
-  Table class_table_ GUARDED_BY(Locks::classlinker_classes_lock_);
-
-  // Do we need to search dex caches to find image classes?
-  bool dex_cache_image_class_lookup_required_;
-  // Number of times we've searched dex caches for a class. After a certain number of misses we move
-  // the classes into the class_table_ to avoid dex cache based searches.
-  AtomicInteger failed_dex_cache_class_lookups_;
-
-  mirror::Class* LookupClassFromTableLocked(const char* descriptor,
-                                            const mirror::ClassLoader* class_loader,
-                                            size_t hash)
-      SHARED_LOCKS_REQUIRED(Locks::classlinker_classes_lock_, Locks::mutator_lock_);
-
-  void MoveImageClassesToClassTable() LOCKS_EXCLUDED(Locks::classlinker_classes_lock_)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
-  mirror::Class* LookupClassFromImage(const char* descriptor)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+  // The loaded classes, keyed by the hash of their descriptor. Read without the
+  // classlinker_classes_lock_, changed with it held.
+  ClassTable class_table_;
 
   // indexes into class_roots_.
   // needs to be kept in sync with class_roots_descriptors_.
@@ -621,7 +606,7 @@ class ClassLinker {
   const void* portable_resolution_trampoline_;
   const void* quick_resolution_trampoline_;
 
-  friend class ImageWriter;  // for GetClassRoots
+  friend class ImageWriter;  // for GetClassRoots and class_table_
   FRIEND_TEST(ClassLinkerTest, ClassRootDescriptors);
   FRIEND_TEST(mirror::DexCacheTest, Open);
   FRIEND_TEST(ExceptionTest, FindExceptionHandler);
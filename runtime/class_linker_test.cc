@@ -981,6 +981,34 @@ TEST_F(ClassLinkerTest, Interfaces) {
   EXPECT_EQ(Afoo, Kfoo);
 }
 
+static bool CollectSubClassCandidates(mirror::Class* klass, void* arg)
+    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  if (!klass->IsInterface() && !klass->IsArrayClass() && !klass->IsPrimitive()) {
+    reinterpret_cast<std::vector<mirror::Class*>*>(arg)->push_back(klass);
+  }
+  return true;
+}
+
+// Checks the paths kept for IsSubClass give the same answer as walking the super classes.
+TEST_F(ClassLinkerTest, IsSubClass) {
+  ScopedObjectAccess soa(Thread::Current());
+  class_linker_->FindSystemClass("Ljava/util/HashMap;");
+  class_linker_->FindSystemClass("Ljava/util/ArrayList;");
+  class_linker_->FindSystemClass("Ljava/lang/IllegalArgumentException;");
+  std::vector<mirror::Class*> classes;
+  class_linker_->VisitClasses(CollectSubClassCandidates, &classes);
+  for (mirror::Class* klass : classes) {
+    for (mirror::Class* super_class : classes) {
+      bool is_subclass = false;
+      for (mirror::Class* c = klass; c != NULL; c = c->GetSuperClass()) {
+        is_subclass = is_subclass || c == super_class;
+      }
+      EXPECT_EQ(is_subclass, klass->IsSubClass(super_class))
+          << PrettyClass(klass) << " " << PrettyClass(super_class);
+    }
+  }
+}
+
 TEST_F(ClassLinkerTest, ResolveVerifyAndClinit) {
   // pretend we are trying to get the static storage for the StaticsFromCode class.
 
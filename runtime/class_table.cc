@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "class_table.h"
+
+#include <string.h>
+
+#include "base/stl_util.h"
+#include "class_linker.h"
+#include "cutils/atomic-inline.h"
+#include "mirror/class-inl.h"
+#include "mirror/object_array-inl.h"
+#include "object_utils.h"
+#include "runtime.h"
+#include "thread.h"
+#include "utils.h"
+
+namespace art {
+
+// Capacity of an empty table.
+static constexpr size_t kMinTableCapacity = 64;
+
+ClassTable::ClassTable()
+    : slots_(new Slots(kMinTableCapacity)),
+      num_used_slots_(0),
+      num_classes_(0),
+      image_classes_(NULL),
+      num_image_classes_(0) {
+}
+
+ClassTable::~ClassTable() {
+  delete slots_;
+  STLDeleteElements(&retired_slots_);
+}
+
+size_t ClassTable::Size() const {
+  return num_classes_ + num_image_classes_;
+}
+
+mirror::Class* ClassTable::LookupImage(const char* descriptor, size_t hash) const {
+  const size_t mask = image_classes_->GetLength() - 1;
+  ClassHelper kh;
+  for (size_t i = FirstSlot(hash, mask); ; i = (i + 1) & mask) {
+    mirror::Class* klass = image_classes_->GetWithoutChecks(i);
+    if (klass == NULL) {
+      return NULL;
+    }
+    kh.ChangeClass(klass);
+    if (strcmp(descriptor, kh.GetDescriptor()) == 0) {
+      return klass;
+    }
+  }
+}
+
+mirror::Class* ClassTable::Lookup(const char* descriptor, const mirror::ClassLoader* class_loader,
+                                  size_t hash) const {
+  // The image only has classes of the boot class loader.
+  if (class_loader == NULL && image_classes_ != NULL) {
+    mirror::Class* klass = LookupImage(descriptor, hash);
+    if (klass != NULL) {
+      return klass;
+    }
+  }
+  const Slots& slots = *slots_;
+  const size_t mask = slots.size() - 1;
+  ClassHelper kh;
+  for (size_t i = FirstSlot(hash, mask); ; i = (i + 1) & mask) {
+    const size_t slot_hash = slots[i].hash;
+    mirror::Class* klass = slots[i].klass;
+    if (klass == NULL) {
+      return NULL;
+    }
+    if (klass != Tombstone() && slot_hash == hash && klass->GetClassLoader() == class_loader) {
+      kh.ChangeClass(klass);
+      if (strcmp(descriptor, kh.GetDescriptor()) == 0) {
+        return klass;
+      }
+    }
+  }
+}
+
+void ClassTable::LookupAll(const char* descriptor, size_t hash,
+                           std::vector<mirror::Class*>* classes) const {
+  if (image_classes_ != NULL) {
+    mirror::Class* klass = LookupImage(descriptor, hash);
+    if (klass != NULL) {
+      classes->push_back(klass);
+    }
+  }
+  const Slots& slots = *slots_;
+  const size_t mask = slots.size() - 1;
+  ClassHelper kh;
+  for (size_t i = FirstSlot(hash, mask); slots[i].klass != NULL; i = (i + 1) & mask) {
+    mirror::Class* klass = slots[i].klass;
+    if (klass != Tombstone() && slots[i].hash == hash) {
+      kh.ChangeClass(klass);
+      if (strcmp(descriptor, kh.GetDescriptor()) == 0) {
+        classes->push_back(klass);
+      }
+    }
+  }
+}
+
+void ClassTable::Put(Slots* slots, mirror::Class* klass, size_t hash) {
+  const size_t mask = slots->size() - 1;
+  size_t i = FirstSlot(hash, mask);
+  while ((*slots)[i].klass != NULL) {
+    i = (i + 1) & mask;
+  }
+  (*slots)[i].hash = hash;
+  // Lock free readers which find the class must see its hash.
+  ANDROID_MEMBAR_STORE();
+  (*slots)[i].klass = klass;
+}
+
+void ClassTable::Insert(mirror::Class* klass, size_t hash) {
+  if ((num_used_slots_ + 1) * 2 > slots_->size()) {
+    // Grow unless most of the used slots are tombstones.
+    Resize(num_classes_ * 4 > slots_->size() ? slots_->size() * 2 : slots_->size());
+  }
+  Put(slots_, klass, hash);
+  ++num_used_slots_;
+  ++num_classes_;
+}
+
+void ClassTable::Resize(size_t capacity) {
+  Slots* old_slots = slots_;
+  Slots* new_slots = new Slots(capacity);
+  for (const Slot& slot : *old_slots) {
+    if (IsLiveClass(slot.klass)) {
+      Put(new_slots, slot.klass, slot.hash);
+    }
+  }
+  ANDROID_MEMBAR_STORE();
+  slots_ = new_slots;
+  num_used_slots_ = num_classes_;
+  // Readers may still be probing the old slots.
+  retired_slots_.push_back(old_slots);
+}
+
+bool ClassTable::Remove(const char* descriptor, const mirror::ClassLoader* class_loader,
+                        size_t hash) {
+  Slots& slots = *slots_;
+  const size_t mask = slots.size() - 1;
+  ClassHelper kh;
+  for (size_t i = FirstSlot(hash, mask); slots[i].klass != NULL; i = (i + 1) & mask) {
+    mirror::Class* klass = slots[i].klass;
+    if (klass != Tombstone() && slots[i].hash == hash &&
+        klass->GetClassLoader() == class_loader) {
+      kh.ChangeClass(klass);
+      if (strcmp(descriptor, kh.GetDescriptor()) == 0) {
+        slots[i].klass = Tombstone();
+        --num_classes_;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ClassTable::Visit(Visitor* visitor, void* arg) const {
+  if (image_classes_ != NULL) {
+    for (int32_t i = 0; i < image_classes_->GetLength(); ++i) {
+      mirror::Class* klass = image_classes_->GetWithoutChecks(i);
+      if (klass != NULL && !visitor(klass, arg)) {
+        return;
+      }
+    }
+  }
+  for (const Slot& slot : *slots_) {
+    if (IsLiveClass(slot.klass) && !visitor(slot.klass, arg)) {
+      return;
+    }
+  }
+}
+
+void ClassTable::VisitRoots(RootVisitor* visitor, void* arg) const {
+  // The image classes are handled by rescanning the dirty cards of the image.
+  for (const Slot& slot : *slots_) {
+    if (IsLiveClass(slot.klass)) {
+      visitor(slot.klass, arg);
+    }
+  }
+}
+
+mirror::ObjectArray<mirror::Class>* ClassTable::CreateImageTable(Thread* self) {
+  std::vector<std::pair<mirror::Class*, size_t> > classes;
+  {
+    ReaderMutexLock mu(self, *Locks::classlinker_classes_lock_);
+    CHECK(image_classes_ == NULL) << "Writing an image on top of another";
+    for (const Slot& slot : *slots_) {
+      if (IsLiveClass(slot.klass)) {
+        CHECK(slot.klass->GetClassLoader() == NULL) << PrettyClass(slot.klass);
+        classes.push_back(std::make_pair(slot.klass, slot.hash));
+      }
+    }
+  }
+  size_t capacity = kMinTableCapacity;
+  while (capacity < classes.size() * 2) {
+    capacity *= 2;
+  }
+  mirror::Class* array_class =
+      Runtime::Current()->GetClassLinker()->FindSystemClass("[Ljava/lang/Class;");
+  CHECK(array_class != NULL);
+  mirror::ObjectArray<mirror::Class>* image_table =
+      mirror::ObjectArray<mirror::Class>::Alloc(self, array_class, capacity);
+  CHECK(image_table != NULL);
+  const size_t mask = capacity - 1;
+  for (const std::pair<mirror::Class*, size_t>& klass : classes) {
+    size_t i = FirstSlot(klass.second, mask);
+    while (image_table->GetWithoutChecks(i) != NULL) {
+      i = (i + 1) & mask;
+    }
+    image_table->SetWithoutChecks(i, klass.first);
+  }
+  return image_table;
+}
+
+void ClassTable::SetImageTable(mirror::ObjectArray<mirror::Class>* image_table) {
+  DCHECK(image_classes_ == NULL);
+  CHECK(IsPowerOfTwo(image_table->GetLength())) << image_table->GetLength();
+  size_t num_image_classes = 0;
+  for (int32_t i = 0; i < image_table->GetLength(); ++i) {
+    if (image_table->GetWithoutChecks(i) != NULL) {
+      ++num_image_classes;
+    }
+  }
+  image_classes_ = image_table;
+  num_image_classes_ = num_image_classes;
+}
+
+void ClassTable::FreeRetiredSlots() {
+  STLDeleteElements(&retired_slots_);
+}
+
+}  // namespace art
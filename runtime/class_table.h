@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_CLASS_TABLE_H_
+#define ART_RUNTIME_CLASS_TABLE_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/macros.h"
+#include "locks.h"
+#include "root_visitor.h"
+
+namespace art {
+
+class Thread;
+
+namespace mirror {
+  class Class;
+  class ClassLoader;
+  template<class T> class ObjectArray;
+}  // namespace mirror
+
+// The loaded classes, keyed by the hash of their descriptor in an open addressed table with
+// linear probing. Lookups don't take any lock, the table is only changed with the
+// classlinker_classes_lock_ held. The classes of the boot image are in an immutable table
+// written to the image, laid out the same way, which is looked up first.
+class ClassTable {
+ public:
+  typedef bool (Visitor)(mirror::Class* c, void* arg);
+
+  ClassTable();
+  ~ClassTable();
+
+  // Number of classes in the table, including those of the image.
+  size_t Size() const SHARED_LOCKS_REQUIRED(Locks::classlinker_classes_lock_);
+
+  mirror::Class* Lookup(const char* descriptor, const mirror::ClassLoader* class_loader,
+                        size_t hash) const
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Appends the classes with the given descriptor, regardless of their class loader.
+  void LookupAll(const char* descriptor, size_t hash, std::vector<mirror::Class*>* classes) const
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  void Insert(mirror::Class* klass, size_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::classlinker_classes_lock_);
+
+  // Leaves a tombstone in the slot of the class, which only goes away when the table is grown.
+  bool Remove(const char* descriptor, const mirror::ClassLoader* class_loader, size_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::classlinker_classes_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Visits the classes until the visitor returns false, the image ones first.
+  void Visit(Visitor* visitor, void* arg) const
+      SHARED_LOCKS_REQUIRED(Locks::classlinker_classes_lock_, Locks::mutator_lock_);
+
+  // Visits the classes which aren't in the image.
+  void VisitRoots(RootVisitor* visitor, void* arg) const
+      SHARED_LOCKS_REQUIRED(Locks::classlinker_classes_lock_);
+
+  // Allocates the table of the classes to write to the boot image.
+  mirror::ObjectArray<mirror::Class>* CreateImageTable(Thread* self)
+      LOCKS_EXCLUDED(Locks::classlinker_classes_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Sets the table written by CreateImageTable, before any class is inserted.
+  void SetImageTable(mirror::ObjectArray<mirror::Class>* image_table)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Frees the slots replaced by growing the table, lock free readers must be excluded.
+  void FreeRetiredSlots() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+ private:
+  struct Slot {
+    Slot() : hash(0), klass(NULL) {}
+
+    // Written before the class, a reader which reads a stale hash for a class being inserted
+    // just misses it.
+    volatile size_t hash;
+    mirror::Class* volatile klass;
+  };
+  typedef std::vector<Slot> Slots;
+
+  // Index of the first slot to probe for hash in a table of capacity mask + 1. Only the low 32
+  // bits of the hash are used so that the image table is the same for 32 and 64-bit compilers.
+  static size_t FirstSlot(size_t hash, size_t mask) {
+    uint32_t hash32 = static_cast<uint32_t>(hash);
+    return (hash32 ^ (hash32 >> 16)) & mask;
+  }
+
+  static bool IsLiveClass(const mirror::Class* klass) {
+    return klass != NULL && klass != Tombstone();
+  }
+
+  static mirror::Class* Tombstone() {
+    return reinterpret_cast<mirror::Class*>(1);
+  }
+
+  mirror::Class* LookupImage(const char* descriptor, size_t hash) const
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  static void Put(Slots* slots, mirror::Class* klass, size_t hash);
+
+  void Resize(size_t capacity) EXCLUSIVE_LOCKS_REQUIRED(Locks::classlinker_classes_lock_);
+
+  // Replaced as a whole when the table grows, so that a reader sees either the old or the new
+  // slots.
+  Slots* volatile slots_;
+  // Classes and tombstones, which are both counted to keep the table at most half full.
+  size_t num_used_slots_ GUARDED_BY(Locks::classlinker_classes_lock_);
+  size_t num_classes_ GUARDED_BY(Locks::classlinker_classes_lock_);
+  std::vector<Slots*> retired_slots_;
+
+  // Immutable once set, NULL without an image.
+  mirror::ObjectArray<mirror::Class>* image_classes_;
+  size_t num_image_classes_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClassTable);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_CLASS_TABLE_H_
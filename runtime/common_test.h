@@ -120,6 +120,12 @@ byte* DecodeBase64(const char* src, size_t* dst_size) {
   return dst.release();
 }
 
+// A linear congruential generator for tests which want repeatable pseudo-random values.
+static inline size_t test_rand(size_t* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed;
+}
+
 class ScratchFile {
  public:
   ScratchFile() {
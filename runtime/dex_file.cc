@@ -48,6 +48,31 @@ namespace art {
 const byte DexFile::kDexMagic[] = { 'd', 'e', 'x', '\n' };
 const byte DexFile::kDexMagicVersion[] = { '0', '3', '5', '\0' };
 
+struct DexFile::ClassDefIndex {
+  struct Slot {
+    Slot() : hash(0), class_def_idx(kDexNoIndex) {}
+
+    uint32_t hash;
+    uint32_t class_def_idx;
+  };
+
+  // Class definition index of each type, kDexNoIndex16 for the types defined in other dex files.
+  std::vector<uint16_t> type_to_class_def;
+  // The class definitions keyed by the hash of their descriptor in an open addressed table, with
+  // kDexNoIndex in the free slots. The hash is kept in the slot so that the misses of class path
+  // searches don't touch the string data. The capacity is a power of two, at least twice the
+  // number of class definitions.
+  std::vector<Slot> class_defs_by_descriptor;
+};
+
+static uint32_t DescriptorHash(const char* descriptor) {
+  uint32_t hash = 0;
+  for (; *descriptor != '\0'; ++descriptor) {
+    hash = hash * 31 + static_cast<uint8_t>(*descriptor);
+  }
+  return hash;
+}
+
 DexFile::ClassPathEntry DexFile::FindInClassPath(const char* descriptor,
                                                  const ClassPath& class_path) {
   for (size_t i = 0; i != class_path.size(); ++i) {
@@ -274,6 +299,7 @@ DexFile::~DexFile() {
   // that's only called after DetachCurrentThread, which means there's no JNIEnv. We could
   // re-attach, but cleaning up these global references is not obviously useful. It's not as if
   // the global reference table is otherwise empty!
+  delete class_def_index_;
 }
 
 bool DexFile::Init() {
@@ -331,11 +357,66 @@ uint32_t DexFile::GetVersion() const {
   return atoi(version);
 }
 
+const DexFile::ClassDefIndex* DexFile::GetClassDefIndex() const {
+  const ClassDefIndex* index = class_def_index_;
+  if (LIKELY(index != NULL)) {
+    return index;
+  }
+  const size_t num_class_defs = NumClassDefs();
+  if (num_class_defs >= kDexNoIndex16) {
+    return NULL;
+  }
+  ClassDefIndex* new_index = new ClassDefIndex;
+  new_index->type_to_class_def.resize(NumTypeIds(), kDexNoIndex16);
+  size_t capacity = 16;
+  while (capacity < num_class_defs * 2) {
+    capacity *= 2;
+  }
+  new_index->class_defs_by_descriptor.resize(capacity);
+  const size_t mask = capacity - 1;
+  for (size_t i = 0; i < num_class_defs; ++i) {
+    const ClassDef& class_def = GetClassDef(i);
+    // The first definition of a type wins, as it did when the class definitions were scanned.
+    if (new_index->type_to_class_def[class_def.class_idx_] != kDexNoIndex16) {
+      continue;
+    }
+    new_index->type_to_class_def[class_def.class_idx_] = i;
+    const uint32_t hash = DescriptorHash(GetClassDescriptor(class_def));
+    size_t slot = hash & mask;
+    while (new_index->class_defs_by_descriptor[slot].class_def_idx != kDexNoIndex) {
+      slot = (slot + 1) & mask;
+    }
+    new_index->class_defs_by_descriptor[slot].hash = hash;
+    new_index->class_defs_by_descriptor[slot].class_def_idx = i;
+  }
+  // Another thread may have built the index meanwhile, in which case ours is dropped.
+  if (!__sync_bool_compare_and_swap(&class_def_index_, static_cast<const ClassDefIndex*>(NULL),
+                                    new_index)) {
+    delete new_index;
+  }
+  return class_def_index_;
+}
+
 const DexFile::ClassDef* DexFile::FindClassDef(const char* descriptor) const {
   size_t num_class_defs = NumClassDefs();
   if (num_class_defs == 0) {
     return NULL;
   }
+  const ClassDefIndex* index = GetClassDefIndex();
+  if (LIKELY(index != NULL)) {
+    const std::vector<ClassDefIndex::Slot>& slots = index->class_defs_by_descriptor;
+    const size_t mask = slots.size() - 1;
+    const uint32_t hash = DescriptorHash(descriptor);
+    for (size_t i = hash & mask; slots[i].class_def_idx != kDexNoIndex; i = (i + 1) & mask) {
+      if (slots[i].hash == hash) {
+        const ClassDef& class_def = GetClassDef(slots[i].class_def_idx);
+        if (strcmp(descriptor, GetClassDescriptor(class_def)) == 0) {
+          return &class_def;
+        }
+      }
+    }
+    return NULL;
+  }
   const StringId* string_id = FindStringId(descriptor);
   if (string_id == NULL) {
     return NULL;
@@ -344,18 +425,22 @@ const DexFile::ClassDef* DexFile::FindClassDef(const char* descriptor) const {
   if (type_id == NULL) {
     return NULL;
   }
-  uint16_t type_idx = GetIndexForTypeId(*type_id);
-  for (size_t i = 0; i < num_class_defs; ++i) {
-    const ClassDef& class_def = GetClassDef(i);
-    if (class_def.class_idx_ == type_idx) {
-      return &class_def;
-    }
-  }
-  return NULL;
+  return FindClassDef(GetIndexForTypeId(*type_id));
 }
 
 const DexFile::ClassDef* DexFile::FindClassDef(uint16_t type_idx) const {
   size_t num_class_defs = NumClassDefs();
+  if (num_class_defs == 0) {
+    return NULL;
+  }
+  const ClassDefIndex* index = GetClassDefIndex();
+  if (LIKELY(index != NULL)) {
+    if (type_idx >= index->type_to_class_def.size()) {
+      return NULL;
+    }
+    const uint16_t class_def_idx = index->type_to_class_def[type_idx];
+    return (class_def_idx != kDexNoIndex16) ? &GetClassDef(class_def_idx) : NULL;
+  }
   for (size_t i = 0; i < num_class_defs; ++i) {
     const ClassDef& class_def = GetClassDef(i);
     if (class_def.class_idx_ == type_idx) {
@@ -850,7 +850,8 @@ class DexFile {
         field_ids_(0),
         method_ids_(0),
         proto_ids_(0),
-        class_defs_(0) {
+        class_defs_(0),
+        class_def_index_(NULL) {
     CHECK(begin_ != NULL) << GetLocation();
     CHECK_GT(size_, 0U) << GetLocation();
   }
@@ -864,6 +865,12 @@ class DexFile {
   // Returns true if the header magic and version numbers are of the expected values.
   bool CheckMagicAndVersion() const;
 
+  // Maps the type indices and the descriptors of the classes to their class definitions.
+  struct ClassDefIndex;
+
+  // Builds the index on first use. Returns NULL if the class definitions are too many to index.
+  const ClassDefIndex* GetClassDefIndex() const;
+
   void DecodeDebugInfo0(const CodeItem* code_item, bool is_static, uint32_t method_idx,
       DexDebugNewPositionCb position_cb, DexDebugNewLocalCb local_cb,
       void* context, const byte* stream, LocalInfo* local_in_reg) const;
@@ -910,6 +917,9 @@ class DexFile {
 
   // Points to the base of the class definition list.
   const ClassDef* class_defs_;
+
+  // Built by the first class definition lookup, immutable afterwards.
+  mutable const ClassDefIndex* volatile class_def_index_;
 };
 
 // Iterate over a dex file's ProtoId's paramters
@@ -269,4 +269,22 @@ TEST_F(DexFileTest, FindFieldId) {
   }
 }
 
+TEST_F(DexFileTest, FindClassDef) {
+  for (size_t i = 0; i < java_lang_dex_file_->NumClassDefs(); i++) {
+    const DexFile::ClassDef& to_find = java_lang_dex_file_->GetClassDef(i);
+    const char* descriptor = java_lang_dex_file_->GetClassDescriptor(to_find);
+    EXPECT_EQ(&to_find, java_lang_dex_file_->FindClassDef(descriptor)) << descriptor;
+    EXPECT_EQ(&to_find, java_lang_dex_file_->FindClassDef(to_find.class_idx_)) << descriptor;
+  }
+  // Types which are only referenced aren't defined.
+  for (size_t i = 0; i < java_lang_dex_file_->NumTypeIds(); i++) {
+    const DexFile::ClassDef* class_def = java_lang_dex_file_->FindClassDef(i);
+    if (class_def != NULL) {
+      EXPECT_EQ(i, class_def->class_idx_);
+    }
+  }
+  EXPECT_TRUE(java_lang_dex_file_->FindClassDef("Ljava/lang/DoesNotExist;") == NULL);
+  EXPECT_TRUE(java_lang_dex_file_->FindClassDef("I") == NULL);
+}
+
 }  // namespace art
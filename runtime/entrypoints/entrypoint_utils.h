@@ -20,6 +20,7 @@
 #include "class_linker.h"
 #include "common_throws.h"
 #include "dex_file.h"
+#include "gc/heap.h"
 #include "indirect_reference_table.h"
 #include "invoke_type.h"
 #include "jni_internal.h"
@@ -73,6 +74,10 @@ static inline mirror::Object* AllocObjectFromCode(uint32_t type_idx, mirror::Art
     DCHECK(self->IsExceptionPending());
     return NULL;  // Failure
   }
+  gc::Heap* heap = runtime->GetHeap();
+  if (UNLIKELY(heap->IsTenuredAllocationSite(method, klass))) {
+    return heap->AllocTenuredObject(self, klass, klass->GetObjectSize());
+  }
   return klass->AllocObject(self);
 }
 
@@ -104,6 +109,9 @@ static inline mirror::Array* AllocArrayFromCode(uint32_t type_idx, mirror::ArtMe
       return NULL;  // Failure
     }
   }
+  if (UNLIKELY(Runtime::Current()->GetHeap()->IsTenuredAllocationSite(method, klass))) {
+    return mirror::Array::AllocTenured(self, klass, component_count);
+  }
   return mirror::Array::Alloc(self, klass, component_count);
 }
 
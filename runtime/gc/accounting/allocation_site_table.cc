@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_site_table.h"
+
+#include <ostream>
+
+#include "base/logging.h"
+#include "cutils/atomic-inline.h"
+#include "mirror/art_method-inl.h"
+#include "mirror/class-inl.h"
+#include "mirror/object-inl.h"
+#include "stack.h"
+#include "thread.h"
+#include "utils.h"
+
+namespace art {
+namespace gc {
+namespace accounting {
+
+// Finds the innermost method which isn't a runtime method, as the allocation tracker does.
+class AllocationSiteVisitor : public StackVisitor {
+ public:
+  explicit AllocationSiteVisitor(Thread* thread) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+      : StackVisitor(thread, NULL), method(NULL), dex_pc(0) {}
+
+  // TODO: Enable annotalysis. We know lock is held in constructor, but abstraction confuses
+  // annotalysis.
+  bool VisitFrame() NO_THREAD_SAFETY_ANALYSIS {
+    mirror::ArtMethod* m = GetMethod();
+    if (m->IsRuntimeMethod()) {
+      return true;
+    }
+    method = m;
+    dex_pc = GetDexPc();
+    return false;
+  }
+
+  const mirror::ArtMethod* method;
+  uint32_t dex_pc;
+};
+
+AllocationSiteTable::AllocationSiteTable()
+    : lock_("allocation site table lock"),
+      collection_count_(0),
+      num_tenured_sites_(0) {
+  memset(tenured_sites_, 0, sizeof(tenured_sites_));
+}
+
+void AllocationSiteTable::SampleAllocation(Thread* self, mirror::Object* obj) {
+  AllocationSiteVisitor visitor(self);
+  visitor.WalkStack();
+  if (visitor.method == NULL) {
+    // Allocated by the runtime itself, e.g. during startup.
+    return;
+  }
+  AddSample(self, visitor.method, visitor.dex_pc, obj->GetClass(), obj);
+}
+
+void AllocationSiteTable::AddSample(Thread* self, const mirror::ArtMethod* method,
+                                    uint32_t dex_pc, const mirror::Class* klass,
+                                    const mirror::Object* obj) {
+  MutexLock mu(self, lock_);
+  const SiteKey key(method, dex_pc);
+  auto it = sites_.find(key);
+  if (it == sites_.end()) {
+    SiteStats stats = { method, klass, 0, 0, false };
+    sites_.Put(key, stats);
+    it = sites_.find(key);
+  }
+  SiteStats* site = &it->second;
+  if (site->klass != klass) {
+    site->klass = NULL;
+  }
+  if (site->klass != NULL && !site->tenured) {
+    Sample sample = { obj, site, collection_count_ };
+    samples_.push_back(sample);
+  }
+}
+
+void AllocationSiteTable::StartCollection() {
+  MutexLock mu(Thread::Current(), lock_);
+  ++collection_count_;
+}
+
+void AllocationSiteTable::SweepSamples(SampleFateCallback* callback, void* arg) {
+  MutexLock mu(Thread::Current(), lock_);
+  auto out = samples_.begin();
+  for (auto it = samples_.begin(); it != samples_.end(); ++it) {
+    if (it->collection != collection_count_) {
+      SampleFate fate = callback(it->obj, arg);
+      if (fate != kSampleUnknown) {
+        SiteStats* site = it->site;
+        ++site->samples;
+        if (fate == kSampleSurvived) {
+          ++site->survived;
+        }
+        if (!site->tenured && site->klass != NULL && site->samples >= kMinTenureSamples &&
+            site->survived * 100 >= site->samples * kTenureSurvivalPercent) {
+          TenureSite(site);
+        }
+        continue;
+      }
+    }
+    *out++ = *it;
+  }
+  samples_.erase(out, samples_.end());
+}
+
+void AllocationSiteTable::TenureSite(SiteStats* site) {
+  // The allocation entrypoints only know the method, sites allocating the same class at different
+  // dex pcs of a method share a tenured entry.
+  if (IsTenured(site->method, site->klass)) {
+    site->tenured = true;
+    return;
+  }
+  if (num_tenured_sites_ >= kMaxTenuredSites) {
+    // The site stays untenured, and sampled.
+    return;
+  }
+  size_t i = TenuredSiteHash(site->method, site->klass);
+  while (tenured_sites_[i].method != NULL) {
+    i = (i + 1) % kTenuredSiteTableSize;
+  }
+  tenured_sites_[i].klass = site->klass;
+  ANDROID_MEMBAR_STORE();
+  tenured_sites_[i].method = site->method;
+  ++num_tenured_sites_;
+  site->tenured = true;
+  VLOG(heap) << "Tenuring allocations of " << PrettyClass(site->klass) << " by "
+             << PrettyMethod(site->method) << ", " << site->survived << " of " << site->samples
+             << " samples survived";
+}
+
+void AllocationSiteTable::VisitSamples(RootVisitor* visitor, void* arg) {
+  MutexLock mu(Thread::Current(), lock_);
+  for (const Sample& sample : samples_) {
+    visitor(sample.obj, arg);
+  }
+}
+
+void AllocationSiteTable::Dump(std::ostream& os) {
+  MutexLock mu(Thread::Current(), lock_);
+  size_t samples = 0;
+  size_t survived = 0;
+  for (const auto& entry : sites_) {
+    samples += entry.second.samples;
+    survived += entry.second.survived;
+  }
+  os << "Allocation sites: " << sites_.size() << " sampled, " << num_tenured_sites_
+     << " tenured, " << survived << " of " << samples << " samples survived\n";
+}
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
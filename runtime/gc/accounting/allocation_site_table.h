@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_ACCOUNTING_ALLOCATION_SITE_TABLE_H_
+#define ART_RUNTIME_GC_ACCOUNTING_ALLOCATION_SITE_TABLE_H_
+
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "globals.h"
+#include "locks.h"
+#include "root_visitor.h"
+#include "safe_map.h"
+
+namespace art {
+
+class Thread;
+
+namespace mirror {
+  class ArtMethod;
+  class Class;
+  class Object;
+}  // namespace mirror
+
+namespace gc {
+namespace accounting {
+
+// Samples allocation sites and keeps track of how many of the sampled objects survive the first
+// collection after their allocation. Once enough samples of a site have survived, allocations of
+// the same class by the same method are tenured: they are treated as live from the start of the
+// next collection rather than being traced and swept by the sticky collections.
+class AllocationSiteTable {
+ public:
+  // Outcome of a sample for a collection.
+  enum SampleFate {
+    kSampleDead,
+    kSampleSurvived,
+    // The collection can't tell, the sample is kept for the next one.
+    kSampleUnknown,
+  };
+  typedef SampleFate (SampleFateCallback)(const mirror::Object* obj, void* arg);
+
+  AllocationSiteTable();
+
+  // Number of bytes a thread allocates between two samples.
+  static constexpr size_t kSampleIntervalBytes = 256 * KB;
+  // Number of resolved samples needed before a site is considered for tenuring.
+  static constexpr size_t kMinTenureSamples = 32;
+  // Percentage of the samples of a site which need to survive for it to be tenured.
+  static constexpr size_t kTenureSurvivalPercent = 90;
+  // The tenured sites are kept in an open addressed table which is never more than half full so
+  // that the lookups always end on an empty slot.
+  static constexpr size_t kTenuredSiteTableSize = 512;
+  static constexpr size_t kMaxTenuredSites = kTenuredSiteTableSize / 2;
+
+  // Record obj, just allocated by self, as a sample of the site of the allocation. Like the
+  // debugger's allocation tracker, the site is the innermost method on the stack which isn't a
+  // runtime method and its dex pc.
+  void SampleAllocation(Thread* self, mirror::Object* obj)
+      LOCKS_EXCLUDED(lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Record obj, of class klass, as a sample of the allocation site at dex_pc in method.
+  void AddSample(Thread* self, const mirror::ArtMethod* method, uint32_t dex_pc,
+                 const mirror::Class* klass, const mirror::Object* obj) LOCKS_EXCLUDED(lock_);
+
+  // Called when a collection starts, samples taken from then on are left for the next collection.
+  void StartCollection() LOCKS_EXCLUDED(lock_);
+
+  // Resolve the samples taken before the current collection started and tenure the sites whose
+  // objects survive.
+  void SweepSamples(SampleFateCallback* callback, void* arg) LOCKS_EXCLUDED(lock_);
+
+  // Visit the sampled objects which are still waiting for a collection, used by the collectors
+  // which move objects to keep them in place.
+  void VisitSamples(RootVisitor* visitor, void* arg) LOCKS_EXCLUDED(lock_);
+
+  // Returns true if allocations of klass by referrer are tenured. Doesn't take any lock, sites
+  // are never removed once tenured.
+  bool IsTenured(const mirror::ArtMethod* referrer, const mirror::Class* klass) const {
+    if (LIKELY(num_tenured_sites_ == 0)) {
+      return false;
+    }
+    for (size_t i = TenuredSiteHash(referrer, klass); ; i = (i + 1) % kTenuredSiteTableSize) {
+      const TenuredSite& site = tenured_sites_[i];
+      if (site.method == NULL) {
+        return false;
+      }
+      if (site.method == referrer && site.klass == klass) {
+        return true;
+      }
+    }
+  }
+
+  size_t GetTenuredSiteCount() const {
+    return num_tenured_sites_;
+  }
+
+  void Dump(std::ostream& os) LOCKS_EXCLUDED(lock_);
+
+ private:
+  typedef std::pair<const mirror::ArtMethod*, uint32_t> SiteKey;
+
+  struct SiteStats {
+    const mirror::ArtMethod* method;
+    // Class allocated by the site, NULL if the site allocates several classes, in which case it
+    // is never tenured.
+    const mirror::Class* klass;
+    size_t samples;
+    size_t survived;
+    bool tenured;
+  };
+
+  struct Sample {
+    const mirror::Object* obj;
+    SiteStats* site;
+    // Value of collection_count_ when the sample was taken.
+    uint32_t collection;
+  };
+
+  // The method is published after the class so that a reader which sees the method sees both.
+  struct TenuredSite {
+    const mirror::ArtMethod* volatile method;
+    const mirror::Class* volatile klass;
+  };
+
+  static size_t TenuredSiteHash(const mirror::ArtMethod* method, const mirror::Class* klass) {
+    return ((reinterpret_cast<uintptr_t>(method) ^ reinterpret_cast<uintptr_t>(klass)) /
+        kObjectAlignment) % kTenuredSiteTableSize;
+  }
+
+  void TenureSite(SiteStats* site) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  Mutex lock_;
+  SafeMap<SiteKey, SiteStats> sites_ GUARDED_BY(lock_);
+  std::vector<Sample> samples_ GUARDED_BY(lock_);
+  uint32_t collection_count_ GUARDED_BY(lock_);
+
+  TenuredSite tenured_sites_[kTenuredSiteTableSize];
+  volatile size_t num_tenured_sites_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocationSiteTable);
+};
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_ACCOUNTING_ALLOCATION_SITE_TABLE_H_
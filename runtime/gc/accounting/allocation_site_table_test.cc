@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_site_table.h"
+
+#include "common_test.h"
+#include "thread.h"
+
+namespace art {
+namespace gc {
+namespace accounting {
+
+// Copied so that the test macros, which take references, don't need definitions of the members.
+static const size_t kSamples = AllocationSiteTable::kMinTenureSamples;
+static const size_t kMaxSites = AllocationSiteTable::kMaxTenuredSites;
+
+class AllocationSiteTableTest : public CommonTest {
+ public:
+  // The table only compares the methods, classes and objects, any distinct aligned values do.
+  static const mirror::ArtMethod* Method(size_t i) {
+    return reinterpret_cast<const mirror::ArtMethod*>(0x10000000 + i * kObjectAlignment);
+  }
+
+  static const mirror::Class* Class(size_t i) {
+    return reinterpret_cast<const mirror::Class*>(0x20000000 + i * kObjectAlignment);
+  }
+
+  static const mirror::Object* Object(size_t i) {
+    return reinterpret_cast<const mirror::Object*>(0x30000000 + i * kObjectAlignment);
+  }
+
+  // Adds count samples of the site at dex pc 0 of method allocating klass.
+  static void AddSamples(AllocationSiteTable* table, const mirror::ArtMethod* method,
+                         const mirror::Class* klass, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      table->AddSample(Thread::Current(), method, 0, klass, Object(i));
+    }
+  }
+
+  static AllocationSiteTable::SampleFate FateCallback(const mirror::Object*, void* arg) {
+    return *reinterpret_cast<AllocationSiteTable::SampleFate*>(arg);
+  }
+
+  // Resolves the samples taken before this call with fate.
+  static void Collect(AllocationSiteTable* table, AllocationSiteTable::SampleFate fate) {
+    table->StartCollection();
+    table->SweepSamples(FateCallback, &fate);
+  }
+
+  static void CountSample(const mirror::Object*, void* arg) {
+    ++*reinterpret_cast<size_t*>(arg);
+  }
+
+  static size_t CountSamples(AllocationSiteTable* table) {
+    size_t count = 0;
+    table->VisitSamples(CountSample, &count);
+    return count;
+  }
+};
+
+TEST_F(AllocationSiteTableTest, TenureSurvivingSite) {
+  AllocationSiteTable table;
+  AddSamples(&table, Method(0), Class(0), kSamples);
+  // Samples taken during the collection are left for the next one.
+  AllocationSiteTable::SampleFate fate = AllocationSiteTable::kSampleSurvived;
+  table.SweepSamples(FateCallback, &fate);
+  EXPECT_EQ(kSamples, CountSamples(&table));
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(0)));
+
+  Collect(&table, AllocationSiteTable::kSampleSurvived);
+  EXPECT_EQ(0U, CountSamples(&table));
+  EXPECT_TRUE(table.IsTenured(Method(0), Class(0)));
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(1)));
+  EXPECT_FALSE(table.IsTenured(Method(1), Class(0)));
+  EXPECT_EQ(1U, table.GetTenuredSiteCount());
+
+  // Tenured sites aren't sampled anymore.
+  AddSamples(&table, Method(0), Class(0), 1);
+  EXPECT_EQ(0U, CountSamples(&table));
+}
+
+TEST_F(AllocationSiteTableTest, DontTenureDyingSite) {
+  AllocationSiteTable table;
+  AddSamples(&table, Method(0), Class(0), kSamples);
+  Collect(&table, AllocationSiteTable::kSampleDead);
+  EXPECT_EQ(0U, CountSamples(&table));
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(0)));
+
+  // Surviving samples don't make up for the ones which died.
+  AddSamples(&table, Method(0), Class(0), kSamples);
+  Collect(&table, AllocationSiteTable::kSampleSurvived);
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(0)));
+  EXPECT_EQ(0U, table.GetTenuredSiteCount());
+}
+
+TEST_F(AllocationSiteTableTest, KeepUnknownSamples) {
+  AllocationSiteTable table;
+  AddSamples(&table, Method(0), Class(0), kSamples);
+  Collect(&table, AllocationSiteTable::kSampleUnknown);
+  EXPECT_EQ(kSamples, CountSamples(&table));
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(0)));
+
+  Collect(&table, AllocationSiteTable::kSampleSurvived);
+  EXPECT_EQ(0U, CountSamples(&table));
+  EXPECT_TRUE(table.IsTenured(Method(0), Class(0)));
+}
+
+TEST_F(AllocationSiteTableTest, DontTenurePolymorphicSite) {
+  AllocationSiteTable table;
+  AddSamples(&table, Method(0), Class(0), kSamples);
+  AddSamples(&table, Method(0), Class(1), 1);
+  Collect(&table, AllocationSiteTable::kSampleSurvived);
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(0)));
+  EXPECT_FALSE(table.IsTenured(Method(0), Class(1)));
+
+  // The site isn't sampled anymore.
+  AddSamples(&table, Method(0), Class(0), 1);
+  EXPECT_EQ(0U, CountSamples(&table));
+}
+
+TEST_F(AllocationSiteTableTest, FullTable) {
+  AllocationSiteTable table;
+  for (size_t i = 0; i < kMaxSites; ++i) {
+    AddSamples(&table, Method(i), Class(0), kSamples);
+  }
+  Collect(&table, AllocationSiteTable::kSampleSurvived);
+  EXPECT_EQ(kMaxSites, table.GetTenuredSiteCount());
+  for (size_t i = 0; i < kMaxSites; ++i) {
+    EXPECT_TRUE(table.IsTenured(Method(i), Class(0))) << i;
+  }
+
+  // A site which doesn't fit isn't tenured, and keeps being sampled.
+  const mirror::ArtMethod* method = Method(kMaxSites);
+  AddSamples(&table, method, Class(0), kSamples);
+  Collect(&table, AllocationSiteTable::kSampleSurvived);
+  EXPECT_FALSE(table.IsTenured(method, Class(0)));
+  EXPECT_EQ(kMaxSites, table.GetTenuredSiteCount());
+  AddSamples(&table, method, Class(0), 1);
+  EXPECT_EQ(1U, CountSamples(&table));
+}
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
@@ -17,6 +17,7 @@
 #ifndef ART_RUNTIME_GC_ACCOUNTING_ATOMIC_STACK_H_
 #define ART_RUNTIME_GC_ACCOUNTING_ATOMIC_STACK_H_
 
+#include <algorithm>
 #include <string>
 
 #include "atomic_integer.h"
@@ -73,6 +74,29 @@ class AtomicStack {
     return true;
   }
 
+  // Atomically reserve num_slots slots at the back of the stack, cleared to T(), for a single
+  // thread to push into without further synchronization. Returns false if we overflowed the stack.
+  bool AtomicBumpBack(size_t num_slots, T** start_address, T** end_address) {
+    if (kIsDebugBuild) {
+      debug_is_sorted_ = false;
+    }
+    int32_t index;
+    int32_t new_index;
+    do {
+      index = back_index_;
+      new_index = index + num_slots;
+      if (UNLIKELY(static_cast<size_t>(new_index) > capacity_)) {
+        // Stack overflow.
+        return false;
+      }
+    } while (!back_index_.compare_and_swap(index, new_index));
+    // Slots given back with PopBackCount may still hold old values.
+    std::fill(begin_ + index, begin_ + new_index, T());
+    *start_address = begin_ + index;
+    *end_address = begin_ + new_index;
+    return true;
+  }
+
   void PushBack(const T& value) {
     if (kIsDebugBuild) {
       debug_is_sorted_ = false;
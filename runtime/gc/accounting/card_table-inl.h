@@ -22,6 +22,7 @@
 #include "cutils/atomic-inline.h"
 #include "space_bitmap.h"
 #include "utils.h"
+#include "vector_scan.h"
 
 namespace art {
 namespace gc {
@@ -52,57 +53,13 @@ inline size_t CardTable::Scan(SpaceBitmap* bitmap, byte* scan_begin, byte* scan_
   CheckCardValid(card_end);
   size_t cards_scanned = 0;
 
-  // Handle any unaligned cards at the start.
-  while (!IsAligned<sizeof(word)>(card_cur) && card_cur < card_end) {
-    if (*card_cur >= minimum_age) {
-      uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(card_cur));
-      bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
-      ++cards_scanned;
-    }
-    ++card_cur;
-  }
-
-  byte* aligned_end = card_end -
-      (reinterpret_cast<uintptr_t>(card_end) & (sizeof(uintptr_t) - 1));
-
-  uintptr_t* word_end = reinterpret_cast<uintptr_t*>(aligned_end);
-  for (uintptr_t* word_cur = reinterpret_cast<uintptr_t*>(card_cur); word_cur < word_end;
-      ++word_cur) {
-    while (LIKELY(*word_cur == 0)) {
-      ++word_cur;
-      if (UNLIKELY(word_cur >= word_end)) {
-        goto exit_for;
-      }
-    }
-
-    // Find the first dirty card.
-    uintptr_t start_word = *word_cur;
-    uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(reinterpret_cast<byte*>(word_cur)));
+  for (const byte* card = FindCardAtLeast(card_cur, card_end, minimum_age); card < card_end;
+       card = FindCardAtLeast(card + 1, card_end, minimum_age)) {
     // TODO: Investigate if processing continuous runs of dirty cards with a single bitmap visit is
     // more efficient.
-    for (size_t i = 0; i < sizeof(uintptr_t); ++i) {
-      if (static_cast<byte>(start_word) >= minimum_age) {
-        auto* card = reinterpret_cast<byte*>(word_cur) + i;
-        DCHECK(*card == static_cast<byte>(start_word) || *card == kCardDirty)
-            << "card " << static_cast<size_t>(*card) << " word " << (start_word & 0xFF);
-        bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
-        ++cards_scanned;
-      }
-      start_word >>= 8;
-      start += kCardSize;
-    }
-  }
-  exit_for:
-
-  // Handle any unaligned cards at the end.
-  card_cur = reinterpret_cast<byte*>(word_end);
-  while (card_cur < card_end) {
-    if (*card_cur >= minimum_age) {
-      uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(card_cur));
-      bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
-      ++cards_scanned;
-    }
-    ++card_cur;
+    uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(card));
+    bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
+    ++cards_scanned;
   }
 
   return cards_scanned;
@@ -146,7 +103,7 @@ inline void CardTable::ModifyCardsAtomic(byte* scan_begin, byte* scan_end, const
       new_value = visitor(expected);
     } while (expected != new_value && UNLIKELY(!byte_cas(expected, new_value, card_end)));
     if (expected != new_value) {
-      modified(card_cur, expected, new_value);
+      modified(card_end, expected, new_value);
     }
   }
 
@@ -158,6 +115,14 @@ inline void CardTable::ModifyCardsAtomic(byte* scan_begin, byte* scan_end, const
 
   // TODO: Parallelize.
   while (word_cur < word_end) {
+    // Skip to the word holding the next card which isn't clean.
+    const byte* card = FindCardAtLeast(reinterpret_cast<byte*>(word_cur),
+                                       reinterpret_cast<byte*>(word_end), kCardClean + 1);
+    word_cur = reinterpret_cast<uintptr_t*>(RoundDown(reinterpret_cast<uintptr_t>(card),
+                                                      sizeof(uintptr_t)));
+    if (word_cur >= word_end) {
+      break;
+    }
     while ((expected_word = *word_cur) != 0) {
       new_word =
           (visitor((expected_word >> 0) & 0xFF) << 0) |
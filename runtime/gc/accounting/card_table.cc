@@ -17,11 +17,14 @@
 #include "card_table.h"
 
 #include "base/logging.h"
+#include "base/stl_util.h"
 #include "card_table-inl.h"
 #include "gc/heap.h"
 #include "gc/space/space.h"
 #include "heap_bitmap.h"
 #include "runtime.h"
+#include "thread.h"
+#include "thread_pool.h"
 #include "utils.h"
 
 namespace art {
@@ -92,6 +95,74 @@ void CardTable::ClearSpaceCards(space::ContinuousSpace* space) {
   memset(reinterpret_cast<void*>(card_start), kCardClean, card_end - card_start);
 }
 
+// Ages a stripe of cards, remembering the ones which were dirty if record_cleared.
+class AgeCardsTask : public Task {
+ public:
+  AgeCardsTask(CardTable* card_table, byte* begin, byte* end, bool record_cleared)
+      : card_table_(card_table),
+        begin_(begin),
+        end_(end),
+        record_cleared_(record_cleared) {
+  }
+
+  const std::vector<byte*>& GetClearedCards() const {
+    return cleared_cards_;
+  }
+
+  virtual void Run(Thread* self) {
+    if (record_cleared_) {
+      std::vector<byte*>* cleared_cards = &cleared_cards_;
+      card_table_->ModifyCardsAtomic(begin_, end_, AgeCardVisitor(),
+          [cleared_cards](byte* card, byte expected_value, byte new_value) {
+        if (expected_value == CardTable::kCardDirty) {
+          cleared_cards->push_back(card);
+        }
+      });
+    } else {
+      card_table_->ModifyCardsAtomic(begin_, end_, AgeCardVisitor(), VoidFunctor());
+    }
+  }
+
+ private:
+  CardTable* const card_table_;
+  byte* const begin_;
+  byte* const end_;
+  const bool record_cleared_;
+  std::vector<byte*> cleared_cards_;
+};
+
+void CardTable::AgeCards(byte* scan_begin, byte* scan_end, ThreadPool* thread_pool,
+                         size_t thread_count, std::vector<byte*>* cleared_cards) {
+  Thread* self = Thread::Current();
+  const bool record_cleared = cleared_cards != NULL;
+  std::vector<AgeCardsTask*> tasks;
+  if (thread_pool != NULL && thread_count > 1) {
+    // Stripes are aligned so that every word of cards belongs to a single stripe.
+    const size_t stripe_size = RoundUp((scan_end - scan_begin) / thread_count + 1,
+                                       kCardSize * sizeof(word));
+    for (byte* stripe_begin = scan_begin; stripe_begin < scan_end; stripe_begin += stripe_size) {
+      byte* stripe_end = stripe_begin + std::min(stripe_size,
+                                                 static_cast<size_t>(scan_end - stripe_begin));
+      tasks.push_back(new AgeCardsTask(this, stripe_begin, stripe_end, record_cleared));
+      thread_pool->AddTask(self, tasks.back());
+    }
+    thread_pool->SetMaxActiveWorkers(thread_count - 1);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, true, true);
+    thread_pool->StopWorkers(self);
+  } else {
+    tasks.push_back(new AgeCardsTask(this, scan_begin, scan_end, record_cleared));
+    tasks.back()->Run(self);
+  }
+  if (record_cleared) {
+    for (AgeCardsTask* task : tasks) {
+      cleared_cards->insert(cleared_cards->end(), task->GetClearedCards().begin(),
+                            task->GetClearedCards().end());
+    }
+  }
+  STLDeleteElements(&tasks);
+}
+
 void CardTable::ClearCardTable() {
   // TODO: clear just the range of the table that has been modified
   memset(mem_map_->Begin(), kCardClean, mem_map_->Size());
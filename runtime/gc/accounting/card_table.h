@@ -17,6 +17,8 @@
 #ifndef ART_RUNTIME_GC_ACCOUNTING_CARD_TABLE_H_
 #define ART_RUNTIME_GC_ACCOUNTING_CARD_TABLE_H_
 
+#include <vector>
+
 #include "globals.h"
 #include "locks.h"
 #include "mem_map.h"
@@ -28,6 +30,8 @@ namespace mirror {
   class Object;
 }  // namespace mirror
 
+class ThreadPool;
+
 namespace gc {
 
 namespace space {
@@ -99,6 +103,12 @@ class CardTable {
   void ModifyCardsAtomic(byte* scan_begin, byte* scan_end, const Visitor& visitor,
                          const ModifiedVisitor& modified);
 
+  // Ages the cards between scan_begin and scan_end, see AgeCardVisitor. With more than one thread
+  // the cards are split into stripes which are aged by the workers of thread_pool. The cards which
+  // were dirty are appended to cleared_cards unless it is NULL.
+  void AgeCards(byte* scan_begin, byte* scan_end, ThreadPool* thread_pool, size_t thread_count,
+                std::vector<byte*>* cleared_cards);
+
   // For every dirty at least minumum age between begin and end invoke the visitor with the
   // specified argument. Returns how many cards the visitor was run on.
   template <typename Visitor>
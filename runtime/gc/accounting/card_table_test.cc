@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "card_table.h"
+
+#include "card_table-inl.h"
+#include "common_test.h"
+#include "gc/heap.h"
+#include "globals.h"
+#include "scoped_thread_state_change.h"
+#include "space_bitmap-inl.h"
+#include "UniquePtr.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace art {
+namespace gc {
+namespace accounting {
+
+class CardTableTest : public CommonTest {
+ public:
+};
+
+// Fills the cards of the heap with a few scattered dirty and aged cards and returns their copy.
+static std::vector<byte> ScatterCards(CardTable* card_table, byte* heap_begin,
+                                      size_t heap_capacity, size_t* seed) {
+  const size_t num_cards = heap_capacity / CardTable::kCardSize;
+  byte* cards = card_table->CardFromAddr(heap_begin);
+  std::vector<byte> values(num_cards, CardTable::kCardClean);
+  for (size_t i = 0; i < num_cards / 64; ++i) {
+    size_t card = test_rand(seed) % num_cards;
+    values[card] = (test_rand(seed) % 2 == 0) ? CardTable::kCardDirty : CardTable::kCardDirty - 1;
+  }
+  std::copy(values.begin(), values.end(), cards);
+  return values;
+}
+
+class CollectVisitor {
+ public:
+  explicit CollectVisitor(std::vector<const mirror::Object*>* objects) : objects_(objects) {}
+
+  void operator()(const mirror::Object* obj) const {
+    objects_->push_back(obj);
+  }
+
+ private:
+  std::vector<const mirror::Object*>* const objects_;
+};
+
+TEST_F(CardTableTest, Scan) {
+  ScopedObjectAccess soa(Thread::Current());
+  WriterMutexLock mu(soa.Self(), *Locks::heap_bitmap_lock_);
+  byte* heap_begin = reinterpret_cast<byte*>(0x10000000);
+  size_t heap_capacity = 4 * MB;
+  UniquePtr<CardTable> card_table(CardTable::Create(heap_begin, heap_capacity));
+  UniquePtr<SpaceBitmap> bitmap(SpaceBitmap::Create("test bitmap", heap_begin, heap_capacity));
+  ASSERT_TRUE(card_table.get() != NULL);
+  ASSERT_TRUE(bitmap.get() != NULL);
+
+  // An object at the start of every card and a few more in between.
+  for (byte* addr = heap_begin; addr < heap_begin + heap_capacity; addr += CardTable::kCardSize) {
+    bitmap->Set(reinterpret_cast<mirror::Object*>(addr));
+    bitmap->Set(reinterpret_cast<mirror::Object*>(addr + 5 * SpaceBitmap::kAlignment));
+  }
+  size_t seed = 0;
+  std::vector<byte> values = ScatterCards(card_table.get(), heap_begin, heap_capacity, &seed);
+
+  // Scan from and to every card of the first and last vector of cards so that the edges are
+  // covered for both minimum ages.
+  for (byte minimum_age = CardTable::kCardDirty - 1; minimum_age <= CardTable::kCardDirty;
+       ++minimum_age) {
+    for (size_t begin_card = 0; begin_card < 32; ++begin_card) {
+      for (size_t end_card = 0; end_card < 32; end_card += 3) {
+        byte* begin = heap_begin + begin_card * CardTable::kCardSize;
+        byte* end = heap_begin + heap_capacity - end_card * CardTable::kCardSize;
+        std::vector<const mirror::Object*> objects;
+        size_t cards_scanned = card_table->Scan(bitmap.get(), begin, end,
+                                                CollectVisitor(&objects), minimum_age);
+        std::vector<const mirror::Object*> expected;
+        const size_t num_cards = (end - begin) / CardTable::kCardSize;
+        size_t expected_cards = 0;
+        for (size_t card = begin_card; card < begin_card + num_cards; ++card) {
+          if (values[card] >= minimum_age) {
+            byte* addr = heap_begin + card * CardTable::kCardSize;
+            expected.push_back(reinterpret_cast<mirror::Object*>(addr));
+            expected.push_back(
+                reinterpret_cast<mirror::Object*>(addr + 5 * SpaceBitmap::kAlignment));
+            ++expected_cards;
+          }
+        }
+        EXPECT_EQ(expected_cards, cards_scanned);
+        EXPECT_TRUE(objects == expected) << begin_card << " " << end_card;
+      }
+    }
+  }
+}
+
+TEST_F(CardTableTest, AgeCards) {
+  byte* heap_begin = reinterpret_cast<byte*>(0x10000000);
+  size_t heap_capacity = 4 * MB;
+  UniquePtr<CardTable> card_table(CardTable::Create(heap_begin, heap_capacity));
+  ASSERT_TRUE(card_table.get() != NULL);
+  size_t seed = 0;
+  for (size_t begin_card = 0; begin_card < 32; begin_card += 5) {
+    for (size_t end_card = 0; end_card < 32; end_card += 7) {
+      std::vector<byte> values = ScatterCards(card_table.get(), heap_begin, heap_capacity, &seed);
+      byte* begin = heap_begin + begin_card * CardTable::kCardSize;
+      byte* end = heap_begin + heap_capacity - end_card * CardTable::kCardSize;
+      std::vector<byte*> cleared_cards;
+      card_table->AgeCards(begin, end, NULL, 1, &cleared_cards);
+      std::sort(cleared_cards.begin(), cleared_cards.end());
+
+      byte* cards = card_table->CardFromAddr(heap_begin);
+      std::vector<byte*> expected_cleared;
+      for (size_t card = 0; card < values.size(); ++card) {
+        byte expected = values[card];
+        if (card >= begin_card && card < values.size() - end_card) {
+          if (expected == CardTable::kCardDirty) {
+            expected_cleared.push_back(&cards[card]);
+          }
+          expected = AgeCardVisitor()(expected);
+        }
+        ASSERT_EQ(expected, cards[card]) << card;
+      }
+      EXPECT_TRUE(cleared_cards == expected_cleared) << begin_card << " " << end_card;
+    }
+  }
+}
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
@@ -28,6 +28,7 @@
 #include "mirror/object_array-inl.h"
 #include "space_bitmap-inl.h"
 #include "thread.h"
+#include "thread_pool.h"
 #include "UniquePtr.h"
 
 using ::art::mirror::Object;
@@ -36,22 +37,6 @@ namespace art {
 namespace gc {
 namespace accounting {
 
-class ModUnionClearCardSetVisitor {
- public:
-  explicit ModUnionClearCardSetVisitor(ModUnionTable::CardSet* const cleared_cards)
-    : cleared_cards_(cleared_cards) {
-  }
-
-  inline void operator()(byte* card, byte expected_value, byte new_value) const {
-    if (expected_value == CardTable::kCardDirty) {
-      cleared_cards_->insert(card);
-    }
-  }
-
- private:
-  ModUnionTable::CardSet* const cleared_cards_;
-};
-
 class ModUnionClearCardVisitor {
  public:
   explicit ModUnionClearCardVisitor(std::vector<byte*>* cleared_cards)
@@ -83,11 +68,18 @@ class ModUnionScanImageRootVisitor {
   collector::MarkSweep* const mark_sweep_;
 };
 
-void ModUnionTableReferenceCache::ClearCards(space::ContinuousSpace* space) {
-  CardTable* card_table = GetHeap()->GetCardTable();
-  ModUnionClearCardSetVisitor visitor(&cleared_cards_);
+// Ages the cards of a space, adding the ones which were dirty to cleared_cards.
+static void ClearSpaceCards(Heap* heap, space::ContinuousSpace* space, size_t thread_count,
+                            ModUnionTable::CardSet* cleared_cards) {
+  std::vector<byte*> stripe_cleared_cards;
+  heap->GetCardTable()->AgeCards(space->Begin(), space->End(), heap->GetThreadPool(),
+                                 thread_count, &stripe_cleared_cards);
+  cleared_cards->insert(stripe_cleared_cards.begin(), stripe_cleared_cards.end());
+}
+
+void ModUnionTableReferenceCache::ClearCards(space::ContinuousSpace* space, size_t thread_count) {
   // Clear dirty cards in the this space and update the corresponding mod-union bits.
-  card_table->ModifyCardsAtomic(space->Begin(), space->End(), AgeCardVisitor(), visitor);
+  ClearSpaceCards(GetHeap(), space, thread_count, &cleared_cards_);
 }
 
 class AddToReferenceArrayVisitor {
@@ -233,35 +225,91 @@ void ModUnionTableReferenceCache::Dump(std::ostream& os) {
   }
 }
 
-void ModUnionTableReferenceCache::Update() {
-  Heap* heap = GetHeap();
-  CardTable* card_table = heap->GetCardTable();
+// Re-computes the alloc space references of a stripe of cleared cards. The references are cached
+// by the task until they are merged into the table.
+class ModUnionUpdateTask : public Task {
+ public:
+  typedef std::vector<std::pair<const byte*, std::vector<const Object*> > > CardReferences;
+
+  ModUnionUpdateTask(ModUnionTableReferenceCache* mod_union_table,
+                     ModUnionTable::CardSet::const_iterator begin,
+                     ModUnionTable::CardSet::const_iterator end)
+      : mod_union_table_(mod_union_table),
+        begin_(begin),
+        end_(end) {
+  }
 
-  std::vector<const Object*> cards_references;
-  ModUnionReferenceVisitor visitor(this, &cards_references);
+  CardReferences& GetCardReferences() {
+    return card_references_;
+  }
 
-  for (const auto& card : cleared_cards_) {
-    // Clear and re-compute alloc space references associated with this card.
-    cards_references.clear();
-    uintptr_t start = reinterpret_cast<uintptr_t>(card_table->AddrFromCard(card));
-    uintptr_t end = start + CardTable::kCardSize;
-    auto* space = heap->FindContinuousSpaceFromObject(reinterpret_cast<Object*>(start), false);
-    DCHECK(space != nullptr);
-    SpaceBitmap* live_bitmap = space->GetLiveBitmap();
-    live_bitmap->VisitMarkedRange(start, end, visitor);
-
-    // Update the corresponding references for the card.
-    auto found = references_.find(card);
-    if (found == references_.end()) {
-      if (cards_references.empty()) {
-        // No reason to add empty array.
-        continue;
+  virtual void Run(Thread* self) NO_THREAD_SAFETY_ANALYSIS {
+    Heap* heap = mod_union_table_->GetHeap();
+    CardTable* card_table = heap->GetCardTable();
+    space::ContinuousSpace* space = nullptr;
+    for (auto it = begin_; it != end_; ++it) {
+      const byte* card = *it;
+      card_references_.push_back(std::make_pair(card, std::vector<const Object*>()));
+      ModUnionReferenceVisitor visitor(mod_union_table_, &card_references_.back().second);
+      uintptr_t start = reinterpret_cast<uintptr_t>(card_table->AddrFromCard(card));
+      uintptr_t end = start + CardTable::kCardSize;
+      Object* obj_start = reinterpret_cast<Object*>(start);
+      if (UNLIKELY(space == nullptr || !space->Contains(obj_start))) {
+        space = heap->FindContinuousSpaceFromObject(obj_start, false);
+        DCHECK(space != nullptr);
+      }
+      space->GetLiveBitmap()->VisitMarkedRange(start, end, visitor);
+    }
+  }
+
+ private:
+  ModUnionTableReferenceCache* const mod_union_table_;
+  const ModUnionTable::CardSet::const_iterator begin_;
+  const ModUnionTable::CardSet::const_iterator end_;
+  CardReferences card_references_;
+};
+
+void ModUnionTableReferenceCache::Update(size_t thread_count) {
+  Thread* self = Thread::Current();
+  ThreadPool* thread_pool = GetHeap()->GetThreadPool();
+  std::vector<ModUnionUpdateTask*> tasks;
+  if (thread_pool != nullptr && thread_count > 1) {
+    const size_t stripe_size = cleared_cards_.size() / thread_count + 1;
+    auto stripe_begin = cleared_cards_.begin();
+    while (stripe_begin != cleared_cards_.end()) {
+      auto stripe_end = stripe_begin;
+      for (size_t i = 0; i < stripe_size && stripe_end != cleared_cards_.end(); ++i) {
+        ++stripe_end;
+      }
+      tasks.push_back(new ModUnionUpdateTask(this, stripe_begin, stripe_end));
+      thread_pool->AddTask(self, tasks.back());
+      stripe_begin = stripe_end;
+    }
+    thread_pool->SetMaxActiveWorkers(thread_count - 1);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, true, true);
+    thread_pool->StopWorkers(self);
+  } else {
+    tasks.push_back(new ModUnionUpdateTask(this, cleared_cards_.begin(), cleared_cards_.end()));
+    tasks.back()->Run(self);
+  }
+
+  // Update the corresponding references for the cards, the stripes don't share any card.
+  for (ModUnionUpdateTask* task : tasks) {
+    for (auto& card_references : task->GetCardReferences()) {
+      auto found = references_.find(card_references.first);
+      if (found == references_.end()) {
+        if (card_references.second.empty()) {
+          // No reason to add empty array.
+          continue;
+        }
+        references_.Put(card_references.first, card_references.second);
+      } else {
+        found->second.swap(card_references.second);
       }
-      references_.Put(card, cards_references);
-    } else {
-      found->second = cards_references;
     }
   }
+  STLDeleteElements(&tasks);
   cleared_cards_.clear();
 }
 
@@ -279,11 +327,9 @@ void ModUnionTableReferenceCache::MarkReferences(collector::MarkSweep* mark_swee
   }
 }
 
-void ModUnionTableCardCache::ClearCards(space::ContinuousSpace* space) {
-  CardTable* card_table = GetHeap()->GetCardTable();
-  ModUnionClearCardSetVisitor visitor(&cleared_cards_);
+void ModUnionTableCardCache::ClearCards(space::ContinuousSpace* space, size_t thread_count) {
   // Clear dirty cards in the this space and update the corresponding mod-union bits.
-  card_table->ModifyCardsAtomic(space->Begin(), space->End(), AgeCardVisitor(), visitor);
+  ClearSpaceCards(GetHeap(), space, thread_count, &cleared_cards_);
 }
 
 // Mark all references to the alloc space(s).
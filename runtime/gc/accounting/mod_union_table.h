@@ -58,12 +58,13 @@ class ModUnionTable {
 
   // Clear cards which map to a memory range of a space. This doesn't immediately update the
   // mod-union table, as updating the mod-union table may have an associated cost, such as
-  // determining references to track.
-  virtual void ClearCards(space::ContinuousSpace* space) = 0;
+  // determining references to track. With more than one thread the cards are split into stripes
+  // which are cleared by the heap's thread pool.
+  virtual void ClearCards(space::ContinuousSpace* space, size_t thread_count) = 0;
 
   // Update the mod-union table using data stored by ClearCards. There may be multiple ClearCards
   // before a call to update, for example, back-to-back sticky GCs.
-  virtual void Update() = 0;
+  virtual void Update(size_t thread_count) = 0;
 
   // Mark the bitmaps for all references which are stored in the mod-union table.
   virtual void MarkReferences(collector::MarkSweep* mark_sweep) = 0;
@@ -91,10 +92,12 @@ class ModUnionTableReferenceCache : public ModUnionTable {
   virtual ~ModUnionTableReferenceCache() {}
 
   // Clear and store cards for a space.
-  void ClearCards(space::ContinuousSpace* space);
+  void ClearCards(space::ContinuousSpace* space, size_t thread_count);
 
-  // Update table based on cleared cards.
-  void Update()
+  // Update table based on cleared cards. With more than one thread the cleared cards are split
+  // into stripes whose references are found by the heap's thread pool, each stripe caching them on
+  // its own until they are merged into the table.
+  void Update(size_t thread_count)
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
@@ -128,10 +131,10 @@ class ModUnionTableCardCache : public ModUnionTable {
   virtual ~ModUnionTableCardCache() {}
 
   // Clear and store cards for a space.
-  void ClearCards(space::ContinuousSpace* space);
+  void ClearCards(space::ContinuousSpace* space, size_t thread_count);
 
   // Nothing to update as all dirty cards were placed into cleared cards during clearing.
-  void Update() {}
+  void Update(size_t /* thread_count */) {}
 
   // Mark all references to the alloc space(s).
   void MarkReferences(collector::MarkSweep* mark_sweep)
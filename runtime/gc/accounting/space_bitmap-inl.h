@@ -20,6 +20,7 @@
 #include "base/logging.h"
 #include "cutils/atomic-inline.h"
 #include "utils.h"
+#include "vector_scan.h"
 
 namespace art {
 namespace gc {
@@ -85,16 +86,16 @@ void SpaceBitmap::VisitMarkedRange(uintptr_t visit_begin, uintptr_t visit_end,
   }
   word_start++;
 
-  for (size_t i = word_start; i < word_end; i++) {
+  for (size_t i = FindSetWord(bitmap_begin_, NULL, word_start, word_end); i < word_end;
+       i = FindSetWord(bitmap_begin_, NULL, i + 1, word_end)) {
+    // Read the word again, it may have changed since the search.
     size_t w = bitmap_begin_[i];
-    if (w != 0) {
-      uintptr_t ptr_base = IndexToOffset(i) + heap_begin_;
-      do {
-        const size_t shift = CLZ(w);
-        mirror::Object* obj = reinterpret_cast<mirror::Object*>(ptr_base + shift * kAlignment);
-        visitor(obj);
-        w ^= static_cast<size_t>(kWordHighBitMask) >> shift;
-      } while (w != 0);
+    uintptr_t ptr_base = IndexToOffset(i) + heap_begin_;
+    while (w != 0) {
+      const size_t shift = CLZ(w);
+      mirror::Object* obj = reinterpret_cast<mirror::Object*>(ptr_base + shift * kAlignment);
+      visitor(obj);
+      w ^= static_cast<size_t>(kWordHighBitMask) >> shift;
     }
   }
 
@@ -150,21 +150,21 @@ void SpaceBitmap::SweepWalk(const SpaceBitmap& live_bitmap,
   CHECK_LT(end, live_bitmap.Size() / kWordSize);
   word* live = live_bitmap.bitmap_begin_;
   word* mark = mark_bitmap.bitmap_begin_;
-  for (size_t i = start; i <= end; i++) {
+  // Most of the words are usually free of garbage, skip them in bulk.
+  for (size_t i = FindSetWord(live, mark, start, end + 1); i <= end;
+       i = FindSetWord(live, mark, i + 1, end + 1)) {
     word garbage = live[i] & ~mark[i];
-    if (UNLIKELY(garbage != 0)) {
-      uintptr_t ptr_base = IndexToOffset(i) + live_bitmap.heap_begin_;
-      do {
-        const size_t shift = CLZ(garbage);
-        garbage ^= static_cast<size_t>(kWordHighBitMask) >> shift;
-        *pb++ = reinterpret_cast<mirror::Object*>(ptr_base + shift * kAlignment);
-      } while (garbage != 0);
-      // Make sure that there are always enough slots available for an
-      // entire word of one bits.
-      if (pb >= &pointer_buf[buffer_size - kBitsPerWord]) {
-        (*callback)(pb - &pointer_buf[0], &pointer_buf[0], arg);
-        pb = &pointer_buf[0];
-      }
+    uintptr_t ptr_base = IndexToOffset(i) + live_bitmap.heap_begin_;
+    while (garbage != 0) {
+      const size_t shift = CLZ(garbage);
+      garbage ^= static_cast<size_t>(kWordHighBitMask) >> shift;
+      *pb++ = reinterpret_cast<mirror::Object*>(ptr_base + shift * kAlignment);
+    }
+    // Make sure that there are always enough slots available for an
+    // entire word of one bits.
+    if (pb >= &pointer_buf[buffer_size - kBitsPerWord]) {
+      (*callback)(pb - &pointer_buf[0], &pointer_buf[0], arg);
+      pb = &pointer_buf[0];
     }
   }
   if (pb > &pointer_buf[0]) {
@@ -22,6 +22,8 @@
 #include "UniquePtr.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <vector>
 
 namespace art {
 namespace gc {
@@ -88,6 +90,68 @@ TEST_F(SpaceBitmapTest, ScanRange) {
   }
 }
 
+static void CollectGarbageCallback(size_t ptr_count, mirror::Object** ptrs, void* arg) {
+  std::vector<mirror::Object*>* garbage = reinterpret_cast<std::vector<mirror::Object*>*>(arg);
+  garbage->insert(garbage->end(), ptrs, ptrs + ptr_count);
+}
+
+TEST_F(SpaceBitmapTest, SweepWalk) {
+  byte* heap_begin = reinterpret_cast<byte*>(0x10000000);
+  size_t heap_capacity = 16 * MB;
+  UniquePtr<SpaceBitmap> live_bitmap(SpaceBitmap::Create("test live bitmap",
+                                                         heap_begin, heap_capacity));
+  UniquePtr<SpaceBitmap> mark_bitmap(SpaceBitmap::Create("test mark bitmap",
+                                                         heap_begin, heap_capacity));
+  ASSERT_TRUE(live_bitmap.get() != NULL);
+  ASSERT_TRUE(mark_bitmap.get() != NULL);
+
+  // Scatter a few clusters of live objects, marking about half of them, so that the sweep goes
+  // through long runs of clean words between them.
+  const size_t num_objects = heap_capacity / SpaceBitmap::kAlignment;
+  std::vector<mirror::Object*> expected;
+  size_t seed = 0;
+  for (size_t cluster = 0; cluster < 64; ++cluster) {
+    size_t first = test_rand(&seed) % (num_objects - 256);
+    for (size_t j = 0; j < 256; j += 1 + test_rand(&seed) % 8) {
+      mirror::Object* obj =
+          reinterpret_cast<mirror::Object*>(heap_begin + (first + j) * SpaceBitmap::kAlignment);
+      live_bitmap->Set(obj);
+      if (test_rand(&seed) % 2 == 0) {
+        mark_bitmap->Set(obj);
+      }
+    }
+  }
+  for (size_t i = 0; i < num_objects; ++i) {
+    mirror::Object* obj =
+        reinterpret_cast<mirror::Object*>(heap_begin + i * SpaceBitmap::kAlignment);
+    if (live_bitmap->Test(obj) && !mark_bitmap->Test(obj)) {
+      expected.push_back(obj);
+    }
+  }
+
+  // Sweep ranges starting and ending at various words so that every alignment of the vector
+  // scans is covered.
+  const size_t word_coverage = kBitsPerWord * SpaceBitmap::kAlignment;
+  for (size_t begin_words = 0; begin_words < 8; ++begin_words) {
+    for (size_t end_words = 0; end_words < 8; ++end_words) {
+      uintptr_t begin = reinterpret_cast<uintptr_t>(heap_begin) + begin_words * word_coverage;
+      uintptr_t end = reinterpret_cast<uintptr_t>(heap_begin) + heap_capacity -
+          end_words * word_coverage;
+      std::vector<mirror::Object*> garbage;
+      SpaceBitmap::SweepWalk(*live_bitmap, *mark_bitmap, begin, end, CollectGarbageCallback,
+                             &garbage);
+      std::sort(garbage.begin(), garbage.end());
+      std::vector<mirror::Object*> expected_in_range;
+      for (mirror::Object* obj : expected) {
+        if (reinterpret_cast<uintptr_t>(obj) >= begin && reinterpret_cast<uintptr_t>(obj) < end) {
+          expected_in_range.push_back(obj);
+        }
+      }
+      EXPECT_TRUE(garbage == expected_in_range) << begin_words << " " << end_words;
+    }
+  }
+}
+
 }  // namespace accounting
 }  // namespace gc
 }  // namespace art
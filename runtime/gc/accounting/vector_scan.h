@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_ACCOUNTING_VECTOR_SCAN_H_
+#define ART_RUNTIME_GC_ACCOUNTING_VECTOR_SCAN_H_
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "base/macros.h"
+#include "globals.h"
+#include "utils.h"
+
+namespace art {
+namespace gc {
+namespace accounting {
+
+// Searches used by the bitmap sweep, the bitmap visits and the card table to skip over clean
+// memory. When the build targets SSE2 or NEON they go through the aligned middle of the range a
+// vector at a time, leaving the edges and the vector which matched to the scalar loop.
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+static constexpr bool kUseVectorScan = true;
+#else
+static constexpr bool kUseVectorScan = false;
+#endif
+static constexpr size_t kVectorScanBytes = 16;
+
+// Returns the first card in [begin, end) whose value is at least minimum, or end.
+static inline const byte* FindCardAtLeast(const byte* begin, const byte* end, byte minimum) {
+  const byte* cur = begin;
+  if (kUseVectorScan) {
+    while (!IsAligned<kVectorScanBytes>(cur) && cur < end) {
+      if (*cur >= minimum) {
+        return cur;
+      }
+      ++cur;
+    }
+#if defined(__SSE2__)
+    const __m128i minimums = _mm_set1_epi8(static_cast<char>(minimum));
+    for (; cur + kVectorScanBytes <= end; cur += kVectorScanBytes) {
+      const __m128i cards = _mm_load_si128(reinterpret_cast<const __m128i*>(cur));
+      // There is no unsigned byte comparison, a card is at least minimum if it is the maximum.
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(cards, minimums), cards)) != 0) {
+        break;
+      }
+    }
+#elif defined(__ARM_NEON__)
+    const uint8x16_t minimums = vdupq_n_u8(minimum);
+    for (; cur + kVectorScanBytes <= end; cur += kVectorScanBytes) {
+      const uint64x2_t found = vreinterpretq_u64_u8(vcgeq_u8(vld1q_u8(cur), minimums));
+      if ((vgetq_lane_u64(found, 0) | vgetq_lane_u64(found, 1)) != 0) {
+        break;
+      }
+    }
+#endif
+  }
+  for (; cur < end; ++cur) {
+    if (*cur >= minimum) {
+      return cur;
+    }
+  }
+  return end;
+}
+
+// Returns the index of the first word in [begin, end) with a bit set in words and, unless
+// excluded is NULL, clear in excluded. Returns end if there is none.
+static inline size_t FindSetWord(const word* words, const word* excluded, size_t begin,
+                                 size_t end) {
+  size_t i = begin;
+  if (kUseVectorScan) {
+    static constexpr size_t kWordsPerVector = kVectorScanBytes / sizeof(word);
+    while (!IsAligned<kVectorScanBytes>(&words[i]) && i < end) {
+      if ((words[i] & (excluded != NULL ? ~excluded[i] : ~static_cast<word>(0))) != 0) {
+        return i;
+      }
+      ++i;
+    }
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + kWordsPerVector <= end; i += kWordsPerVector) {
+      __m128i bits = _mm_load_si128(reinterpret_cast<const __m128i*>(&words[i]));
+      if (excluded != NULL) {
+        bits = _mm_andnot_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&excluded[i])),
+                                bits);
+      }
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) != 0xFFFF) {
+        break;
+      }
+    }
+#elif defined(__ARM_NEON__)
+    for (; i + kWordsPerVector <= end; i += kWordsPerVector) {
+      uint8x16_t bits = vld1q_u8(reinterpret_cast<const uint8_t*>(&words[i]));
+      if (excluded != NULL) {
+        bits = vbicq_u8(bits, vld1q_u8(reinterpret_cast<const uint8_t*>(&excluded[i])));
+      }
+      const uint64x2_t halves = vreinterpretq_u64_u8(bits);
+      if ((vgetq_lane_u64(halves, 0) | vgetq_lane_u64(halves, 1)) != 0) {
+        break;
+      }
+    }
+#endif
+  }
+  for (; i < end; ++i) {
+    if ((words[i] & (excluded != NULL ? ~excluded[i] : ~static_cast<word>(0))) != 0) {
+      return i;
+    }
+  }
+  return end;
+}
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_ACCOUNTING_VECTOR_SCAN_H_
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_ACCOUNTING_WORK_STEALING_DEQUE_H_
+#define ART_RUNTIME_GC_ACCOUNTING_WORK_STEALING_DEQUE_H_
+
+#include <vector>
+
+#include "atomic_integer.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "cutils/atomic-inline.h"
+#include "utils.h"
+
+namespace art {
+namespace gc {
+namespace accounting {
+
+// A fixed capacity Chase-Lev deque. The owning thread pushes and pops at the bottom without
+// synchronizing with other threads unless the deque is about to run empty, any other thread may
+// steal from the top.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  // Capacity must be a power of two.
+  explicit WorkStealingDeque(size_t capacity)
+      : top_(0), bottom_(0), mask_(capacity - 1), buffer_(capacity) {
+    CHECK(IsPowerOfTwo(capacity)) << capacity;
+  }
+
+  // Only called while no other thread uses the deque.
+  void Reset() {
+    top_ = 0;
+    bottom_ = 0;
+  }
+
+  // Owner only. Returns false if the deque is full.
+  bool Push(const T& value) {
+    const int32_t bottom = bottom_;
+    if (UNLIKELY(static_cast<size_t>(bottom - top_) > mask_)) {
+      return false;
+    }
+    buffer_[bottom & mask_] = value;
+    // The element must be visible before thieves can see the new bottom.
+    ANDROID_MEMBAR_STORE();
+    bottom_ = bottom + 1;
+    return true;
+  }
+
+  // Owner only. Returns false if the deque is empty.
+  bool Pop(T* value) {
+    const int32_t bottom = bottom_ - 1;
+    bottom_ = bottom;
+    // Claim the bottom element before looking at top, thieves do it the other way around.
+    ANDROID_MEMBAR_FULL();
+    const int32_t top = top_;
+    if (top > bottom) {
+      bottom_ = bottom + 1;
+      return false;
+    }
+    *value = buffer_[bottom & mask_];
+    if (top != bottom) {
+      return true;
+    }
+    // Last element, race the thieves for it.
+    const bool won = top_.compare_and_swap(top, top + 1);
+    bottom_ = bottom + 1;
+    return won;
+  }
+
+  // Any thread. Returns false if the deque is empty or another thread won the race for the top
+  // element.
+  bool Steal(T* value) {
+    const int32_t top = top_;
+    ANDROID_MEMBAR_FULL();
+    const int32_t bottom = bottom_;
+    if (top >= bottom) {
+      return false;
+    }
+    const T result = buffer_[top & mask_];
+    if (!top_.compare_and_swap(top, top + 1)) {
+      return false;
+    }
+    *value = result;
+    return true;
+  }
+
+  // Racy unless called by the owner.
+  bool IsEmpty() const {
+    return static_cast<int32_t>(bottom_) <= static_cast<int32_t>(top_);
+  }
+
+  size_t Capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  // Index of the next element to steal.
+  AtomicInteger top_;
+  // Index past the last pushed element, only written by the owner.
+  volatile int32_t bottom_;
+  const size_t mask_;
+  std::vector<T> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingDeque);
+};
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_ACCOUNTING_WORK_STEALING_DEQUE_H_
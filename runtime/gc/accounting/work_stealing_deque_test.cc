@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "work_stealing_deque.h"
+
+#include <pthread.h>
+
+#include "common_test.h"
+
+namespace art {
+namespace gc {
+namespace accounting {
+
+class WorkStealingDequeTest : public CommonTest {};
+
+TEST_F(WorkStealingDequeTest, PushPopSteal) {
+  WorkStealingDeque<size_t> deque(4);
+  size_t value;
+  EXPECT_TRUE(deque.IsEmpty());
+  EXPECT_FALSE(deque.Pop(&value));
+  EXPECT_FALSE(deque.Steal(&value));
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_TRUE(deque.Push(i));
+  }
+  // Full.
+  EXPECT_FALSE(deque.Push(4));
+  // The owner pops the newest element, thieves take the oldest.
+  EXPECT_TRUE(deque.Pop(&value));
+  EXPECT_EQ(3U, value);
+  EXPECT_TRUE(deque.Steal(&value));
+  EXPECT_EQ(0U, value);
+  // Wrap around.
+  EXPECT_TRUE(deque.Push(5));
+  EXPECT_TRUE(deque.Push(6));
+  EXPECT_FALSE(deque.Push(7));
+  EXPECT_TRUE(deque.Pop(&value));
+  EXPECT_EQ(6U, value);
+  EXPECT_TRUE(deque.Pop(&value));
+  EXPECT_EQ(5U, value);
+  EXPECT_TRUE(deque.Steal(&value));
+  EXPECT_EQ(1U, value);
+  EXPECT_TRUE(deque.Pop(&value));
+  EXPECT_EQ(2U, value);
+  EXPECT_TRUE(deque.IsEmpty());
+  EXPECT_FALSE(deque.Pop(&value));
+}
+
+static constexpr size_t kNumValues = 100000;
+
+struct StealArgs {
+  WorkStealingDeque<size_t>* deque;
+  AtomicInteger* done;
+  uint64_t sum;
+  size_t count;
+};
+
+static void* StealCallback(void* arg) {
+  StealArgs* args = reinterpret_cast<StealArgs*>(arg);
+  size_t value;
+  while (*args->done == 0 || !args->deque->IsEmpty()) {
+    if (args->deque->Steal(&value)) {
+      args->sum += value;
+      ++args->count;
+    }
+  }
+  return NULL;
+}
+
+TEST_F(WorkStealingDequeTest, ConcurrentSteal) {
+  static constexpr size_t kNumThieves = 3;
+  WorkStealingDeque<size_t> deque(1024);
+  AtomicInteger done(0);
+  pthread_t threads[kNumThieves];
+  StealArgs args[kNumThieves];
+  for (size_t i = 0; i < kNumThieves; ++i) {
+    args[i].deque = &deque;
+    args[i].done = &done;
+    args[i].sum = 0;
+    args[i].count = 0;
+    CHECK_PTHREAD_CALL(pthread_create, (&threads[i], NULL, StealCallback, &args[i]), "thief");
+  }
+  // Every value must be taken exactly once, either by the owner or by a thief.
+  uint64_t sum = 0;
+  size_t count = 0;
+  size_t value;
+  for (size_t i = 1; i <= kNumValues; ++i) {
+    while (!deque.Push(i)) {
+      if (deque.Pop(&value)) {
+        sum += value;
+        ++count;
+      }
+    }
+    if (i % 3 == 0 && deque.Pop(&value)) {
+      sum += value;
+      ++count;
+    }
+  }
+  while (deque.Pop(&value)) {
+    sum += value;
+    ++count;
+  }
+  done = 1;
+  for (size_t i = 0; i < kNumThieves; ++i) {
+    CHECK_PTHREAD_CALL(pthread_join, (threads[i], NULL), "thief");
+    sum += args[i].sum;
+    count += args[i].count;
+  }
+  EXPECT_EQ(kNumValues, count);
+  EXPECT_EQ(static_cast<uint64_t>(kNumValues) * (kNumValues + 1) / 2, sum);
+}
+
+}  // namespace accounting
+}  // namespace gc
+}  // namespace art
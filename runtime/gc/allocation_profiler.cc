@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_profiler.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <ostream>
+
+#include "base/logging.h"
+#include "mirror/art_method-inl.h"
+#include "mirror/class-inl.h"
+#include "object_utils.h"
+#include "stack.h"
+#include "thread.h"
+#include "utils.h"
+
+namespace art {
+namespace gc {
+
+// Collects the innermost frames which aren't runtime methods, as the allocation tracker does.
+class AllocationProfilerStackVisitor : public StackVisitor {
+ public:
+  AllocationProfilerStackVisitor(Thread* thread, AllocationProfiler::Site* site)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+      : StackVisitor(thread, NULL), site_(site), depth_(0) {}
+
+  // TODO: Enable annotalysis. We know lock is held in constructor, but abstraction confuses
+  // annotalysis.
+  bool VisitFrame() NO_THREAD_SAFETY_ANALYSIS {
+    mirror::ArtMethod* m = GetMethod();
+    if (m->IsRuntimeMethod()) {
+      return true;
+    }
+    site_->methods[depth_] = m;
+    site_->dex_pcs[depth_] = GetDexPc();
+    return ++depth_ < AllocationProfiler::kMaxStackDepth;
+  }
+
+ private:
+  AllocationProfiler::Site* const site_;
+  size_t depth_;
+};
+
+static size_t SiteHash(const AllocationProfiler::Site& site) {
+  size_t hash = reinterpret_cast<uintptr_t>(site.klass) / kObjectAlignment;
+  for (size_t i = 0; i < AllocationProfiler::kMaxStackDepth; ++i) {
+    hash = hash * 31 + reinterpret_cast<uintptr_t>(site.methods[i]) / kObjectAlignment;
+    hash = hash * 31 + site.dex_pcs[i];
+  }
+  return hash;
+}
+
+static bool SameSite(const AllocationProfiler::Site& a, const AllocationProfiler::Site& b) {
+  return a.klass == b.klass &&
+      memcmp(a.methods, b.methods, sizeof(a.methods)) == 0 &&
+      memcmp(a.dex_pcs, b.dex_pcs, sizeof(a.dex_pcs)) == 0;
+}
+
+static bool HasMoreBytes(const AllocationProfiler::Site& a, const AllocationProfiler::Site& b) {
+  return a.estimated_bytes > b.estimated_bytes;
+}
+
+AllocationProfiler::AllocationProfiler(size_t sample_interval)
+    : sample_interval_(sample_interval),
+      lock_("allocation profiler lock"),
+      num_sites_(0),
+      dropped_samples_(0) {
+}
+
+size_t AllocationProfiler::NextSampleBytes() const {
+  const size_t sample_interval = sample_interval_;
+  if (sample_interval < 4) {
+    return sample_interval;
+  }
+  // Only called once per sample, the clock is cheap enough for that.
+  return sample_interval - sample_interval / 4 + NanoTime() % (sample_interval / 2);
+}
+
+void AllocationProfiler::SampleAllocation(Thread* self, const mirror::Class* klass,
+                                          size_t byte_count) {
+  Site sample;
+  memset(&sample, 0, sizeof(sample));
+  sample.klass = klass;
+  AllocationProfilerStackVisitor visitor(self, &sample);
+  visitor.WalkStack();
+  if (sample.methods[0] == NULL) {
+    // Allocated by the runtime itself, e.g. during startup.
+    return;
+  }
+  AddSample(self, sample, byte_count);
+}
+
+void AllocationProfiler::AddSample(Thread* self, const Site& sample, size_t byte_count) {
+  const uint64_t estimated_bytes = std::max(byte_count, static_cast<size_t>(sample_interval_));
+  MutexLock mu(self, lock_);
+  if (sites_.empty()) {
+    sites_.resize(kSiteTableSize);
+  }
+  Site& site = sites_[FindSlot(sample)];
+  if (site.samples == 0) {
+    if (num_sites_ >= kMaxSites) {
+      ++dropped_samples_;
+      return;
+    }
+    site = sample;
+    site.samples = 0;
+    site.estimated_bytes = 0;
+    ++num_sites_;
+  }
+  ++site.samples;
+  site.estimated_bytes += estimated_bytes;
+}
+
+size_t AllocationProfiler::FindSlot(const Site& site) const {
+  for (size_t i = SiteHash(site) % kSiteTableSize; ; i = (i + 1) % kSiteTableSize) {
+    if (sites_[i].samples == 0 || SameSite(sites_[i], site)) {
+      return i;
+    }
+  }
+}
+
+void AllocationProfiler::GetTopSites(size_t max_sites, std::vector<Site>* sites) {
+  std::vector<Site> all_sites;
+  {
+    MutexLock mu(Thread::Current(), lock_);
+    all_sites.reserve(num_sites_);
+    for (const Site& site : sites_) {
+      if (site.samples != 0) {
+        all_sites.push_back(site);
+      }
+    }
+  }
+  max_sites = std::min(max_sites, all_sites.size());
+  std::partial_sort(all_sites.begin(), all_sites.begin() + max_sites, all_sites.end(),
+                    HasMoreBytes);
+  sites->insert(sites->end(), all_sites.begin(), all_sites.begin() + max_sites);
+}
+
+void AllocationProfiler::Reset() {
+  MutexLock mu(Thread::Current(), lock_);
+  sites_.clear();
+  num_sites_ = 0;
+  dropped_samples_ = 0;
+}
+
+uint64_t AllocationProfiler::GetDroppedSamples() {
+  MutexLock mu(Thread::Current(), lock_);
+  return dropped_samples_;
+}
+
+void AllocationProfiler::Dump(std::ostream& os, size_t max_sites) {
+  std::vector<Site> sites;
+  GetTopSites(max_sites, &sites);
+  const uint64_t dropped_samples = GetDroppedSamples();
+  os << "Allocation sites sampled every " << PrettySize(sample_interval_) << ", "
+     << dropped_samples << " samples of new sites dropped\n";
+  MethodHelper mh;
+  for (const Site& site : sites) {
+    os << PrettySize(site.estimated_bytes) << " in " << site.samples << " samples of "
+       << PrettyDescriptor(site.klass) << "\n";
+    for (size_t i = 0; i < kMaxStackDepth && site.methods[i] != NULL; ++i) {
+      mh.ChangeMethod(const_cast<mirror::ArtMethod*>(site.methods[i]));
+      const char* source_file = mh.GetDeclaringClassSourceFile();
+      os << "  at " << PrettyMethod(site.methods[i], false) << "("
+         << (source_file != NULL ? source_file : "unavailable") << ":"
+         << mh.GetLineNumFromDexPC(site.dex_pcs[i]) << ")\n";
+    }
+  }
+}
+
+}  // namespace gc
+}  // namespace art
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_ALLOCATION_PROFILER_H_
+#define ART_RUNTIME_GC_ALLOCATION_PROFILER_H_
+
+#include <stdint.h>
+
+#include <iosfwd>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "locks.h"
+
+namespace art {
+
+class Thread;
+
+namespace mirror {
+  class ArtMethod;
+  class Class;
+}  // namespace mirror
+
+namespace gc {
+
+// Samples one allocation every sample interval bytes allocated by each thread and counts the
+// samples by allocation site, the class allocated and the innermost kMaxStackDepth frames which
+// aren't runtime methods. Unlike the debugger's allocation tracker, the stack is only walked for
+// the samples, so that it can be left running in production.
+class AllocationProfiler {
+ public:
+  static constexpr size_t kMaxStackDepth = 4;
+  // The sites are kept in an open addressed table which is never more than half full. Samples of
+  // new sites are dropped once there are kMaxSites.
+  static constexpr size_t kSiteTableSize = 8192;
+  static constexpr size_t kMaxSites = kSiteTableSize / 2;
+
+  struct Site {
+    const mirror::Class* klass;
+    // Unused frames have a NULL method.
+    const mirror::ArtMethod* methods[kMaxStackDepth];
+    uint32_t dex_pcs[kMaxStackDepth];
+    uint64_t samples;
+    // Each sample stands for the sample interval bytes, or its own size if it is larger.
+    uint64_t estimated_bytes;
+  };
+
+  // A sample interval of 0 leaves the profiler stopped.
+  explicit AllocationProfiler(size_t sample_interval);
+
+  // Doesn't take any lock, checked by every allocation.
+  size_t GetSampleInterval() const {
+    return sample_interval_;
+  }
+
+  // Starts sampling every sample_interval bytes, or stops if it is 0. The sites already counted
+  // are kept.
+  void SetSampleInterval(size_t sample_interval) {
+    sample_interval_ = sample_interval;
+  }
+
+  // Bytes a thread allocates before taking its next sample: the sample interval give or take a
+  // quarter, so that allocation patterns which repeat every interval bytes aren't always sampled
+  // at the same point.
+  size_t NextSampleBytes() const;
+
+  // Count the allocation of byte_count bytes of klass, just made by self, as a sample of its site.
+  void SampleAllocation(Thread* self, const mirror::Class* klass, size_t byte_count)
+      LOCKS_EXCLUDED(lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Count a sample of byte_count bytes of the site whose class and frames are set in sample.
+  void AddSample(Thread* self, const Site& sample, size_t byte_count) LOCKS_EXCLUDED(lock_);
+
+  // Appends the at most max_sites sites with the most estimated bytes to sites, largest first.
+  void GetTopSites(size_t max_sites, std::vector<Site>* sites) LOCKS_EXCLUDED(lock_);
+
+  // Forgets the sites counted so far.
+  void Reset() LOCKS_EXCLUDED(lock_);
+
+  // Number of samples dropped since the last reset because their site didn't fit in the table.
+  uint64_t GetDroppedSamples() LOCKS_EXCLUDED(lock_);
+
+  // Dump the at most max_sites sites with the most estimated bytes, one line per site followed
+  // by its frames.
+  void Dump(std::ostream& os, size_t max_sites)
+      LOCKS_EXCLUDED(lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+ private:
+  // Returns the slot of the site, a free slot if the site isn't in the table.
+  size_t FindSlot(const Site& site) const EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  volatile size_t sample_interval_;
+
+  Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
+  std::vector<Site> sites_ GUARDED_BY(lock_);
+  size_t num_sites_ GUARDED_BY(lock_);
+  // Samples of sites which didn't fit in the table.
+  uint64_t dropped_samples_ GUARDED_BY(lock_);
+
+  DISALLOW_COPY_AND_ASSIGN(AllocationProfiler);
+};
+
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_ALLOCATION_PROFILER_H_
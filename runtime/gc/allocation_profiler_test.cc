@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_profiler.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "common_test.h"
+#include "gc/heap.h"
+#include "mirror/string.h"
+#include "thread.h"
+
+namespace art {
+namespace gc {
+
+// Copied so that the test macros, which take references, don't need a definition of the member.
+static const size_t kMaxSites = AllocationProfiler::kMaxSites;
+
+class AllocationProfilerTest : public CommonTest {
+ public:
+  // The profiler only compares the classes and methods of the samples it counts, any distinct
+  // aligned values do.
+  static AllocationProfiler::Site MakeSite(size_t klass, size_t method, uint32_t dex_pc) {
+    AllocationProfiler::Site site;
+    memset(&site, 0, sizeof(site));
+    site.klass = reinterpret_cast<const mirror::Class*>(0x10000000 + klass * kObjectAlignment);
+    site.methods[0] =
+        reinterpret_cast<const mirror::ArtMethod*>(0x20000000 + method * kObjectAlignment);
+    site.dex_pcs[0] = dex_pc;
+    return site;
+  }
+};
+
+TEST_F(AllocationProfilerTest, NextSampleBytes) {
+  AllocationProfiler profiler(0);
+  EXPECT_EQ(0U, profiler.NextSampleBytes());
+  const size_t interval = 64 * KB;
+  profiler.SetSampleInterval(interval);
+  EXPECT_EQ(interval, profiler.GetSampleInterval());
+  for (size_t i = 0; i < 100; ++i) {
+    const size_t sample_bytes = profiler.NextSampleBytes();
+    EXPECT_LE(interval - interval / 4, sample_bytes);
+    EXPECT_GT(interval + interval / 4, sample_bytes);
+  }
+}
+
+TEST_F(AllocationProfilerTest, AggregateSites) {
+  Thread* self = Thread::Current();
+  const size_t interval = 1 * KB;
+  AllocationProfiler profiler(interval);
+  // Samples smaller than the interval stand for the interval, larger ones for themselves.
+  profiler.AddSample(self, MakeSite(0, 0, 0), 16);
+  profiler.AddSample(self, MakeSite(0, 0, 0), 16);
+  profiler.AddSample(self, MakeSite(0, 0, 0), 4 * KB);
+  // The class, method and dex pc all tell the sites apart.
+  profiler.AddSample(self, MakeSite(1, 0, 0), 16);
+  profiler.AddSample(self, MakeSite(0, 1, 0), 16);
+  profiler.AddSample(self, MakeSite(0, 0, 1), 16);
+
+  std::vector<AllocationProfiler::Site> sites;
+  profiler.GetTopSites(10, &sites);
+  ASSERT_EQ(4U, sites.size());
+  EXPECT_EQ(MakeSite(0, 0, 0).klass, sites[0].klass);
+  EXPECT_EQ(MakeSite(0, 0, 0).methods[0], sites[0].methods[0]);
+  EXPECT_EQ(3U, sites[0].samples);
+  EXPECT_EQ(6 * KB, sites[0].estimated_bytes);
+  for (size_t i = 1; i < sites.size(); ++i) {
+    EXPECT_EQ(1U, sites[i].samples);
+    EXPECT_EQ(interval, sites[i].estimated_bytes);
+  }
+
+  sites.clear();
+  profiler.GetTopSites(1, &sites);
+  ASSERT_EQ(1U, sites.size());
+  EXPECT_EQ(3U, sites[0].samples);
+}
+
+TEST_F(AllocationProfilerTest, DropNewSitesWhenFull) {
+  Thread* self = Thread::Current();
+  AllocationProfiler profiler(1 * KB);
+  for (size_t i = 0; i < kMaxSites; ++i) {
+    profiler.AddSample(self, MakeSite(0, i, 0), 16);
+  }
+  EXPECT_EQ(0U, profiler.GetDroppedSamples());
+  profiler.AddSample(self, MakeSite(0, kMaxSites, 0), 16);
+  EXPECT_EQ(1U, profiler.GetDroppedSamples());
+  // Known sites are still counted.
+  profiler.AddSample(self, MakeSite(0, 0, 0), 16);
+  EXPECT_EQ(1U, profiler.GetDroppedSamples());
+
+  std::vector<AllocationProfiler::Site> sites;
+  profiler.GetTopSites(kMaxSites + 1, &sites);
+  EXPECT_EQ(kMaxSites, sites.size());
+  EXPECT_EQ(2U, sites[0].samples);
+}
+
+TEST_F(AllocationProfilerTest, Reset) {
+  Thread* self = Thread::Current();
+  AllocationProfiler profiler(1 * KB);
+  for (size_t i = 0; i <= kMaxSites; ++i) {
+    profiler.AddSample(self, MakeSite(0, i, 0), 16);
+  }
+  profiler.Reset();
+  EXPECT_EQ(0U, profiler.GetDroppedSamples());
+  std::vector<AllocationProfiler::Site> sites;
+  profiler.GetTopSites(10, &sites);
+  EXPECT_TRUE(sites.empty());
+  // The profiler keeps sampling after a reset.
+  EXPECT_EQ(1 * KB, profiler.GetSampleInterval());
+  profiler.AddSample(self, MakeSite(0, kMaxSites, 0), 16);
+  profiler.GetTopSites(10, &sites);
+  EXPECT_EQ(1U, sites.size());
+}
+
+// A thread's first allocation once profiling starts begins its countdown rather than always being
+// sampled.
+TEST_F(AllocationProfilerTest, SeedCountdown) {
+  ScopedObjectAccess soa(Thread::Current());
+  AllocationProfiler* profiler = Runtime::Current()->GetHeap()->GetAllocationProfiler();
+  const size_t interval = 64 * KB;
+  profiler->SetSampleInterval(interval);
+  soa.Self()->SetAllocationSampleBytes(0);
+  ASSERT_TRUE(mirror::String::AllocFromModifiedUtf8(soa.Self(), "hello, world!") != NULL);
+  const size_t sample_bytes = soa.Self()->GetAllocationSampleBytes();
+  profiler->SetSampleInterval(0);
+  // Counted down by the allocations which followed the first one, of the string and its array.
+  EXPECT_LT(interval / 2, sample_bytes);
+  EXPECT_GT(interval + interval / 4, sample_bytes);
+}
+
+}  // namespace gc
+}  // namespace art
@@ -37,6 +37,14 @@ static void art_heap_usage_error(const char* function, void* p);
 #pragma GCC diagnostic warning "-Wstrict-aliasing"
 #pragma GCC diagnostic warning "-Wempty-body"
 
+// Check that the chunk helpers in dlmalloc.h agree with the layout used by malloc.c.
+COMPILE_ASSERT(kDlMallocChunkOverhead == CHUNK_OVERHEAD, dlmalloc_chunk_overhead_mismatch);
+COMPILE_ASSERT(kDlMallocChunkHeaderSize == TWO_SIZE_T_SIZES, dlmalloc_chunk_header_mismatch);
+COMPILE_ASSERT(kDlMallocChunkAlignMask == CHUNK_ALIGN_MASK, dlmalloc_chunk_align_mismatch);
+COMPILE_ASSERT(kDlMallocMinChunkSize == MIN_CHUNK_SIZE, dlmalloc_min_chunk_size_mismatch);
+COMPILE_ASSERT(kDlMallocInUseBits == INUSE_BITS, dlmalloc_inuse_bits_mismatch);
+COMPILE_ASSERT(kDlMallocFlagBits == FLAG_BITS, dlmalloc_flag_bits_mismatch);
+
 
 static void art_heap_corruption(const char* function) {
   LOG(FATAL) << "Corrupt heap detected in: " << function;
@@ -50,6 +58,70 @@ static void art_heap_usage_error(const char* function, void* p) {
 #include "utils.h"
 #include <sys/mman.h>
 
+// Calls back for the free chunk q if it overlaps [begin, end), the way internal_inspect_all does
+// for free chunks.
+static void art_inspect_free_chunk(mchunkptr q, size_t size, void* begin, void* end,
+                                   void(*handler)(void*, void*, size_t, void*), void* arg) {
+  // Skip the free list bookkeeping at the start of the chunk.
+  size_t bookkeeping = is_small(size) ? sizeof(struct malloc_chunk)
+                                      : sizeof(struct malloc_tree_chunk);
+  void* start = reinterpret_cast<char*>(q) + bookkeeping;
+  void* chunk_end = reinterpret_cast<char*>(q) + size;
+  if (start < begin) {
+    start = begin;
+  }
+  if (chunk_end > end) {
+    chunk_end = end;
+  }
+  if (start < chunk_end) {
+    handler(start, chunk_end, 0, arg);
+  }
+}
+
+// Visits the chunks of the tree rooted at t and of the rings of same sized chunks of its nodes.
+static void art_inspect_free_tree(tchunkptr t, void* begin, void* end,
+                                  void(*handler)(void*, void*, size_t, void*), void* arg) {
+  while (t != 0) {
+    tchunkptr u = t;
+    do {
+      art_inspect_free_chunk(reinterpret_cast<mchunkptr>(u), chunksize(u), begin, end, handler,
+                             arg);
+      u = u->fd;
+    } while (u != t);
+    art_inspect_free_tree(t->child[0], begin, end, handler, arg);
+    t = t->child[1];
+  }
+}
+
+extern "C" void art_mspace_inspect_free_range(mspace msp, void* begin, void* end,
+                                              void(*handler)(void*, void*, size_t, void*),
+                                              void* arg) {
+  mstate m = reinterpret_cast<mstate>(msp);
+  if (!ok_magic(m)) {
+    USAGE_ERROR_ACTION(m, m);
+    return;
+  }
+  if (PREACTION(m) || !is_initialized(m)) {
+    return;
+  }
+  // Chunks of the small bins are too small to hold a page, the free chunks which may are the
+  // designated victim, the top chunk and the larger chunks of the tree bins.
+  if (m->dv != 0) {
+    art_inspect_free_chunk(m->dv, m->dvsize, begin, end, handler, arg);
+  }
+  if (m->top != 0) {
+    art_inspect_free_chunk(m->top, m->topsize, begin, end, handler, arg);
+  }
+  for (bindex_t i = 0; i < NTREEBINS; ++i) {
+    if (i + 1 < NTREEBINS && minsize_for_tree_index(i + 1) <= art::kPageSize) {
+      // All the chunks of the bin are smaller than a page.
+      continue;
+    }
+    art_inspect_free_tree(*treebin_at(m, i), begin, end, handler, arg);
+  }
+  POSTACTION(m);
+}
+
 extern "C" void DlmallocMadviseCallback(void* start, void* end, size_t used_bytes, void* arg) {
   // Is this chunk in use?
   if (used_bytes != 0) {
@@ -30,6 +30,8 @@
 
 #include "../../bionic/libc/upstream-dlmalloc/malloc.h"
 
+#include <stdint.h>
+
 // Define dlmalloc routines from bionic that cannot be included directly because of redefining
 // symbols from the include above.
 extern "C" void dlmalloc_inspect_all(void(*handler)(void*, void *, size_t, void*), void* arg);
@@ -39,4 +41,58 @@ extern "C" int  dlmalloc_trim(size_t);
 // pages back to the kernel.
 extern "C" void DlmallocMadviseCallback(void* start, void* end, size_t used_bytes, void* /*arg*/);
 
+// Like mspace_inspect_all but only calls back for the free chunks overlapping [begin, end), clipped
+// to the range, leaving out those too small to hold a page. The free chunks are found in the bins
+// of the mspace rather than by walking all the chunks from its base, so the cost of a range
+// doesn't depend on where it is.
+extern "C" void art_mspace_inspect_free_range(mspace msp, void* begin, void* end,
+                                              void(*handler)(void*, void*, size_t, void*),
+                                              void* arg);
+
+// Helpers used to carve thread local allocation buffers into individually freeable chunks without
+// holding the mspace lock. These mirror the chunk layout of malloc.c for our configuration (no
+// FOOTERS) and are checked against it in dlmalloc.cc.
+static constexpr size_t kDlMallocChunkOverhead = sizeof(size_t);
+static constexpr size_t kDlMallocChunkHeaderSize = 2 * sizeof(size_t);
+static constexpr size_t kDlMallocChunkAlignMask = 2 * sizeof(void*) - 1;
+static constexpr size_t kDlMallocMinChunkSize = 4 * sizeof(size_t);
+static constexpr size_t kDlMallocInUseBits = 3;  // PINUSE_BIT | CINUSE_BIT
+static constexpr size_t kDlMallocFlagBits = 7;
+
+// Returns the size of the chunk dlmalloc uses to satisfy a request of num_bytes.
+static inline size_t DlMallocChunkSize(size_t num_bytes) {
+  if (num_bytes < kDlMallocMinChunkSize - kDlMallocChunkOverhead) {
+    return kDlMallocMinChunkSize;
+  }
+  return (num_bytes + kDlMallocChunkOverhead + kDlMallocChunkAlignMask) & ~kDlMallocChunkAlignMask;
+}
+
+static inline void* DlMallocChunkToMem(void* chunk) {
+  return reinterpret_cast<uint8_t*>(chunk) + kDlMallocChunkHeaderSize;
+}
+
+static inline void* DlMallocMemToChunk(void* mem) {
+  return reinterpret_cast<uint8_t*>(mem) - kDlMallocChunkHeaderSize;
+}
+
+static inline size_t* DlMallocChunkHead(void* chunk) {
+  return reinterpret_cast<size_t*>(chunk) + 1;
+}
+
+// Returns the size of an in-use chunk.
+static inline size_t DlMallocChunkGetSize(void* chunk) {
+  return *DlMallocChunkHead(chunk) & ~kDlMallocFlagBits;
+}
+
+// Formats chunk as an in-use chunk of chunk_size bytes whose predecessor is in use.
+static inline void DlMallocSetInUseChunk(void* chunk, size_t chunk_size) {
+  *DlMallocChunkHead(chunk) = chunk_size | kDlMallocInUseBits;
+}
+
+// Shrinks an in-use chunk to chunk_size bytes, preserving its flag bits.
+static inline void DlMallocResizeInUseChunk(void* chunk, size_t chunk_size) {
+  size_t* head = DlMallocChunkHead(chunk);
+  *head = (*head & kDlMallocFlagBits) | chunk_size;
+}
+
 #endif  // ART_RUNTIME_GC_ALLOCATOR_DLMALLOC_H_
@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rosalloc.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "cutils/atomic.h"
+
+namespace art {
+namespace gc {
+namespace allocator {
+
+size_t RosAlloc::bracket_sizes_[kNumOfSizeBrackets];
+size_t RosAlloc::num_of_pages_[kNumOfSizeBrackets];
+size_t RosAlloc::num_of_slots_[kNumOfSizeBrackets];
+size_t RosAlloc::header_sizes_[kNumOfSizeBrackets];
+bool RosAlloc::initialized_ = false;
+
+// The initial value of a bitmap word, the bits of non-existent slots are set so that they are never
+// handed out.
+static inline int32_t InitialBitMapWord(size_t word_idx, size_t num_slots) {
+  const size_t first_slot = word_idx * 32;
+  if (first_slot + 32 <= num_slots) {
+    return 0;
+  } else if (first_slot >= num_slots) {
+    return -1;
+  } else {
+    return static_cast<int32_t>(~((1U << (num_slots - first_slot)) - 1));
+  }
+}
+
+void RosAlloc::Initialize() {
+  for (size_t i = 0; i < kNumOfSizeBrackets; ++i) {
+    if (i < kNumOfQuantumSizeBrackets) {
+      bracket_sizes_[i] = kBracketQuantumSize * (i + 1);
+    } else if (i == kNumOfQuantumSizeBrackets) {
+      bracket_sizes_[i] = 1 * KB;
+    } else {
+      bracket_sizes_[i] = 2 * KB;
+    }
+    // Larger brackets use longer runs so that each run still holds a useful number of slots.
+    if (i < kNumOfQuantumSizeBrackets / 2) {
+      num_of_pages_[i] = 1;
+    } else if (i < kNumOfQuantumSizeBrackets) {
+      num_of_pages_[i] = 2;
+    } else if (i == kNumOfQuantumSizeBrackets) {
+      num_of_pages_[i] = 4;
+    } else {
+      num_of_pages_[i] = 8;
+    }
+    header_sizes_[i] = RoundUp(sizeof(Run), kBracketQuantumSize);
+    num_of_slots_[i] = (num_of_pages_[i] * kPageSize - header_sizes_[i]) / bracket_sizes_[i];
+    CHECK_LE(num_of_slots_[i], kBitMapWords * 32);
+  }
+  initialized_ = true;
+}
+
+RosAlloc::RosAlloc(void* base, size_t initial_footprint, size_t capacity)
+    : base_(reinterpret_cast<byte*>(base)), capacity_(capacity),
+      lock_("rosalloc global lock", kRosAllocGlobalLock),
+      page_map_(capacity / kPageSize, kPageMapEmpty),
+      footprint_(initial_footprint), footprint_limit_(initial_footprint) {
+  CHECK(IsAligned<kPageSize>(base_));
+  CHECK(IsAligned<kPageSize>(capacity));
+  CHECK(IsAligned<kPageSize>(initial_footprint));
+  CHECK_LE(initial_footprint, capacity);
+  if (!initialized_) {
+    Initialize();
+  }
+  for (size_t i = 0; i < kNumOfSizeBrackets; ++i) {
+    size_bracket_locks_[i] = new Mutex("a rosalloc size bracket lock", kRosAllocBracketLock);
+  }
+  if (initial_footprint != 0) {
+    free_page_runs_[0] = initial_footprint / kPageSize;
+  }
+}
+
+RosAlloc::~RosAlloc() {
+  for (size_t i = 0; i < kNumOfSizeBrackets; ++i) {
+    delete size_bracket_locks_[i];
+  }
+}
+
+void RosAlloc::Run::Init(size_t idx) {
+  magic_num_ = kMagicNum;
+  size_bracket_idx_ = idx;
+  is_thread_local_ = 0;
+  padding_ = 0;
+  first_search_word_ = 0;
+  for (size_t w = 0; w < kBitMapWords; ++w) {
+    alloc_bit_map_[w] = InitialBitMapWord(w, num_of_slots_[idx]);
+  }
+}
+
+void* RosAlloc::Run::AllocSlot() {
+  for (size_t i = 0; i < kBitMapWords; ++i) {
+    const size_t w = (first_search_word_ + i) % kBitMapWords;
+    const uint32_t word = static_cast<uint32_t>(alloc_bit_map_[w]);
+    if (word != 0xFFFFFFFFU) {
+      const size_t bit = __builtin_ctz(~word);
+      const int32_t mask = static_cast<int32_t>(1U << bit);
+      // Only the allocator of a run sets bits so the bit is still clear, but frees may be clearing
+      // other bits of the word concurrently.
+      int32_t old_word = android_atomic_or(mask, &alloc_bit_map_[w]);
+      DCHECK_EQ(old_word & mask, 0);
+      first_search_word_ = w;
+      return SlotBegin() + (w * 32 + bit) * bracket_sizes_[size_bracket_idx_];
+    }
+  }
+  return NULL;
+}
+
+size_t RosAlloc::Run::FreeSlot(void* ptr) {
+  const size_t bracket_size = bracket_sizes_[size_bracket_idx_];
+  const size_t offset = reinterpret_cast<byte*>(ptr) - SlotBegin();
+  DCHECK_EQ(offset % bracket_size, 0U) << ptr;
+  const size_t slot_idx = offset / bracket_size;
+  DCHECK_LT(slot_idx, num_of_slots_[size_bracket_idx_]);
+  const int32_t mask = static_cast<int32_t>(1U << (slot_idx % 32));
+  int32_t old_word = android_atomic_and(~mask, &alloc_bit_map_[slot_idx / 32]);
+  DCHECK_NE(old_word & mask, 0) << "Freeing unallocated slot " << ptr;
+  return bracket_size;
+}
+
+bool RosAlloc::Run::IsFull() const {
+  for (size_t w = 0; w < kBitMapWords; ++w) {
+    if (alloc_bit_map_[w] != -1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RosAlloc::Run::IsAllFree() const {
+  for (size_t w = 0; w < kBitMapWords; ++w) {
+    if (alloc_bit_map_[w] != InitialBitMapWord(w, num_of_slots_[size_bracket_idx_])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RosAlloc::Run::IsSlotAllocated(size_t slot_idx) const {
+  return (alloc_bit_map_[slot_idx / 32] & static_cast<int32_t>(1U << (slot_idx % 32))) != 0;
+}
+
+RosAlloc::Run* RosAlloc::RunForPage(size_t pm_idx) const {
+  while (page_map_[pm_idx] == kPageMapRunPart) {
+    --pm_idx;
+  }
+  DCHECK(page_map_[pm_idx] == kPageMapRun) << pm_idx;
+  Run* run = reinterpret_cast<Run*>(base_ + pm_idx * kPageSize);
+  DCHECK(run->magic_num_ == kMagicNum) << reinterpret_cast<void*>(run);
+  return run;
+}
+
+byte* RosAlloc::AllocPages(Thread* self, size_t num_pages, PageMapKind kind) {
+  lock_.AssertHeld(self);
+  size_t pm_idx = 0;
+  bool found = false;
+  // First fit so that the bottom of the space is preferred.
+  for (std::map<size_t, size_t>::iterator it = free_page_runs_.begin();
+       it != free_page_runs_.end(); ++it) {
+    if (it->second >= num_pages) {
+      pm_idx = it->first;
+      const size_t remaining = it->second - num_pages;
+      free_page_runs_.erase(it);
+      if (remaining != 0) {
+        free_page_runs_[pm_idx + num_pages] = remaining;
+      }
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    // Grow the footprint, starting from the free run at its end if there is one.
+    const size_t footprint_pages = footprint_ / kPageSize;
+    pm_idx = footprint_pages;
+    if (!free_page_runs_.empty()) {
+      std::map<size_t, size_t>::reverse_iterator last = free_page_runs_.rbegin();
+      if (last->first + last->second == footprint_pages) {
+        pm_idx = last->first;
+      }
+    }
+    const size_t increment = (pm_idx + num_pages - footprint_pages) * kPageSize;
+    if (footprint_ + increment > footprint_limit_) {
+      return NULL;
+    }
+    if (pm_idx != footprint_pages) {
+      free_page_runs_.erase(pm_idx);
+    }
+    art_heap_rosalloc_morecore(this, increment);
+    footprint_ += increment;
+  }
+  const uint8_t part = (kind == kPageMapRun) ? kPageMapRunPart : kPageMapLargeObjectPart;
+  page_map_[pm_idx] = kind;
+  for (size_t i = 1; i < num_pages; ++i) {
+    page_map_[pm_idx + i] = part;
+  }
+  return base_ + pm_idx * kPageSize;
+}
+
+void RosAlloc::FreePages(Thread* self, size_t pm_idx, size_t num_pages) {
+  lock_.AssertHeld(self);
+  for (size_t i = 0; i < num_pages; ++i) {
+    page_map_[pm_idx + i] = kPageMapEmpty;
+  }
+  // Coalesce with the following free run.
+  std::map<size_t, size_t>::iterator next = free_page_runs_.find(pm_idx + num_pages);
+  if (next != free_page_runs_.end()) {
+    num_pages += next->second;
+    free_page_runs_.erase(next);
+  }
+  // Coalesce with the preceding free run.
+  std::map<size_t, size_t>::iterator prev = free_page_runs_.lower_bound(pm_idx);
+  if (prev != free_page_runs_.begin()) {
+    --prev;
+    if (prev->first + prev->second == pm_idx) {
+      prev->second += num_pages;
+      return;
+    }
+  }
+  free_page_runs_[pm_idx] = num_pages;
+}
+
+void* RosAlloc::AllocLargeObject(Thread* self, size_t size, size_t* bytes_allocated) {
+  const size_t num_pages = RoundUp(size, kPageSize) / kPageSize;
+  byte* result;
+  {
+    MutexLock mu(self, lock_);
+    result = AllocPages(self, num_pages, kPageMapLargeObject);
+  }
+  if (result != NULL) {
+    *bytes_allocated = num_pages * kPageSize;
+  }
+  return result;
+}
+
+size_t RosAlloc::FreeLargeObject(Thread* self, size_t pm_idx) {
+  MutexLock mu(self, lock_);
+  DCHECK(page_map_[pm_idx] == kPageMapLargeObject);
+  size_t num_pages = 1;
+  while (pm_idx + num_pages < page_map_.size() &&
+         page_map_[pm_idx + num_pages] == kPageMapLargeObjectPart) {
+    ++num_pages;
+  }
+  FreePages(self, pm_idx, num_pages);
+  return num_pages * kPageSize;
+}
+
+RosAlloc::Run* RosAlloc::RefillRunLocked(Thread* self, size_t idx) {
+  std::set<Run*>& non_full_runs = non_full_runs_[idx];
+  if (!non_full_runs.empty()) {
+    Run* run = *non_full_runs.begin();
+    non_full_runs.erase(non_full_runs.begin());
+    return run;
+  }
+  MutexLock mu(self, lock_);
+  Run* run = reinterpret_cast<Run*>(AllocPages(self, num_of_pages_[idx], kPageMapRun));
+  if (run != NULL) {
+    // Initialized while holding lock_ so that InspectAll never sees a run without a header.
+    run->Init(idx);
+  }
+  return run;
+}
+
+void RosAlloc::UpdateRunLocked(Thread* self, Run* run) {
+  if (run->is_thread_local_) {
+    // The owner picks up the freed slots, empty thread local runs are freed when revoked.
+    return;
+  }
+  const size_t idx = run->size_bracket_idx_;
+  if (run->IsAllFree()) {
+    non_full_runs_[idx].erase(run);
+    MutexLock mu(self, lock_);
+    FreePages(self, ToPageMapIndex(run), num_of_pages_[idx]);
+  } else if (!run->IsFull()) {
+    non_full_runs_[idx].insert(run);
+  }
+}
+
+void* RosAlloc::Alloc(Thread* self, size_t size, size_t* bytes_allocated) {
+  if (UNLIKELY(size > kLargeSizeThreshold)) {
+    return AllocLargeObject(self, size, bytes_allocated);
+  }
+  const size_t idx = SizeToIndex(size);
+  void* slot;
+  if (LIKELY(idx < kNumThreadLocalSizeBrackets)) {
+    Run* run = reinterpret_cast<Run*>(self->GetRosAllocRun(idx));
+    // Runs must be revoked before the thread moves on to another allocator.
+    DCHECK(run == NULL || (reinterpret_cast<byte*>(run) >= base_ &&
+                           reinterpret_cast<byte*>(run) < base_ + capacity_));
+    slot = (run != NULL) ? run->AllocSlot() : NULL;
+    if (UNLIKELY(slot == NULL)) {
+      MutexLock mu(self, *size_bracket_locks_[idx]);
+      if (run != NULL) {
+        // Frees that raced with us may have made room in the run again, in which case it goes back
+        // to the shared pool.
+        run->is_thread_local_ = 0;
+        UpdateRunLocked(self, run);
+      }
+      run = RefillRunLocked(self, idx);
+      self->SetRosAllocRun(idx, run);
+      if (UNLIKELY(run == NULL)) {
+        return NULL;
+      }
+      run->is_thread_local_ = 1;
+      slot = run->AllocSlot();
+      DCHECK(slot != NULL);
+    }
+  } else {
+    MutexLock mu(self, *size_bracket_locks_[idx]);
+    Run* run = RefillRunLocked(self, idx);
+    if (UNLIKELY(run == NULL)) {
+      return NULL;
+    }
+    slot = run->AllocSlot();
+    DCHECK(slot != NULL);
+    if (!run->IsFull()) {
+      non_full_runs_[idx].insert(run);
+    }
+  }
+  *bytes_allocated = bracket_sizes_[idx];
+  return slot;
+}
+
+size_t RosAlloc::Free(Thread* self, void* ptr) {
+  const size_t pm_idx = ToPageMapIndex(ptr);
+  if (page_map_[pm_idx] == kPageMapLargeObject) {
+    return FreeLargeObject(self, pm_idx);
+  }
+  Run* run = RunForPage(pm_idx);
+  MutexLock mu(self, *size_bracket_locks_[run->size_bracket_idx_]);
+  const size_t freed_bytes = run->FreeSlot(ptr);
+  UpdateRunLocked(self, run);
+  return freed_bytes;
+}
+
+size_t RosAlloc::BulkFree(Thread* self, void** ptrs, size_t num_ptrs) {
+  size_t freed_bytes = 0;
+  Run* locked_run = NULL;
+  Mutex* held_lock = NULL;
+  for (size_t i = 0; i < num_ptrs; ++i) {
+    void* ptr = ptrs[i];
+    const size_t pm_idx = ToPageMapIndex(ptr);
+    if (page_map_[pm_idx] == kPageMapLargeObject) {
+      freed_bytes += FreeLargeObject(self, pm_idx);
+      continue;
+    }
+    Run* run = RunForPage(pm_idx);
+    if (run != locked_run) {
+      if (locked_run != NULL) {
+        UpdateRunLocked(self, locked_run);
+        held_lock->ExclusiveUnlock(self);
+      }
+      held_lock = size_bracket_locks_[run->size_bracket_idx_];
+      held_lock->ExclusiveLock(self);
+      locked_run = run;
+    }
+    freed_bytes += run->FreeSlot(ptr);
+  }
+  if (locked_run != NULL) {
+    UpdateRunLocked(self, locked_run);
+    held_lock->ExclusiveUnlock(self);
+  }
+  return freed_bytes;
+}
+
+size_t RosAlloc::UsableSize(const void* ptr) {
+  size_t pm_idx = ToPageMapIndex(ptr);
+  switch (page_map_[pm_idx]) {
+    case kPageMapLargeObject: {
+      // The pages of a live allocation can't change under us.
+      size_t num_pages = 1;
+      while (pm_idx + num_pages < page_map_.size() &&
+             page_map_[pm_idx + num_pages] == kPageMapLargeObjectPart) {
+        ++num_pages;
+      }
+      return num_pages * kPageSize;
+    }
+    case kPageMapRun:
+    case kPageMapRunPart:
+      return bracket_sizes_[RunForPage(pm_idx)->size_bracket_idx_];
+    default:
+      LOG(FATAL) << "Unexpected page map entry " << static_cast<int>(page_map_[pm_idx])
+                 << " for " << ptr;
+      return 0;
+  }
+}
+
+void RosAlloc::RevokeThreadLocalRuns(Thread* thread) {
+  Thread* self = Thread::Current();
+  for (size_t idx = 0; idx < kNumThreadLocalSizeBrackets; ++idx) {
+    Run* run = reinterpret_cast<Run*>(thread->GetRosAllocRun(idx));
+    if (run != NULL) {
+      MutexLock mu(self, *size_bracket_locks_[idx]);
+      DCHECK(run->is_thread_local_);
+      run->is_thread_local_ = 0;
+      UpdateRunLocked(self, run);
+      thread->SetRosAllocRun(idx, NULL);
+    }
+  }
+}
+
+size_t RosAlloc::Footprint() {
+  MutexLock mu(Thread::Current(), lock_);
+  return footprint_;
+}
+
+size_t RosAlloc::FootprintLimit() {
+  MutexLock mu(Thread::Current(), lock_);
+  return footprint_limit_;
+}
+
+void RosAlloc::SetFootprintLimit(size_t new_limit) {
+  MutexLock mu(Thread::Current(), lock_);
+  new_limit = std::min(RoundUp(new_limit, kPageSize), capacity_);
+  footprint_limit_ = std::max(new_limit, footprint_);
+}
+
+size_t RosAlloc::Trim() {
+  return TrimRange(base_, base_ + capacity_);
+}
+
+size_t RosAlloc::TrimRange(byte* begin, byte* end) {
+  DCHECK_ALIGNED(begin, kPageSize);
+  MutexLock mu(Thread::Current(), lock_);
+  size_t reclaimed = 0;
+  if (!free_page_runs_.empty() && end >= base_ + footprint_) {
+    std::map<size_t, size_t>::iterator last = free_page_runs_.end();
+    --last;
+    const size_t footprint_pages = footprint_ / kPageSize;
+    // Keep at least one page so that the space never becomes empty.
+    const size_t new_footprint_pages = std::max<size_t>(last->first, 1);
+    if (last->first + last->second == footprint_pages && new_footprint_pages < footprint_pages) {
+      // MoreCore releases and protects the pages past the new end.
+      const size_t decrement = (footprint_pages - new_footprint_pages) * kPageSize;
+      if (last->first == new_footprint_pages) {
+        free_page_runs_.erase(last);
+      } else {
+        last->second = new_footprint_pages - last->first;
+      }
+      art_heap_rosalloc_morecore(this, -static_cast<intptr_t>(decrement));
+      footprint_ -= decrement;
+      reclaimed += decrement;
+    }
+  }
+  // Release the pages of the remaining free runs, their bookkeeping doesn't live in them. Start
+  // with the run containing begin, if any.
+  const size_t begin_idx = (begin - base_) / kPageSize;
+  const size_t end_idx = RoundUp(std::min<size_t>(end - base_, footprint_), kPageSize) / kPageSize;
+  std::map<size_t, size_t>::const_iterator it = free_page_runs_.upper_bound(begin_idx);
+  if (it != free_page_runs_.begin()) {
+    --it;
+  }
+  for (; it != free_page_runs_.end() && it->first < end_idx; ++it) {
+    const size_t start_idx = std::max(it->first, begin_idx);
+    const size_t limit_idx = std::min(it->first + it->second, end_idx);
+    if (start_idx >= limit_idx) {
+      continue;
+    }
+    byte* start = base_ + start_idx * kPageSize;
+    const size_t length = (limit_idx - start_idx) * kPageSize;
+    int rc = madvise(start, length, MADV_DONTNEED);
+    if (UNLIKELY(rc != 0)) {
+      errno = rc;
+      PLOG(FATAL) << "madvise failed during heap trimming";
+    }
+    reclaimed += length;
+  }
+  return reclaimed;
+}
+
+void RosAlloc::InspectAll(WalkCallback callback, void* arg) {
+  MutexLock mu(Thread::Current(), lock_);
+  const size_t footprint_pages = footprint_ / kPageSize;
+  size_t pm_idx = 0;
+  while (pm_idx < footprint_pages) {
+    byte* start = base_ + pm_idx * kPageSize;
+    switch (page_map_[pm_idx]) {
+      case kPageMapEmpty: {
+        std::map<size_t, size_t>::const_iterator it = free_page_runs_.find(pm_idx);
+        DCHECK(it != free_page_runs_.end()) << pm_idx;
+        const size_t num_pages = it->second;
+        callback(start, start + num_pages * kPageSize, 0, arg);
+        pm_idx += num_pages;
+        break;
+      }
+      case kPageMapLargeObject: {
+        size_t num_pages = 1;
+        while (pm_idx + num_pages < footprint_pages &&
+               page_map_[pm_idx + num_pages] == kPageMapLargeObjectPart) {
+          ++num_pages;
+        }
+        callback(start, start + num_pages * kPageSize, num_pages * kPageSize, arg);
+        pm_idx += num_pages;
+        break;
+      }
+      case kPageMapRun: {
+        Run* run = reinterpret_cast<Run*>(start);
+        const size_t idx = run->size_bracket_idx_;
+        const size_t bracket_size = bracket_sizes_[idx];
+        byte* slot = run->SlotBegin();
+        for (size_t i = 0; i < num_of_slots_[idx]; ++i, slot += bracket_size) {
+          callback(slot, slot + bracket_size, run->IsSlotAllocated(i) ? bracket_size : 0, arg);
+        }
+        pm_idx += num_of_pages_[idx];
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unexpected page map entry " << static_cast<int>(page_map_[pm_idx])
+                   << " at page " << pm_idx;
+    }
+  }
+}
+
+}  // namespace allocator
+}  // namespace gc
+}  // namespace art
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_ALLOCATOR_ROSALLOC_H_
+#define ART_RUNTIME_GC_ALLOCATOR_ROSALLOC_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "globals.h"
+#include "thread.h"
+#include "utils.h"
+
+namespace art {
+namespace gc {
+namespace allocator {
+
+// A runs-of-slots allocator. Memory is managed in page granularity and handed out as runs, each of
+// which serves a single size bracket out of a bitmap of equally sized slots. Runs of the smaller
+// brackets are owned by threads which allocate from them without locking, the remaining brackets
+// each have their own lock. Requests larger than the largest bracket are given whole pages.
+//
+// Slots are freed by atomically clearing their bit so that the GC can free into a run while its
+// owner allocates from it. Runs that become empty are handed back to the page allocator, except
+// for thread local runs which are only released when revoked.
+class RosAlloc {
+ public:
+  typedef void (*WalkCallback)(void* start, void* end, size_t num_bytes, void* arg);
+
+  // Brackets are kBracketQuantumSize apart up to kMaxQuantumBracketSize, followed by a 1KB and a
+  // 2KB bracket.
+  static constexpr size_t kNumOfSizeBrackets = 34;
+  static constexpr size_t kNumOfQuantumSizeBrackets = 32;
+  static constexpr size_t kBracketQuantumSize = 16;
+  static constexpr size_t kMaxQuantumBracketSize = kNumOfQuantumSizeBrackets * kBracketQuantumSize;
+  // Anything larger is allocated as a run of whole pages.
+  static constexpr size_t kLargeSizeThreshold = 2 * KB;
+  static constexpr size_t kNumThreadLocalSizeBrackets = Thread::kRosAllocNumThreadLocalSizeBrackets;
+
+  // Creates an allocator managing capacity bytes of page aligned memory starting at base, of which
+  // the first initial_footprint bytes are already usable. Further memory is obtained through
+  // art_heap_rosalloc_morecore.
+  RosAlloc(void* base, size_t initial_footprint, size_t capacity);
+  ~RosAlloc();
+
+  // Allocates size bytes, returns NULL if the footprint limit doesn't allow it. The memory isn't
+  // zeroed.
+  void* Alloc(Thread* self, size_t size, size_t* bytes_allocated);
+
+  // Returns the number of bytes freed.
+  size_t Free(Thread* self, void* ptr) LOCKS_EXCLUDED(lock_);
+
+  // Frees a list of pointers, taking each bracket lock once per run rather than once per slot.
+  // Works best when the pointers are sorted by address, as they are when sweeping.
+  size_t BulkFree(Thread* self, void** ptrs, size_t num_ptrs) LOCKS_EXCLUDED(lock_)
+      NO_THREAD_SAFETY_ANALYSIS;
+
+  // The size of the slot or pages backing ptr.
+  size_t UsableSize(const void* ptr);
+
+  // Bytes of the managed region currently obtained from the system.
+  size_t Footprint() LOCKS_EXCLUDED(lock_);
+  size_t FootprintLimit() LOCKS_EXCLUDED(lock_);
+  // The footprint may not be grown beyond the limit, which is never set below the footprint.
+  void SetFootprintLimit(size_t bytes) LOCKS_EXCLUDED(lock_);
+
+  // Shrinks the footprint if the end of the region is free and releases the pages of all free page
+  // runs to the system. Returns the number of bytes released.
+  size_t Trim() LOCKS_EXCLUDED(lock_);
+
+  // Like Trim but only releases the free pages within [begin, end), the footprint is only shrunk if
+  // end is past it.
+  size_t TrimRange(byte* begin, byte* end) LOCKS_EXCLUDED(lock_);
+
+  // Calls back for every slot, free page run and large allocation. Free slots and pages are
+  // reported with num_bytes equaling zero.
+  void InspectAll(WalkCallback callback, void* arg) LOCKS_EXCLUDED(lock_);
+
+  // Hands the thread's runs back to the shared pools, freeing the ones that are empty. The thread
+  // must either be the caller or be suspended.
+  void RevokeThreadLocalRuns(Thread* thread);
+
+  // Returns the bracket size used for an allocation of size bytes.
+  static size_t RoundToBracketSize(size_t size) {
+    DCHECK_LE(size, kLargeSizeThreshold);
+    return bracket_sizes_[SizeToIndex(size)];
+  }
+
+ private:
+  enum PageMapKind {
+    kPageMapEmpty = 0,            // Not allocated.
+    kPageMapRun,                  // The first page of a run.
+    kPageMapRunPart,              // The following pages of a run.
+    kPageMapLargeObject,          // The first page of a large allocation.
+    kPageMapLargeObjectPart,      // The following pages of a large allocation.
+  };
+
+  static constexpr uint8_t kMagicNum = 42;
+  // Enough bits for the smallest bracket in a one page run.
+  static constexpr size_t kBitMapWords = kPageSize / kBracketQuantumSize / 32;
+
+  // The header of a run, at the start of its first page.
+  class Run {
+   public:
+    uint8_t magic_num_;
+    uint8_t size_bracket_idx_;
+    // Only accessed with the bracket lock held.
+    uint8_t is_thread_local_;
+    uint8_t padding_;
+    // Where to start searching for a free slot. Only used by whoever allocates from the run.
+    uint32_t first_search_word_;
+    // One bit per slot, set if allocated. Bits past the last slot are always set.
+    volatile int32_t alloc_bit_map_[kBitMapWords];
+
+    void Init(size_t idx);
+    // Returns NULL if the run is full.
+    void* AllocSlot();
+    // Atomically clears the slot's bit, returns the bracket size.
+    size_t FreeSlot(void* ptr);
+    bool IsFull() const;
+    bool IsAllFree() const;
+    bool IsSlotAllocated(size_t slot_idx) const;
+    byte* SlotBegin() const {
+      return reinterpret_cast<byte*>(const_cast<Run*>(this)) + header_sizes_[size_bracket_idx_];
+    }
+  };
+
+  static size_t SizeToIndex(size_t size) {
+    DCHECK_GT(size, 0U);
+    if (LIKELY(size <= kMaxQuantumBracketSize)) {
+      return RoundUp(size, kBracketQuantumSize) / kBracketQuantumSize - 1;
+    } else if (size <= 1 * KB) {
+      return kNumOfQuantumSizeBrackets;
+    } else {
+      DCHECK_LE(size, kLargeSizeThreshold);
+      return kNumOfQuantumSizeBrackets + 1;
+    }
+  }
+
+  static void Initialize();
+
+  size_t ToPageMapIndex(const void* ptr) const {
+    DCHECK_GE(reinterpret_cast<const byte*>(ptr), base_);
+    DCHECK_LT(reinterpret_cast<const byte*>(ptr), base_ + capacity_);
+    return (reinterpret_cast<const byte*>(ptr) - base_) / kPageSize;
+  }
+
+  // Finds the run containing the page, which must be part of a run.
+  Run* RunForPage(size_t pm_idx) const;
+
+  void* AllocLargeObject(Thread* self, size_t size, size_t* bytes_allocated)
+      LOCKS_EXCLUDED(lock_);
+  size_t FreeLargeObject(Thread* self, size_t pm_idx) LOCKS_EXCLUDED(lock_);
+
+  // Returns a run with at least one free slot, preferring partially used ones over new pages. The
+  // run is taken out of the non full set. Requires the bracket lock.
+  Run* RefillRunLocked(Thread* self, size_t idx) LOCKS_EXCLUDED(lock_);
+  // Files a run that isn't owned by a thread according to its free slots, freeing it if it is
+  // empty. Requires the bracket lock.
+  void UpdateRunLocked(Thread* self, Run* run) LOCKS_EXCLUDED(lock_);
+
+  byte* AllocPages(Thread* self, size_t num_pages, PageMapKind kind)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void FreePages(Thread* self, size_t pm_idx, size_t num_pages) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  static size_t bracket_sizes_[kNumOfSizeBrackets];
+  static size_t num_of_pages_[kNumOfSizeBrackets];
+  static size_t num_of_slots_[kNumOfSizeBrackets];
+  static size_t header_sizes_[kNumOfSizeBrackets];
+  static bool initialized_;
+
+  byte* const base_;
+  const size_t capacity_;
+
+  // Guards the page map, the free page runs and the footprint.
+  Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
+  // One byte per page describing what the page is used for, see PageMapKind.
+  std::vector<uint8_t> page_map_;
+  // Free page runs keyed by their first page index, valued by their length in pages. Kept out of
+  // the pages so that their memory can be released.
+  std::map<size_t, size_t> free_page_runs_ GUARDED_BY(lock_);
+  size_t footprint_ GUARDED_BY(lock_);
+  size_t footprint_limit_ GUARDED_BY(lock_);
+
+  // Runs with at least one free slot that aren't owned by a thread, ordered by address so that
+  // allocation prefers the bottom of the space.
+  std::set<Run*> non_full_runs_[kNumOfSizeBrackets];
+  Mutex* size_bracket_locks_[kNumOfSizeBrackets];
+
+  DISALLOW_COPY_AND_ASSIGN(RosAlloc);
+};
+
+// Callback from rosalloc when it needs to increase or decrease the footprint, mirrors
+// art_heap_morecore for dlmalloc.
+extern "C" void* art_heap_rosalloc_morecore(RosAlloc* rosalloc, intptr_t increment);
+
+}  // namespace allocator
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_ALLOCATOR_ROSALLOC_H_
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compactor.h"
+
+#include <functional>
+#include <numeric>
+
+#include "base/logging.h"
+#include "base/mutex-inl.h"
+#include "base/timing_logger.h"
+#include "forwarding.h"
+#include "gc/accounting/heap_bitmap-inl.h"
+#include "gc/accounting/space_bitmap-inl.h"
+#include "gc/heap.h"
+#include "gc/space/malloc_space.h"
+#include "gc/space/space-inl.h"
+#include "intern_table.h"
+#include "jni_internal.h"
+#include "mark_sweep-inl.h"
+#include "monitor.h"
+#include "mirror/art_field.h"
+#include "mirror/class-inl.h"
+#include "mirror/object-inl.h"
+#include "mirror/object_array-inl.h"
+#include "runtime.h"
+#include "thread.h"
+
+using ::art::mirror::Object;
+
+namespace art {
+namespace gc {
+namespace collector {
+
+Compactor::Compactor(Heap* heap)
+    : GarbageCollector(heap, "compacting"),
+      alloc_space_(NULL),
+      pinned_bitmap_(NULL),
+      moved_objects_(0),
+      moved_bytes_(0),
+      freed_bytes_(0) {
+}
+
+void Compactor::InitializePhase() {
+  timings_.Reset();
+  base::TimingLogger::ScopedSplit split("InitializePhase", &timings_);
+  alloc_space_ = heap_->GetAllocSpace();
+  pinned_bitmap_ = alloc_space_->GetMarkBitmap();
+  pinned_objects_.clear();
+  moved_from_.clear();
+  moved_objects_ = 0;
+  moved_bytes_ = 0;
+  freed_bytes_ = 0;
+}
+
+void Compactor::MarkingPhase() {
+  base::TimingLogger::ScopedSplit split("MarkingPhase", &timings_);
+  Thread* self = Thread::Current();
+  Runtime* runtime = Runtime::Current();
+
+  // The unused tails of the allocation buffers would stop the space from shrinking.
+  heap_->RevokeAllThreadLocalBuffers();
+
+  WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
+  // Objects allocated since the last collection need to be in the live bitmap to be found.
+  timings_.NewSplit("FlushAllocStack");
+  heap_->FlushAllocStack();
+
+  timings_.NewSplit("PinRoots");
+  runtime->VisitRoots(PinRootCallback, this, false, false);
+
+  timings_.NewSplit("PinSystemWeaks");
+  runtime->GetInternTable()->SweepInternTableWeaks(PinSystemWeakCallback, this);
+  runtime->GetMonitorList()->SweepMonitorList(PinSystemWeakCallback, this);
+  runtime->GetJavaVM()->SweepWeakGlobals(PinSystemWeakCallback, this);
+  // Pending allocation samples hold the addresses of the sampled objects.
+  if (heap_->GetAllocationSiteTable() != NULL) {
+    heap_->GetAllocationSiteTable()->VisitSamples(PinRootCallback, this);
+  }
+
+  timings_.NewSplit("PinUnmovableReferents");
+  PinUnmovableReferents();
+  timings_.EndSplit();
+}
+
+void Compactor::ReclaimPhase() {
+  base::TimingLogger::ScopedSplit split("ReclaimPhase", &timings_);
+  WriterMutexLock mu(Thread::Current(), *Locks::heap_bitmap_lock_);
+  timings_.NewSplit("MoveObjects");
+  MoveObjects();
+
+  timings_.NewSplit("UpdateReferences");
+  UpdateReferences();
+
+  timings_.NewSplit("FreeMovedObjects");
+  FreeMovedObjects();
+  for (const Object* obj : pinned_objects_) {
+    pinned_bitmap_->Clear(obj);
+  }
+
+  // The copies may have been allocated from thread local runs of this thread.
+  heap_->RevokeAllThreadLocalBuffers();
+  timings_.EndSplit();
+}
+
+void Compactor::FinishPhase() {
+  base::TimingLogger::ScopedSplit split("FinishPhase", &timings_);
+  VLOG(heap) << GetName() << " moved " << moved_objects_ << " objects ("
+             << PrettySize(moved_bytes_) << "), pinned " << pinned_objects_.size()
+             << " objects, freed " << PrettySize(freed_bytes_);
+
+  // Update the cumulative statistics.
+  total_time_ns_ += GetDurationNs();
+  total_paused_time_ns_ += std::accumulate(GetPauseTimes().begin(), GetPauseTimes().end(), 0,
+                                           std::plus<uint64_t>());
+  total_freed_bytes_ += freed_bytes_;
+
+  // Update the cumulative loggers.
+  cumulative_timings_.Start();
+  cumulative_timings_.AddLogger(timings_);
+  cumulative_timings_.End();
+}
+
+bool Compactor::CanMove(const Object* obj) const {
+  if (pinned_bitmap_->Test(obj)) {
+    return false;
+  }
+  return !obj->IsClass() && !obj->IsArtMethod() && !obj->IsArtField();
+}
+
+void Compactor::Pin(const Object* obj) {
+  if (alloc_space_->Contains(obj) && !pinned_bitmap_->Set(obj)) {
+    pinned_objects_.push_back(obj);
+  }
+}
+
+void Compactor::PinUnmovableReferents() {
+  heap_->GetLiveBitmap()->Visit([this](const Object* obj) NO_THREAD_SAFETY_ANALYSIS {
+    if (obj->IsClass() || obj->IsArtMethod() || obj->IsArtField()) {
+      MarkSweep::VisitObjectReferences(obj, [this](const Object* /* obj */, const Object* ref,
+          const MemberOffset& /* offset */, bool /* is_static */) NO_THREAD_SAFETY_ANALYSIS {
+        if (ref != NULL) {
+          Pin(ref);
+        }
+      });
+    }
+  });
+}
+
+void Compactor::MoveObjects() {
+  Thread* self = Thread::Current();
+  accounting::SpaceBitmap* live_bitmap = alloc_space_->GetLiveBitmap();
+  std::vector<Object*> objects;
+  live_bitmap->VisitMarkedRange(live_bitmap->HeapBegin(), live_bitmap->HeapLimit(),
+                                [&objects](Object* obj) {
+    objects.push_back(obj);
+  });
+  // Objects only ever move down so that the top of the space empties out. Copies which dlmalloc
+  // places above their original are given back straight away.
+  for (auto it = objects.rbegin(); it != objects.rend(); ++it) {
+    Object* obj = *it;
+    if (!CanMove(obj)) {
+      continue;
+    }
+    const size_t size = obj->SizeOf();
+    size_t bytes_allocated;
+    Object* copy = alloc_space_->Alloc(self, size, &bytes_allocated);
+    if (copy == NULL) {
+      // There is no free memory left below the remaining objects.
+      break;
+    }
+    if (copy > obj) {
+      alloc_space_->Free(self, copy);
+      continue;
+    }
+    memcpy(copy, obj, size);
+    live_bitmap->Set(copy);
+    SetForwardingAddress(obj, copy);
+    moved_from_.push_back(obj);
+    ++moved_objects_;
+    moved_bytes_ += bytes_allocated;
+  }
+}
+
+void Compactor::UpdateReferences() {
+  heap_->GetLiveBitmap()->Visit([this](const Object* obj) NO_THREAD_SAFETY_ANALYSIS {
+    if (alloc_space_->Contains(obj) && IsForwarded(obj)) {
+      // Old location of a moved object, its copy is visited instead.
+      return;
+    }
+    Object* o = const_cast<Object*>(obj);
+    MarkSweep::VisitObjectReferences(obj, [this](const Object* obj, const Object* ref,
+        const MemberOffset& offset, bool /* is_static */) NO_THREAD_SAFETY_ANALYSIS {
+      if (ref != NULL && alloc_space_->Contains(ref) && IsForwarded(ref)) {
+        const_cast<Object*>(obj)->SetFieldObject(offset, GetForwardingAddress(ref), false);
+      }
+    });
+    if (UNLIKELY(o->GetClass()->IsReferenceClass())) {
+      // The referent is hidden from the reference visitors.
+      Object* referent = heap_->GetReferenceReferent(o);
+      if (referent != NULL && alloc_space_->Contains(referent) && IsForwarded(referent)) {
+        o->SetFieldObject(heap_->GetReferenceReferentOffset(), GetForwardingAddress(referent),
+                          true);
+      }
+    }
+  });
+}
+
+void Compactor::FreeMovedObjects() {
+  if (moved_from_.empty()) {
+    return;
+  }
+  accounting::SpaceBitmap* live_bitmap = alloc_space_->GetLiveBitmap();
+  for (const Object* obj : moved_from_) {
+    live_bitmap->Clear(obj);
+  }
+  const size_t bytes_freed = alloc_space_->FreeList(Thread::Current(), moved_from_.size(),
+                                                    &moved_from_[0]);
+  // The copies were allocated straight from the space, only the difference shows in the heap.
+  if (bytes_freed > moved_bytes_) {
+    freed_bytes_ = bytes_freed - moved_bytes_;
+    heap_->num_bytes_allocated_.fetch_sub(freed_bytes_);
+  } else {
+    heap_->num_bytes_allocated_.fetch_add(moved_bytes_ - bytes_freed);
+  }
+}
+
+void Compactor::PinRootCallback(const Object* root, void* arg) {
+  reinterpret_cast<Compactor*>(arg)->Pin(root);
+}
+
+bool Compactor::PinSystemWeakCallback(const Object* obj, void* arg) {
+  PinRootCallback(obj, arg);
+  // Keep the weak, it is swept by the next mark sweep.
+  return true;
+}
+
+}  // namespace collector
+}  // namespace gc
+}  // namespace art
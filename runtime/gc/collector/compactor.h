@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_COLLECTOR_COMPACTOR_H_
+#define ART_RUNTIME_GC_COLLECTOR_COMPACTOR_H_
+
+#include <vector>
+
+#include "base/macros.h"
+#include "garbage_collector.h"
+#include "locks.h"
+
+namespace art {
+
+namespace mirror {
+  class Object;
+}  // namespace mirror
+
+namespace gc {
+
+namespace accounting {
+  class SpaceBitmap;
+}  // namespace accounting
+
+namespace space {
+  class MallocSpace;
+}  // namespace space
+
+class Heap;
+
+namespace collector {
+
+// Reduces the fragmentation of the alloc space by moving objects from the top of the space into
+// free chunks below them, so that the freed tail can be trimmed. It doesn't collect garbage itself
+// and expects to run right after a full mark sweep, while the live bitmaps are exact.
+//
+// The root visitors can't update the roots, so objects referenced directly by a root or a system
+// weak stay where they are, as do classes, methods, fields and the objects they reference. All
+// other references to the moved objects are updated by walking the whole heap. Runtime code still
+// holds unrooted mirror pointers across allocations, and identity hash codes are addresses, so the
+// heap only compacts when asked to by tests.
+class Compactor : public GarbageCollector {
+ public:
+  explicit Compactor(Heap* heap);
+
+  ~Compactor() {}
+
+  virtual bool IsConcurrent() const {
+    return false;
+  }
+
+  virtual GcType GetGcType() const {
+    return kGcTypeFull;
+  }
+
+  size_t GetMovedObjects() const {
+    return moved_objects_;
+  }
+
+  size_t GetMovedBytes() const {
+    return moved_bytes_;
+  }
+
+  size_t GetPinnedObjects() const {
+    return pinned_objects_.size();
+  }
+
+  // Returns the number of bytes the space shrunk by, as in the number of bytes freed at the old
+  // locations minus the bytes allocated for the copies.
+  size_t GetFreedBytes() const {
+    return freed_bytes_;
+  }
+
+ protected:
+  virtual void InitializePhase();
+  virtual void MarkingPhase() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
+  virtual void ReclaimPhase() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
+  virtual void FinishPhase();
+
+ private:
+  void Pin(const mirror::Object* obj)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  bool CanMove(const mirror::Object* obj) const
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Pins the alloc space objects that classes, methods and fields reference, the runtime keeps
+  // raw pointers to them.
+  void PinUnmovableReferents()
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Copies the movable objects of the alloc space into lower free chunks, starting with the
+  // highest ones.
+  void MoveObjects()
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Points every reference to a moved object at its copy.
+  void UpdateReferences()
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Frees the old locations of the moved objects.
+  void FreeMovedObjects()
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  static void PinRootCallback(const mirror::Object* root, void* arg)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  static bool PinSystemWeakCallback(const mirror::Object* obj, void* arg)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  space::MallocSpace* alloc_space_;
+
+  // The mark bitmap of the alloc space, used to remember pinned objects.
+  accounting::SpaceBitmap* pinned_bitmap_;
+
+  std::vector<const mirror::Object*> pinned_objects_;
+
+  // The old locations of the moved objects.
+  std::vector<mirror::Object*> moved_from_;
+
+  size_t moved_objects_;
+  size_t moved_bytes_;
+  size_t freed_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(Compactor);
+};
+
+}  // namespace collector
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_COLLECTOR_COMPACTOR_H_
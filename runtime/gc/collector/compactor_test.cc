@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compactor.h"
+
+#include <vector>
+
+#include "common_test.h"
+#include "forwarding.h"
+#include "gc/heap.h"
+#include "intern_table.h"
+#include "mirror/class-inl.h"
+#include "mirror/object-inl.h"
+#include "mirror/object_array-inl.h"
+#include "mirror/string.h"
+#include "sirt_ref.h"
+
+namespace art {
+namespace gc {
+namespace collector {
+
+class CompactorTest : public CommonTest {};
+
+TEST_F(CompactorTest, Forwarding) {
+  ScopedObjectAccess soa(Thread::Current());
+  mirror::Class* c = class_linker_->FindSystemClass("[I");
+  // Just the class and lock words, forwarding doesn't look at the rest of the object.
+  uintptr_t from_words[2] = { reinterpret_cast<uintptr_t>(c), 0 };
+  uintptr_t to_words[2] = { reinterpret_cast<uintptr_t>(c), 0 };
+  mirror::Object* from = reinterpret_cast<mirror::Object*>(from_words);
+  mirror::Object* to = reinterpret_cast<mirror::Object*>(to_words);
+  EXPECT_FALSE(IsForwarded(from));
+  EXPECT_EQ(c, from->GetClass());
+
+  SetForwardingAddress(from, to);
+  EXPECT_TRUE(IsForwarded(from));
+  EXPECT_EQ(to, GetForwardingAddress(from));
+  EXPECT_FALSE(IsForwarded(to));
+  EXPECT_EQ(c, to->GetClass());
+}
+
+TEST_F(CompactorTest, Compact) {
+  ScopedObjectAccess soa(Thread::Current());
+  Thread* self = soa.Self();
+  Heap* heap = Runtime::Current()->GetHeap();
+  mirror::Class* object_array_class = class_linker_->FindSystemClass("[Ljava/lang/Object;");
+  mirror::Class* int_array_class = class_linker_->FindSystemClass("[I");
+
+  // Each object is a one element array referencing an int array holding its index. Garbage
+  // allocated in between leaves free chunks below the objects once it is collected.
+  const size_t num_objects = 512;
+  SirtRef<mirror::ObjectArray<mirror::Object> > holder(self,
+      mirror::ObjectArray<mirror::Object>::Alloc(self, object_array_class, num_objects));
+  ASSERT_TRUE(holder.get() != NULL);
+  for (size_t i = 0; i < num_objects; ++i) {
+    ASSERT_TRUE(mirror::IntArray::Alloc(self, 1024) != NULL);
+    SirtRef<mirror::ObjectArray<mirror::Object> > object(self,
+        mirror::ObjectArray<mirror::Object>::Alloc(self, object_array_class, 1));
+    ASSERT_TRUE(object.get() != NULL);
+    mirror::IntArray* value = mirror::IntArray::Alloc(self, 1);
+    ASSERT_TRUE(value != NULL);
+    value->Set(0, i);
+    object->Set(0, value);
+    holder->Set(i, object.get());
+  }
+
+  // Objects referenced by roots and system weaks are pinned, the objects they reference aren't.
+  SirtRef<mirror::Object> rooted(self, holder->Get(num_objects - 1));
+  mirror::String* interned = Runtime::Current()->GetInternTable()->InternWeak(
+      mirror::String::AllocFromModifiedUtf8(self, "compactor test"));
+  ASSERT_TRUE(interned != NULL);
+  holder->Set(0, interned);
+
+  // Addresses are only compared, the objects are read through the holder afterwards.
+  const uintptr_t holder_address = reinterpret_cast<uintptr_t>(holder.get());
+  const uintptr_t rooted_address = reinterpret_cast<uintptr_t>(rooted.get());
+  const uintptr_t interned_address = reinterpret_cast<uintptr_t>(interned);
+  std::vector<uintptr_t> addresses;
+  for (size_t i = 0; i < num_objects; ++i) {
+    addresses.push_back(reinterpret_cast<uintptr_t>(holder->Get(i)));
+  }
+
+  heap->Compact(self);
+
+  EXPECT_EQ(holder_address, reinterpret_cast<uintptr_t>(holder.get()));
+  EXPECT_EQ(rooted_address, reinterpret_cast<uintptr_t>(rooted.get()));
+  EXPECT_EQ(rooted.get(), holder->Get(num_objects - 1));
+  mirror::String* string = holder->Get(0)->AsString();
+  EXPECT_EQ(interned_address, reinterpret_cast<uintptr_t>(string));
+  EXPECT_TRUE(string->Equals("compactor test"));
+
+  // Every reference to a moved object points at its copy, and objects only move down.
+  size_t moved = 0;
+  for (size_t i = 1; i < num_objects; ++i) {
+    mirror::Object* object = holder->Get(i);
+    const uintptr_t address = reinterpret_cast<uintptr_t>(object);
+    ASSERT_FALSE(IsForwarded(object)) << i;
+    ASSERT_EQ(object_array_class, object->GetClass()) << i;
+    EXPECT_LE(address, addresses[i]) << i;
+    if (address != addresses[i]) {
+      ++moved;
+    }
+    mirror::Object* value = object->AsObjectArray<mirror::Object>()->Get(0);
+    ASSERT_FALSE(IsForwarded(value)) << i;
+    ASSERT_EQ(int_array_class, value->GetClass()) << i;
+    EXPECT_EQ(static_cast<int32_t>(i), value->AsIntArray()->Get(0)) << i;
+  }
+  EXPECT_LT(0U, moved);
+  EXPECT_LE(moved, heap->GetCompactor()->GetMovedObjects());
+  EXPECT_LT(0U, heap->GetCompactor()->GetPinnedObjects());
+}
+
+}  // namespace collector
+}  // namespace gc
+}  // namespace art
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_COLLECTOR_FORWARDING_H_
+#define ART_RUNTIME_GC_COLLECTOR_FORWARDING_H_
+
+#include "base/logging.h"
+#include "mirror/object.h"
+
+namespace art {
+namespace gc {
+namespace collector {
+
+// Objects moved by the copying collectors have the address of their copy stored in place of their
+// class, tagged with the low bit which is never set in a class pointer.
+static constexpr uintptr_t kForwardingTag = 1;
+
+static inline uintptr_t GetClassWord(const mirror::Object* obj) {
+  DCHECK_EQ(mirror::Object::ClassOffset().Uint32Value(), 0U);
+  return *reinterpret_cast<const uintptr_t*>(obj);
+}
+
+static inline bool IsForwarded(const mirror::Object* obj) {
+  return (GetClassWord(obj) & kForwardingTag) != 0;
+}
+
+static inline mirror::Object* GetForwardingAddress(const mirror::Object* obj) {
+  DCHECK(IsForwarded(obj));
+  return reinterpret_cast<mirror::Object*>(GetClassWord(obj) & ~kForwardingTag);
+}
+
+static inline void SetForwardingAddress(mirror::Object* obj, mirror::Object* forward_address) {
+  DCHECK_EQ(reinterpret_cast<uintptr_t>(forward_address) & kForwardingTag, 0U);
+  *reinterpret_cast<uintptr_t*>(obj) =
+      reinterpret_cast<uintptr_t>(forward_address) | kForwardingTag;
+}
+
+}  // namespace collector
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_COLLECTOR_FORWARDING_H_
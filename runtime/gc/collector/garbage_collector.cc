@@ -21,6 +21,7 @@
 
 #include "garbage_collector.h"
 
+#include "base/histogram-inl.h"
 #include "base/logging.h"
 #include "base/mutex-inl.h"
 #include "gc/accounting/heap_bitmap.h"
@@ -33,13 +34,18 @@ namespace art {
 namespace gc {
 namespace collector {
 
+// Pause histogram buckets, in microseconds.
+static constexpr uint64_t kPauseBucketSize = 500;
+static constexpr size_t kPauseBucketCount = 64;
+
 GarbageCollector::GarbageCollector(Heap* heap, const std::string& name)
     : heap_(heap),
       name_(name),
       verbose_(VLOG_IS_ON(heap)),
       duration_ns_(0),
       timings_(name_.c_str(), true, verbose_),
-      cumulative_timings_(name) {
+      cumulative_timings_(name),
+      pause_histogram_((name_ + " paused").c_str(), kPauseBucketSize, kPauseBucketCount) {
   ResetCumulativeStatistics();
 }
 
@@ -58,6 +64,7 @@ void GarbageCollector::ResetCumulativeStatistics() {
   total_paused_time_ns_ = 0;
   total_freed_objects_ = 0;
   total_freed_bytes_ = 0;
+  pause_histogram_.Reset();
 }
 
 void GarbageCollector::Run() {
@@ -108,6 +115,9 @@ void GarbageCollector::Run() {
 
   uint64_t end_time = NanoTime();
   duration_ns_ = end_time - start_time;
+  for (uint64_t pause : pause_times_) {
+    pause_histogram_.AddValue(pause / 1000);
+  }
 
   FinishPhase();
 }
@@ -127,7 +137,7 @@ void GarbageCollector::SwapBitmaps() {
       if (live_bitmap != mark_bitmap) {
         heap_->GetLiveBitmap()->ReplaceBitmap(live_bitmap, mark_bitmap);
         heap_->GetMarkBitmap()->ReplaceBitmap(mark_bitmap, live_bitmap);
-        space->AsDlMallocSpace()->SwapBitmaps();
+        space->AsMallocSpace()->SwapBitmaps();
       }
     }
   }
@@ -19,6 +19,7 @@
 
 #include "gc_type.h"
 #include "locks.h"
+#include "base/histogram.h"
 #include "base/timing_logger.h"
 
 #include <stdint.h>
@@ -74,6 +75,27 @@ class GarbageCollector {
 
   void ResetCumulativeStatistics();
 
+  uint64_t GetTotalTimeNs() const {
+    return total_time_ns_;
+  }
+
+  uint64_t GetTotalPausedTimeNs() const {
+    return total_paused_time_ns_;
+  }
+
+  uint64_t GetTotalFreedObjects() const {
+    return total_freed_objects_;
+  }
+
+  uint64_t GetTotalFreedBytes() const {
+    return total_freed_bytes_;
+  }
+
+  // Returns the pauses of every run since the cumulative statistics were reset, in microseconds.
+  Histogram<uint64_t>& GetPauseHistogram() {
+    return pause_histogram_;
+  }
+
   // Swap the live and mark bitmaps of spaces that are active for the collector. For partial GC,
   // this is the allocation space, for full GC then we swap the zygote bitmaps too.
   void SwapBitmaps() EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
@@ -110,6 +132,7 @@ class GarbageCollector {
   uint64_t total_freed_bytes_;
 
   CumulativeLogger cumulative_timings_;
+  Histogram<uint64_t> pause_histogram_;
 
   std::vector<uint64_t> pause_times_;
 };
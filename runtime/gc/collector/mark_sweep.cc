@@ -19,16 +19,19 @@
 #include <functional>
 #include <numeric>
 #include <climits>
+#include <sched.h>
 #include <vector>
 
 #include "base/bounded_fifo.h"
 #include "base/logging.h"
 #include "base/macros.h"
 #include "base/mutex-inl.h"
+#include "base/stl_util.h"
 #include "base/timing_logger.h"
 #include "gc/accounting/card_table-inl.h"
 #include "gc/accounting/heap_bitmap.h"
 #include "gc/accounting/space_bitmap-inl.h"
+#include "gc/accounting/work_stealing_deque.h"
 #include "gc/heap.h"
 #include "gc/space/image_space.h"
 #include "gc/space/large_object_space.h"
@@ -74,6 +77,15 @@ constexpr bool kParallelRecursiveMark = true;
 // ProcessMarkStack with very small mark stacks.
 constexpr size_t kMinimumParallelMarkStackSize = 128;
 constexpr bool kParallelProcessMarkStack = true;
+constexpr bool kParallelSweep = true;
+// Number of sweep tasks created for each space or allocation stack per GC thread, more tasks than
+// threads balances out ranges with few dead objects.
+constexpr size_t kSweepTasksPerThread = 2;
+// Capacity of the work stealing deque of each parallel marking thread, objects that don't fit go to
+// a shared overflow stack.
+constexpr size_t kParallelMarkDequeSize = 8 * KB;
+// Number of objects a parallel marking thread takes from the overflow stack at a time.
+constexpr size_t kParallelMarkOverflowBatchSize = 128;
 
 // Profiling and information flags.
 constexpr bool kCountClassesMarked = false;
@@ -146,7 +158,8 @@ MarkSweep::MarkSweep(Heap* heap, bool is_concurrent, const std::string& name_pre
       large_object_lock_("mark sweep large object lock", kMarkSweepLargeObjectLock),
       mark_stack_lock_("mark sweep mark stack lock", kMarkSweepMarkStackLock),
       is_concurrent_(is_concurrent),
-      clear_soft_references_(false) {
+      clear_soft_references_(false),
+      process_references_concurrently_(false) {
 }
 
 void MarkSweep::InitializePhase() {
@@ -173,7 +186,12 @@ void MarkSweep::InitializePhase() {
   overhead_time_ = 0;
   work_chunks_created_ = 0;
   work_chunks_deleted_ = 0;
+  objects_stolen_ = 0;
   reference_count_ = 0;
+  // The heap verification expects the references to be processed by the time the pause ends.
+  process_references_concurrently_ = IsConcurrent() &&
+      heap_->IsConcurrentReferenceProcessingEnabled() && !heap_->verify_missing_card_marks_ &&
+      !heap_->verify_pre_gc_heap_ && !heap_->verify_post_gc_heap_;
   java_lang_Class_ = Class::GetJavaLangClass();
   CHECK(java_lang_Class_ != nullptr);
 
@@ -186,9 +204,20 @@ void MarkSweep::InitializePhase() {
 
 void MarkSweep::ProcessReferences(Thread* self) {
   base::TimingLogger::ScopedSplit split("ProcessReferences", &timings_);
-  WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
-  ProcessReferences(&soft_reference_list_, clear_soft_references_, &weak_reference_list_,
-                    &finalizer_reference_list_, &phantom_reference_list_);
+  {
+    WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
+    ProcessReferences(&soft_reference_list_, clear_soft_references_, &weak_reference_list_,
+                      &finalizer_reference_list_, &phantom_reference_list_);
+  }
+  if (process_references_concurrently_) {
+    heap_->DisableReferenceProcessingSlowPath(self);
+  }
+}
+
+void MarkSweep::SetReferentsMarking(bool marking) {
+  if (process_references_concurrently_) {
+    heap_->SetReferentMarkedTester(Thread::Current(), marking ? NULL : IsMarkedCallback, this);
+  }
 }
 
 bool MarkSweep::HandleDirtyObjectsPhase() {
@@ -196,6 +225,12 @@ bool MarkSweep::HandleDirtyObjectsPhase() {
   Thread* self = Thread::Current();
   Locks::mutator_lock_->AssertExclusiveHeld(self);
 
+  // Unused parts of allocation buffers must be returned before we sweep since the chunks inside a
+  // live buffer can't be freed.
+  GetHeap()->RevokeAllThreadLocalBuffers();
+  GetHeap()->RevokeAllThreadLocalAllocationStacks();
+  GetHeap()->FlushAllNativeAllocationDeltas();
+
   {
     WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
 
@@ -206,7 +241,13 @@ bool MarkSweep::HandleDirtyObjectsPhase() {
     RecursiveMarkDirtyObjects(true, accounting::CardTable::kCardDirty);
   }
 
-  ProcessReferences(self);
+  if (process_references_concurrently_) {
+    // Marking is complete, the references are processed once the mutators are resumed. Until
+    // then Reference.get only returns referents which are marked.
+    heap_->EnableReferenceProcessingSlowPath(self, IsMarkedCallback, this);
+  } else {
+    ProcessReferences(self);
+  }
 
   // Only need to do this if we have the card mark verification on, and only during concurrent GC.
   if (GetHeap()->verify_missing_card_marks_ || GetHeap()->verify_pre_gc_heap_||
@@ -244,16 +285,30 @@ void MarkSweep::MarkingPhase() {
   BindBitmaps();
   FindDefaultMarkBitmap();
 
+  const bool paused = Locks::mutator_lock_->IsExclusiveHeld(self);
+  if (paused) {
+    // Non concurrent GCs don't have a HandleDirtyObjectsPhase, revoke the allocation buffers here.
+    // Concurrent GCs revoke the allocation stack segments in the thread roots checkpoint.
+    heap_->RevokeAllThreadLocalBuffers();
+    heap_->RevokeAllThreadLocalAllocationStacks();
+    heap_->FlushAllNativeAllocationDeltas();
+  }
+
   // Process dirty cards and add dirty cards to mod union tables.
-  heap_->ProcessCards(timings_);
+  heap_->ProcessCards(timings_, GetThreadCount(paused));
 
   // Need to do this before the checkpoint since we don't want any threads to add references to
   // the live stack during the recursive mark.
   timings_.NewSplit("SwapStacks");
   heap_->SwapStacks();
+  // The samples taken from now on are in the allocation stack, left for the next collection.
+  accounting::AllocationSiteTable* allocation_sites = heap_->GetAllocationSiteTable();
+  if (allocation_sites != NULL) {
+    allocation_sites->StartCollection();
+  }
 
   WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
-  if (Locks::mutator_lock_->IsExclusiveHeld(self)) {
+  if (paused) {
     // If we exclusively hold the mutator lock, all threads must be suspended.
     MarkRoots();
   } else {
@@ -262,6 +317,16 @@ void MarkSweep::MarkingPhase() {
     MarkNonThreadRoots();
   }
   live_stack_freeze_size_ = heap_->GetLiveStack()->Size();
+
+  // Objects of tenured sites allocated before the collection started are made live without being
+  // marked, as if they had survived a collection already. The bound bitmaps of the sticky
+  // collections mark them, their references are found by scanning their dirty cards.
+  timings_.StartSplit("MarkTenuredStackAsLive");
+  accounting::ObjectStack* tenured_stack = heap_->GetTenuredLiveStack();
+  heap_->MarkAllocStack(heap_->alloc_space_->GetLiveBitmap(),
+                        heap_->large_object_space_->GetLiveObjects(), tenured_stack);
+  tenured_stack->Reset();
+  timings_.EndSplit();
   MarkConcurrentRoots();
 
   heap_->UpdateAndMarkModUnion(this, timings_, GetGcType());
@@ -289,7 +354,7 @@ void MarkSweep::ReclaimPhase() {
   base::TimingLogger::ScopedSplit split("ReclaimPhase", &timings_);
   Thread* self = Thread::Current();
 
-  if (!IsConcurrent()) {
+  if (!IsConcurrent() || process_references_concurrently_) {
     ProcessReferences(self);
   }
 
@@ -344,6 +409,10 @@ void MarkSweep::ReclaimPhase() {
     // Unbind the live and mark bitmaps.
     UnBindBitmaps();
   }
+
+  // Unmapping the dead large objects doesn't need the bitmaps, so it is done without blocking
+  // other users of the heap bitmap lock. Nothing can reach the objects any more.
+  FreeLargeObjects();
 }
 
 void MarkSweep::SetImmuneRange(Object* begin, Object* end) {
@@ -599,8 +668,8 @@ void MarkSweep::VerifyImageRootVisitor(Object* root, void* arg) {
 }
 
 void MarkSweep::BindLiveToMarkBitmap(space::ContinuousSpace* space) {
-  CHECK(space->IsDlMallocSpace());
-  space::DlMallocSpace* alloc_space = space->AsDlMallocSpace();
+  CHECK(space->IsMallocSpace());
+  space::MallocSpace* alloc_space = space->AsMallocSpace();
   accounting::SpaceBitmap* live_bitmap = space->GetLiveBitmap();
   accounting::SpaceBitmap* mark_bitmap = alloc_space->mark_bitmap_.release();
   GetHeap()->GetMarkBitmap()->ReplaceBitmap(mark_bitmap, live_bitmap);
@@ -994,6 +1063,13 @@ bool MarkSweep::IsMarkedCallback(const Object* object, void* arg) {
   return reinterpret_cast<MarkSweep*>(arg)->IsMarked(object);
 }
 
+accounting::AllocationSiteTable::SampleFate MarkSweep::SampleFateCallback(const Object* object,
+                                                                          void* arg) {
+  return reinterpret_cast<MarkSweep*>(arg)->IsMarked(object) ?
+      accounting::AllocationSiteTable::kSampleSurvived :
+      accounting::AllocationSiteTable::kSampleDead;
+}
+
 void MarkSweep::RecursiveMarkDirtyObjects(bool paused, byte minimum_age) {
   ScanGrayObjects(paused, minimum_age);
   ProcessMarkStack(paused);
@@ -1033,6 +1109,10 @@ void MarkSweep::SweepSystemWeaks() {
   runtime->GetInternTable()->SweepInternTableWeaks(IsMarkedCallback, this);
   runtime->GetMonitorList()->SweepMonitorList(IsMarkedCallback, this);
   SweepJniWeakGlobals(IsMarkedCallback, this);
+  accounting::AllocationSiteTable* allocation_sites = GetHeap()->GetAllocationSiteTable();
+  if (allocation_sites != NULL) {
+    allocation_sites->SweepSamples(SampleFateCallback, this);
+  }
   timings_.EndSplit();
 }
 
@@ -1048,7 +1128,10 @@ void MarkSweep::VerifyIsLive(const Object* obj) {
     space::LargeObjectSpace* large_object_space = GetHeap()->GetLargeObjectsSpace();
     if (!large_object_space->GetLiveObjects()->Test(obj)) {
       if (std::find(heap->allocation_stack_->Begin(), heap->allocation_stack_->End(), obj) ==
-          heap->allocation_stack_->End()) {
+          heap->allocation_stack_->End() &&
+          std::find(heap->tenured_allocation_stack_->Begin(),
+                    heap->tenured_allocation_stack_->End(), obj) ==
+          heap->tenured_allocation_stack_->End()) {
         // Object not found!
         heap->DumpSpaces();
         LOG(FATAL) << "Found dead object " << obj;
@@ -1069,6 +1152,9 @@ struct SweepCallbackContext {
   MarkSweep* mark_sweep;
   space::AllocSpace* space;
   Thread* self;
+  // Freed counts are accumulated here and recorded once the sweep is over.
+  size_t freed_objects;
+  size_t freed_bytes;
 };
 
 class CheckpointMarkThreadRoots : public Closure {
@@ -1082,6 +1168,9 @@ class CheckpointMarkThreadRoots : public Closure {
     CHECK(thread == self || thread->IsSuspended() || thread->GetState() == kWaitingPerformingGc)
         << thread->GetState() << " thread " << thread << " self " << self;
     thread->VisitRoots(MarkSweep::MarkRootParallelCallback, mark_sweep_);
+    // The stacks have been swapped, objects allocated from now on must go on the new allocation
+    // stack.
+    thread->RevokeThreadLocalAllocationStack();
     ATRACE_END();
     mark_sweep_->GetBarrier().Pass(self);
   }
@@ -1112,20 +1201,13 @@ void MarkSweep::MarkRootsCheckpoint(Thread* self) {
 
 void MarkSweep::SweepCallback(size_t num_ptrs, Object** ptrs, void* arg) {
   SweepCallbackContext* context = static_cast<SweepCallbackContext*>(arg);
-  MarkSweep* mark_sweep = context->mark_sweep;
-  Heap* heap = mark_sweep->GetHeap();
-  space::AllocSpace* space = context->space;
-  Thread* self = context->self;
-  Locks::heap_bitmap_lock_->AssertExclusiveHeld(self);
+  // The heap bitmap lock is held by the thread which started the sweep, which may not be us.
   // Use a bulk free, that merges consecutive objects before freeing or free per object?
   // Documentation suggests better free performance with merging, but this may be at the expensive
   // of allocation.
-  size_t freed_objects = num_ptrs;
+  context->freed_objects += num_ptrs;
   // AllocSpace::FreeList clears the value in ptrs, so perform after clearing the live bit
-  size_t freed_bytes = space->FreeList(self, num_ptrs, ptrs);
-  heap->RecordFree(freed_objects, freed_bytes);
-  mark_sweep->freed_objects_.fetch_add(freed_objects);
-  mark_sweep->freed_bytes_.fetch_add(freed_bytes);
+  context->freed_bytes += context->space->FreeList(context->self, num_ptrs, ptrs);
 }
 
 void MarkSweep::ZygoteSweepCallback(size_t num_ptrs, Object** ptrs, void* arg) {
@@ -1140,8 +1222,123 @@ void MarkSweep::ZygoteSweepCallback(size_t num_ptrs, Object** ptrs, void* arg) {
   }
 }
 
+// Sweeps [begin, end) of a malloc space, counting what it frees locally. The ranges of the tasks
+// of a space are aligned to the words of its bitmaps so that no two tasks share a word.
+class SweepBitmapTask : public Task {
+ public:
+  SweepBitmapTask(MarkSweep* mark_sweep, space::AllocSpace* space,
+                  const accounting::SpaceBitmap* live_bitmap,
+                  const accounting::SpaceBitmap* mark_bitmap, uintptr_t begin, uintptr_t end)
+      : live_bitmap_(live_bitmap),
+        mark_bitmap_(mark_bitmap),
+        begin_(begin),
+        end_(end) {
+    context_.mark_sweep = mark_sweep;
+    context_.space = space;
+    context_.self = NULL;
+    context_.freed_objects = 0;
+    context_.freed_bytes = 0;
+  }
+
+  size_t GetFreedObjects() const {
+    return context_.freed_objects;
+  }
+
+  size_t GetFreedBytes() const {
+    return context_.freed_bytes;
+  }
+
+  virtual void Run(Thread* self) NO_THREAD_SAFETY_ANALYSIS {
+    context_.self = self;
+    accounting::SpaceBitmap::SweepWalk(*live_bitmap_, *mark_bitmap_, begin_, end_,
+                                       &MarkSweep::SweepCallback, &context_);
+  }
+
+ private:
+  const accounting::SpaceBitmap* const live_bitmap_;
+  const accounting::SpaceBitmap* const mark_bitmap_;
+  const uintptr_t begin_;
+  const uintptr_t end_;
+  SweepCallbackContext context_;
+};
+
+// Sweeps a chunk of an allocation stack, counting what it frees locally. Dead large objects are
+// only collected, see MarkSweep::FreeLargeObjects.
+class SweepArrayTask : public Task {
+ public:
+  SweepArrayTask(space::AllocSpace* space, const accounting::SpaceBitmap* mark_bitmap,
+                 const accounting::SpaceSetMap* large_mark_objects, Object** begin, Object** end)
+      : space_(space),
+        mark_bitmap_(mark_bitmap),
+        large_mark_objects_(large_mark_objects),
+        begin_(begin),
+        end_(end),
+        freed_objects_(0),
+        freed_bytes_(0) {
+  }
+
+  size_t GetFreedObjects() const {
+    return freed_objects_;
+  }
+
+  size_t GetFreedBytes() const {
+    return freed_bytes_;
+  }
+
+  const std::vector<Object*>& GetDeadLargeObjects() const {
+    return dead_large_objects_;
+  }
+
+  virtual void Run(Thread* self) NO_THREAD_SAFETY_ANALYSIS {
+    Object** out = begin_;
+    Object** objects_to_chunk_free = out;
+    for (Object** it = begin_; it != end_; ++it) {
+      Object* obj = *it;
+      if (UNLIKELY(obj == NULL)) {
+        // Unused slot of a thread's segment.
+        continue;
+      }
+      // There should only be objects in the AllocSpace/LargeObjectSpace in the allocation stack.
+      if (LIKELY(mark_bitmap_->HasAddress(obj))) {
+        if (!mark_bitmap_->Test(obj)) {
+          // Don't bother un-marking since we clear the mark bitmap anyways.
+          *(out++) = obj;
+          // Free objects in chunks.
+          DCHECK_LE(static_cast<size_t>(out - objects_to_chunk_free), kSweepArrayChunkFreeSize);
+          if (static_cast<size_t>(out - objects_to_chunk_free) == kSweepArrayChunkFreeSize) {
+            FreeChunk(self, objects_to_chunk_free, out);
+            objects_to_chunk_free = out;
+          }
+        }
+      } else if (!large_mark_objects_->Test(obj)) {
+        dead_large_objects_.push_back(obj);
+      }
+    }
+    // Free the remaining objects in chunks.
+    if (out != objects_to_chunk_free) {
+      FreeChunk(self, objects_to_chunk_free, out);
+    }
+  }
+
+ private:
+  void FreeChunk(Thread* self, Object** begin, Object** end) {
+    const size_t chunk_freed_objects = end - begin;
+    freed_objects_ += chunk_freed_objects;
+    freed_bytes_ += space_->FreeList(self, chunk_freed_objects, begin);
+  }
+
+  space::AllocSpace* const space_;
+  const accounting::SpaceBitmap* const mark_bitmap_;
+  const accounting::SpaceSetMap* const large_mark_objects_;
+  Object** const begin_;
+  Object** const end_;
+  size_t freed_objects_;
+  size_t freed_bytes_;
+  std::vector<Object*> dead_large_objects_;
+};
+
 void MarkSweep::SweepArray(accounting::ObjectStack* allocations, bool swap_bitmaps) {
-  space::DlMallocSpace* space = heap_->GetAllocSpace();
+  space::MallocSpace* space = heap_->GetAllocSpace();
   timings_.StartSplit("SweepArray");
   // Newly allocated objects MUST be in the alloc space and those are the only objects which we are
   // going to free.
@@ -1155,62 +1352,50 @@ void MarkSweep::SweepArray(accounting::ObjectStack* allocations, bool swap_bitma
     std::swap(large_live_objects, large_mark_objects);
   }
 
-  size_t freed_bytes = 0;
-  size_t freed_large_object_bytes = 0;
-  size_t freed_objects = 0;
-  size_t freed_large_objects = 0;
-  size_t count = allocations->Size();
+  const size_t count = allocations->Size();
   Object** objects = const_cast<Object**>(allocations->Begin());
-  Object** out = objects;
-  Object** objects_to_chunk_free = out;
 
-  // Empty the allocation stack.
+  // Empty the allocation stack. Each task compacts the dead objects of its own chunk in place.
   Thread* self = Thread::Current();
-  for (size_t i = 0; i < count; ++i) {
-    Object* obj = objects[i];
-    // There should only be objects in the AllocSpace/LargeObjectSpace in the allocation stack.
-    if (LIKELY(mark_bitmap->HasAddress(obj))) {
-      if (!mark_bitmap->Test(obj)) {
-        // Don't bother un-marking since we clear the mark bitmap anyways.
-        *(out++) = obj;
-        // Free objects in chunks.
-        DCHECK_GE(out, objects_to_chunk_free);
-        DCHECK_LE(static_cast<size_t>(out - objects_to_chunk_free), kSweepArrayChunkFreeSize);
-        if (static_cast<size_t>(out - objects_to_chunk_free) == kSweepArrayChunkFreeSize) {
-          timings_.StartSplit("FreeList");
-          size_t chunk_freed_objects = out - objects_to_chunk_free;
-          freed_objects += chunk_freed_objects;
-          freed_bytes += space->FreeList(self, chunk_freed_objects, objects_to_chunk_free);
-          objects_to_chunk_free = out;
-          timings_.EndSplit();
-        }
-      }
-    } else if (!large_mark_objects->Test(obj)) {
-      ++freed_large_objects;
-      freed_large_object_bytes += large_object_space->Free(self, obj);
+  ThreadPool* thread_pool = GetHeap()->GetThreadPool();
+  const size_t thread_count = GetThreadCount(Locks::mutator_lock_->IsExclusiveHeld(self));
+  std::vector<SweepArrayTask*> tasks;
+  if (kParallelSweep && thread_count > 1 && count > kSweepArrayChunkFreeSize) {
+    const size_t delta = count / (thread_count * kSweepTasksPerThread) + 1;
+    for (size_t begin = 0; begin < count; begin += delta) {
+      tasks.push_back(new SweepArrayTask(space, mark_bitmap, large_mark_objects, objects + begin,
+                                         objects + std::min(begin + delta, count)));
+      thread_pool->AddTask(self, tasks.back());
     }
+    thread_pool->SetMaxActiveWorkers(thread_count - 1);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, true, true);
+    thread_pool->StopWorkers(self);
+  } else {
+    tasks.push_back(new SweepArrayTask(space, mark_bitmap, large_mark_objects, objects,
+                                       objects + count));
+    tasks.back()->Run(self);
   }
-  // Free the remaining objects in chunks.
-  DCHECK_GE(out, objects_to_chunk_free);
-  DCHECK_LE(static_cast<size_t>(out - objects_to_chunk_free), kSweepArrayChunkFreeSize);
-  if (out - objects_to_chunk_free > 0) {
-    timings_.StartSplit("FreeList");
-    size_t chunk_freed_objects = out - objects_to_chunk_free;
-    freed_objects += chunk_freed_objects;
-    freed_bytes += space->FreeList(self, chunk_freed_objects, objects_to_chunk_free);
-    timings_.EndSplit();
-  }
+
+  size_t freed_bytes = 0;
+  size_t freed_objects = 0;
+  for (SweepArrayTask* task : tasks) {
+    freed_objects += task->GetFreedObjects();
+    freed_bytes += task->GetFreedBytes();
+    large_objects_to_free_.insert(large_objects_to_free_.end(),
+                                  task->GetDeadLargeObjects().begin(),
+                                  task->GetDeadLargeObjects().end());
+  }
+  STLDeleteElements(&tasks);
   CHECK_EQ(count, allocations->Size());
   timings_.EndSplit();
 
   timings_.StartSplit("RecordFree");
   VLOG(heap) << "Freed " << freed_objects << "/" << count
              << " objects with size " << PrettySize(freed_bytes);
-  heap_->RecordFree(freed_objects + freed_large_objects, freed_bytes + freed_large_object_bytes);
+  heap_->RecordFree(freed_objects, freed_bytes);
   freed_objects_.fetch_add(freed_objects);
-  freed_large_objects_.fetch_add(freed_large_objects);
   freed_bytes_.fetch_add(freed_bytes);
-  freed_large_object_bytes_.fetch_add(freed_large_object_bytes);
   timings_.EndSplit();
 
   timings_.StartSplit("ResetStack");
@@ -1223,9 +1408,14 @@ void MarkSweep::Sweep(bool swap_bitmaps) {
   base::TimingLogger::ScopedSplit("Sweep", &timings_);
 
   const bool partial = (GetGcType() == kGcTypePartial);
+  Thread* self = Thread::Current();
+  ThreadPool* thread_pool = GetHeap()->GetThreadPool();
+  const size_t thread_count = GetThreadCount(Locks::mutator_lock_->IsExclusiveHeld(self));
+  const bool parallel = kParallelSweep && thread_count > 1;
   SweepCallbackContext scc;
   scc.mark_sweep = this;
-  scc.self = Thread::Current();
+  scc.self = self;
+  std::vector<SweepBitmapTask*> tasks;
   for (const auto& space : GetHeap()->GetContinuousSpaces()) {
     // We always sweep always collect spaces.
     bool sweep_space = (space->GetGcRetentionPolicy() == space::kGcRetentionPolicyAlwaysCollect);
@@ -1236,17 +1426,22 @@ void MarkSweep::Sweep(bool swap_bitmaps) {
     if (sweep_space) {
       uintptr_t begin = reinterpret_cast<uintptr_t>(space->Begin());
       uintptr_t end = reinterpret_cast<uintptr_t>(space->End());
-      scc.space = space->AsDlMallocSpace();
+      scc.space = space->AsMallocSpace();
       accounting::SpaceBitmap* live_bitmap = space->GetLiveBitmap();
       accounting::SpaceBitmap* mark_bitmap = space->GetMarkBitmap();
       if (swap_bitmaps) {
         std::swap(live_bitmap, mark_bitmap);
       }
       if (!space->IsZygoteSpace()) {
-        base::TimingLogger::ScopedSplit split("SweepAllocSpace", &timings_);
         // Bitmaps are pre-swapped for optimization which enables sweeping with the heap unlocked.
-        accounting::SpaceBitmap::SweepWalk(*live_bitmap, *mark_bitmap, begin, end,
-                                           &SweepCallback, reinterpret_cast<void*>(&scc));
+        const size_t task_count = parallel ? thread_count * kSweepTasksPerThread : 1;
+        const uintptr_t delta = RoundUp((end - begin) / task_count + 1,
+                                        accounting::SpaceBitmap::kAlignment * kBitsPerWord);
+        for (uintptr_t range_begin = begin; range_begin < end; range_begin += delta) {
+          tasks.push_back(new SweepBitmapTask(this, space->AsMallocSpace(), live_bitmap,
+                                              mark_bitmap, range_begin,
+                                              std::min(range_begin + delta, end)));
+        }
       } else {
         base::TimingLogger::ScopedSplit split("SweepZygote", &timings_);
         // Zygote sweep takes care of dirtying cards and clearing live bits, does not free actual
@@ -1257,6 +1452,34 @@ void MarkSweep::Sweep(bool swap_bitmaps) {
     }
   }
 
+  {
+    base::TimingLogger::ScopedSplit split("SweepAllocSpace", &timings_);
+    if (parallel) {
+      for (SweepBitmapTask* task : tasks) {
+        thread_pool->AddTask(self, task);
+      }
+      thread_pool->SetMaxActiveWorkers(thread_count - 1);
+      thread_pool->StartWorkers(self);
+      thread_pool->Wait(self, true, true);
+      thread_pool->StopWorkers(self);
+    } else {
+      for (SweepBitmapTask* task : tasks) {
+        task->Run(self);
+      }
+    }
+    // Merge the counts of the tasks.
+    size_t freed_objects = 0;
+    size_t freed_bytes = 0;
+    for (SweepBitmapTask* task : tasks) {
+      freed_objects += task->GetFreedObjects();
+      freed_bytes += task->GetFreedBytes();
+    }
+    STLDeleteElements(&tasks);
+    GetHeap()->RecordFree(freed_objects, freed_bytes);
+    freed_objects_.fetch_add(freed_objects);
+    freed_bytes_.fetch_add(freed_bytes);
+  }
+
   SweepLargeObjects(swap_bitmaps);
 }
 
@@ -1270,15 +1493,23 @@ void MarkSweep::SweepLargeObjects(bool swap_bitmaps) {
     std::swap(large_live_objects, large_mark_objects);
   }
   // O(n*log(n)) but hopefully there are not too many large objects.
-  size_t freed_objects = 0;
-  size_t freed_bytes = 0;
-  Thread* self = Thread::Current();
   for (const Object* obj : large_live_objects->GetObjects()) {
     if (!large_mark_objects->Test(obj)) {
-      freed_bytes += large_object_space->Free(self, const_cast<Object*>(obj));
-      ++freed_objects;
+      large_objects_to_free_.push_back(const_cast<Object*>(obj));
     }
   }
+}
+
+void MarkSweep::FreeLargeObjects() {
+  base::TimingLogger::ScopedSplit split("FreeLargeObjects", &timings_);
+  const size_t freed_objects = large_objects_to_free_.size();
+  if (freed_objects == 0) {
+    return;
+  }
+  space::LargeObjectSpace* large_object_space = GetHeap()->GetLargeObjectsSpace();
+  size_t freed_bytes = large_object_space->FreeList(Thread::Current(), freed_objects,
+                                                    &large_objects_to_free_[0]);
+  large_objects_to_free_.clear();
   freed_large_objects_.fetch_add(freed_objects);
   freed_large_object_bytes_.fetch_add(freed_bytes);
   GetHeap()->RecordFree(freed_objects, freed_bytes);
@@ -1286,7 +1517,7 @@ void MarkSweep::SweepLargeObjects(bool swap_bitmaps) {
 
 void MarkSweep::CheckReference(const Object* obj, const Object* ref, MemberOffset offset, bool is_static) {
   for (const auto& space : GetHeap()->GetContinuousSpaces()) {
-    if (space->IsDlMallocSpace() && space->Contains(ref)) {
+    if (space->IsMallocSpace() && space->Contains(ref)) {
       DCHECK(IsMarked(obj));
 
       bool is_marked = IsMarked(ref);
@@ -1399,25 +1630,191 @@ void MarkSweep::ScanObject(const Object* obj) {
   ScanObjectVisit(obj, visitor);
 }
 
+// State shared by the tasks of one ProcessMarkStackParallel.
+class ParallelMarkContext {
+ public:
+  ParallelMarkContext(size_t thread_count, mirror::Object** begin, mirror::Object** end)
+      : overflow_lock_("parallel mark overflow lock", kMarkSweepMarkStackLock),
+        overflow_stack_(begin, end),
+        overflow_size_(end - begin),
+        started_count_(0),
+        idle_count_(0) {
+    for (size_t i = 0; i < thread_count; ++i) {
+      deques_.push_back(new accounting::WorkStealingDeque<const Object*>(kParallelMarkDequeSize));
+    }
+  }
+
+  ~ParallelMarkContext() {
+    STLDeleteElements(&deques_);
+  }
+
+  accounting::WorkStealingDeque<const Object*>* GetDeque(size_t index) {
+    return deques_[index];
+  }
+
+  size_t GetThreadCount() const {
+    return deques_.size();
+  }
+
+  void PushOverflow(Thread* self, const Object* obj) {
+    MutexLock mu(self, overflow_lock_);
+    overflow_stack_.push_back(obj);
+    ++overflow_size_;
+  }
+
+  // Moves a batch of objects from the overflow stack to the deque of thread index, returning one of
+  // them in obj.
+  bool PopOverflow(Thread* self, size_t index, const Object** obj) {
+    if (overflow_size_ == 0) {
+      return false;
+    }
+    MutexLock mu(self, overflow_lock_);
+    if (overflow_stack_.empty()) {
+      return false;
+    }
+    *obj = overflow_stack_.back();
+    overflow_stack_.pop_back();
+    accounting::WorkStealingDeque<const Object*>* deque = deques_[index];
+    size_t count = 1;
+    while (count < kParallelMarkOverflowBatchSize && !overflow_stack_.empty() &&
+        deque->Push(overflow_stack_.back())) {
+      overflow_stack_.pop_back();
+      ++count;
+    }
+    overflow_size_.fetch_sub(count);
+    return true;
+  }
+
+  // Steals one object from the other threads' deques, starting with the next thread.
+  bool Steal(size_t index, const Object** obj) {
+    const size_t thread_count = deques_.size();
+    for (size_t i = 1; i < thread_count; ++i) {
+      if (deques_[(index + i) % thread_count]->Steal(obj)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool HasWork() const {
+    if (overflow_size_ != 0) {
+      return true;
+    }
+    for (const auto& deque : deques_) {
+      if (!deque->IsEmpty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Mutex overflow_lock_;
+  std::vector<const Object*> overflow_stack_ GUARDED_BY(overflow_lock_);
+  AtomicInteger overflow_size_;
+  std::vector<accounting::WorkStealingDeque<const Object*>*> deques_;
+  // Number of tasks which started running and how many of them ran out of work.
+  AtomicInteger started_count_;
+  AtomicInteger idle_count_;
+};
+
+class ParallelMarkTask : public Task {
+ public:
+  ParallelMarkTask(MarkSweep* mark_sweep, ParallelMarkContext* context, size_t index)
+      : mark_sweep_(mark_sweep), context_(context), index_(index) {
+  }
+
+  // Owned by ProcessMarkStackParallel.
+  virtual void Finalize() {}
+
+  virtual void Run(Thread* self) NO_THREAD_SAFETY_ANALYSIS {
+    accounting::WorkStealingDeque<const Object*>* deque = context_->GetDeque(index_);
+    ++context_->started_count_;
+    const Object* obj = NULL;
+    for (;;) {
+      while (deque->Pop(&obj)) {
+        ScanObject(self, obj);
+      }
+      if (GetWork(self, &obj)) {
+        ScanObject(self, obj);
+        continue;
+      }
+      // Out of work, we are done once every started task is idle and there is nothing left to
+      // steal. Tasks which haven't started yet have nothing to contribute.
+      ++context_->idle_count_;
+      bool done = false;
+      for (;;) {
+        const bool has_work = context_->HasWork();
+        if (!has_work && context_->idle_count_ == context_->started_count_) {
+          done = true;
+          break;
+        }
+        if (has_work) {
+          --context_->idle_count_;
+          if (GetWork(self, &obj)) {
+            ScanObject(self, obj);
+            break;
+          }
+          ++context_->idle_count_;
+        }
+        sched_yield();
+      }
+      if (done) {
+        break;
+      }
+    }
+  }
+
+ private:
+  bool GetWork(Thread* self, const Object** obj) {
+    if (context_->PopOverflow(self, index_, obj)) {
+      return true;
+    }
+    if (context_->Steal(index_, obj)) {
+      if (kCountTasks) {
+        ++mark_sweep_->objects_stolen_;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void ScanObject(Thread* self, const Object* obj) NO_THREAD_SAFETY_ANALYSIS {
+    MarkSweep* mark_sweep = mark_sweep_;
+    mark_sweep->ScanObjectVisit(obj,
+        [mark_sweep, self, this](const Object* /* obj */, const Object* ref,
+            const MemberOffset& /* offset */, bool /* is_static */) ALWAYS_INLINE {
+      if (ref != nullptr && mark_sweep->MarkObjectParallel(ref) &&
+          UNLIKELY(!context_->GetDeque(index_)->Push(ref))) {
+        context_->PushOverflow(self, ref);
+      }
+    });
+  }
+
+  MarkSweep* const mark_sweep_;
+  ParallelMarkContext* const context_;
+  const size_t index_;
+};
+
 void MarkSweep::ProcessMarkStackParallel(size_t thread_count) {
   Thread* self = Thread::Current();
   ThreadPool* thread_pool = GetHeap()->GetThreadPool();
-  const size_t chunk_size = std::min(mark_stack_->Size() / thread_count + 1,
-                                     static_cast<size_t>(MarkStackTask<false>::kMaxSize));
-  CHECK_GT(chunk_size, 0U);
-  // Split the current mark stack up into work tasks.
-  for (mirror::Object **it = mark_stack_->Begin(), **end = mark_stack_->End(); it < end; ) {
-    const size_t delta = std::min(static_cast<size_t>(end - it), chunk_size);
-    thread_pool->AddTask(self, new MarkStackTask<false>(thread_pool, this, delta,
-                                                        const_cast<const mirror::Object**>(it)));
-    it += delta;
+  // The tasks start by taking batches of the current mark stack.
+  ParallelMarkContext context(thread_count, mark_stack_->Begin(), mark_stack_->End());
+  mark_stack_->Reset();
+  std::vector<ParallelMarkTask*> tasks;
+  for (size_t i = 0; i < thread_count; ++i) {
+    tasks.push_back(new ParallelMarkTask(this, &context, i));
+    thread_pool->AddTask(self, tasks.back());
   }
   thread_pool->SetMaxActiveWorkers(thread_count - 1);
   thread_pool->StartWorkers(self);
   thread_pool->Wait(self, true, true);
   thread_pool->StopWorkers(self);
-  mark_stack_->Reset();
-  CHECK_EQ(work_chunks_created_, work_chunks_deleted_) << " some of the work chunks were leaked";
+  STLDeleteElements(&tasks);
+  DCHECK(!context.HasWork());
+  if (kCountTasks) {
+    VLOG(heap) << "Parallel marking stole " << objects_stolen_ << " objects";
+  }
 }
 
 // Scan anything that's on the mark stack.
@@ -1466,6 +1863,8 @@ void MarkSweep::PreserveSomeSoftReferences(Object** list) {
   DCHECK(list != NULL);
   Object* clear = NULL;
   size_t counter = 0;
+  // Without timestamps, every other white referent is preserved.
+  const bool lru_policy = heap_->IsSoftReferenceLruPolicyEnabled();
 
   DCHECK(mark_stack_->IsEmpty());
 
@@ -1478,7 +1877,8 @@ void MarkSweep::PreserveSomeSoftReferences(Object** list) {
       continue;
     }
     bool is_marked = IsMarked(referent);
-    if (!is_marked && ((++counter) & 1)) {
+    if (!is_marked &&
+        (lru_policy ? heap_->ShouldPreserveSoftReferent(ref) : ((++counter) & 1) != 0)) {
       // Referent is white and biased toward saving, mark it.
       MarkObject(referent);
       is_marked = true;
@@ -1568,7 +1968,9 @@ void MarkSweep::ProcessReferences(Object** soft_references, bool clear_soft,
   // Unless we are in the zygote or required to clear soft references
   // with white references, preserve some white referents.
   if (!clear_soft && !Runtime::Current()->IsZygote()) {
+    SetReferentsMarking(true);
     PreserveSomeSoftReferences(soft_references);
+    SetReferentsMarking(false);
   }
 
   timings_.StartSplit("ProcessReferences");
@@ -1580,7 +1982,9 @@ void MarkSweep::ProcessReferences(Object** soft_references, bool clear_soft,
 
   // Preserve all white objects with finalize methods and schedule
   // them for finalization.
+  SetReferentsMarking(true);
   EnqueueFinalizerReferences(finalizer_references);
+  SetReferentsMarking(false);
 
   timings_.StartSplit("ProcessReferences");
   // Clear all f-reachable soft and weak references with white
@@ -1602,8 +2006,8 @@ void MarkSweep::ProcessReferences(Object** soft_references, bool clear_soft,
 void MarkSweep::UnBindBitmaps() {
   base::TimingLogger::ScopedSplit split("UnBindBitmaps", &timings_);
   for (const auto& space : GetHeap()->GetContinuousSpaces()) {
-    if (space->IsDlMallocSpace()) {
-      space::DlMallocSpace* alloc_space = space->AsDlMallocSpace();
+    if (space->IsMallocSpace()) {
+      space::MallocSpace* alloc_space = space->AsMallocSpace();
       if (alloc_space->temp_bitmap_.get() != NULL) {
         // At this point, the temp_bitmap holds our old mark bitmap.
         accounting::SpaceBitmap* new_bitmap = alloc_space->temp_bitmap_.release();
@@ -1628,7 +2032,7 @@ void MarkSweep::FinishPhase() {
   heap->PostGcVerification(this);
 
   timings_.NewSplit("GrowForUtilization");
-  heap->GrowForUtilization(GetGcType(), GetDurationNs());
+  heap->GrowForUtilization(this);
 
   timings_.NewSplit("RequestHeapTrim");
   heap->RequestHeapTrim();
@@ -1642,6 +2046,7 @@ void MarkSweep::FinishPhase() {
 
   // Ensure that the mark stack is empty.
   CHECK(mark_stack_->IsEmpty());
+  DCHECK(large_objects_to_free_.empty());
 
   if (kCountScannedTypes) {
     VLOG(gc) << "MarkSweep scanned classes=" << class_count_ << " arrays=" << array_count_
@@ -17,11 +17,14 @@
 #ifndef ART_RUNTIME_GC_COLLECTOR_MARK_SWEEP_H_
 #define ART_RUNTIME_GC_COLLECTOR_MARK_SWEEP_H_
 
+#include <vector>
+
 #include "atomic_integer.h"
 #include "barrier.h"
 #include "base/macros.h"
 #include "base/mutex.h"
 #include "garbage_collector.h"
+#include "gc/accounting/allocation_site_table.h"
 #include "offsets.h"
 #include "root_visitor.h"
 #include "UniquePtr.h"
@@ -137,12 +140,16 @@ class MarkSweep : public GarbageCollector {
   void ProcessReferences(Thread* self)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
-  // Sweeps unmarked objects to complete the garbage collection.
+  // Sweeps unmarked objects to complete the garbage collection. The alloc spaces are split into
+  // address ranges which are swept by the GC thread pool.
   virtual void Sweep(bool swap_bitmaps) EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
 
-  // Sweeps unmarked objects to complete the garbage collection.
+  // Finds the unmarked large objects, which are freed by FreeLargeObjects.
   void SweepLargeObjects(bool swap_bitmaps) EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
 
+  // Frees the large objects found dead by the sweep, which doesn't require the heap bitmap lock.
+  void FreeLargeObjects() LOCKS_EXCLUDED(Locks::heap_bitmap_lock_);
+
   // Sweep only pointers within an array. WARNING: Trashes objects.
   void SweepArray(accounting::ObjectStack* allocation_stack_, bool swap_bitmaps)
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
@@ -182,22 +189,6 @@ class MarkSweep : public GarbageCollector {
     return freed_large_objects_;
   }
 
-  uint64_t GetTotalTimeNs() const {
-    return total_time_ns_;
-  }
-
-  uint64_t GetTotalPausedTimeNs() const {
-    return total_paused_time_ns_;
-  }
-
-  uint64_t GetTotalFreedObjects() const {
-    return total_freed_objects_;
-  }
-
-  uint64_t GetTotalFreedBytes() const {
-    return total_freed_bytes_;
-  }
-
   // Everything inside the immune range is assumed to be marked.
   void SetImmuneRange(mirror::Object* begin, mirror::Object* end);
 
@@ -248,6 +239,11 @@ class MarkSweep : public GarbageCollector {
   static bool IsMarkedArrayCallback(const mirror::Object* object, void* arg)
       SHARED_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
 
+  // A sampled object survived if it is marked.
+  static accounting::AllocationSiteTable::SampleFate SampleFateCallback(
+      const mirror::Object* object, void* arg)
+      SHARED_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
+
   static void ReMarkObjectVisitor(const mirror::Object* root, void* arg)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
@@ -282,8 +278,10 @@ class MarkSweep : public GarbageCollector {
   // Returns true if we need to add obj to a mark stack.
   bool MarkObjectParallel(const mirror::Object* obj) NO_THREAD_SAFETY_ANALYSIS;
 
+  // Frees a batch of dead objects, may be called by the GC thread pool while the thread running
+  // the collection holds the heap bitmap lock.
   static void SweepCallback(size_t num_ptrs, mirror::Object** ptrs, void* arg)
-      EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
+      NO_THREAD_SAFETY_ANALYSIS;
 
   // Special sweep for zygote that just marks objects / dirties cards.
   static void ZygoteSweepCallback(size_t num_ptrs, mirror::Object** ptrs, void* arg)
@@ -368,6 +366,8 @@ class MarkSweep : public GarbageCollector {
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Drains the mark stack with one task per GC thread. Each task marks from its own work stealing
+  // deque and steals single objects from the other tasks when it runs out of work.
   void ProcessMarkStackParallel(size_t thread_count)
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
@@ -390,6 +390,10 @@ class MarkSweep : public GarbageCollector {
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // When references are processed concurrently, mutators must not read referents which are marked
+  // but not scanned yet, they wait in Reference.get while we mark.
+  void SetReferentsMarking(bool marking);
+
   void SweepJniWeakGlobals(IsMarkedTester is_marked, void* arg)
       SHARED_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
 
@@ -437,9 +441,13 @@ class MarkSweep : public GarbageCollector {
   AtomicInteger overhead_time_;
   AtomicInteger work_chunks_created_;
   AtomicInteger work_chunks_deleted_;
+  AtomicInteger objects_stolen_;
   AtomicInteger reference_count_;
   AtomicInteger cards_scanned_;
 
+  // Dead large objects which haven't been freed yet.
+  std::vector<mirror::Object*> large_objects_to_free_;
+
   // Verification.
   size_t live_stack_freeze_size_;
 
@@ -451,6 +459,10 @@ class MarkSweep : public GarbageCollector {
 
   bool clear_soft_references_;
 
+  // True if the references are processed after the pause of a concurrent collection rather than
+  // during it.
+  bool process_references_concurrently_;
+
  private:
   friend class AddIfReachesAllocSpaceVisitor;  // Used by mod-union table.
   friend class CardScanTask;
@@ -468,7 +480,9 @@ class MarkSweep : public GarbageCollector {
   friend class ModUnionScanImageRootVisitor;
   friend class ScanBitmapVisitor;
   friend class ScanImageRootVisitor;
+  friend class SweepBitmapTask;
   template<bool kUseFinger> friend class MarkStackTask;
+  friend class ParallelMarkTask;
   friend class FifoMarkStackChunk;
 
   DISALLOW_COPY_AND_ASSIGN(MarkSweep);
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gc_event_log.h"
+
+#include <algorithm>
+#include <ostream>
+
+#include "base/histogram-inl.h"
+#include "base/logging.h"
+#include "base/timing_logger.h"
+#include "gc/collector/garbage_collector.h"
+#include "gc/collector/gc_type.h"
+#include "gc/heap.h"
+#include "thread.h"
+
+namespace art {
+namespace gc {
+
+GcEventLog::GcEventLog()
+    : lock_("GC event log lock"),
+      events_(kCapacity),
+      event_count_(0) {
+}
+
+uint32_t GcEventLog::GetNameIndex(const std::string& name) {
+  auto it = name_indices_.find(name);
+  if (it != name_indices_.end()) {
+    return it->second;
+  }
+  const uint32_t index = names_.size();
+  names_.push_back(name);
+  name_indices_.insert(std::make_pair(name, index));
+  return index;
+}
+
+void GcEventLog::Append(GcEvent* event, const std::string& collector_name,
+                        const base::TimingLogger& timings) {
+  MutexLock mu(Thread::Current(), lock_);
+  event->sequence = event_count_;
+  event->collector = GetNameIndex(collector_name);
+  event->num_splits = 0;
+  for (const base::TimingLogger::SplitTiming& split : timings.GetSplits()) {
+    if (event->num_splits < GcEvent::kMaxSplits) {
+      GcEvent::Split& event_split = event->splits[event->num_splits++];
+      event_split.label = GetNameIndex(split.second);
+      event_split.duration_ns = split.first;
+    } else {
+      event->splits[GcEvent::kMaxSplits - 1].duration_ns += split.first;
+    }
+  }
+  events_[event_count_ % kCapacity] = *event;
+  ++event_count_;
+}
+
+uint64_t GcEventLog::GetEventCount() {
+  MutexLock mu(Thread::Current(), lock_);
+  return event_count_;
+}
+
+uint64_t GcEventLog::FirstSequence(uint64_t first_sequence) const {
+  const uint64_t oldest = event_count_ > kCapacity ? event_count_ - kCapacity : 0;
+  return std::max(first_sequence, oldest);
+}
+
+void GcEventLog::GetEvents(uint64_t first_sequence, std::vector<GcEvent>* events) {
+  MutexLock mu(Thread::Current(), lock_);
+  for (uint64_t s = FirstSequence(first_sequence); s < event_count_; ++s) {
+    events->push_back(events_[s % kCapacity]);
+  }
+}
+
+void GcEventLog::GetEvents(uint64_t first_sequence, std::vector<int64_t>* events) {
+  std::vector<GcEvent> records;
+  GetEvents(first_sequence, &records);
+  for (const GcEvent& event : records) {
+    const size_t start = events->size();
+    events->push_back(event.sequence);
+    events->push_back(event.start_time_ns);
+    events->push_back(event.duration_ns);
+    events->push_back(event.cause);
+    events->push_back(event.gc_type);
+    events->push_back(event.collector);
+    events->push_back(event.num_pauses);
+    events->insert(events->end(), event.pause_ns, event.pause_ns + GcEvent::kMaxPauses);
+    events->push_back(event.freed_objects);
+    events->push_back(event.freed_bytes);
+    events->push_back(event.bytes_allocated_before);
+    events->push_back(event.bytes_allocated_after);
+    events->push_back(event.total_memory_after);
+    events->push_back(event.num_splits);
+    for (size_t i = 0; i < GcEvent::kMaxSplits; ++i) {
+      events->push_back(i < event.num_splits ? event.splits[i].label : 0);
+      events->push_back(i < event.num_splits ? event.splits[i].duration_ns : 0);
+    }
+    DCHECK_EQ(events->size() - start, static_cast<size_t>(kFlattenedEventSize));
+  }
+}
+
+std::vector<std::string> GcEventLog::GetNames() {
+  MutexLock mu(Thread::Current(), lock_);
+  return names_;
+}
+
+void GcEventLog::DumpCsv(std::ostream& os) {
+  MutexLock mu(Thread::Current(), lock_);
+  os << "sequence,start_time_ns,duration_ns,cause,gc_type,collector,pauses_ns,freed_objects,"
+     << "freed_bytes,bytes_allocated_before,bytes_allocated_after,total_memory_after,splits\n";
+  for (uint64_t s = FirstSequence(0); s < event_count_; ++s) {
+    const GcEvent& event = events_[s % kCapacity];
+    os << event.sequence << "," << event.start_time_ns << "," << event.duration_ns << ","
+       << static_cast<GcCause>(event.cause) << ","
+       << static_cast<collector::GcType>(event.gc_type) << "," << names_[event.collector] << ",";
+    // Lists are separated by semicolons to keep to one field.
+    for (size_t i = 0; i < event.num_pauses; ++i) {
+      os << (i != 0 ? ";" : "") << event.pause_ns[i];
+    }
+    os << "," << event.freed_objects << "," << event.freed_bytes << ","
+       << event.bytes_allocated_before << "," << event.bytes_allocated_after << ","
+       << event.total_memory_after << ",";
+    for (size_t i = 0; i < event.num_splits; ++i) {
+      os << (i != 0 ? ";" : "") << names_[event.splits[i].label] << "="
+         << event.splits[i].duration_ns;
+    }
+    os << "\n";
+  }
+}
+
+void GcEventLog::DumpJson(std::ostream& os,
+                          const std::vector<collector::GarbageCollector*>& collectors) {
+  MutexLock mu(Thread::Current(), lock_);
+  // The names are collector names and split labels, none of which needs escaping.
+  os << "{\"events\":[";
+  for (uint64_t s = FirstSequence(0); s < event_count_; ++s) {
+    const GcEvent& event = events_[s % kCapacity];
+    os << (s != FirstSequence(0) ? "," : "")
+       << "{\"sequence\":" << event.sequence
+       << ",\"start_time_ns\":" << event.start_time_ns
+       << ",\"duration_ns\":" << event.duration_ns
+       << ",\"cause\":\"" << static_cast<GcCause>(event.cause) << "\""
+       << ",\"gc_type\":\"" << static_cast<collector::GcType>(event.gc_type) << "\""
+       << ",\"collector\":\"" << names_[event.collector] << "\""
+       << ",\"pauses_ns\":[";
+    for (size_t i = 0; i < event.num_pauses; ++i) {
+      os << (i != 0 ? "," : "") << event.pause_ns[i];
+    }
+    os << "],\"freed_objects\":" << event.freed_objects
+       << ",\"freed_bytes\":" << event.freed_bytes
+       << ",\"bytes_allocated_before\":" << event.bytes_allocated_before
+       << ",\"bytes_allocated_after\":" << event.bytes_allocated_after
+       << ",\"total_memory_after\":" << event.total_memory_after
+       << ",\"splits\":[";
+    // Labels may repeat, the splits are kept in order rather than keyed by label.
+    for (size_t i = 0; i < event.num_splits; ++i) {
+      os << (i != 0 ? "," : "") << "{\"label\":\"" << names_[event.splits[i].label]
+         << "\",\"duration_ns\":" << event.splits[i].duration_ns << "}";
+    }
+    os << "]}";
+  }
+  os << "],\"pause_histograms\":{";
+  bool first = true;
+  for (collector::GarbageCollector* collector : collectors) {
+    Histogram<uint64_t>& histogram = collector->GetPauseHistogram();
+    if (histogram.SampleSize() == 0) {
+      continue;
+    }
+    Histogram<uint64_t>::CumulativeData cumulative_data;
+    histogram.CreateHistogram(cumulative_data);
+    os << (first ? "" : ",") << "\"" << collector->GetName() << "\":{"
+       << "\"count\":" << histogram.SampleSize()
+       << ",\"sum_us\":" << histogram.Sum()
+       << ",\"mean_us\":" << histogram.Mean()
+       << ",\"p50_us\":" << histogram.Percentile(0.5, cumulative_data)
+       << ",\"p90_us\":" << histogram.Percentile(0.9, cumulative_data)
+       << ",\"p99_us\":" << histogram.Percentile(0.99, cumulative_data)
+       << ",\"max_us\":" << histogram.Max() << "}";
+    first = false;
+  }
+  os << "}}\n";
+}
+
+}  // namespace gc
+}  // namespace art
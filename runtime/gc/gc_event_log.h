@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_GC_EVENT_LOG_H_
+#define ART_RUNTIME_GC_GC_EVENT_LOG_H_
+
+#include <stdint.h>
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "locks.h"
+
+namespace art {
+
+namespace base {
+  class TimingLogger;
+}  // namespace base
+
+namespace gc {
+
+namespace collector {
+  class GarbageCollector;
+}  // namespace collector
+
+// A collection as recorded by the GC event log. Records have a fixed size, the collector name and
+// the split labels are indices into the name table of the log.
+struct GcEvent {
+  static constexpr size_t kMaxPauses = 4;
+  static constexpr size_t kMaxSplits = 24;
+
+  struct Split {
+    uint32_t label;
+    uint64_t duration_ns;
+  };
+
+  // Number of collections recorded before this one.
+  uint64_t sequence;
+  // NanoTime() when the collection started.
+  uint64_t start_time_ns;
+  uint64_t duration_ns;
+  // A GcCause and a collector::GcType.
+  uint32_t cause;
+  uint32_t gc_type;
+  uint32_t collector;
+  // At most kMaxPauses, further pauses are added to the last one.
+  uint32_t num_pauses;
+  uint64_t pause_ns[kMaxPauses];
+  uint64_t freed_objects;
+  uint64_t freed_bytes;
+  uint64_t bytes_allocated_before;
+  uint64_t bytes_allocated_after;
+  uint64_t total_memory_after;
+  // Splits past kMaxSplits are added to the last one.
+  uint32_t num_splits;
+  Split splits[kMaxSplits];
+};
+
+// Keeps the records of the last kCapacity collections in a ring buffer, for tools which would
+// otherwise have to parse the log for the GC timings.
+class GcEventLog {
+ public:
+  static constexpr size_t kCapacity = 128;
+
+  // Number of longs an event takes once flattened by GetEvents, in the order of the fields of
+  // GcEvent with each split taking two longs.
+  static constexpr size_t kFlattenedEventSize = 13 + GcEvent::kMaxPauses + 2 * GcEvent::kMaxSplits;
+
+  GcEventLog();
+
+  // Records a collection which just finished. The sequence, collector and splits of event are
+  // filled in from the arguments.
+  void Append(GcEvent* event, const std::string& collector_name,
+              const base::TimingLogger& timings) LOCKS_EXCLUDED(lock_);
+
+  // Number of collections recorded since startup, including those no longer in the buffer.
+  uint64_t GetEventCount() LOCKS_EXCLUDED(lock_);
+
+  // Appends the events still in the buffer whose sequence is at least first_sequence to events,
+  // oldest first.
+  void GetEvents(uint64_t first_sequence, std::vector<GcEvent>* events) LOCKS_EXCLUDED(lock_);
+
+  // Same as above, but each event is flattened into kFlattenedEventSize longs.
+  void GetEvents(uint64_t first_sequence, std::vector<int64_t>* events) LOCKS_EXCLUDED(lock_);
+
+  // Returns the collector names and split labels events refer to.
+  std::vector<std::string> GetNames() LOCKS_EXCLUDED(lock_);
+
+  // Dump the events still in the buffer, one line per event.
+  void DumpCsv(std::ostream& os) LOCKS_EXCLUDED(lock_);
+
+  // Dump the events still in the buffer and the pause percentiles of each of collectors, taken from
+  // their pause histograms.
+  void DumpJson(std::ostream& os, const std::vector<collector::GarbageCollector*>& collectors)
+      LOCKS_EXCLUDED(lock_);
+
+ private:
+  uint32_t GetNameIndex(const std::string& name) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Sequence of the oldest event still in the buffer with a sequence at least first_sequence.
+  uint64_t FirstSequence(uint64_t first_sequence) const EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
+
+  // The event of sequence s is at index s % kCapacity.
+  std::vector<GcEvent> events_ GUARDED_BY(lock_);
+  uint64_t event_count_ GUARDED_BY(lock_);
+
+  std::vector<std::string> names_ GUARDED_BY(lock_);
+  std::map<std::string, uint32_t> name_indices_ GUARDED_BY(lock_);
+
+  DISALLOW_COPY_AND_ASSIGN(GcEventLog);
+};
+
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_GC_EVENT_LOG_H_
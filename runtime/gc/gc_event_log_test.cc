@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gc_event_log.h"
+
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/timing_logger.h"
+#include "common_test.h"
+#include "gc/collector/garbage_collector.h"
+#include "gc/collector/gc_type.h"
+#include "gc/heap.h"
+
+namespace art {
+namespace gc {
+
+// Copied so that the test macros, which take references, don't need a definition of the members.
+static const size_t kCapacity = GcEventLog::kCapacity;
+static const size_t kFlattenedEventSize = GcEventLog::kFlattenedEventSize;
+static const size_t kMaxPauses = GcEvent::kMaxPauses;
+static const size_t kMaxSplits = GcEvent::kMaxSplits;
+
+class GcEventLogTest : public CommonTest {
+ public:
+  static GcEvent MakeEvent(uint64_t start_time_ns) {
+    GcEvent event;
+    memset(&event, 0, sizeof(event));
+    event.start_time_ns = start_time_ns;
+    event.duration_ns = 1000;
+    event.cause = kGcCauseExplicit;
+    event.gc_type = collector::kGcTypeFull;
+    return event;
+  }
+};
+
+TEST_F(GcEventLogTest, Wraparound) {
+  GcEventLog log;
+  base::TimingLogger timings("test", true, false);
+  for (size_t i = 0; i < kCapacity + 10; ++i) {
+    GcEvent event = MakeEvent(i);
+    log.Append(&event, "collector", timings);
+    EXPECT_EQ(i, event.sequence);
+  }
+  EXPECT_EQ(kCapacity + 10, log.GetEventCount());
+
+  // The 10 oldest events were overwritten.
+  std::vector<GcEvent> events;
+  log.GetEvents(0, &events);
+  ASSERT_EQ(kCapacity, events.size());
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(i + 10, events[i].sequence);
+    EXPECT_EQ(i + 10, events[i].start_time_ns);
+  }
+
+  events.clear();
+  log.GetEvents(kCapacity + 5, &events);
+  ASSERT_EQ(5U, events.size());
+  EXPECT_EQ(kCapacity + 5, events[0].sequence);
+  EXPECT_EQ(kCapacity + 9, events[4].sequence);
+
+  events.clear();
+  log.GetEvents(kCapacity + 10, &events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST_F(GcEventLogTest, Names) {
+  GcEventLog log;
+  base::TimingLogger timings("test", true, false);
+  timings.StartSplit("mark");
+  timings.EndSplit();
+  timings.StartSplit("sweep");
+  timings.EndSplit();
+  GcEvent first = MakeEvent(0);
+  log.Append(&first, "first collector", timings);
+  GcEvent second = MakeEvent(1);
+  log.Append(&second, "second collector", timings);
+
+  std::vector<std::string> names = log.GetNames();
+  ASSERT_EQ(4U, names.size());
+  ASSERT_LT(first.collector, names.size());
+  ASSERT_LT(second.collector, names.size());
+  EXPECT_EQ("first collector", names[first.collector]);
+  EXPECT_EQ("second collector", names[second.collector]);
+  // Both collections share the split labels.
+  ASSERT_EQ(2U, second.num_splits);
+  EXPECT_EQ(first.splits[0].label, second.splits[0].label);
+  EXPECT_EQ(first.splits[1].label, second.splits[1].label);
+  EXPECT_EQ("mark", names[second.splits[0].label]);
+  EXPECT_EQ("sweep", names[second.splits[1].label]);
+}
+
+TEST_F(GcEventLogTest, SplitOverflow) {
+  GcEventLog log;
+  base::TimingLogger timings("test", true, false);
+  for (size_t i = 0; i < kMaxSplits + 3; ++i) {
+    timings.StartSplit("split");
+    timings.EndSplit();
+  }
+  GcEvent event = MakeEvent(0);
+  log.Append(&event, "collector", timings);
+
+  // The splits past the last one are added to it.
+  ASSERT_EQ(kMaxSplits, event.num_splits);
+  uint64_t total_ns = 0;
+  for (size_t i = 0; i < event.num_splits; ++i) {
+    total_ns += event.splits[i].duration_ns;
+  }
+  EXPECT_EQ(timings.GetTotalNs(), total_ns);
+}
+
+TEST_F(GcEventLogTest, Flattening) {
+  GcEventLog log;
+  base::TimingLogger timings("test", true, false);
+  timings.StartSplit("mark");
+  timings.EndSplit();
+  GcEvent event = MakeEvent(42);
+  event.num_pauses = 2;
+  event.pause_ns[0] = 100;
+  event.pause_ns[1] = 200;
+  event.freed_objects = 3;
+  event.freed_bytes = 4;
+  event.bytes_allocated_before = 5;
+  event.bytes_allocated_after = 6;
+  event.total_memory_after = 7;
+  log.Append(&event, "collector", timings);
+  GcEvent other = MakeEvent(43);
+  log.Append(&other, "collector", timings);
+
+  std::vector<int64_t> flattened;
+  log.GetEvents(0, &flattened);
+  ASSERT_EQ(2 * kFlattenedEventSize, flattened.size());
+  EXPECT_EQ(0, flattened[0]);
+  EXPECT_EQ(42, flattened[1]);
+  EXPECT_EQ(1000, flattened[2]);
+  EXPECT_EQ(static_cast<int64_t>(kGcCauseExplicit), flattened[3]);
+  EXPECT_EQ(static_cast<int64_t>(collector::kGcTypeFull), flattened[4]);
+  EXPECT_EQ(static_cast<int64_t>(event.collector), flattened[5]);
+  EXPECT_EQ(2, flattened[6]);
+  EXPECT_EQ(100, flattened[7]);
+  EXPECT_EQ(200, flattened[8]);
+  for (size_t i = 2; i < kMaxPauses; ++i) {
+    EXPECT_EQ(0, flattened[7 + i]);
+  }
+  const size_t after_pauses = 7 + kMaxPauses;
+  EXPECT_EQ(3, flattened[after_pauses]);
+  EXPECT_EQ(4, flattened[after_pauses + 1]);
+  EXPECT_EQ(5, flattened[after_pauses + 2]);
+  EXPECT_EQ(6, flattened[after_pauses + 3]);
+  EXPECT_EQ(7, flattened[after_pauses + 4]);
+  EXPECT_EQ(1, flattened[after_pauses + 5]);
+  const size_t splits = after_pauses + 6;
+  EXPECT_EQ(static_cast<int64_t>(event.splits[0].label), flattened[splits]);
+  EXPECT_EQ(static_cast<int64_t>(event.splits[0].duration_ns), flattened[splits + 1]);
+  // Unused splits are zeroed.
+  for (size_t i = splits + 2; i < kFlattenedEventSize; ++i) {
+    EXPECT_EQ(0, flattened[i]);
+  }
+  // The second event starts right after the first.
+  EXPECT_EQ(1, flattened[kFlattenedEventSize]);
+  EXPECT_EQ(43, flattened[kFlattenedEventSize + 1]);
+
+  // Flattening starts at the requested sequence too.
+  flattened.clear();
+  log.GetEvents(1, &flattened);
+  ASSERT_EQ(kFlattenedEventSize, flattened.size());
+  EXPECT_EQ(1, flattened[0]);
+}
+
+TEST_F(GcEventLogTest, DumpJsonWithoutCollectors) {
+  GcEventLog log;
+  std::ostringstream os;
+  log.DumpJson(os, std::vector<collector::GarbageCollector*>());
+  EXPECT_EQ("{\"events\":[],\"pause_histograms\":{}}\n", os.str());
+}
+
+}  // namespace gc
+}  // namespace art
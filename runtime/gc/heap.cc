@@ -23,8 +23,11 @@
 #include <vector>
 #include <valgrind.h>
 
+#include "atomic.h"
+#include "base/histogram-inl.h"
 #include "base/stl_util.h"
 #include "common_throws.h"
+#include "cutils/atomic-inline.h"
 #include "cutils/sched_policy.h"
 #include "debugger.h"
 #include "gc/accounting/atomic_stack.h"
@@ -32,12 +35,16 @@
 #include "gc/accounting/heap_bitmap-inl.h"
 #include "gc/accounting/mod_union_table-inl.h"
 #include "gc/accounting/space_bitmap-inl.h"
+#include "gc/allocation_profiler.h"
+#include "gc/collector/compactor.h"
 #include "gc/collector/mark_sweep-inl.h"
 #include "gc/collector/partial_mark_sweep.h"
 #include "gc/collector/sticky_mark_sweep.h"
+#include "gc/gc_event_log.h"
 #include "gc/space/dlmalloc_space-inl.h"
 #include "gc/space/image_space.h"
 #include "gc/space/large_object_space.h"
+#include "gc/space/rosalloc_space-inl.h"
 #include "gc/space/space-inl.h"
 #include "image.h"
 #include "invoke_arg_array_builder.h"
@@ -65,34 +72,67 @@ static constexpr bool kDumpGcPerformanceOnShutdown = false;
 static constexpr size_t kMinConcurrentRemainingBytes = 128 * KB;
 // If true, measure the total allocation time.
 static constexpr bool kMeasureAllocationTime = false;
-
-Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max_free,
-           double target_utilization, size_t capacity, const std::string& original_image_file_name,
-           bool concurrent_gc, size_t parallel_gc_threads, size_t conc_gc_threads,
-           bool low_memory_mode, size_t long_pause_log_threshold, size_t long_gc_log_threshold,
-           bool ignore_max_footprint)
+// If true, small objects are allocated from a per thread buffer carved out of the alloc space.
+static constexpr bool kUseThreadLocalAllocationBuffers = true;
+// Native bytes a thread registers or frees before they are added to the heap's total.
+static constexpr int kNativeAllocationFlushBytes = 256 * KB;
+// Number of allocation stack slots handed out to a thread when its current segment is full.
+static constexpr size_t kThreadLocalAllocationStackSize = 128;
+// Size of the buffer handed out to a thread when its current one is exhausted.
+static constexpr size_t kThreadLocalAllocationBufferSize = 32 * KB;
+// Objects larger than this always take the shared allocation path so that a few big allocations
+// don't waste the tail of the buffer.
+static constexpr size_t kMaxThreadLocalAllocationSize = 2 * KB;
+// Compaction is skipped unless the alloc space has at least this many free bytes.
+static constexpr size_t kMinCompactionFreeBytes = 1 * MB;
+// A step of the alloc space isn't trimmed again until this many milliseconds after its last trim.
+static constexpr uint64_t kHeapTrimStepIntervalMs = 10 * 1000;
+// Weight of the latest collection in the moving average of the time spent collecting.
+static constexpr double kGcTimeFractionWeight = 0.3;
+// Factor by which the ergonomics grow or shrink the heap scales after a collection.
+static constexpr double kErgonomicsScaleStep = 1.25;
+// Bounds of the scale applied to the free space by the ergonomics.
+static constexpr double kMinFreeScale = 0.25;
+static constexpr double kMaxFreeScale = 8.0;
+// Bound of the scale applied to the bytes allocated during a concurrent collection.
+static constexpr double kMaxConcurrentStartScale = 4.0;
+// Percentile of the pauses of a collector compared against the pause goal.
+static constexpr double kPauseGoalPercentile = 0.9;
+
+Heap::Heap(const HeapOptions& options)
     : alloc_space_(NULL),
+      use_rosalloc_(false),
       card_table_(NULL),
-      concurrent_gc_(concurrent_gc),
-      parallel_gc_threads_(parallel_gc_threads),
-      conc_gc_threads_(conc_gc_threads),
-      low_memory_mode_(low_memory_mode),
-      long_pause_log_threshold_(long_pause_log_threshold),
-      long_gc_log_threshold_(long_gc_log_threshold),
-      ignore_max_footprint_(ignore_max_footprint),
+      concurrent_gc_(options.concurrent_gc),
+      parallel_gc_threads_(options.parallel_gc_threads),
+      conc_gc_threads_(options.conc_gc_threads),
+      low_memory_mode_(options.low_memory_mode),
+      long_pause_log_threshold_(options.long_pause_log_threshold),
+      long_gc_log_threshold_(options.long_gc_log_threshold),
+      ignore_max_footprint_(options.ignore_max_footprint),
       have_zygote_space_(false),
       soft_ref_queue_lock_(NULL),
       weak_ref_queue_lock_(NULL),
       finalizer_ref_queue_lock_(NULL),
       phantom_ref_queue_lock_(NULL),
+      reference_processor_lock_(NULL),
+      concurrent_reference_processing_(false),
+      soft_ref_lru_policy_ms_per_mb_(options.soft_ref_lru_policy_ms_per_mb),
+      soft_reference_timestamp_offset_(0),
+      soft_reference_clock_ms_(NsToMs(NanoTime())),
+      soft_reference_max_age_ms_(0),
+      reference_processing_slow_path_(false),
+      referent_marked_tester_(NULL),
+      referent_marked_arg_(NULL),
       is_gc_running_(false),
+      thread_pool_borrowed_(false),
       last_gc_type_(collector::kGcTypeNone),
       next_gc_type_(collector::kGcTypePartial),
-      capacity_(capacity),
-      growth_limit_(growth_limit),
-      max_allowed_footprint_(initial_size),
-      native_footprint_gc_watermark_(initial_size),
-      native_footprint_limit_(2 * initial_size),
+      capacity_(options.capacity),
+      growth_limit_(options.growth_limit),
+      max_allowed_footprint_(options.initial_size),
+      native_footprint_gc_watermark_(options.initial_size),
+      native_footprint_limit_(2 * options.initial_size),
       activity_thread_class_(NULL),
       application_thread_class_(NULL),
       activity_thread_(NULL),
@@ -101,7 +141,7 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
       // Initially care about pauses in case we never get notified of process states, or if the JNI
       // code becomes broken.
       care_about_pause_times_(true),
-      concurrent_start_bytes_(concurrent_gc_ ? initial_size - kMinConcurrentRemainingBytes
+      concurrent_start_bytes_(concurrent_gc_ ? options.initial_size - kMinConcurrentRemainingBytes
           :  std::numeric_limits<size_t>::max()),
       total_bytes_freed_ever_(0),
       total_objects_freed_ever_(0),
@@ -117,6 +157,11 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
       min_alloc_space_size_for_sticky_gc_(2 * MB),
       min_remaining_space_for_sticky_gc_(1 * MB),
       last_trim_time_ms_(0),
+      heap_trim_step_size_(RoundUp(options.heap_trim_step_size, kPageSize)),
+      heap_trim_budget_(options.heap_trim_budget),
+      heap_trim_lock_(NULL),
+      trim_space_(NULL),
+      trim_cursor_(0),
       allocation_rate_(0),
       /* For GC a lot mode, we limit the allocations stacks to be kGcAlotInterval allocations. This
        * causes a lot of GC since we do a GC for alloc whenever the stack is full. When heap
@@ -130,9 +175,15 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
       reference_queueNext_offset_(0),
       reference_pendingNext_offset_(0),
       finalizer_reference_zombie_offset_(0),
-      min_free_(min_free),
-      max_free_(max_free),
-      target_utilization_(target_utilization),
+      min_free_(options.min_free),
+      max_free_(options.max_free),
+      target_utilization_(options.target_utilization),
+      pause_goal_ns_(MsToNs(options.pause_goal_ms)),
+      gc_time_ratio_(options.gc_time_ratio),
+      gc_time_fraction_(0.0),
+      free_scale_(1.0),
+      concurrent_start_scale_(1.0),
+      current_gc_cause_(kGcCauseBackground),
       total_wait_time_(0),
       total_allocation_time_(0),
       verify_object_mode_(kHeapVerificationNotPermitted),
@@ -146,7 +197,7 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
 
   // Requested begin for the alloc space, to follow the mapped image and oat files
   byte* requested_alloc_space_begin = NULL;
-  std::string image_file_name(original_image_file_name);
+  const std::string& image_file_name = options.image_file_name;
   if (!image_file_name.empty()) {
     space::ImageSpace* image_space = space::ImageSpace::Create(image_file_name);
     CHECK(image_space != NULL) << "Failed to create space for " << image_file_name;
@@ -162,18 +213,27 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
     }
   }
 
-  alloc_space_ = space::DlMallocSpace::Create(Runtime::Current()->IsZygote() ? "zygote space" : "alloc space",
-                                              initial_size,
-                                              growth_limit, capacity,
-                                              requested_alloc_space_begin);
+  const char* alloc_space_name = Runtime::Current()->IsZygote() ? "zygote space" : "alloc space";
+  // Valgrind only knows about the red zones of the dlmalloc space.
+  if (options.use_rosalloc && !running_on_valgrind_) {
+    alloc_space_ = space::RosAllocSpace::Create(alloc_space_name, options.initial_size,
+                                                options.growth_limit, options.capacity,
+                                                requested_alloc_space_begin);
+  } else {
+    alloc_space_ = space::DlMallocSpace::Create(alloc_space_name, options.initial_size,
+                                                options.growth_limit, options.capacity,
+                                                requested_alloc_space_begin);
+  }
   CHECK(alloc_space_ != NULL) << "Failed to create alloc space";
   alloc_space_->SetFootprintLimit(alloc_space_->Capacity());
   AddContinuousSpace(alloc_space_);
 
-  // Allocate the large object space.
-  const bool kUseFreeListSpaceForLOS = false;
-  if (kUseFreeListSpaceForLOS) {
-    large_object_space_ = space::FreeListSpace::Create("large object space", NULL, capacity);
+  // Allocate the large object space. The free list space reserves as much address space as the
+  // alloc space up front, so it is only used when asked for.
+  if (options.free_list_large_object_space) {
+    large_object_space_ = space::FreeListSpace::Create("large object space", NULL,
+                                                       options.capacity,
+                                                       options.large_object_huge_pages);
   } else {
     large_object_space_ = space::LargeObjectMapSpace::Create("large object space");
   }
@@ -183,8 +243,8 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
   // Compute heap capacity. Continuous spaces are sorted in order of Begin().
   byte* heap_begin = continuous_spaces_.front()->Begin();
   size_t heap_capacity = continuous_spaces_.back()->End() - continuous_spaces_.front()->Begin();
-  if (continuous_spaces_.back()->IsDlMallocSpace()) {
-    heap_capacity += continuous_spaces_.back()->AsDlMallocSpace()->NonGrowthLimitCapacity();
+  if (continuous_spaces_.back()->IsMallocSpace()) {
+    heap_capacity += continuous_spaces_.back()->AsMallocSpace()->NonGrowthLimitCapacity();
   }
 
   // Allocate the card table.
@@ -207,6 +267,13 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
                                                           max_allocation_stack_size_));
   live_stack_.reset(accounting::ObjectStack::Create("live stack",
                                                     max_allocation_stack_size_));
+  tenured_allocation_stack_.reset(accounting::ObjectStack::Create("tenured allocation stack",
+                                                                  max_allocation_stack_size_));
+  tenured_live_stack_.reset(accounting::ObjectStack::Create("tenured live stack",
+                                                            max_allocation_stack_size_));
+  if (options.allocation_site_pretenuring) {
+    allocation_sites_.reset(new accounting::AllocationSiteTable);
+  }
 
   // It's still too early to take a lock because there are no threads yet, but we can create locks
   // now. We don't create it earlier to make it clear that you can't use locks during heap
@@ -221,6 +288,15 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
   finalizer_ref_queue_lock_ = new Mutex("Finalizer reference queue lock");
   phantom_ref_queue_lock_ = new Mutex("Phantom reference queue lock");
 
+  reference_processor_lock_ = new Mutex("Reference processor lock");
+  reference_processor_cond_.reset(new ConditionVariable("Reference processor condition variable",
+                                                        *reference_processor_lock_));
+
+  heap_trim_lock_ = new Mutex("Heap trim lock");
+
+  gc_event_log_.reset(new GcEventLog);
+  allocation_profiler_.reset(new AllocationProfiler(options.allocation_profile_interval));
+
   last_gc_time_ns_ = NanoTime();
   last_gc_size_ = GetBytesAllocated();
 
@@ -236,6 +312,7 @@ Heap::Heap(size_t initial_size, size_t growth_limit, size_t min_free, size_t max
     mark_sweep_collectors_.push_back(new collector::PartialMarkSweep(this, concurrent));
     mark_sweep_collectors_.push_back(new collector::StickyMarkSweep(this, concurrent));
   }
+  compactor_.reset(new collector::Compactor(this));
 
   CHECK_NE(max_allowed_footprint_, 0U);
   if (VLOG_IS_ON(heap) || VLOG_IS_ON(startup)) {
@@ -380,8 +457,9 @@ void Heap::AddContinuousSpace(space::ContinuousSpace* space) {
   DCHECK(space->GetMarkBitmap() != NULL);
   mark_bitmap_->AddContinuousSpaceBitmap(space->GetMarkBitmap());
   continuous_spaces_.push_back(space);
-  if (space->IsDlMallocSpace() && !space->IsLargeObjectSpace()) {
-    alloc_space_ = space->AsDlMallocSpace();
+  if (space->IsMallocSpace() && !space->IsLargeObjectSpace()) {
+    alloc_space_ = space->AsMallocSpace();
+    use_rosalloc_ = alloc_space_->IsRosAllocSpace();
   }
 
   // Ensure that spaces remain sorted in increasing order of start address (required for CMS finger)
@@ -400,7 +478,7 @@ void Heap::AddContinuousSpace(space::ContinuousSpace* space) {
     } else if (space->IsZygoteSpace()) {
       DCHECK(!seen_alloc);
       seen_zygote = true;
-    } else if (space->IsDlMallocSpace()) {
+    } else if (space->IsMallocSpace()) {
       seen_alloc = true;
     }
   }
@@ -428,6 +506,15 @@ void Heap::AddDiscontinuousSpace(space::DiscontinuousSpace* space) {
   discontinuous_spaces_.push_back(space);
 }
 
+std::vector<collector::GarbageCollector*> Heap::GetCollectors() const {
+  std::vector<collector::GarbageCollector*> collectors(mark_sweep_collectors_.begin(),
+                                                       mark_sweep_collectors_.end());
+  if (compactor_.get() != NULL) {
+    collectors.push_back(compactor_.get());
+  }
+  return collectors;
+}
+
 void Heap::DumpGcPerformanceInfo(std::ostream& os) {
   // Dump cumulative timings.
   os << "Dumping cumulative Gc timings\n";
@@ -435,7 +522,7 @@ void Heap::DumpGcPerformanceInfo(std::ostream& os) {
 
   // Dump cumulative loggers for each GC type.
   uint64_t total_paused_time = 0;
-  for (const auto& collector : mark_sweep_collectors_) {
+  for (const auto& collector : GetCollectors()) {
     CumulativeLogger& logger = collector->GetCumulativeTimings();
     if (logger.GetTotalNs() != 0) {
       os << Dumpable<CumulativeLogger>(logger);
@@ -450,6 +537,13 @@ void Heap::DumpGcPerformanceInfo(std::ostream& os) {
          << " objects with total size " << PrettySize(freed_bytes) << "\n"
          << collector->GetName() << " throughput: " << freed_objects / seconds << "/s / "
          << PrettySize(freed_bytes / seconds) << "/s\n";
+      Histogram<uint64_t>& pause_histogram = collector->GetPauseHistogram();
+      if (pause_histogram.SampleSize() != 0) {
+        Histogram<uint64_t>::CumulativeData cumulative_data;
+        pause_histogram.CreateHistogram(cumulative_data);
+        os << collector->GetName() << " pauses: ";
+        pause_histogram.PrintConfidenceIntervals(os, 0.99, cumulative_data);
+      }
       total_duration += total_ns;
       total_paused_time += total_pause_ns;
     }
@@ -472,6 +566,9 @@ void Heap::DumpGcPerformanceInfo(std::ostream& os) {
     os << "Mean allocation time: " << PrettyDuration(allocation_time / total_objects_allocated)
        << "\n";
   }
+  if (allocation_sites_.get() != NULL) {
+    allocation_sites_->Dump(os);
+  }
   os << "Total mutator paused time: " << PrettyDuration(total_paused_time) << "\n";
   os << "Total time waiting for GC to complete: " << PrettyDuration(total_wait_time_) << "\n";
   os << "Approximate GC data structures memory overhead: " << gc_memory_overhead_;
@@ -487,6 +584,8 @@ Heap::~Heap() {
   // If we don't reset then the mark stack complains in it's destructor.
   allocation_stack_->Reset();
   live_stack_->Reset();
+  tenured_allocation_stack_->Reset();
+  tenured_live_stack_->Reset();
 
   VLOG(heap) << "~Heap()";
   // We can't take the heap lock here because there might be a daemon thread suspended with the
@@ -500,6 +599,8 @@ Heap::~Heap() {
   delete weak_ref_queue_lock_;
   delete finalizer_ref_queue_lock_;
   delete phantom_ref_queue_lock_;
+  delete reference_processor_lock_;
+  delete heap_trim_lock_;
 }
 
 space::ContinuousSpace* Heap::FindContinuousSpaceFromObject(const mirror::Object* obj,
@@ -554,7 +655,8 @@ static void MSpaceChunkCallback(void* start, void* end, size_t used_bytes, void*
   }
 }
 
-mirror::Object* Heap::AllocObject(Thread* self, mirror::Class* c, size_t byte_count) {
+mirror::Object* Heap::AllocObjectInternal(Thread* self, mirror::Class* c, size_t byte_count,
+                                          bool tenured) {
   DCHECK(c == NULL || (c->IsClassClass() && byte_count >= sizeof(mirror::Class)) ||
          (c->IsVariableSize() || c->GetObjectSize() == byte_count) ||
          strlen(ClassHelper(c).GetDescriptor()) == 0);
@@ -562,6 +664,7 @@ mirror::Object* Heap::AllocObject(Thread* self, mirror::Class* c, size_t byte_co
 
   mirror::Object* obj = NULL;
   size_t bytes_allocated = 0;
+  bool thread_local_allocation = false;
   uint64_t allocation_start = 0;
   if (UNLIKELY(kMeasureAllocationTime)) {
     allocation_start = NanoTime() / kTimeAdjust;
@@ -581,7 +684,18 @@ mirror::Object* Heap::AllocObject(Thread* self, mirror::Class* c, size_t byte_co
            reinterpret_cast<byte*>(obj) < continuous_spaces_.front()->Begin() ||
            reinterpret_cast<byte*>(obj) >= continuous_spaces_.back()->End());
   } else {
-    obj = Allocate(self, alloc_space_, byte_count, &bytes_allocated);
+    if (use_rosalloc_) {
+      // RosAlloc hands out slots from runs owned by the thread, no buffer is needed on top.
+      obj = Allocate(self, alloc_space_->AsRosAllocSpace(), byte_count, &bytes_allocated);
+    } else {
+      if (kUseThreadLocalAllocationBuffers && !running_on_valgrind_) {
+        obj = AllocateThreadLocal(self, byte_count, &bytes_allocated);
+        thread_local_allocation = obj != NULL;
+      }
+      if (!thread_local_allocation) {
+        obj = Allocate(self, alloc_space_->AsDlMallocSpace(), byte_count, &bytes_allocated);
+      }
+    }
     // Ensure that we did not allocate into a zygote space.
     DCHECK(obj == NULL || !have_zygote_space_ || !FindSpaceFromObject(obj, false)->IsZygoteSpace());
   }
@@ -591,11 +705,34 @@ mirror::Object* Heap::AllocObject(Thread* self, mirror::Class* c, size_t byte_co
 
     // Record allocation after since we want to use the atomic add for the atomic fence to guard
     // the SetClass since we do not want the class to appear NULL in another thread.
-    RecordAllocation(bytes_allocated, obj);
+    // Only objects in the alloc space can be tenured.
+    tenured = tenured && !large_object_allocation;
+    RecordAllocation(self, bytes_allocated, obj, thread_local_allocation, tenured);
 
     if (Dbg::IsAllocTrackingEnabled()) {
       Dbg::RecordAllocation(c, byte_count);
     }
+    // The allocation profiler and the allocation site table take their samples from the same
+    // countdown, which is at the rate of the profiler while it runs.
+    const bool profiling = allocation_profiler_->GetSampleInterval() != 0;
+    if (UNLIKELY(profiling) || allocation_sites_.get() != NULL) {
+      const size_t sample_bytes = self->GetAllocationSampleBytes();
+      if (UNLIKELY(sample_bytes <= bytes_allocated)) {
+        self->SetAllocationSampleBytes(profiling ? allocation_profiler_->NextSampleBytes()
+            : accounting::AllocationSiteTable::kSampleIntervalBytes);
+        // A thread which hasn't counted yet starts its countdown rather than taking a sample.
+        if (sample_bytes != 0) {
+          if (profiling) {
+            allocation_profiler_->SampleAllocation(self, c, bytes_allocated);
+          }
+          if (allocation_sites_.get() != NULL && !tenured && !large_object_allocation) {
+            allocation_sites_->SampleAllocation(self, obj);
+          }
+        }
+      } else {
+        self->SetAllocationSampleBytes(sample_bytes - bytes_allocated);
+      }
+    }
     if (UNLIKELY(static_cast<size_t>(num_bytes_allocated_) >= concurrent_start_bytes_)) {
       // The SirtRef is necessary since the calls in RequestConcurrentGC are a safepoint.
       SirtRef<mirror::Object> ref(self, obj);
@@ -619,8 +756,8 @@ mirror::Object* Heap::AllocObject(Thread* self, mirror::Class* c, size_t byte_co
     if (!large_object_allocation && total_bytes_free >= byte_count) {
       size_t max_contiguous_allocation = 0;
       for (const auto& space : continuous_spaces_) {
-        if (space->IsDlMallocSpace()) {
-          space->AsDlMallocSpace()->Walk(MSpaceChunkCallback, &max_contiguous_allocation);
+        if (space->IsMallocSpace()) {
+          space->AsMallocSpace()->Walk(MSpaceChunkCallback, &max_contiguous_allocation);
         }
       }
       oss << "; failed due to fragmentation (largest possible contiguous allocation "
@@ -671,20 +808,24 @@ bool Heap::IsLiveObjectLocked(const mirror::Object* obj, bool search_allocation_
 
     if (search_allocation_stack) {
       if (sorted) {
-        if (allocation_stack_->ContainsSorted(const_cast<mirror::Object*>(obj))) {
+        if (allocation_stack_->ContainsSorted(const_cast<mirror::Object*>(obj)) ||
+            tenured_allocation_stack_->ContainsSorted(const_cast<mirror::Object*>(obj))) {
           return true;
         }
-      } else if (allocation_stack_->Contains(const_cast<mirror::Object*>(obj))) {
+      } else if (allocation_stack_->Contains(const_cast<mirror::Object*>(obj)) ||
+                 tenured_allocation_stack_->Contains(const_cast<mirror::Object*>(obj))) {
         return true;
       }
     }
 
     if (search_live_stack) {
       if (sorted) {
-        if (live_stack_->ContainsSorted(const_cast<mirror::Object*>(obj))) {
+        if (live_stack_->ContainsSorted(const_cast<mirror::Object*>(obj)) ||
+            tenured_live_stack_->ContainsSorted(const_cast<mirror::Object*>(obj))) {
           return true;
         }
-      } else if (live_stack_->Contains(const_cast<mirror::Object*>(obj))) {
+      } else if (live_stack_->Contains(const_cast<mirror::Object*>(obj)) ||
+                 tenured_live_stack_->Contains(const_cast<mirror::Object*>(obj))) {
         return true;
       }
     }
@@ -771,13 +912,16 @@ void Heap::VerifyHeap() {
   GetLiveBitmap()->Walk(Heap::VerificationCallback, this);
 }
 
-inline void Heap::RecordAllocation(size_t size, mirror::Object* obj) {
+inline void Heap::RecordAllocation(Thread* self, size_t size, mirror::Object* obj,
+                                   bool thread_local, bool tenured) {
   DCHECK(obj != NULL);
   DCHECK_GT(size, 0u);
-  num_bytes_allocated_.fetch_add(size);
+  if (!thread_local) {
+    num_bytes_allocated_.fetch_add(size);
+  }
 
   if (Runtime::Current()->HasStatsEnabled()) {
-    RuntimeStats* thread_stats = Thread::Current()->GetStats();
+    RuntimeStats* thread_stats = self->GetStats();
     ++thread_stats->allocated_objects;
     thread_stats->allocated_bytes += size;
 
@@ -789,8 +933,12 @@ inline void Heap::RecordAllocation(size_t size, mirror::Object* obj) {
 
   // This is safe to do since the GC will never free objects which are neither in the allocation
   // stack or the live bitmap.
-  while (!allocation_stack_->AtomicPushBack(obj)) {
-    CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseForAlloc, false);
+  if (UNLIKELY(tenured)) {
+    while (!tenured_allocation_stack_->AtomicPushBack(obj)) {
+      CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseForAlloc, false);
+    }
+  } else if (UNLIKELY(!self->PushOnThreadLocalAllocationStack(obj))) {
+    PushOnNewThreadLocalAllocationStack(self, obj);
   }
 }
 
@@ -848,6 +996,15 @@ inline mirror::Object* Heap::TryToAllocate(Thread* self, space::DlMallocSpace* s
   }
 }
 
+// RosAllocSpace-specific version.
+inline mirror::Object* Heap::TryToAllocate(Thread* self, space::RosAllocSpace* space,
+                                           size_t alloc_size, bool grow, size_t* bytes_allocated) {
+  if (UNLIKELY(IsOutOfMemoryOnAllocation(alloc_size, grow))) {
+    return NULL;
+  }
+  return space->AllocNonvirtual(self, alloc_size, bytes_allocated);
+}
+
 template <class T>
 inline mirror::Object* Heap::Allocate(Thread* self, T* space, size_t alloc_size,
                                       size_t* bytes_allocated) {
@@ -863,6 +1020,63 @@ inline mirror::Object* Heap::Allocate(Thread* self, T* space, size_t alloc_size,
   return AllocateInternalWithGc(self, space, alloc_size, bytes_allocated);
 }
 
+inline mirror::Object* Heap::AllocateThreadLocal(Thread* self, size_t alloc_size,
+                                                 size_t* bytes_allocated) {
+  space::DlMallocSpace* alloc_space = alloc_space_->AsDlMallocSpace();
+  mirror::Object* ptr = alloc_space->AllocThreadLocal(self, alloc_size, bytes_allocated);
+  if (LIKELY(ptr != NULL) || alloc_size > kMaxThreadLocalAllocationSize) {
+    return ptr;
+  }
+  // The current buffer is exhausted, hand its tail back and carve a new one. The whole buffer
+  // counts as allocated so that the GC triggers remain accurate.
+  RevokeThreadLocalBuffer(self);
+  if (UNLIKELY(IsOutOfMemoryOnAllocation(kThreadLocalAllocationBufferSize, false))) {
+    return NULL;
+  }
+  size_t buffer_bytes_allocated = 0;
+  ptr = alloc_space->AllocWithNewThreadLocalBuffer(self, alloc_size,
+                                                    kThreadLocalAllocationBufferSize,
+                                                    bytes_allocated, &buffer_bytes_allocated);
+  if (buffer_bytes_allocated != 0) {
+    num_bytes_allocated_.fetch_add(buffer_bytes_allocated);
+  }
+  return ptr;
+}
+
+void Heap::RevokeThreadLocalBuffer(Thread* thread) {
+  size_t unused_bytes = alloc_space_->RevokeThreadLocalBuffer(thread);
+  if (unused_bytes != 0) {
+    DCHECK_LE(unused_bytes, static_cast<size_t>(num_bytes_allocated_));
+    num_bytes_allocated_.fetch_sub(unused_bytes);
+  }
+}
+
+void Heap::RevokeAllThreadLocalBuffers() {
+  MutexLock mu(Thread::Current(), *Locks::thread_list_lock_);
+  for (Thread* thread : Runtime::Current()->GetThreadList()->GetList()) {
+    RevokeThreadLocalBuffer(thread);
+  }
+}
+
+void Heap::RevokeAllThreadLocalAllocationStacks() {
+  MutexLock mu(Thread::Current(), *Locks::thread_list_lock_);
+  for (Thread* thread : Runtime::Current()->GetThreadList()->GetList()) {
+    thread->RevokeThreadLocalAllocationStack();
+  }
+}
+
+void Heap::PushOnNewThreadLocalAllocationStack(Thread* self, mirror::Object* obj) {
+  mirror::Object** start;
+  mirror::Object** end;
+  while (!allocation_stack_->AtomicBumpBack(kThreadLocalAllocationStackSize, &start, &end)) {
+    // The collection revokes the segment of every thread, including ours.
+    CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseForAlloc, false);
+  }
+  self->SetThreadLocalAllocationStack(start, end);
+  bool pushed = self->PushOnThreadLocalAllocationStack(obj);
+  DCHECK(pushed);
+}
+
 mirror::Object* Heap::AllocateInternalWithGc(Thread* self, space::AllocSpace* space,
                                              size_t alloc_size, size_t* bytes_allocated) {
   mirror::Object* ptr;
@@ -953,8 +1167,8 @@ size_t Heap::GetObjectsAllocated() const {
   typedef std::vector<space::ContinuousSpace*>::const_iterator It;
   for (It it = continuous_spaces_.begin(), end = continuous_spaces_.end(); it != end; ++it) {
     space::ContinuousSpace* space = *it;
-    if (space->IsDlMallocSpace()) {
-      total += space->AsDlMallocSpace()->GetObjectsAllocated();
+    if (space->IsMallocSpace()) {
+      total += space->AsMallocSpace()->GetObjectsAllocated();
     }
   }
   typedef std::vector<space::DiscontinuousSpace*>::const_iterator It2;
@@ -970,8 +1184,8 @@ size_t Heap::GetObjectsAllocatedEver() const {
   typedef std::vector<space::ContinuousSpace*>::const_iterator It;
   for (It it = continuous_spaces_.begin(), end = continuous_spaces_.end(); it != end; ++it) {
     space::ContinuousSpace* space = *it;
-    if (space->IsDlMallocSpace()) {
-      total += space->AsDlMallocSpace()->GetTotalObjectsAllocated();
+    if (space->IsMallocSpace()) {
+      total += space->AsMallocSpace()->GetTotalObjectsAllocated();
     }
   }
   typedef std::vector<space::DiscontinuousSpace*>::const_iterator It2;
@@ -987,8 +1201,8 @@ size_t Heap::GetBytesAllocatedEver() const {
   typedef std::vector<space::ContinuousSpace*>::const_iterator It;
   for (It it = continuous_spaces_.begin(), end = continuous_spaces_.end(); it != end; ++it) {
     space::ContinuousSpace* space = *it;
-    if (space->IsDlMallocSpace()) {
-      total += space->AsDlMallocSpace()->GetTotalBytesAllocated();
+    if (space->IsMallocSpace()) {
+      total += space->AsMallocSpace()->GetTotalBytesAllocated();
     }
   }
   typedef std::vector<space::DiscontinuousSpace*>::const_iterator It2;
@@ -999,11 +1213,88 @@ size_t Heap::GetBytesAllocatedEver() const {
   return total;
 }
 
+template <typename Visitor>
+class VisitLiveObjectsTask : public Task {
+ public:
+  VisitLiveObjectsTask(accounting::SpaceBitmap* bitmap, uintptr_t begin, uintptr_t end,
+                       const Visitor* visitor)
+      : bitmap_(bitmap), begin_(begin), end_(end), visitor_(visitor) {
+  }
+
+  // TODO: Fix lock analysis to not use NO_THREAD_SAFETY_ANALYSIS, requires support for
+  // annotalysis on visitors.
+  virtual void Run(Thread* self) NO_THREAD_SAFETY_ANALYSIS {
+    bitmap_->VisitMarkedRange(begin_, end_, *visitor_);
+  }
+
+ private:
+  accounting::SpaceBitmap* const bitmap_;
+  const uintptr_t begin_;
+  const uintptr_t end_;
+  const Visitor* const visitor_;
+};
+
+template <typename Visitor, typename MakeVisitor>
+void Heap::VisitLiveObjectsParallel(Thread* self, MakeVisitor make_visitor,
+                                    std::vector<Visitor*>* visitors) {
+  // The thread pool belongs to the collectors, it is only borrowed while no GC is running. Not
+  // marking a GC as running keeps waiters for a GC from mistaking this visit for one.
+  bool use_thread_pool = false;
+  if (thread_pool_.get() != NULL) {
+    MutexLock mu(self, *gc_complete_lock_);
+    if (!is_gc_running_ && !thread_pool_borrowed_) {
+      thread_pool_borrowed_ = true;
+      use_thread_pool = true;
+    }
+  }
+  const size_t thread_count = use_thread_pool ? thread_pool_->GetThreadCount() + 1 : 1;
+  {
+    ReaderMutexLock mu(self, *Locks::heap_bitmap_lock_);
+    std::vector<VisitLiveObjectsTask<Visitor>*> tasks;
+    for (accounting::SpaceBitmap* bitmap : live_bitmap_->continuous_space_bitmaps_) {
+      const uintptr_t begin = bitmap->HeapBegin();
+      const uintptr_t end = bitmap->HeapLimit();
+      // Stripes are aligned so that every word of the bitmap belongs to a single stripe.
+      const uintptr_t stripe_size = RoundUp((end - begin) / thread_count + 1,
+                                            accounting::SpaceBitmap::kAlignment * kBitsPerWord);
+      for (uintptr_t stripe_begin = begin; stripe_begin < end; stripe_begin += stripe_size) {
+        const uintptr_t stripe_end = stripe_begin + std::min(stripe_size, end - stripe_begin);
+        visitors->push_back(make_visitor());
+        tasks.push_back(new VisitLiveObjectsTask<Visitor>(bitmap, stripe_begin, stripe_end,
+                                                          visitors->back()));
+        if (use_thread_pool) {
+          thread_pool_->AddTask(self, tasks.back());
+        } else {
+          tasks.back()->Run(self);
+        }
+      }
+    }
+    if (use_thread_pool) {
+      thread_pool_->SetMaxActiveWorkers(thread_count - 1);
+      thread_pool_->StartWorkers(self);
+      thread_pool_->Wait(self, true, true);
+      thread_pool_->StopWorkers(self);
+    }
+    STLDeleteElements(&tasks);
+
+    // The discontinuous spaces only hold large objects, too few to be worth splitting.
+    visitors->push_back(make_visitor());
+    for (accounting::SpaceSetMap* space_set : live_bitmap_->discontinuous_space_sets_) {
+      space_set->Visit(*visitors->back());
+    }
+  }
+  if (use_thread_pool) {
+    MutexLock mu(self, *gc_complete_lock_);
+    thread_pool_borrowed_ = false;
+    gc_complete_cond_->Broadcast(self);
+  }
+}
+
 class InstanceCounter {
  public:
-  InstanceCounter(const std::vector<mirror::Class*>& classes, bool use_is_assignable_from, uint64_t* counts)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-      : classes_(classes), use_is_assignable_from_(use_is_assignable_from), counts_(counts) {
+  InstanceCounter(const std::vector<mirror::Class*>& classes, bool use_is_assignable_from)
+      : classes_(classes), use_is_assignable_from_(use_is_assignable_from),
+        counts_(classes.size(), 0) {
   }
 
   void operator()(const mirror::Object* o) const SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
@@ -1021,10 +1312,15 @@ class InstanceCounter {
     }
   }
 
+  const std::vector<uint64_t>& GetCounts() const {
+    return counts_;
+  }
+
  private:
   const std::vector<mirror::Class*>& classes_;
   bool use_is_assignable_from_;
-  uint64_t* const counts_;
+  // Counted by the bitmap visit, which takes the visitor by const reference.
+  mutable std::vector<uint64_t> counts_;
 
   DISALLOW_COPY_AND_ASSIGN(InstanceCounter);
 };
@@ -1038,16 +1334,22 @@ void Heap::CountInstances(const std::vector<mirror::Class*>& classes, bool use_i
   CollectGarbage(false);
   self->TransitionFromSuspendedToRunnable();
 
-  InstanceCounter counter(classes, use_is_assignable_from, counts);
-  ReaderMutexLock mu(self, *Locks::heap_bitmap_lock_);
-  GetLiveBitmap()->Visit(counter);
+  std::vector<InstanceCounter*> counters;
+  VisitLiveObjectsParallel(self, [&classes, use_is_assignable_from]() {
+    return new InstanceCounter(classes, use_is_assignable_from);
+  }, &counters);
+  for (InstanceCounter* counter : counters) {
+    for (size_t i = 0; i < classes.size(); ++i) {
+      counts[i] += counter->GetCounts()[i];
+    }
+  }
+  STLDeleteElements(&counters);
 }
 
 class InstanceCollector {
  public:
-  InstanceCollector(mirror::Class* c, int32_t max_count, std::vector<mirror::Object*>& instances)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-      : class_(c), max_count_(max_count), instances_(instances) {
+  InstanceCollector(mirror::Class* c, int32_t max_count)
+      : class_(c), max_count_(max_count) {
   }
 
   void operator()(const mirror::Object* o) const SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
@@ -1059,14 +1361,33 @@ class InstanceCollector {
     }
   }
 
+  const std::vector<mirror::Object*>& GetFoundObjects() const {
+    return instances_;
+  }
+
  private:
   mirror::Class* class_;
   uint32_t max_count_;
-  std::vector<mirror::Object*>& instances_;
+  mutable std::vector<mirror::Object*> instances_;
 
   DISALLOW_COPY_AND_ASSIGN(InstanceCollector);
 };
 
+// Appends the objects found by each of the visitors, in order, as long as there are fewer than
+// max_count of them, or without limit if max_count is 0.
+template <typename Visitor>
+static void MergeFoundObjects(const std::vector<Visitor*>& visitors, int32_t max_count,
+                              std::vector<mirror::Object*>* objects) {
+  for (Visitor* visitor : visitors) {
+    for (mirror::Object* o : visitor->GetFoundObjects()) {
+      if (max_count != 0 && objects->size() >= static_cast<size_t>(max_count)) {
+        return;
+      }
+      objects->push_back(o);
+    }
+  }
+}
+
 void Heap::GetInstances(mirror::Class* c, int32_t max_count,
                         std::vector<mirror::Object*>& instances) {
   // We only want reachable instances, so do a GC. This also ensures that the alloc stack
@@ -1076,17 +1397,18 @@ void Heap::GetInstances(mirror::Class* c, int32_t max_count,
   CollectGarbage(false);
   self->TransitionFromSuspendedToRunnable();
 
-  InstanceCollector collector(c, max_count, instances);
-  ReaderMutexLock mu(self, *Locks::heap_bitmap_lock_);
-  GetLiveBitmap()->Visit(collector);
+  std::vector<InstanceCollector*> collectors;
+  VisitLiveObjectsParallel(self, [c, max_count]() {
+    return new InstanceCollector(c, max_count);
+  }, &collectors);
+  MergeFoundObjects(collectors, max_count, &instances);
+  STLDeleteElements(&collectors);
 }
 
 class ReferringObjectsFinder {
  public:
-  ReferringObjectsFinder(mirror::Object* object, int32_t max_count,
-                         std::vector<mirror::Object*>& referring_objects)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-      : object_(object), max_count_(max_count), referring_objects_(referring_objects) {
+  ReferringObjectsFinder(mirror::Object* object, int32_t max_count)
+      : object_(object), max_count_(max_count) {
   }
 
   // For bitmap Visit.
@@ -1104,10 +1426,14 @@ class ReferringObjectsFinder {
     }
   }
 
+  const std::vector<mirror::Object*>& GetFoundObjects() const {
+    return referring_objects_;
+  }
+
  private:
   mirror::Object* object_;
   uint32_t max_count_;
-  std::vector<mirror::Object*>& referring_objects_;
+  mutable std::vector<mirror::Object*> referring_objects_;
 
   DISALLOW_COPY_AND_ASSIGN(ReferringObjectsFinder);
 };
@@ -1121,9 +1447,12 @@ void Heap::GetReferringObjects(mirror::Object* o, int32_t max_count,
   CollectGarbage(false);
   self->TransitionFromSuspendedToRunnable();
 
-  ReferringObjectsFinder finder(o, max_count, referring_objects);
-  ReaderMutexLock mu(self, *Locks::heap_bitmap_lock_);
-  GetLiveBitmap()->Visit(finder);
+  std::vector<ReferringObjectsFinder*> finders;
+  VisitLiveObjectsParallel(self, [o, max_count]() {
+    return new ReferringObjectsFinder(o, max_count);
+  }, &finders);
+  MergeFoundObjects(finders, max_count, &referring_objects);
+  STLDeleteElements(&finders);
 }
 
 void Heap::CollectGarbage(bool clear_soft_references) {
@@ -1148,6 +1477,9 @@ void Heap::PreZygoteFork() {
 
   VLOG(heap) << "Starting PreZygoteFork with alloc space size " << PrettySize(alloc_space_->Size());
 
+  // Hand back any allocation buffers carved since the collection so that the zygote space doesn't
+  // end up with unused tails that the new alloc space can't reuse.
+  RevokeAllThreadLocalBuffers();
   {
     // Flush the alloc stack.
     WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
@@ -1156,7 +1488,7 @@ void Heap::PreZygoteFork() {
 
   // Turns the current alloc space into a Zygote space and obtain the new alloc space composed
   // of the remaining available heap memory.
-  space::DlMallocSpace* zygote_space = alloc_space_;
+  space::MallocSpace* zygote_space = alloc_space_;
   alloc_space_ = zygote_space->CreateZygoteSpace("alloc space");
   alloc_space_->SetFootprintLimit(alloc_space_->Capacity());
 
@@ -1172,9 +1504,14 @@ void Heap::PreZygoteFork() {
 }
 
 void Heap::FlushAllocStack() {
+  // Threads must not keep pushing into the segments of the stack once it is reset.
+  RevokeAllThreadLocalAllocationStacks();
   MarkAllocStack(alloc_space_->GetLiveBitmap(), large_object_space_->GetLiveObjects(),
                  allocation_stack_.get());
   allocation_stack_->Reset();
+  MarkAllocStack(alloc_space_->GetLiveBitmap(), large_object_space_->GetLiveObjects(),
+                 tenured_allocation_stack_.get());
+  tenured_allocation_stack_->Reset();
 }
 
 void Heap::MarkAllocStack(accounting::SpaceBitmap* bitmap, accounting::SpaceSetMap* large_objects,
@@ -1182,7 +1519,10 @@ void Heap::MarkAllocStack(accounting::SpaceBitmap* bitmap, accounting::SpaceSetM
   mirror::Object** limit = stack->End();
   for (mirror::Object** it = stack->Begin(); it != limit; ++it) {
     const mirror::Object* obj = *it;
-    DCHECK(obj != NULL);
+    if (UNLIKELY(obj == NULL)) {
+      // Unused slot of a thread's segment.
+      continue;
+    }
     if (LIKELY(bitmap->HasAddress(obj))) {
       bitmap->Set(obj);
     } else {
@@ -1216,6 +1556,10 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type, GcCaus
       if (!is_gc_running_) {
         is_gc_running_ = true;
         start_collect = true;
+        // The collectors need the thread pool back.
+        while (thread_pool_borrowed_) {
+          gc_complete_cond_->Wait(self);
+        }
       }
     }
     if (!start_collect) {
@@ -1268,9 +1612,13 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type, GcCaus
       << " and type=" << gc_type;
 
   collector->clear_soft_references_ = clear_soft_references;
+  current_gc_cause_ = gc_cause;
   collector->Run();
   total_objects_freed_ever_ += collector->GetFreedObjects();
   total_bytes_freed_ever_ += collector->GetFreedBytes();
+  RecordGcEvent(collector, gc_cause, gc_start_time_ns, gc_start_size,
+                collector->GetFreedObjects() + collector->GetFreedLargeObjects(),
+                collector->GetFreedBytes() + collector->GetFreedLargeObjectBytes());
   if (care_about_pause_times_) {
     const size_t duration = collector->GetDurationNs();
     std::vector<uint64_t> pauses = collector->GetPauseTimes();
@@ -1321,6 +1669,36 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type, GcCaus
   return gc_type;
 }
 
+void Heap::RecordGcEvent(collector::GarbageCollector* collector, GcCause gc_cause,
+                         uint64_t start_time_ns, uint64_t bytes_allocated_before,
+                         uint64_t freed_objects, uint64_t freed_bytes) {
+  GcEvent event;
+  event.start_time_ns = start_time_ns;
+  event.duration_ns = collector->GetDurationNs();
+  event.cause = gc_cause;
+  event.gc_type = collector->GetGcType();
+  const std::vector<uint64_t>& pauses = collector->GetPauseTimes();
+  event.num_pauses = pauses.size() < GcEvent::kMaxPauses ? pauses.size() : GcEvent::kMaxPauses;
+  std::fill(event.pause_ns, event.pause_ns + GcEvent::kMaxPauses, 0);
+  for (size_t i = 0; i < pauses.size(); ++i) {
+    event.pause_ns[std::min(i, GcEvent::kMaxPauses - 1)] += pauses[i];
+  }
+  event.freed_objects = freed_objects;
+  event.freed_bytes = freed_bytes;
+  event.bytes_allocated_before = bytes_allocated_before;
+  event.bytes_allocated_after = GetBytesAllocated();
+  event.total_memory_after = GetTotalMemory();
+  gc_event_log_->Append(&event, collector->GetName(), collector->GetTimings());
+}
+
+void Heap::DumpGcEvents(std::ostream& os, bool json) {
+  if (json) {
+    gc_event_log_->DumpJson(os, GetCollectors());
+  } else {
+    gc_event_log_->DumpCsv(os);
+  }
+}
+
 void Heap::UpdateAndMarkModUnion(collector::MarkSweep* mark_sweep, base::TimingLogger& timings,
                                  collector::GcType gc_type) {
   if (gc_type == collector::kGcTypeSticky) {
@@ -1330,10 +1708,12 @@ void Heap::UpdateAndMarkModUnion(collector::MarkSweep* mark_sweep, base::TimingL
   }
 
   base::TimingLogger::ScopedSplit split("UpdateModUnionTable", &timings);
+  const size_t thread_count =
+      mark_sweep->GetThreadCount(Locks::mutator_lock_->IsExclusiveHeld(Thread::Current()));
   // Update zygote mod union table.
   if (gc_type == collector::kGcTypePartial) {
     base::TimingLogger::ScopedSplit split("UpdateZygoteModUnionTable", &timings);
-    zygote_mod_union_table_->Update();
+    zygote_mod_union_table_->Update(thread_count);
 
     timings.NewSplit("ZygoteMarkReferences");
     zygote_mod_union_table_->MarkReferences(mark_sweep);
@@ -1341,7 +1721,7 @@ void Heap::UpdateAndMarkModUnion(collector::MarkSweep* mark_sweep, base::TimingL
 
   // Processes the cards we cleared earlier and adds their objects into the mod-union table.
   timings.NewSplit("UpdateModUnionTable");
-  image_mod_union_table_->Update();
+  image_mod_union_table_->Update(thread_count);
 
   // Scans all objects in the mod-union table.
   timings.NewSplit("MarkImageToAllocSpaceReferences");
@@ -1401,8 +1781,8 @@ class VerifyReferenceVisitor {
 
         // Attmept to find the class inside of the recently freed objects.
         space::ContinuousSpace* ref_space = heap_->FindContinuousSpaceFromObject(ref, true);
-        if (ref_space->IsDlMallocSpace()) {
-          space::DlMallocSpace* space = ref_space->AsDlMallocSpace();
+        if (ref_space->IsMallocSpace()) {
+          space::MallocSpace* space = ref_space->AsMallocSpace();
           mirror::Class* ref_class = space->FindRecentFreedObject(ref);
           if (ref_class != nullptr) {
             LOG(ERROR) << "Reference " << ref << " found as a recently freed object with class "
@@ -1505,9 +1885,13 @@ class VerifyObjectVisitor {
 // Must do this with mutators suspended since we are directly accessing the allocation stacks.
 bool Heap::VerifyHeapReferences() {
   Locks::mutator_lock_->AssertExclusiveHeld(Thread::Current());
+  // Sorting moves the slots of the segments which threads are still pushing into.
+  RevokeAllThreadLocalAllocationStacks();
   // Lets sort our allocation stacks so that we can efficiently binary search them.
   allocation_stack_->Sort();
   live_stack_->Sort();
+  tenured_allocation_stack_->Sort();
+  tenured_live_stack_->Sort();
   // Perform the verification.
   VerifyObjectVisitor visitor(this);
   Runtime::Current()->VisitRoots(VerifyReferenceVisitor::VerifyRoots, &visitor, false, false);
@@ -1516,6 +1900,12 @@ bool Heap::VerifyHeapReferences() {
   // 1. Allocated prior to the GC (pre GC verification).
   // 2. Allocated during the GC (pre sweep GC verification).
   for (mirror::Object** it = allocation_stack_->Begin(); it != allocation_stack_->End(); ++it) {
+    if (*it != NULL) {
+      visitor(*it);
+    }
+  }
+  for (mirror::Object** it = tenured_allocation_stack_->Begin();
+       it != tenured_allocation_stack_->End(); ++it) {
     visitor(*it);
   }
   // We don't want to verify the objects in the live stack since they themselves may be
@@ -1624,6 +2014,9 @@ class VerifyLiveStackReferences {
 
 bool Heap::VerifyMissingCardMarks() {
   Locks::mutator_lock_->AssertExclusiveHeld(Thread::Current());
+  // The live stack was just swapped in by PreGcVerification, sorting would move the slots of the
+  // segments which threads are still pushing into.
+  RevokeAllThreadLocalAllocationStacks();
 
   // We need to sort the live stack since we binary search it.
   live_stack_->Sort();
@@ -1632,7 +2025,9 @@ bool Heap::VerifyMissingCardMarks() {
 
   // We can verify objects in the live stack since none of these should reference dead objects.
   for (mirror::Object** it = live_stack_->Begin(); it != live_stack_->End(); ++it) {
-    visitor(*it);
+    if (*it != NULL) {
+      visitor(*it);
+    }
   }
 
   if (visitor.Failed()) {
@@ -1644,22 +2039,23 @@ bool Heap::VerifyMissingCardMarks() {
 
 void Heap::SwapStacks() {
   allocation_stack_.swap(live_stack_);
+  tenured_allocation_stack_.swap(tenured_live_stack_);
 }
 
-void Heap::ProcessCards(base::TimingLogger& timings) {
+void Heap::ProcessCards(base::TimingLogger& timings, size_t thread_count) {
   // Clear cards and keep track of cards cleared in the mod-union table.
   for (const auto& space : continuous_spaces_) {
     if (space->IsImageSpace()) {
       base::TimingLogger::ScopedSplit split("ImageModUnionClearCards", &timings);
-      image_mod_union_table_->ClearCards(space);
+      image_mod_union_table_->ClearCards(space, thread_count);
     } else if (space->IsZygoteSpace()) {
       base::TimingLogger::ScopedSplit split("ZygoteModUnionClearCards", &timings);
-      zygote_mod_union_table_->ClearCards(space);
+      zygote_mod_union_table_->ClearCards(space, thread_count);
     } else {
       base::TimingLogger::ScopedSplit split("AllocSpaceClearCards", &timings);
       // No mod union table for the AllocSpace. Age the cards so that the GC knows that these cards
       // were dirty before the GC started.
-      card_table_->ModifyCardsAtomic(space->Begin(), space->End(), AgeCardVisitor(), VoidFunctor());
+      card_table_->AgeCards(space->Begin(), space->End(), thread_pool_.get(), thread_count, NULL);
     }
   }
 }
@@ -1697,9 +2093,9 @@ void Heap::PreGcVerification(collector::GarbageCollector* gc) {
   if (verify_mod_union_table_) {
     thread_list->SuspendAll();
     ReaderMutexLock reader_lock(self, *Locks::heap_bitmap_lock_);
-    zygote_mod_union_table_->Update();
+    zygote_mod_union_table_->Update(0);
     zygote_mod_union_table_->Verify();
-    image_mod_union_table_->Update();
+    image_mod_union_table_->Update(0);
     image_mod_union_table_->Verify();
     thread_list->ResumeAll();
   }
@@ -1785,7 +2181,7 @@ void Heap::SetIdealFootprint(size_t max_allowed_footprint) {
 }
 
 void Heap::UpdateMaxNativeFootprint() {
-  size_t native_size = native_bytes_allocated_;
+  size_t native_size = GetNativeBytesAllocated();
   // TODO: Tune the native heap utilization to be a value other than the java heap utilization.
   size_t target_size = native_size / GetTargetHeapUtilization();
   if (target_size > native_size + max_free_) {
@@ -1797,35 +2193,115 @@ void Heap::UpdateMaxNativeFootprint() {
   native_footprint_limit_ = 2 * target_size - native_size;
 }
 
-void Heap::GrowForUtilization(collector::GcType gc_type, uint64_t gc_duration) {
+void Heap::UpdateErgonomics(collector::GarbageCollector* collector, uint64_t now) {
+  const uint64_t gc_duration = collector->GetDurationNs();
+  // GC for alloc pauses the allocating thread, so consider it as a pause.
+  uint64_t max_pause = current_gc_cause_ == kGcCauseForAlloc ? gc_duration : 0;
+  for (uint64_t pause : collector->GetPauseTimes()) {
+    max_pause = std::max(max_pause, pause);
+  }
+  if (now > last_gc_time_ns_) {
+    const double gc_time_fraction =
+        std::min(static_cast<double>(gc_duration) / (now - last_gc_time_ns_), 1.0);
+    gc_time_fraction_ += (gc_time_fraction - gc_time_fraction_) * kGcTimeFractionWeight;
+  }
+
+  const bool missed_pause_goal = pause_goal_ns_ != 0 && max_pause > pause_goal_ns_;
+  const bool missed_throughput_goal =
+      gc_time_ratio_ != 0 && gc_time_fraction_ > 1.0 / (1 + gc_time_ratio_);
+  if (missed_pause_goal) {
+    if (concurrent_gc_ && current_gc_cause_ == kGcCauseForAlloc) {
+      // The concurrent collection didn't finish before the heap filled up, start it earlier.
+      concurrent_start_scale_ = std::min(concurrent_start_scale_ * kErgonomicsScaleStep,
+                                         kMaxConcurrentStartScale);
+    } else {
+      // Collect more often, leaving less work for each collection.
+      free_scale_ = std::max(free_scale_ / kErgonomicsScaleStep, kMinFreeScale);
+    }
+  } else if (missed_throughput_goal) {
+    // Trade memory for fewer collections.
+    free_scale_ = std::min(free_scale_ * kErgonomicsScaleStep, kMaxFreeScale);
+  } else {
+    // Both goals are met, drift back to the default footprint.
+    free_scale_ = free_scale_ > 1.0 ? std::max(free_scale_ / kErgonomicsScaleStep, 1.0)
+                                    : std::min(free_scale_ * kErgonomicsScaleStep, 1.0);
+    concurrent_start_scale_ = std::max(concurrent_start_scale_ / kErgonomicsScaleStep, 1.0);
+  }
+  VLOG(heap) << "Ergonomics: max pause " << PrettyDuration(max_pause) << ", gc time "
+             << static_cast<int>(gc_time_fraction_ * 100) << "%, free scale " << free_scale_
+             << ", concurrent start scale " << concurrent_start_scale_;
+}
+
+// Returns the given percentile of the pauses of the collectors of gc_type, 0 if they haven't run.
+static uint64_t GetPausePercentileNs(const std::vector<collector::MarkSweep*>& collectors,
+                                     collector::GcType gc_type, bool concurrent) {
+  for (collector::MarkSweep* collector : collectors) {
+    if (collector->IsConcurrent() == concurrent && collector->GetGcType() == gc_type) {
+      Histogram<uint64_t>& histogram = collector->GetPauseHistogram();
+      if (histogram.SampleSize() == 0) {
+        return 0;
+      }
+      Histogram<uint64_t>::CumulativeData data;
+      histogram.CreateHistogram(data);
+      return static_cast<uint64_t>(histogram.Percentile(kPauseGoalPercentile, data)) * 1000;
+    }
+  }
+  return 0;
+}
+
+bool Heap::ShouldDeferPartialGc() {
+  if (pause_goal_ns_ == 0) {
+    return false;
+  }
+  return GetPausePercentileNs(mark_sweep_collectors_, collector::kGcTypePartial, concurrent_gc_) >
+      pause_goal_ns_ &&
+      GetPausePercentileNs(mark_sweep_collectors_, collector::kGcTypeSticky, concurrent_gc_) <=
+      pause_goal_ns_;
+}
+
+void Heap::GrowForUtilization(collector::GarbageCollector* collector) {
+  const collector::GcType gc_type = collector->GetGcType();
+  const uint64_t gc_duration = collector->GetDurationNs();
   // We know what our utilization is at this moment.
   // This doesn't actually resize any memory. It just lets the heap grow more when necessary.
   const size_t bytes_allocated = GetBytesAllocated();
+  const uint64_t now = NanoTime();
+  if (UseErgonomics()) {
+    UpdateErgonomics(collector, now);
+  }
   last_gc_size_ = bytes_allocated;
-  last_gc_time_ns_ = NanoTime();
+  last_gc_time_ns_ = now;
+  if (IsSoftReferenceLruPolicyEnabled()) {
+    UpdateSoftReferenceClock(now, bytes_allocated);
+  }
 
+  const double free_scale = UseErgonomics() ? free_scale_ : 1.0;
+  const size_t min_free = min_free_ * free_scale;
+  const size_t max_free = max_free_ * free_scale;
   size_t target_size;
   if (gc_type != collector::kGcTypeSticky) {
     // Grow the heap for non sticky GC.
     target_size = bytes_allocated / GetTargetHeapUtilization();
-    if (target_size > bytes_allocated + max_free_) {
-      target_size = bytes_allocated + max_free_;
-    } else if (target_size < bytes_allocated + min_free_) {
-      target_size = bytes_allocated + min_free_;
+    if (target_size > bytes_allocated + max_free) {
+      target_size = bytes_allocated + max_free;
+    } else if (target_size < bytes_allocated + min_free) {
+      target_size = bytes_allocated + min_free;
     }
     next_gc_type_ = collector::kGcTypeSticky;
   } else {
     // Based on how close the current heap size is to the target size, decide
-    // whether or not to do a partial or sticky GC next.
-    if (bytes_allocated + min_free_ <= max_allowed_footprint_) {
+    // whether or not to do a partial or sticky GC next. Partial GCs which miss the pause goal are
+    // put off until the heap is actually full.
+    if (bytes_allocated + min_free <= max_allowed_footprint_ ||
+        (bytes_allocated < max_allowed_footprint_ && ShouldDeferPartialGc())) {
       next_gc_type_ = collector::kGcTypeSticky;
     } else {
       next_gc_type_ = collector::kGcTypePartial;
     }
 
     // If we have freed enough memory, shrink the heap back down.
-    if (bytes_allocated + max_free_ < max_allowed_footprint_) {
-      target_size = bytes_allocated + max_free_;
+    if (bytes_allocated + max_free < max_allowed_footprint_) {
+      target_size = bytes_allocated + max_free;
     } else {
       target_size = std::max(bytes_allocated, max_allowed_footprint_);
     }
@@ -1841,6 +2317,9 @@ void Heap::GrowForUtilization(collector::GcType gc_type, uint64_t gc_duration) {
       double gc_duration_seconds = NsToMs(gc_duration) / 1000.0;
       // Estimate how many remaining bytes we will have when we need to start the next GC.
       size_t remaining_bytes = allocation_rate_ * gc_duration_seconds;
+      if (UseErgonomics()) {
+        remaining_bytes *= concurrent_start_scale_;
+      }
       remaining_bytes = std::max(remaining_bytes, kMinConcurrentRemainingBytes);
       if (UNLIKELY(remaining_bytes > max_allowed_footprint_)) {
         // A never going to happen situation that from the estimated allocation rate we will exceed
@@ -1895,6 +2374,101 @@ void Heap::ClearReferenceReferent(mirror::Object* reference) {
   reference->SetFieldObject(reference_referent_offset_, NULL, true);
 }
 
+void Heap::UpdateSoftReferenceClock(uint64_t now_ns, size_t bytes_allocated) {
+  QuasiAtomic::Write64(&soft_reference_clock_ms_, NsToMs(now_ns));
+  const size_t free_bytes = GetMaxMemory() - std::min<int64_t>(bytes_allocated, GetMaxMemory());
+  soft_reference_max_age_ms_ = static_cast<int64_t>(free_bytes / MB) *
+      soft_ref_lru_policy_ms_per_mb_;
+}
+
+void Heap::SetSoftReferenceTimestampOffset(MemberOffset offset) {
+  CHECK_NE(offset.Uint32Value(), 0U);
+  if (soft_ref_lru_policy_ms_per_mb_ != 0) {
+    soft_reference_timestamp_offset_ = offset;
+  }
+}
+
+bool Heap::ShouldPreserveSoftReferent(mirror::Object* ref) {
+  DCHECK(IsSoftReferenceLruPolicyEnabled());
+  const int64_t clock = QuasiAtomic::Read64(&soft_reference_clock_ms_);
+  const int64_t timestamp =
+      static_cast<int64_t>(ref->GetField64(soft_reference_timestamp_offset_, false));
+  if (timestamp == 0) {
+    // Never read since it was created, it ages from now on.
+    ref->SetField64(soft_reference_timestamp_offset_, clock, false);
+    return true;
+  }
+  return clock - timestamp <= soft_reference_max_age_ms_;
+}
+
+mirror::Object* Heap::GetReferent(Thread* self, mirror::Object* reference) {
+  if (IsSoftReferenceLruPolicyEnabled() && reference->GetClass()->IsSoftReferenceClass()) {
+    reference->SetField64(soft_reference_timestamp_offset_,
+                          QuasiAtomic::Read64(&soft_reference_clock_ms_), false);
+  }
+  // The slow path is only enabled in a pause, it can't be enabled while we are runnable. The
+  // barrier makes sure we don't read a referent older than the flag.
+  const bool slow_path = reference_processing_slow_path_;
+  ANDROID_MEMBAR_FULL();
+  if (LIKELY(!slow_path)) {
+    return GetReferenceReferent(reference);
+  }
+  SirtRef<mirror::Object> sirt_reference(self, reference);
+  while (true) {
+    {
+      MutexLock mu(self, *reference_processor_lock_);
+      if (!reference_processing_slow_path_) {
+        break;
+      }
+      mirror::Object* referent = GetReferenceReferent(sirt_reference.get());
+      if (referent == NULL) {
+        // Cleared by the collector or by the user.
+        return NULL;
+      }
+      // A white referent may still be preserved, or reached by a finalizable object.
+      if (referent_marked_tester_ != NULL &&
+          referent_marked_tester_(referent, referent_marked_arg_)) {
+        return referent;
+      }
+    }
+    // Wait suspended so that thread suspensions and checkpoints don't wait for the reference
+    // processing, the referent is read again once runnable.
+    ScopedThreadStateChange tsc(self, kWaitingForGcToComplete);
+    MutexLock mu(self, *reference_processor_lock_);
+    if (reference_processing_slow_path_) {
+      reference_processor_cond_->Wait(self);
+    }
+  }
+  return GetReferenceReferent(sirt_reference.get());
+}
+
+void Heap::EnableReferenceProcessingSlowPath(Thread* self, IsMarkedTester* is_marked, void* arg) {
+  Locks::mutator_lock_->AssertExclusiveHeld(self);
+  MutexLock mu(self, *reference_processor_lock_);
+  referent_marked_tester_ = is_marked;
+  referent_marked_arg_ = arg;
+  reference_processing_slow_path_ = true;
+}
+
+void Heap::SetReferentMarkedTester(Thread* self, IsMarkedTester* is_marked, void* arg) {
+  MutexLock mu(self, *reference_processor_lock_);
+  DCHECK(reference_processing_slow_path_);
+  referent_marked_tester_ = is_marked;
+  referent_marked_arg_ = arg;
+  if (is_marked != NULL) {
+    reference_processor_cond_->Broadcast(self);
+  }
+}
+
+void Heap::DisableReferenceProcessingSlowPath(Thread* self) {
+  MutexLock mu(self, *reference_processor_lock_);
+  DCHECK(reference_processing_slow_path_);
+  referent_marked_tester_ = NULL;
+  referent_marked_arg_ = NULL;
+  reference_processing_slow_path_ = false;
+  reference_processor_cond_->Broadcast(self);
+}
+
 // Returns true if the reference object has not yet been enqueued.
 bool Heap::IsEnqueuable(const mirror::Object* ref) {
   DCHECK(ref != NULL);
@@ -2026,8 +2600,8 @@ void Heap::ConcurrentGC(Thread* self) {
 
 void Heap::RequestHeapTrim() {
   // GC completed and now we must decide whether to request a heap trim (advising pages back to the
-  // kernel) or not. Issuing a request will also cause trimming of the libc heap. As a trim scans
-  // a space it will hold its lock and can become a cause of jank.
+  // kernel) or not. Issuing a request will also cause trimming of the libc heap. A trim of the
+  // alloc space holds its lock for a step at a time but still competes with the mutators.
   // Note, the large object space self trims and the Zygote space was trimmed and unchanging since
   // forking.
 
@@ -2037,16 +2611,23 @@ void Heap::RequestHeapTrim() {
   // to utilization (which is probably inversely proportional to how much benefit we can expect).
   // We could try mincore(2) but that's only a measure of how many pages we haven't given away,
   // not how much use we're making of those pages.
+  Thread* self = Thread::Current();
+  bool trim_in_progress;
+  {
+    MutexLock mu(self, *heap_trim_lock_);
+    trim_in_progress = trim_cursor_ != 0;
+  }
   uint64_t ms_time = MilliTime();
   float utilization =
       static_cast<float>(alloc_space_->GetBytesAllocated()) / alloc_space_->Size();
-  if ((utilization > 0.75f && !IsLowMemoryMode()) || ((ms_time - last_trim_time_ms_) < 2 * 1000)) {
+  if ((utilization > 0.75f && !IsLowMemoryMode() && !trim_in_progress) ||
+      ((ms_time - last_trim_time_ms_) < 2 * 1000)) {
     // Don't bother trimming the alloc space if it's more than 75% utilized and low memory mode is
-    // not enabled, or if a heap trim occurred in the last two seconds.
+    // not enabled, unless the previous trim ran out of budget before the end of the space, or if a
+    // heap trim occurred in the last two seconds.
     return;
   }
 
-  Thread* self = Thread::Current();
   {
     MutexLock mu(self, *Locks::runtime_shutdown_lock_);
     Runtime* runtime = Runtime::Current();
@@ -2073,8 +2654,85 @@ void Heap::RequestHeapTrim() {
 }
 
 size_t Heap::Trim() {
+  Thread* self = Thread::Current();
   // Handle a requested heap trim on a thread outside of the main GC thread.
-  return alloc_space_->Trim();
+  return TrimAllocSpace(self) + large_object_space_->Trim();
+}
+
+size_t Heap::TrimAllocSpace(Thread* self) {
+  space::MallocSpace* space = alloc_space_;
+  size_t reclaimed = 0;
+  size_t budget = heap_trim_budget_;
+  while (budget != 0) {
+    byte* begin;
+    {
+      MutexLock mu(self, *heap_trim_lock_);
+      if (trim_space_ != space) {
+        trim_space_ = space;
+        trim_cursor_ = 0;
+        trim_step_times_ms_.assign(
+            RoundUp(space->Capacity(), heap_trim_step_size_) / heap_trim_step_size_, 0);
+      }
+      if (trim_cursor_ >= space->Size()) {
+        // Reached the end of the space, the next trim starts a new pass.
+        trim_cursor_ = 0;
+        break;
+      }
+      const size_t step = trim_cursor_ / heap_trim_step_size_;
+      begin = space->Begin() + trim_cursor_;
+      trim_cursor_ += heap_trim_step_size_;
+      const uint64_t ms_time = MilliTime();
+      if (ms_time - trim_step_times_ms_[step] < kHeapTrimStepIntervalMs) {
+        continue;
+      }
+      trim_step_times_ms_[step] = ms_time;
+    }
+    // The step past the end of the space also gives back the free memory at its end.
+    reclaimed += space->TrimRange(begin, begin + heap_trim_step_size_);
+    budget -= std::min(budget, heap_trim_step_size_);
+  }
+  return reclaimed;
+}
+
+void Heap::Compact(Thread* self) {
+  // Only objects which survive a full collection are worth moving.
+  CollectGarbageInternal(collector::kGcTypeFull, kGcCauseBackground, false);
+  if (alloc_space_->GetBytesAllocated() + kMinCompactionFreeBytes > alloc_space_->Size()) {
+    return;
+  }
+
+  ScopedThreadStateChange tsc(self, kWaitingPerformingGc);
+  {
+    MutexLock mu(self, *gc_complete_lock_);
+    if (is_gc_running_) {
+      // Whoever is collecting cares more than we do.
+      return;
+    }
+    is_gc_running_ = true;
+  }
+
+  ATRACE_BEGIN("GC Compaction");
+  collector::Compactor* compactor = compactor_.get();
+  const size_t size_before = alloc_space_->Size();
+  const uint64_t start_time_ns = NanoTime();
+  const uint64_t bytes_allocated_before = GetBytesAllocated();
+  compactor->Run();
+  RecordGcEvent(compactor, kGcCauseBackground, start_time_ns, bytes_allocated_before, 0,
+                compactor->GetFreedBytes());
+  VLOG(heap) << compactor->GetName() << " moved " << compactor->GetMovedObjects() << "("
+             << PrettySize(compactor->GetMovedBytes()) << ") objects, pinned "
+             << compactor->GetPinnedObjects() << " objects, alloc space "
+             << PrettySize(size_before) << " utilization "
+             << (alloc_space_->GetBytesAllocated() * 100 / size_before) << "%, paused "
+             << PrettyDuration(compactor->GetDurationNs());
+  ATRACE_END();
+
+  {
+    MutexLock mu(self, *gc_complete_lock_);
+    is_gc_running_ = false;
+    last_gc_type_ = collector::kGcTypeNone;
+    gc_complete_cond_->Broadcast(self);
+  }
 }
 
 bool Heap::IsGCRequestPending() const {
@@ -2082,13 +2740,19 @@ bool Heap::IsGCRequestPending() const {
 }
 
 void Heap::RegisterNativeAllocation(int bytes) {
-  // Total number of native bytes allocated.
-  native_bytes_allocated_.fetch_add(bytes);
   Thread* self = Thread::Current();
-  if (static_cast<size_t>(native_bytes_allocated_) > native_footprint_gc_watermark_) {
+  const int delta = self->GetNativeAllocationDelta() + bytes;
+  if (delta < kNativeAllocationFlushBytes) {
+    self->SetNativeAllocationDelta(delta);
+    return;
+  }
+  // Total number of native bytes allocated.
+  self->SetNativeAllocationDelta(0);
+  native_bytes_allocated_.fetch_add(delta);
+  if (GetNativeBytesAllocated() > native_footprint_gc_watermark_) {
     // The second watermark is higher than the gc watermark. If you hit this it means you are
     // allocating native objects faster than the GC can keep up with.
-    if (static_cast<size_t>(native_bytes_allocated_) > native_footprint_limit_) {
+    if (GetNativeBytesAllocated() > native_footprint_limit_) {
         JNIEnv* env = self->GetJniEnv();
         // Can't do this in WellKnownClasses::Init since System is not properly set up at that
         // point.
@@ -2106,7 +2770,7 @@ void Heap::RegisterNativeAllocation(int bytes) {
         }
 
         // If we still are over the watermark, attempt a GC for alloc and run finalizers.
-        if (static_cast<size_t>(native_bytes_allocated_) > native_footprint_limit_) {
+        if (GetNativeBytesAllocated() > native_footprint_limit_) {
           CollectGarbageInternal(collector::kGcTypePartial, kGcCauseForAlloc, false);
           env->CallStaticVoidMethod(WellKnownClasses::java_lang_System,
                                     WellKnownClasses::java_lang_System_runFinalization);
@@ -2124,16 +2788,28 @@ void Heap::RegisterNativeAllocation(int bytes) {
 }
 
 void Heap::RegisterNativeFree(int bytes) {
-  int expected_size, new_size;
-  do {
-      expected_size = native_bytes_allocated_.load();
-      new_size = expected_size - bytes;
-      if (new_size < 0) {
-        ThrowRuntimeException("attempted to free %d native bytes with only %d native bytes registered as allocated",
-                              bytes, expected_size);
-        break;
-      }
-  } while (!native_bytes_allocated_.compare_and_swap(expected_size, new_size));
+  Thread* self = Thread::Current();
+  const int delta = self->GetNativeAllocationDelta() - bytes;
+  if (delta > -kNativeAllocationFlushBytes) {
+    self->SetNativeAllocationDelta(delta);
+    return;
+  }
+  self->SetNativeAllocationDelta(0);
+  native_bytes_allocated_.fetch_add(delta);
+}
+
+void Heap::FlushNativeAllocationDelta(Thread* thread) {
+  native_bytes_allocated_.fetch_add(thread->GetNativeAllocationDelta());
+  thread->SetNativeAllocationDelta(0);
+}
+
+void Heap::FlushAllNativeAllocationDeltas() {
+  Thread* self = Thread::Current();
+  Locks::mutator_lock_->AssertExclusiveHeld(self);
+  MutexLock mu(self, *Locks::thread_list_lock_);
+  for (Thread* thread : Runtime::Current()->GetThreadList()->GetList()) {
+    FlushNativeAllocationDelta(thread);
+  }
 }
 
 int64_t Heap::GetTotalMemory() const {
@@ -2141,9 +2817,9 @@ int64_t Heap::GetTotalMemory() const {
   for (const auto& space : continuous_spaces_) {
     if (space->IsImageSpace()) {
       // Currently don't include the image space.
-    } else if (space->IsDlMallocSpace()) {
+    } else if (space->IsMallocSpace()) {
       // Zygote or alloc space
-      ret += space->AsDlMallocSpace()->GetFootprint();
+      ret += space->AsMallocSpace()->GetFootprint();
     }
   }
   for (const auto& space : discontinuous_spaces_) {
@@ -17,12 +17,14 @@
 #ifndef ART_RUNTIME_GC_HEAP_H_
 #define ART_RUNTIME_GC_HEAP_H_
 
+#include <algorithm>
 #include <iosfwd>
 #include <string>
 #include <vector>
 
 #include "atomic_integer.h"
 #include "base/timing_logger.h"
+#include "gc/accounting/allocation_site_table.h"
 #include "gc/accounting/atomic_stack.h"
 #include "gc/accounting/card_table.h"
 #include "gc/collector/gc_type.h"
@@ -31,6 +33,7 @@
 #include "jni.h"
 #include "locks.h"
 #include "offsets.h"
+#include "root_visitor.h"
 #include "safe_map.h"
 #include "thread_pool.h"
 
@@ -43,11 +46,17 @@ class Thread;
 class TimingLogger;
 
 namespace mirror {
+  class ArtMethod;
   class Class;
   class Object;
 }  // namespace mirror
 
 namespace gc {
+
+class AllocationProfiler;
+class GcEventLog;
+class HeapTest;
+
 namespace accounting {
   class HeapBitmap;
   class ModUnionTable;
@@ -55,6 +64,7 @@ namespace accounting {
 }  // namespace accounting
 
 namespace collector {
+  class Compactor;
   class GarbageCollector;
   class MarkSweep;
 }  // namespace collector
@@ -65,6 +75,8 @@ namespace space {
   class DlMallocSpace;
   class ImageSpace;
   class LargeObjectSpace;
+  class MallocSpace;
+  class RosAllocSpace;
   class Space;
   class SpaceTest;
 }  // namespace space
@@ -101,12 +113,49 @@ enum HeapVerificationMode {
 };
 static constexpr HeapVerificationMode kDesiredHeapVerification = kNoHeapVerification;
 
+// The sizes and tuning of a heap, as given by the runtime options. Every field must be set.
+struct HeapOptions {
+  size_t initial_size;
+  size_t growth_limit;
+  size_t min_free;
+  size_t max_free;
+  double target_utilization;
+  size_t capacity;
+  // Possibly empty, otherwise the image to load the image space from.
+  std::string image_file_name;
+  bool concurrent_gc;
+  size_t parallel_gc_threads;
+  size_t conc_gc_threads;
+  bool low_memory_mode;
+  size_t long_pause_log_threshold;
+  size_t long_gc_log_threshold;
+  bool ignore_max_footprint;
+  bool use_rosalloc;
+  bool allocation_site_pretenuring;
+  bool free_list_large_object_space;
+  // Whether the free list large object space asks for transparent huge pages for the largest
+  // arrays.
+  bool large_object_huge_pages;
+  // 0 means no pause goal.
+  size_t pause_goal_ms;
+  // 0 means no throughput goal.
+  size_t gc_time_ratio;
+  // 0 means every other soft referent is kept.
+  size_t soft_ref_lru_policy_ms_per_mb;
+  size_t heap_trim_step_size;
+  size_t heap_trim_budget;
+  // 0 means no allocation profiling.
+  size_t allocation_profile_interval;
+};
+
 class Heap {
  public:
   static constexpr size_t kDefaultInitialSize = 2 * MB;
   static constexpr size_t kDefaultMaximumSize = 32 * MB;
   static constexpr size_t kDefaultMaxFree = 2 * MB;
   static constexpr size_t kDefaultMinFree = kDefaultMaxFree / 4;
+  static constexpr size_t kDefaultHeapTrimStepSize = 1 * MB;
+  static constexpr size_t kDefaultHeapTrimBudget = 64 * MB;
   static constexpr size_t kDefaultLongPauseLogThreshold = MsToNs(5);
   static constexpr size_t kDefaultLongGCLogThreshold = MsToNs(100);
 
@@ -116,25 +165,55 @@ class Heap {
   // Used so that we don't overflow the allocation time atomic integer.
   static constexpr size_t kTimeAdjust = 1024;
 
-  // Create a heap with the requested sizes. The possible empty
-  // image_file_names names specify Spaces to load based on
+  // Create a heap with the requested sizes. The image space, if any, is loaded from
   // ImageWriter output.
-  explicit Heap(size_t initial_size, size_t growth_limit, size_t min_free,
-                size_t max_free, double target_utilization, size_t capacity,
-                const std::string& original_image_file_name, bool concurrent_gc,
-                size_t parallel_gc_threads, size_t conc_gc_threads, bool low_memory_mode,
-                size_t long_pause_threshold, size_t long_gc_threshold, bool ignore_max_footprint);
+  explicit Heap(const HeapOptions& options);
 
   ~Heap();
 
   // Allocates and initializes storage for an object instance.
   mirror::Object* AllocObject(Thread* self, mirror::Class* klass, size_t num_bytes)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    return AllocObjectInternal(self, klass, num_bytes, false);
+  }
+
+  // Allocates an object for a tenured allocation site. The object is treated as live from the
+  // start of the next collection, so sticky collections neither mark nor sweep it.
+  mirror::Object* AllocTenuredObject(Thread* self, mirror::Class* klass, size_t num_bytes)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    return AllocObjectInternal(self, klass, num_bytes, true);
+  }
+
+  // Returns true if the allocations of klass by referrer should use AllocTenuredObject.
+  bool IsTenuredAllocationSite(const mirror::ArtMethod* referrer,
+                               const mirror::Class* klass) const {
+    return allocation_sites_.get() != NULL && allocation_sites_->IsTenured(referrer, klass);
+  }
+
+  // Return the unused part of the thread's allocation buffer, or its rosalloc runs, to the alloc
+  // space. The thread must either be the caller or be suspended.
+  void RevokeThreadLocalBuffer(Thread* thread);
+
+  // Revoke the allocation buffers of all threads, requires mutators to be suspended.
+  void RevokeAllThreadLocalBuffers() LOCKS_EXCLUDED(Locks::thread_list_lock_);
 
+  // Make all threads take a new segment of the allocation stack for their next allocation, requires
+  // mutators to be suspended. Unused slots of the old segments are left NULL.
+  void RevokeAllThreadLocalAllocationStacks() LOCKS_EXCLUDED(Locks::thread_list_lock_);
+
+  // Native allocations and frees are accumulated by the calling thread and only added to the
+  // total, and checked against the native watermarks, once they reach a threshold.
   void RegisterNativeAllocation(int bytes)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
   void RegisterNativeFree(int bytes) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Add the native bytes accumulated by thread to the total, thread must be the current thread or
+  // suspended.
+  void FlushNativeAllocationDelta(Thread* thread);
+
+  // Same as above for all threads, requires mutators to be suspended.
+  void FlushAllNativeAllocationDeltas() LOCKS_EXCLUDED(Locks::thread_list_lock_);
+
   // The given reference is believed to be to an object in the Java heap, check the soundness of it.
   void VerifyObjectImpl(const mirror::Object* o);
   void VerifyObject(const mirror::Object* o) {
@@ -256,6 +335,11 @@ class Heap {
   mirror::Object* DequeuePendingReference(mirror::Object** list)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  MemberOffset GetReferenceReferentOffset() {
+    DCHECK_NE(reference_referent_offset_.Uint32Value(), 0U);
+    return reference_referent_offset_;
+  }
+
   MemberOffset GetReferencePendingNextOffset() {
     DCHECK_NE(reference_pendingNext_offset_.Uint32Value(), 0U);
     return reference_pendingNext_offset_;
@@ -266,6 +350,57 @@ class Heap {
     return finalizer_reference_zombie_offset_;
   }
 
+  // Called once Reference.get reads the referent through GetReferent, after which concurrent
+  // collections may process references after their pause.
+  void EnableConcurrentReferenceProcessing() {
+    concurrent_reference_processing_ = true;
+  }
+
+  bool IsConcurrentReferenceProcessingEnabled() const {
+    return concurrent_reference_processing_;
+  }
+
+  // Called once Reference.get reads the referent through GetReferent with the offset of
+  // SoftReference.timestamp, which GetReferent sets to the soft reference clock.
+  void SetSoftReferenceTimestampOffset(MemberOffset offset);
+
+  // True if -XX:SoftRefLRUPolicyMSPerMB was given, the policy is only enabled if the class library
+  // supports it.
+  bool IsSoftReferenceLruPolicyRequested() const {
+    return soft_ref_lru_policy_ms_per_mb_ != 0;
+  }
+
+  // True if white soft referents are preserved based on when they were last read rather than
+  // every other one.
+  bool IsSoftReferenceLruPolicyEnabled() const {
+    return soft_reference_timestamp_offset_.Uint32Value() != 0;
+  }
+
+  // Returns true if the white referent of the soft reference ref should be preserved by the
+  // LRU policy: it was read less than soft_ref_lru_policy_ms_per_mb_ milliseconds per megabyte
+  // of heap free after the last collection before the last collection.
+  bool ShouldPreserveSoftReferent(mirror::Object* ref)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Returns the referent of reference for Reference.get. While references are processed
+  // concurrently, only referents which the collector has finished marking are returned right
+  // away, the caller waits for the processing to complete otherwise.
+  mirror::Object* GetReferent(Thread* self, mirror::Object* reference)
+      LOCKS_EXCLUDED(reference_processor_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Enabled by the collector in its pause, is_marked tests whether a referent may be returned.
+  void EnableReferenceProcessingSlowPath(Thread* self, IsMarkedTester* is_marked, void* arg)
+      LOCKS_EXCLUDED(reference_processor_lock_);
+
+  // Set is_marked to NULL while the collector marks objects, marked objects may not have been
+  // scanned yet until the mark stack is processed.
+  void SetReferentMarkedTester(Thread* self, IsMarkedTester* is_marked, void* arg)
+      LOCKS_EXCLUDED(reference_processor_lock_);
+
+  // Wakes up the threads waiting in GetReferent.
+  void DisableReferenceProcessingSlowPath(Thread* self) LOCKS_EXCLUDED(reference_processor_lock_);
+
   // Enable verification of object references when the runtime is sufficiently initialized.
   void EnableObjectValidation() {
     verify_object_mode_ = kDesiredHeapVerification;
@@ -361,7 +496,33 @@ class Heap {
 
   void DumpForSigQuit(std::ostream& os);
 
-  size_t Trim();
+  GcEventLog* GetGcEventLog() const {
+    return gc_event_log_.get();
+  }
+
+  // Dumps the GC event log as CSV, or as JSON along with the pause histograms of the collectors.
+  void DumpGcEvents(std::ostream& os, bool json);
+
+  AllocationProfiler* GetAllocationProfiler() const {
+    return allocation_profiler_.get();
+  }
+
+  // Trim the alloc space a step at a time, up to the trim budget. The next trim resumes where this
+  // one stopped.
+  size_t Trim() LOCKS_EXCLUDED(gc_complete_lock_, heap_trim_lock_);
+
+  // Run a full collection and move the objects at the top of the alloc space into the free memory
+  // below them, so that a trim can give the top back. Only tests call it: the runtime holds raw
+  // mirror pointers across allocations, which the compactor would leave dangling.
+  void Compact(Thread* self)
+      LOCKS_EXCLUDED(gc_complete_lock_,
+                     Locks::heap_bitmap_lock_,
+                     Locks::mutator_lock_,
+                     Locks::thread_suspend_count_lock_);
+
+  collector::Compactor* GetCompactor() const {
+    return compactor_.get();
+  }
 
   accounting::HeapBitmap* GetLiveBitmap() SHARED_LOCKS_REQUIRED(Locks::heap_bitmap_lock_) {
     return live_bitmap_.get();
@@ -375,9 +536,18 @@ class Heap {
     return live_stack_.get();
   }
 
+  // Objects allocated by tenured sites before the current collection started.
+  accounting::ObjectStack* GetTenuredLiveStack() SHARED_LOCKS_REQUIRED(Locks::heap_bitmap_lock_) {
+    return tenured_live_stack_.get();
+  }
+
+  accounting::AllocationSiteTable* GetAllocationSiteTable() const {
+    return allocation_sites_.get();
+  }
+
   void PreZygoteFork() LOCKS_EXCLUDED(Locks::heap_bitmap_lock_);
 
-  // Mark and empty stack.
+  // Mark and empty stack, requires mutators to be suspended.
   void FlushAllocStack()
       EXCLUSIVE_LOCKS_REQUIRED(Locks::heap_bitmap_lock_);
 
@@ -398,7 +568,7 @@ class Heap {
   // Assumes there is only one image space.
   space::ImageSpace* GetImageSpace() const;
 
-  space::DlMallocSpace* GetAllocSpace() const {
+  space::MallocSpace* GetAllocSpace() const {
     return alloc_space_;
   }
 
@@ -448,10 +618,35 @@ class Heap {
  private:
   // Allocates uninitialized storage. Passing in a null space tries to place the object in the
   // large object space.
-  template <class T> mirror::Object* Allocate(Thread* self, T* space, size_t num_bytes, size_t* bytes_allocated)
+  template <class T> mirror::Object* Allocate(Thread* self, T* space, size_t num_bytes,
+                                              size_t* bytes_allocated)
       LOCKS_EXCLUDED(Locks::thread_suspend_count_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Allocates from the thread's allocation buffer, carving a new buffer when the current one is
+  // exhausted. Never does any GCs, returns NULL if the allocation should take the shared path.
+  mirror::Object* AllocateThreadLocal(Thread* self, size_t alloc_size, size_t* bytes_allocated)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Visits the live objects with one visitor, made by make_visitor, per stripe of each continuous
+  // space, visiting the stripes on the GC thread pool unless a collection is using it. One more
+  // visitor visits the discontinuous spaces on the calling thread. The visitors are appended to
+  // visitors in the order a serial walk would visit their objects, so that their results can be
+  // merged without them having to synchronize.
+  template <typename Visitor, typename MakeVisitor>
+  void VisitLiveObjectsParallel(Thread* self, MakeVisitor make_visitor,
+                                std::vector<Visitor*>* visitors)
+      LOCKS_EXCLUDED(gc_complete_lock_, Locks::heap_bitmap_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // The mark sweep collectors followed by the compactor.
+  std::vector<collector::GarbageCollector*> GetCollectors() const;
+
+  // Adds the collection collector just ran to the GC event log.
+  void RecordGcEvent(collector::GarbageCollector* collector, GcCause gc_cause,
+                     uint64_t start_time_ns, uint64_t bytes_allocated_before,
+                     uint64_t freed_objects, uint64_t freed_bytes);
+
   // Handles Allocate()'s slow allocation path with GC involved after
   // an initial allocation attempt failed.
   mirror::Object* AllocateInternalWithGc(Thread* self, space::AllocSpace* space, size_t num_bytes,
@@ -471,19 +666,42 @@ class Heap {
       LOCKS_EXCLUDED(Locks::thread_suspend_count_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Try to allocate a number of bytes, this function never does any GCs. RosAllocSpace-specialized
+  // version.
+  mirror::Object* TryToAllocate(Thread* self, space::RosAllocSpace* space, size_t alloc_size,
+                                bool grow, size_t* bytes_allocated)
+      LOCKS_EXCLUDED(Locks::thread_suspend_count_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
   bool IsOutOfMemoryOnAllocation(size_t alloc_size, bool grow);
 
   // Pushes a list of cleared references out to the managed heap.
   void EnqueueClearedReferences(mirror::Object** cleared_references);
 
-  void RequestHeapTrim() LOCKS_EXCLUDED(Locks::runtime_shutdown_lock_);
+  void RequestHeapTrim() LOCKS_EXCLUDED(Locks::runtime_shutdown_lock_, heap_trim_lock_);
+
+  // Trims the steps of the current pass over the alloc space until the trim budget is spent,
+  // skipping the steps trimmed less than kHeapTrimStepIntervalMs ago.
+  size_t TrimAllocSpace(Thread* self) LOCKS_EXCLUDED(heap_trim_lock_);
   void RequestConcurrentGC(Thread* self) LOCKS_EXCLUDED(Locks::runtime_shutdown_lock_);
   bool IsGCRequestPending() const;
 
-  void RecordAllocation(size_t size, mirror::Object* object)
+  mirror::Object* AllocObjectInternal(Thread* self, mirror::Class* klass, size_t num_bytes,
+                                      bool tenured)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Objects allocated from a thread local buffer don't update num_bytes_allocated_ since the whole
+  // buffer was accounted for when it was carved. Objects are pushed onto the thread's segment of
+  // the allocation stack, tenured objects go on the tenured allocation stack instead.
+  void RecordAllocation(Thread* self, size_t size, mirror::Object* object, bool thread_local,
+                        bool tenured)
       LOCKS_EXCLUDED(GlobalSynchronization::heap_bitmap_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Give self a new segment of the allocation stack, collecting if it is full, and push obj.
+  void PushOnNewThreadLocalAllocationStack(Thread* self, mirror::Object* obj)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
   // Sometimes CollectGarbageInternal decides to run a different Gc than you requested. Returns
   // which type of Gc was actually ran.
   collector::GcType CollectGarbageInternal(collector::GcType gc_plan, GcCause gc_cause,
@@ -501,10 +719,31 @@ class Heap {
   // bytes allocated and the target utilization ratio.
   void UpdateMaxNativeFootprint();
 
+  size_t GetNativeBytesAllocated() const {
+    return std::max(native_bytes_allocated_.load(), 0);
+  }
+
   // Given the current contents of the alloc space, increase the allowed heap footprint to match
   // the target utilization ratio.  This should only be called immediately after a full garbage
   // collection.
-  void GrowForUtilization(collector::GcType gc_type, uint64_t gc_duration);
+  void GrowForUtilization(collector::GarbageCollector* collector);
+
+  // Advance the soft reference clock to now_ns and let white soft referents read in the last
+  // soft_ref_lru_policy_ms_per_mb_ milliseconds per megabyte of heap free be preserved.
+  void UpdateSoftReferenceClock(uint64_t now_ns, size_t bytes_allocated);
+
+  // True if a pause time goal or a GC time ratio was given.
+  bool UseErgonomics() const {
+    return pause_goal_ns_ != 0 || gc_time_ratio_ != 0;
+  }
+
+  // Adjust the free space and concurrent start scales after the collector ran, favoring the pause
+  // goal over the throughput goal and giving back memory once both are met.
+  void UpdateErgonomics(collector::GarbageCollector* collector, uint64_t now);
+
+  // Returns true if the partial collections don't meet the pause goal while the sticky ones do,
+  // based on the pause histograms of the collectors.
+  bool ShouldDeferPartialGc();
 
   size_t GetPercentFree();
 
@@ -519,11 +758,12 @@ class Heap {
   static void VerificationCallback(mirror::Object* obj, void* arg)
       SHARED_LOCKS_REQUIRED(GlobalSychronization::heap_bitmap_lock_);
 
-  // Swap the allocation stack with the live stack.
+  // Swap the allocation stacks with the live stacks.
   void SwapStacks();
 
-  // Clear cards and update the mod union table.
-  void ProcessCards(base::TimingLogger& timings);
+  // Clear cards and update the mod union table. The cards of each space are split between
+  // thread_count threads of the thread pool.
+  void ProcessCards(base::TimingLogger& timings, size_t thread_count);
 
   // All-known continuous spaces, where objects lie within fixed bounds.
   std::vector<space::ContinuousSpace*> continuous_spaces_;
@@ -532,7 +772,11 @@ class Heap {
   std::vector<space::DiscontinuousSpace*> discontinuous_spaces_;
 
   // The allocation space we are currently allocating into.
-  space::DlMallocSpace* alloc_space_;
+  space::MallocSpace* alloc_space_;
+
+  // Whether alloc_space_ is a RosAllocSpace, cached so that allocating doesn't need a virtual call
+  // to pick the allocator.
+  bool use_rosalloc_;
 
   // The large object space we are currently allocating into.
   space::LargeObjectSpace* large_object_space_;
@@ -586,9 +830,37 @@ class Heap {
   Mutex* finalizer_ref_queue_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   Mutex* phantom_ref_queue_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
 
+  // Guards the state of concurrent reference processing, the condition variable is signalled when
+  // it completes or when the marks become stable.
+  Mutex* reference_processor_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
+  UniquePtr<ConditionVariable> reference_processor_cond_ GUARDED_BY(reference_processor_lock_);
+
+  // True if references may be processed outside of the pause.
+  bool concurrent_reference_processing_;
+
+  // Milliseconds a soft referent is kept for each free megabyte of heap since it was last read,
+  // 0 to preserve every other white soft referent.
+  const size_t soft_ref_lru_policy_ms_per_mb_;
+
+  // Offset of java.lang.ref.SoftReference.timestamp, 0 unless the LRU policy is used.
+  MemberOffset soft_reference_timestamp_offset_;
+
+  // Time of the end of the last collection in milliseconds, stored in the timestamp of soft
+  // references when they are read, and the age after which their white referents are cleared.
+  volatile int64_t soft_reference_clock_ms_;
+  int64_t soft_reference_max_age_ms_;
+
+  // True while references are processed concurrently, read without the lock by GetReferent.
+  volatile bool reference_processing_slow_path_;
+  IsMarkedTester* referent_marked_tester_ GUARDED_BY(reference_processor_lock_);
+  void* referent_marked_arg_ GUARDED_BY(reference_processor_lock_);
+
   // True while the garbage collector is running.
   volatile bool is_gc_running_ GUARDED_BY(gc_complete_lock_);
 
+  // True while VisitLiveObjectsParallel uses the thread pool, the collectors wait for it.
+  bool thread_pool_borrowed_ GUARDED_BY(gc_complete_lock_);
+
   // Last Gc type we ran. Used by WaitForConcurrentGc to know which Gc was waited on.
   volatile collector::GcType last_gc_type_ GUARDED_BY(gc_complete_lock_);
   collector::GcType next_gc_type_;
@@ -640,6 +912,8 @@ class Heap {
   AtomicInteger num_bytes_allocated_;
 
   // Bytes which are allocated and managed by native code but still need to be accounted for.
+  // Threads may free bytes which other threads haven't flushed yet, so it can be briefly negative,
+  // see GetNativeBytesAllocated.
   AtomicInteger native_bytes_allocated_;
 
   // Data structure GC overhead.
@@ -666,6 +940,24 @@ class Heap {
   // The last time a heap trim occurred.
   uint64_t last_trim_time_ms_;
 
+  // Bytes of the alloc space trimmed at a time, the space lock is released between the steps.
+  const size_t heap_trim_step_size_;
+
+  // Bytes of the alloc space a trim goes through before leaving the rest of the pass to the next.
+  const size_t heap_trim_budget_;
+
+  // Guards the progress of the trim passes over the alloc space.
+  Mutex* heap_trim_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
+
+  // The space the current pass is over, which changes when the zygote space is created.
+  space::MallocSpace* trim_space_ GUARDED_BY(heap_trim_lock_);
+
+  // Offset in trim_space_ of the next step to trim, 0 when no pass is in progress.
+  size_t trim_cursor_ GUARDED_BY(heap_trim_lock_);
+
+  // Time in milliseconds at which each step of trim_space_ was last trimmed.
+  std::vector<uint64_t> trim_step_times_ms_ GUARDED_BY(heap_trim_lock_);
+
   // The nanosecond time at which the last GC ended.
   uint64_t last_gc_time_ns_;
 
@@ -684,7 +976,9 @@ class Heap {
   UniquePtr<accounting::ObjectStack> mark_stack_;
 
   // Allocation stack, new allocations go here so that we can do sticky mark bits. This enables us
-  // to use the live bitmap as the old mark bitmap.
+  // to use the live bitmap as the old mark bitmap. Threads reserve segments of the stack and push
+  // into them without synchronization. The GC revokes the segments before it reads the stack, their
+  // unused slots are left NULL.
   const size_t max_allocation_stack_size_;
   bool is_allocation_stack_sorted_;
   UniquePtr<accounting::ObjectStack> allocation_stack_;
@@ -692,6 +986,15 @@ class Heap {
   // Second allocation stack so that we can process allocation with the heap unlocked.
   UniquePtr<accounting::ObjectStack> live_stack_;
 
+  // Objects allocated by tenured sites, and the ones allocated before the current collection
+  // started. Mark sweeps set them live before marking rather than sweeping them with the live
+  // stack.
+  UniquePtr<accounting::ObjectStack> tenured_allocation_stack_;
+  UniquePtr<accounting::ObjectStack> tenured_live_stack_;
+
+  // Allocation site sampling, NULL if pretenuring is disabled.
+  UniquePtr<accounting::AllocationSiteTable> allocation_sites_;
+
   // offset of java.lang.ref.Reference.referent
   MemberOffset reference_referent_offset_;
 
@@ -717,6 +1020,27 @@ class Heap {
   // Target ideal heap utilization ratio
   double target_utilization_;
 
+  // Pause time goal, 0 if none. Collections which pause the mutators for longer make the heap
+  // start concurrent collections earlier, shrink or avoid partial collections.
+  const uint64_t pause_goal_ns_;
+
+  // Throughput goal, 0 if none. At most 1 / (1 + gc_time_ratio_) of the time should be spent
+  // collecting, otherwise the heap is allowed to keep more free space.
+  const size_t gc_time_ratio_;
+
+  // Moving average of the fraction of time spent in collections.
+  double gc_time_fraction_;
+
+  // Scale applied to min_free_ and max_free_ by the ergonomics.
+  double free_scale_;
+
+  // Scale applied to the bytes expected to be allocated during a concurrent collection, when
+  // deciding when to start it.
+  double concurrent_start_scale_;
+
+  // The cause of the collection in progress.
+  GcCause current_gc_cause_;
+
   // Total time which mutators are paused or waiting for GC to complete.
   uint64_t total_wait_time_;
 
@@ -728,13 +1052,24 @@ class Heap {
 
   std::vector<collector::MarkSweep*> mark_sweep_collectors_;
 
+  // Compacts the alloc space, see Compact.
+  UniquePtr<collector::Compactor> compactor_;
+
+  // Records of the recent collections.
+  UniquePtr<GcEventLog> gc_event_log_;
+
+  // Sampled allocation sites, only counted while its sample interval isn't 0.
+  UniquePtr<AllocationProfiler> allocation_profiler_;
+
   const bool running_on_valgrind_;
 
+  friend class collector::Compactor;
   friend class collector::MarkSweep;
   friend class VerifyReferenceCardVisitor;
   friend class VerifyReferenceVisitor;
   friend class VerifyObjectVisitor;
   friend class ScopedHeapLock;
+  friend class HeapTest;
   friend class space::SpaceTest;
 
   DISALLOW_IMPLICIT_CONSTRUCTORS(Heap);
@@ -14,9 +14,13 @@
  * limitations under the License.
  */
 
+#include <sstream>
+#include <vector>
+
 #include "common_test.h"
 #include "gc/accounting/card_table-inl.h"
 #include "gc/accounting/space_bitmap-inl.h"
+#include "gc/gc_event_log.h"
 #include "mirror/class-inl.h"
 #include "mirror/object-inl.h"
 #include "mirror/object_array-inl.h"
@@ -25,7 +29,27 @@
 namespace art {
 namespace gc {
 
-class HeapTest : public CommonTest {};
+class HeapTest : public CommonTest {
+ public:
+  // Enables the soft reference LRU policy, with the timestamp of a soft reference at offset.
+  static void EnableSoftReferenceLruPolicy(Heap* heap, size_t ms_per_mb, MemberOffset offset) {
+    heap->soft_ref_lru_policy_ms_per_mb_ = ms_per_mb;
+    heap->soft_reference_timestamp_offset_ = offset;
+  }
+
+  static void DisableSoftReferenceLruPolicy(Heap* heap) {
+    heap->soft_ref_lru_policy_ms_per_mb_ = 0;
+    heap->soft_reference_timestamp_offset_ = MemberOffset(0);
+  }
+
+  static void UpdateSoftReferenceClock(Heap* heap, uint64_t now_ns, size_t bytes_allocated) {
+    heap->UpdateSoftReferenceClock(now_ns, bytes_allocated);
+  }
+
+  static int64_t GetSoftReferenceMaxAgeMs(Heap* heap) {
+    return heap->soft_reference_max_age_ms_;
+  }
+};
 
 TEST_F(HeapTest, ClearGrowthLimit) {
   Heap* heap = Runtime::Current()->GetHeap();
@@ -67,5 +91,153 @@ TEST_F(HeapTest, HeapBitmapCapacityTest) {
   bitmap->Set(fake_end_of_heap_object);
 }
 
+TEST_F(HeapTest, HeapQueries) {
+  ScopedObjectAccess soa(Thread::Current());
+  Heap* heap = Runtime::Current()->GetHeap();
+  mirror::Class* object_array_class = class_linker_->FindSystemClass("[Ljava/lang/Object;");
+  std::vector<mirror::Class*> classes;
+  classes.push_back(class_linker_->FindSystemClass("[I"));
+  uint64_t count_before = 0;
+  heap->CountInstances(classes, false, &count_before);
+
+  // Enough arrays for every stripe of a parallel walk to find some.
+  const size_t num_arrays = 4096;
+  SirtRef<mirror::ObjectArray<mirror::Object> > holder(soa.Self(),
+      mirror::ObjectArray<mirror::Object>::Alloc(soa.Self(), object_array_class, num_arrays));
+  for (size_t i = 0; i < num_arrays; ++i) {
+    holder->Set(i, mirror::IntArray::Alloc(soa.Self(), 16));
+  }
+  uint64_t count_after = 0;
+  heap->CountInstances(classes, false, &count_after);
+  EXPECT_EQ(count_before + num_arrays, count_after);
+
+  std::vector<mirror::Object*> instances;
+  heap->GetInstances(classes[0], 10, instances);
+  EXPECT_EQ(10U, instances.size());
+  instances.clear();
+  heap->GetInstances(classes[0], 0, instances);
+  EXPECT_EQ(count_after, instances.size());
+
+  std::vector<mirror::Object*> referring_objects;
+  heap->GetReferringObjects(holder->Get(num_arrays - 1), 0, referring_objects);
+  ASSERT_EQ(1U, referring_objects.size());
+  EXPECT_EQ(holder.get(), referring_objects[0]);
+}
+
+TEST_F(HeapTest, ThreadLocalAllocationBuffers) {
+  ScopedObjectAccess soa(Thread::Current());
+  Thread* self = soa.Self();
+  Heap* heap = Runtime::Current()->GetHeap();
+  if (!heap->GetAllocSpace()->IsDlMallocSpace()) {
+    // RosAlloc has thread local runs instead.
+    return;
+  }
+  heap->RevokeThreadLocalBuffer(self);
+  const size_t bytes_before = heap->GetBytesAllocated();
+  const size_t objects_before = heap->GetObjectsAllocated();
+
+  // The first small allocation carves a buffer, the whole of which counts as allocated.
+  SirtRef<mirror::IntArray> first(self, mirror::IntArray::Alloc(self, 4));
+  ASSERT_TRUE(first.get() != NULL);
+  ASSERT_TRUE(self->GetThreadLocalEnd() != NULL);
+  const size_t buffer_size = self->GetThreadLocalEnd() - self->GetThreadLocalStart();
+  EXPECT_EQ(bytes_before + buffer_size, heap->GetBytesAllocated());
+  EXPECT_EQ(objects_before, heap->GetObjectsAllocated());
+
+  // The next one is bumped out of the same buffer.
+  SirtRef<mirror::IntArray> second(self, mirror::IntArray::Alloc(self, 4));
+  ASSERT_TRUE(second.get() != NULL);
+  EXPECT_EQ(reinterpret_cast<byte*>(first.get()) +
+                heap->GetAllocSpace()->AllocationSize(first.get()),
+            reinterpret_cast<byte*>(second.get()));
+  EXPECT_EQ(bytes_before + buffer_size, heap->GetBytesAllocated());
+  EXPECT_EQ(2U, self->GetThreadLocalObjectsAllocated());
+
+  // Revoking keeps only the used part of the buffer and counts its objects.
+  const size_t used = self->GetThreadLocalPos() - self->GetThreadLocalStart();
+  heap->RevokeThreadLocalBuffer(self);
+  EXPECT_TRUE(self->GetThreadLocalEnd() == NULL);
+  EXPECT_EQ(bytes_before + used, heap->GetBytesAllocated());
+  EXPECT_EQ(objects_before + 2, heap->GetObjectsAllocated());
+}
+
+TEST_F(HeapTest, SoftReferenceLruPolicy) {
+  ScopedObjectAccess soa(Thread::Current());
+  Heap* heap = Runtime::Current()->GetHeap();
+  ASSERT_FALSE(heap->IsSoftReferenceLruPolicyEnabled());
+  // The first element of a long array stands in for SoftReference.timestamp.
+  SirtRef<mirror::LongArray> ref(soa.Self(), mirror::LongArray::Alloc(soa.Self(), 1));
+  ASSERT_TRUE(ref.get() != NULL);
+  const MemberOffset timestamp_offset = mirror::Array::DataOffset(sizeof(int64_t));
+  EnableSoftReferenceLruPolicy(heap, 1000, timestamp_offset);
+  ASSERT_TRUE(heap->IsSoftReferenceLruPolicyEnabled());
+
+  // 1000 ms per whole MB free, partial MBs don't count.
+  const size_t max_memory = heap->GetMaxMemory();
+  ASSERT_LE(11 * MB, max_memory);
+  UpdateSoftReferenceClock(heap, MsToNs(100000), max_memory - 10 * MB - 512 * KB);
+  EXPECT_EQ(10000, GetSoftReferenceMaxAgeMs(heap));
+  UpdateSoftReferenceClock(heap, MsToNs(100000), max_memory - 10 * MB);
+  EXPECT_EQ(10000, GetSoftReferenceMaxAgeMs(heap));
+  // More allocated than the maximum leaves nothing free.
+  UpdateSoftReferenceClock(heap, MsToNs(100000), max_memory + MB);
+  EXPECT_EQ(0, GetSoftReferenceMaxAgeMs(heap));
+
+  UpdateSoftReferenceClock(heap, MsToNs(100000), max_memory - 10 * MB);
+  // A referent never read takes the clock as its timestamp and is preserved.
+  ref->Set(0, 0);
+  EXPECT_TRUE(heap->ShouldPreserveSoftReferent(ref.get()));
+  EXPECT_EQ(100000, ref->Get(0));
+  // Preserved up to and including the maximum age.
+  ref->Set(0, 100000 - 10000);
+  EXPECT_TRUE(heap->ShouldPreserveSoftReferent(ref.get()));
+  ref->Set(0, 100000 - 10001);
+  EXPECT_FALSE(heap->ShouldPreserveSoftReferent(ref.get()));
+
+  // Once the clock moves on, the referent is only preserved if it was read since.
+  UpdateSoftReferenceClock(heap, MsToNs(200000), max_memory - 10 * MB);
+  EXPECT_FALSE(heap->ShouldPreserveSoftReferent(ref.get()));
+  ref->Set(0, 200000);
+  EXPECT_TRUE(heap->ShouldPreserveSoftReferent(ref.get()));
+
+  DisableSoftReferenceLruPolicy(heap);
+}
+
+TEST_F(HeapTest, GcEventLog) {
+  Heap* heap = Runtime::Current()->GetHeap();
+  GcEventLog* log = heap->GetGcEventLog();
+  const uint64_t count_before = log->GetEventCount();
+  heap->CollectGarbage(false);
+  ASSERT_EQ(count_before + 1, log->GetEventCount());
+
+  std::vector<GcEvent> events;
+  log->GetEvents(count_before, &events);
+  ASSERT_EQ(1U, events.size());
+  const GcEvent& event = events[0];
+  EXPECT_EQ(count_before, event.sequence);
+  EXPECT_EQ(static_cast<uint32_t>(kGcCauseExplicit), event.cause);
+  EXPECT_LE(1U, event.num_pauses);
+  EXPECT_LE(1U, event.num_splits);
+  std::vector<std::string> names = log->GetNames();
+  ASSERT_LT(event.collector, names.size());
+  EXPECT_NE(std::string::npos, names[event.collector].find("mark sweep"));
+
+  std::vector<int64_t> flattened;
+  log->GetEvents(count_before, &flattened);
+  ASSERT_EQ(static_cast<size_t>(GcEventLog::kFlattenedEventSize), flattened.size());
+  EXPECT_EQ(static_cast<int64_t>(event.sequence), flattened[0]);
+
+  std::ostringstream csv;
+  log->DumpCsv(csv);
+  EXPECT_NE(std::string::npos, csv.str().find(names[event.collector]));
+  std::ostringstream json;
+  heap->DumpGcEvents(json, true);
+  EXPECT_EQ(0U, json.str().find("{\"events\":["));
+  // The pause histogram of the collector which ran is dumped too.
+  const size_t histograms = json.str().find("\"pause_histograms\":{");
+  ASSERT_NE(std::string::npos, histograms);
+  EXPECT_NE(std::string::npos, json.str().find(names[event.collector], histograms));
+}
+
 }  // namespace gc
 }  // namespace art
@@ -18,6 +18,7 @@
 #define ART_RUNTIME_GC_SPACE_DLMALLOC_SPACE_INL_H_
 
 #include "dlmalloc_space.h"
+#include "thread.h"
 
 namespace art {
 namespace gc {
@@ -55,6 +56,38 @@ inline mirror::Object* DlMallocSpace::AllocWithoutGrowthLocked(size_t num_bytes,
   return result;
 }
 
+inline mirror::Object* DlMallocSpace::AllocThreadLocal(Thread* self, size_t num_bytes,
+                                                       size_t* bytes_allocated) {
+  byte* chunk = self->GetThreadLocalPos();
+  size_t remaining = self->GetThreadLocalEnd() - chunk;
+  size_t chunk_size = DlMallocChunkSize(num_bytes);
+  if (UNLIKELY(chunk_size > remaining)) {
+    return NULL;
+  }
+  size_t tail_size = remaining - chunk_size;
+  if (tail_size < kDlMallocMinChunkSize) {
+    // The tail is too small to be a chunk of its own, give it to this allocation.
+    chunk_size = remaining;
+  } else {
+    // Format the new tail before shrinking the current chunk so that the buffer always consists of
+    // valid in-use chunks.
+    DlMallocSetInUseChunk(chunk + chunk_size, tail_size);
+  }
+  DlMallocResizeInUseChunk(chunk, chunk_size);
+  self->RecordThreadLocalAllocation(chunk + chunk_size);
+  mirror::Object* result = reinterpret_cast<mirror::Object*>(DlMallocChunkToMem(chunk));
+  if (kDebugSpaces) {
+    CHECK(Contains(result)) << "Allocation (" << reinterpret_cast<void*>(result)
+        << ") not in bounds of allocation space " << *this;
+    CHECK_EQ(AllocationSizeNonvirtual(result), chunk_size);
+  }
+  DCHECK(bytes_allocated != NULL);
+  *bytes_allocated = chunk_size;
+  // The buffer's memory may hold stale data from previously freed objects.
+  memset(result, 0, num_bytes);
+  return result;
+}
+
 }  // namespace space
 }  // namespace gc
 }  // namespace art
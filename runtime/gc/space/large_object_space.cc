@@ -16,6 +16,8 @@
 
 #include "large_object_space.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/stl_util.h"
 #include "UniquePtr.h"
@@ -106,7 +108,7 @@ size_t LargeObjectSpace::FreeList(Thread* self, size_t num_ptrs, mirror::Object*
   return total;
 }
 
-void LargeObjectMapSpace::Walk(DlMallocSpace::WalkCallback callback, void* arg) {
+void LargeObjectMapSpace::Walk(MallocSpace::WalkCallback callback, void* arg) {
   MutexLock mu(Thread::Current(), lock_);
   for (MemMaps::iterator it = mem_maps_.begin(); it != mem_maps_.end(); ++it) {
     MemMap* mem_map = it->second;
@@ -126,47 +128,137 @@ bool LargeObjectMapSpace::Contains(const mirror::Object* obj) const {
   }
 }
 
-FreeListSpace* FreeListSpace::Create(const std::string& name, byte* requested_begin, size_t size) {
+FreeListSpace* FreeListSpace::Create(const std::string& name, byte* requested_begin, size_t size,
+                                     bool use_huge_pages) {
   CHECK_EQ(size % kAlignment, 0U);
   MemMap* mem_map = MemMap::MapAnonymous(name.c_str(), requested_begin, size,
                                          PROT_READ | PROT_WRITE);
   CHECK(mem_map != NULL) << "Failed to allocate large object space mem map";
-  return new FreeListSpace(name, mem_map, mem_map->Begin(), mem_map->End());
+  return new FreeListSpace(name, mem_map, mem_map->Begin(), mem_map->End(), use_huge_pages);
 }
 
-FreeListSpace::FreeListSpace(const std::string& name, MemMap* mem_map, byte* begin, byte* end)
+FreeListSpace::FreeListSpace(const std::string& name, MemMap* mem_map, byte* begin, byte* end,
+                             bool use_huge_pages)
     : LargeObjectSpace(name),
       begin_(begin),
       end_(end),
+      use_huge_pages_(use_huge_pages),
       mem_map_(mem_map),
-      lock_("free list space lock", kAllocSpaceLock) {
-  free_end_ = end - begin;
+      lock_("free list space lock", kAllocSpaceLock),
+      non_empty_free_lists_(0),
+      dirty_bytes_(0) {
+  std::fill(free_lists_, free_lists_ + kNumFreeLists, static_cast<FreeBlock*>(NULL));
+  // The whole space starts as a single clean free block.
+  FreeBlock* block = reinterpret_cast<FreeBlock*>(begin);
+  block->header.SetAllocationSize(end - begin, true);
+  block->header.SetPrevAllocationSize(0);
+  block->prev = NULL;
+  block->next = NULL;
+  block->dirty_size = 0;
+  const size_t index = GetFreeListIndex(end - begin);
+  free_lists_[index] = block;
+  non_empty_free_lists_ = 1U << index;
 }
 
 FreeListSpace::~FreeListSpace() {}
 
-void FreeListSpace::Walk(DlMallocSpace::WalkCallback callback, void* arg) {
+void FreeListSpace::Walk(MallocSpace::WalkCallback callback, void* arg) {
   MutexLock mu(Thread::Current(), lock_);
-  uintptr_t free_end_start = reinterpret_cast<uintptr_t>(end_) - free_end_;
-  AllocationHeader* cur_header = reinterpret_cast<AllocationHeader*>(Begin());
-  while (reinterpret_cast<uintptr_t>(cur_header) < free_end_start) {
-    cur_header = cur_header->GetNextNonFree();
+  for (AllocationHeader* cur_header = reinterpret_cast<AllocationHeader*>(Begin());
+       reinterpret_cast<byte*>(cur_header) < End();
+       cur_header = cur_header->GetNextAllocationHeader()) {
+    if (cur_header->IsFree()) {
+      continue;
+    }
     size_t alloc_size = cur_header->AllocationSize();
     byte* byte_start = reinterpret_cast<byte*>(cur_header->GetObjectAddress());
     byte* byte_end = byte_start + alloc_size - sizeof(AllocationHeader);
     callback(byte_start, byte_end, alloc_size, arg);
     callback(NULL, NULL, 0, arg);
-    cur_header = reinterpret_cast<AllocationHeader*>(byte_end);
   }
 }
 
-void FreeListSpace::RemoveFreePrev(AllocationHeader* header) {
-  CHECK(!header->IsFree());
-  CHECK_GT(header->GetPrevFree(), size_t(0));
-  FreeBlocks::iterator found = free_blocks_.lower_bound(header);
-  CHECK(found != free_blocks_.end());
-  CHECK_EQ(*found, header);
-  free_blocks_.erase(found);
+void FreeListSpace::AddFreeBlock(FreeBlock* block) {
+  DCHECK(block->header.IsFree());
+  DCHECK_LE(block->dirty_size, block->header.AllocationSize());
+  const size_t index = GetFreeListIndex(block->header.AllocationSize());
+  block->prev = NULL;
+  block->next = free_lists_[index];
+  if (block->next != NULL) {
+    block->next->prev = block;
+  }
+  free_lists_[index] = block;
+  non_empty_free_lists_ |= 1U << index;
+  dirty_bytes_ += block->dirty_size;
+}
+
+void FreeListSpace::RemoveFreeBlock(FreeBlock* block) {
+  DCHECK(block->header.IsFree());
+  const size_t index = GetFreeListIndex(block->header.AllocationSize());
+  if (block->prev != NULL) {
+    block->prev->next = block->next;
+  } else {
+    DCHECK_EQ(free_lists_[index], block);
+    free_lists_[index] = block->next;
+    if (block->next == NULL) {
+      non_empty_free_lists_ &= ~(1U << index);
+    }
+  }
+  if (block->next != NULL) {
+    block->next->prev = block->prev;
+  }
+  DCHECK_GE(dirty_bytes_, block->dirty_size);
+  dirty_bytes_ -= block->dirty_size;
+}
+
+FreeListSpace::FreeBlock* FreeListSpace::FindFreeBlock(size_t size) {
+  // The blocks of the list of size may be smaller than size, those of the larger lists fit.
+  const size_t index = GetFreeListIndex(size);
+  for (FreeBlock* block = free_lists_[index]; block != NULL; block = block->next) {
+    if (block->header.AllocationSize() >= size) {
+      RemoveFreeBlock(block);
+      return block;
+    }
+  }
+  const uint32_t larger_lists = index + 1 < kNumFreeLists ?
+      non_empty_free_lists_ & ~((2U << index) - 1) : 0;
+  if (larger_lists == 0) {
+    return NULL;
+  }
+  FreeBlock* block = free_lists_[CTZ(larger_lists)];
+  RemoveFreeBlock(block);
+  return block;
+}
+
+void FreeListSpace::ReleaseFreeBlock(FreeBlock* block) {
+  const size_t dirty_size = block->dirty_size;
+  if (dirty_size == 0) {
+    return;
+  }
+  // The first page holds the free block, only clear the rest of it.
+  byte* const first_page = reinterpret_cast<byte*>(block);
+  memset(first_page + sizeof(FreeBlock), 0, std::min(dirty_size, kPageSize) - sizeof(FreeBlock));
+  if (dirty_size > kPageSize) {
+    madvise(first_page + kPageSize, dirty_size - kPageSize, MADV_DONTNEED);
+  }
+  block->dirty_size = 0;
+}
+
+size_t FreeListSpace::ReleaseFreeBlocks() {
+  size_t released = 0;
+  for (size_t i = 0; i < kNumFreeLists; ++i) {
+    for (FreeBlock* block = free_lists_[i]; block != NULL; block = block->next) {
+      released += block->dirty_size;
+      ReleaseFreeBlock(block);
+    }
+  }
+  dirty_bytes_ = 0;
+  return released;
+}
+
+size_t FreeListSpace::Trim() {
+  MutexLock mu(Thread::Current(), lock_);
+  return ReleaseFreeBlocks();
 }
 
 FreeListSpace::AllocationHeader* FreeListSpace::GetAllocationHeader(const mirror::Object* obj) {
@@ -175,63 +267,58 @@ FreeListSpace::AllocationHeader* FreeListSpace::GetAllocationHeader(const mirror
       sizeof(AllocationHeader));
 }
 
-FreeListSpace::AllocationHeader* FreeListSpace::AllocationHeader::GetNextNonFree() {
-  // We know that there has to be at least one object after us or else we would have
-  // coalesced with the free end region. May be worth investigating a better way to do this
-  // as it may be expensive for large allocations.
-  for (uintptr_t pos = reinterpret_cast<uintptr_t>(this);; pos += kAlignment) {
-    AllocationHeader* cur = reinterpret_cast<AllocationHeader*>(pos);
-    if (!cur->IsFree()) return cur;
-  }
-}
-
 size_t FreeListSpace::Free(Thread* self, mirror::Object* obj) {
   MutexLock mu(self, lock_);
   DCHECK(Contains(obj));
   AllocationHeader* header = GetAllocationHeader(obj);
   CHECK(IsAligned<kAlignment>(header));
-  size_t allocation_size = header->AllocationSize();
+  CHECK(!header->IsFree()) << "Attempted to free large object which was not live";
+  const size_t allocation_size = header->AllocationSize();
   DCHECK_GT(allocation_size, size_t(0));
   DCHECK(IsAligned<kAlignment>(allocation_size));
-  // Look at the next chunk.
+  FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+  size_t block_size = allocation_size;
+  size_t dirty_size = allocation_size;
+  // Coalesce with the next block, whose header is cleared as it ends up in the middle of ours.
   AllocationHeader* next_header = header->GetNextAllocationHeader();
-  // Calculate the start of the end free block.
-  uintptr_t free_end_start = reinterpret_cast<uintptr_t>(end_) - free_end_;
-  size_t header_prev_free = header->GetPrevFree();
-  size_t new_free_size = allocation_size;
-  if (header_prev_free) {
-    new_free_size += header_prev_free;
-    RemoveFreePrev(header);
+  if (reinterpret_cast<byte*>(next_header) < end_ && next_header->IsFree()) {
+    FreeBlock* next_block = reinterpret_cast<FreeBlock*>(next_header);
+    RemoveFreeBlock(next_block);
+    dirty_size += next_block->dirty_size;
+    block_size += next_header->AllocationSize();
+    memset(next_block, 0, sizeof(*next_block));
   }
-  if (reinterpret_cast<uintptr_t>(next_header) >= free_end_start) {
-    // Easy case, the next chunk is the end free region.
-    CHECK_EQ(reinterpret_cast<uintptr_t>(next_header), free_end_start);
-    free_end_ += new_free_size;
-  } else {
-    AllocationHeader* new_free_header;
-    DCHECK(IsAligned<kAlignment>(next_header));
-    if (next_header->IsFree()) {
-      // Find the next chunk by reading each page until we hit one with non-zero chunk.
-      AllocationHeader* next_next_header = next_header->GetNextNonFree();
-      DCHECK(IsAligned<kAlignment>(next_next_header));
-      DCHECK(IsAligned<kAlignment>(next_next_header->AllocationSize()));
-      RemoveFreePrev(next_next_header);
-      new_free_header = next_next_header;
-      new_free_size += next_next_header->GetPrevFree();
+  // Coalesce with the previous block. Our pages are released first if it has clean pages, or it
+  // would end up dirty as a whole.
+  if (header->GetPrevAllocationSize() != 0 && header->GetPrevAllocationHeader()->IsFree()) {
+    FreeBlock* prev_block = reinterpret_cast<FreeBlock*>(header->GetPrevAllocationHeader());
+    RemoveFreeBlock(prev_block);
+    const size_t prev_size = prev_block->header.AllocationSize();
+    if (prev_block->dirty_size < prev_size) {
+      block->header.SetAllocationSize(block_size, true);
+      block->dirty_size = dirty_size;
+      ReleaseFreeBlock(block);
+      dirty_size = prev_block->dirty_size;
     } else {
-      new_free_header = next_header;
+      dirty_size += prev_size;
     }
-    new_free_header->prev_free_ = new_free_size;
-    free_blocks_.insert(new_free_header);
+    memset(block, 0, sizeof(*block));
+    block = prev_block;
+    block_size += prev_size;
+  }
+  block->header.SetAllocationSize(block_size, true);
+  block->dirty_size = dirty_size;
+  AllocationHeader* following_header = block->header.GetNextAllocationHeader();
+  if (reinterpret_cast<byte*>(following_header) < end_) {
+    following_header->SetPrevAllocationSize(block_size);
+  }
+  AddFreeBlock(block);
+  if (dirty_bytes_ > kMaxDirtyBytes) {
+    ReleaseFreeBlocks();
   }
   --num_objects_allocated_;
   DCHECK_LE(allocation_size, num_bytes_allocated_);
   num_bytes_allocated_ -= allocation_size;
-  madvise(header, allocation_size, MADV_DONTNEED);
-  if (kIsDebugBuild) {
-    // Can't disallow reads since we use them to find next chunks during coalescing.
-    mprotect(header, allocation_size, PROT_READ);
-  }
   return allocation_size;
 }
 
@@ -247,37 +334,41 @@ size_t FreeListSpace::AllocationSize(const mirror::Object* obj) {
 }
 
 mirror::Object* FreeListSpace::Alloc(Thread* self, size_t num_bytes, size_t* bytes_allocated) {
+  // A page is always large enough for the free block once the object is freed.
+  const size_t allocation_size = RoundUp(num_bytes + sizeof(AllocationHeader), kAlignment);
   MutexLock mu(self, lock_);
-  size_t allocation_size = RoundUp(num_bytes + sizeof(AllocationHeader), kAlignment);
-  AllocationHeader temp;
-  temp.SetPrevFree(allocation_size);
-  temp.SetAllocationSize(0);
-  AllocationHeader* new_header;
-  // Find the smallest chunk at least num_bytes in size.
-  FreeBlocks::iterator found = free_blocks_.lower_bound(&temp);
-  if (found != free_blocks_.end()) {
-    AllocationHeader* header = *found;
-    free_blocks_.erase(found);
-
-    // Fit our object in the previous free header space.
-    new_header = header->GetPrevFreeAllocationHeader();
-
-    // Remove the newly allocated block from the header and update the prev_free_.
-    header->prev_free_ -= allocation_size;
-    if (header->prev_free_ > 0) {
-      // If there is remaining space, insert back into the free set.
-      free_blocks_.insert(header);
-    }
-  } else {
-    // Try to steal some memory from the free space at the end of the space.
-    if (LIKELY(free_end_ >= allocation_size)) {
-      // Fit our object at the start of the end free block.
-      new_header = reinterpret_cast<AllocationHeader*>(end_ - free_end_);
-      free_end_ -= allocation_size;
-    } else {
-      return NULL;
+  FreeBlock* block = FindFreeBlock(allocation_size);
+  if (block == NULL) {
+    return NULL;
+  }
+  const size_t block_size = block->header.AllocationSize();
+  const size_t dirty_size = block->dirty_size;
+  AllocationHeader* new_header = &block->header;
+  // Return the rest of the block to the free lists.
+  if (block_size > allocation_size) {
+    FreeBlock* rest = reinterpret_cast<FreeBlock*>(reinterpret_cast<byte*>(block) +
+                                                   allocation_size);
+    rest->header.SetAllocationSize(block_size - allocation_size, true);
+    rest->header.SetPrevAllocationSize(allocation_size);
+    rest->dirty_size = dirty_size > allocation_size ? dirty_size - allocation_size : 0;
+    AllocationHeader* following_header = rest->header.GetNextAllocationHeader();
+    if (reinterpret_cast<byte*>(following_header) < end_) {
+      following_header->SetPrevAllocationSize(block_size - allocation_size);
     }
+    AddFreeBlock(rest);
+  }
+  new_header->SetAllocationSize(allocation_size, false);
+#ifdef MADV_HUGEPAGE
+  if (use_huge_pages_ && allocation_size >= 2 * kHugePageSize) {
+    uintptr_t huge_begin = RoundUp(reinterpret_cast<uintptr_t>(new_header), kHugePageSize);
+    uintptr_t huge_end = RoundDown(reinterpret_cast<uintptr_t>(new_header) + allocation_size,
+                                   kHugePageSize);
+    madvise(reinterpret_cast<void*>(huge_begin), huge_end - huge_begin, MADV_HUGEPAGE);
   }
+#endif
+  // Clean pages only hold zeros apart from the free block itself.
+  const size_t clear_size = std::max(std::min(dirty_size, allocation_size), sizeof(FreeBlock));
+  memset(new_header->GetObjectAddress(), 0, clear_size - sizeof(AllocationHeader));
 
   DCHECK(bytes_allocated != NULL);
   *bytes_allocated = allocation_size;
@@ -287,42 +378,26 @@ mirror::Object* FreeListSpace::Alloc(Thread* self, size_t num_bytes, size_t* byt
   ++total_objects_allocated_;
   num_bytes_allocated_ += allocation_size;
   total_bytes_allocated_ += allocation_size;
-
-  // We always put our object at the start of the free block, there can not be another free block
-  // before it.
-  if (kIsDebugBuild) {
-    mprotect(new_header, allocation_size, PROT_READ | PROT_WRITE);
-  }
-  new_header->SetPrevFree(0);
-  new_header->SetAllocationSize(allocation_size);
   return new_header->GetObjectAddress();
 }
 
 void FreeListSpace::Dump(std::ostream& os) const {
-  MutexLock mu(Thread::Current(), const_cast<Mutex&>(lock_));
+  MutexLock mu(Thread::Current(), lock_);
   os << GetName() << " -"
      << " begin: " << reinterpret_cast<void*>(Begin())
-     << " end: " << reinterpret_cast<void*>(End()) << "\n";
-  uintptr_t free_end_start = reinterpret_cast<uintptr_t>(end_) - free_end_;
-  AllocationHeader* cur_header = reinterpret_cast<AllocationHeader*>(Begin());
-  while (reinterpret_cast<uintptr_t>(cur_header) < free_end_start) {
-    byte* free_start = reinterpret_cast<byte*>(cur_header);
-    cur_header = cur_header->GetNextNonFree();
-    byte* free_end = reinterpret_cast<byte*>(cur_header);
-    if (free_start != free_end) {
-      os << "Free block at address: " << reinterpret_cast<const void*>(free_start)
-         << " of length " << free_end - free_start << " bytes\n";
+     << " end: " << reinterpret_cast<void*>(End())
+     << " dirty free bytes: " << dirty_bytes_ << "\n";
+  for (AllocationHeader* cur_header = reinterpret_cast<AllocationHeader*>(Begin());
+       reinterpret_cast<byte*>(cur_header) < End();
+       cur_header = cur_header->GetNextAllocationHeader()) {
+    if (cur_header->IsFree()) {
+      os << "Free block at address: " << reinterpret_cast<const void*>(cur_header)
+         << " of length " << cur_header->AllocationSize() << " bytes\n";
+    } else {
+      os << "Large object at address: " << reinterpret_cast<const void*>(cur_header)
+         << " of length " << cur_header->AllocationSize() - sizeof(AllocationHeader)
+         << " bytes\n";
     }
-    size_t alloc_size = cur_header->AllocationSize();
-    byte* byte_start = reinterpret_cast<byte*>(cur_header->GetObjectAddress());
-    byte* byte_end = byte_start + alloc_size - sizeof(AllocationHeader);
-    os << "Large object at address: " << reinterpret_cast<const void*>(free_start)
-       << " of length " << byte_end - byte_start << " bytes\n";
-    cur_header = reinterpret_cast<AllocationHeader*>(byte_end);
-  }
-  if (free_end_) {
-    os << "Free block at address: " << reinterpret_cast<const void*>(free_end_start)
-       << " of length " << free_end_ << " bytes\n";
   }
 }
 
@@ -18,11 +18,10 @@
 #define ART_RUNTIME_GC_SPACE_LARGE_OBJECT_SPACE_H_
 
 #include "gc/accounting/gc_allocator.h"
-#include "dlmalloc_space.h"
+#include "malloc_space.h"
 #include "safe_map.h"
 #include "space.h"
 
-#include <set>
 #include <vector>
 
 namespace art {
@@ -38,7 +37,7 @@ class LargeObjectSpace : public DiscontinuousSpace, public AllocSpace {
 
   virtual void SwapBitmaps();
   virtual void CopyLiveToMarked();
-  virtual void Walk(DlMallocSpace::WalkCallback, void* arg) = 0;
+  virtual void Walk(MallocSpace::WalkCallback, void* arg) = 0;
   virtual ~LargeObjectSpace() {}
 
   uint64_t GetBytesAllocated() const {
@@ -59,6 +58,9 @@ class LargeObjectSpace : public DiscontinuousSpace, public AllocSpace {
 
   size_t FreeList(Thread* self, size_t num_ptrs, mirror::Object** ptrs);
 
+  // Release the memory which is no longer in use, returns the number of bytes released.
+  virtual size_t Trim() = 0;
+
  protected:
   explicit LargeObjectSpace(const std::string& name);
 
@@ -85,10 +87,15 @@ class LargeObjectMapSpace : public LargeObjectSpace {
   size_t AllocationSize(const mirror::Object* obj);
   mirror::Object* Alloc(Thread* self, size_t num_bytes, size_t* bytes_allocated);
   size_t Free(Thread* self, mirror::Object* ptr);
-  void Walk(DlMallocSpace::WalkCallback, void* arg) LOCKS_EXCLUDED(lock_);
+  void Walk(MallocSpace::WalkCallback, void* arg) LOCKS_EXCLUDED(lock_);
   // TODO: disabling thread safety analysis as this may be called when we already hold lock_.
   bool Contains(const mirror::Object* obj) const NO_THREAD_SAFETY_ANALYSIS;
 
+  // Freed objects are unmapped right away.
+  size_t Trim() {
+    return 0;
+  }
+
  private:
   explicit LargeObjectMapSpace(const std::string& name);
   virtual ~LargeObjectMapSpace() {}
@@ -102,24 +109,34 @@ class LargeObjectMapSpace : public LargeObjectSpace {
   MemMaps mem_maps_ GUARDED_BY(lock_);
 };
 
-// A continuous large object space with a free-list to handle holes.
+// A continuous large object space. The space is divided into page aligned blocks which each start
+// with a header, free blocks are kept in free lists segregated by their power of two number of
+// pages and coalesced with their free neighbours. The pages of free blocks are released lazily,
+// once enough of them are dirty or when the space is trimmed, allocations which reuse dirty pages
+// clear them instead of faulting in new ones.
 class FreeListSpace : public LargeObjectSpace {
  public:
   virtual ~FreeListSpace();
-  static FreeListSpace* Create(const std::string& name, byte* requested_begin, size_t capacity);
+  // If use_huge_pages, the allocations of multiple huge pages are advised to be backed by
+  // transparent huge pages.
+  static FreeListSpace* Create(const std::string& name, byte* requested_begin, size_t capacity,
+                               bool use_huge_pages = false);
 
-  size_t AllocationSize(const mirror::Object* obj) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  size_t AllocationSize(const mirror::Object* obj);
   mirror::Object* Alloc(Thread* self, size_t num_bytes, size_t* bytes_allocated);
   size_t Free(Thread* self, mirror::Object* obj);
   bool Contains(const mirror::Object* obj) const;
-  void Walk(DlMallocSpace::WalkCallback callback, void* arg) LOCKS_EXCLUDED(lock_);
+  void Walk(MallocSpace::WalkCallback callback, void* arg) LOCKS_EXCLUDED(lock_);
+
+  // Release the dirty pages of the free blocks, returns the number of bytes released.
+  size_t Trim() LOCKS_EXCLUDED(lock_);
 
   // Address at which the space begins.
   byte* Begin() const {
     return begin_;
   }
 
-  // Address at which the space ends, which may vary as the space is filled.
+  // Address at which the space ends.
   byte* End() const {
     return end_;
   }
@@ -133,101 +150,107 @@ class FreeListSpace : public LargeObjectSpace {
 
  private:
   static const size_t kAlignment = kPageSize;
+  // One free list per power of two number of pages.
+  static const size_t kNumFreeLists = 32;
+  // The dirty pages of free blocks are released once there are more than this many bytes of them.
+  static const size_t kMaxDirtyBytes = 16 * MB;
+  static const size_t kHugePageSize = 2 * MB;
 
   class AllocationHeader {
    public:
-    // Returns the allocation size, includes the header.
+    // Returns the size of the block, includes the header.
     size_t AllocationSize() const {
-      return alloc_size_;
-    }
-
-    // Updates the allocation size in the header, the allocation size includes the header itself.
-    void SetAllocationSize(size_t size) {
-      DCHECK(IsAligned<kPageSize>(size));
-      alloc_size_ = size;
+      return size_ & ~kFreeFlag;
     }
 
     bool IsFree() const {
-      return AllocationSize() == 0;
+      return (size_ & kFreeFlag) != 0;
     }
 
-    // Returns the previous free allocation header by using the prev_free_ member to figure out
-    // where it is. If prev free is 0 then we just return ourself.
-    AllocationHeader* GetPrevFreeAllocationHeader() {
-      return reinterpret_cast<AllocationHeader*>(reinterpret_cast<uintptr_t>(this) - prev_free_);
+    void SetAllocationSize(size_t size, bool is_free) {
+      DCHECK(IsAligned<kAlignment>(size));
+      size_ = is_free ? size | kFreeFlag : size;
     }
 
-    // Returns the address of the object associated with this allocation header.
-    mirror::Object* GetObjectAddress() {
-      return reinterpret_cast<mirror::Object*>(reinterpret_cast<uintptr_t>(this) + sizeof(*this));
+    // Returns the size of the previous block, 0 if this is the first block of the space.
+    size_t GetPrevAllocationSize() const {
+      return prev_size_;
     }
 
-    // Returns the next allocation header after the object associated with this allocation header.
-    AllocationHeader* GetNextAllocationHeader() {
-      DCHECK_NE(alloc_size_, 0U);
-      return reinterpret_cast<AllocationHeader*>(reinterpret_cast<uintptr_t>(this) + alloc_size_);
+    void SetPrevAllocationSize(size_t prev_size) {
+      DCHECK(IsAligned<kAlignment>(prev_size));
+      prev_size_ = prev_size;
     }
 
-    // Returns how many free bytes there is before the block.
-    size_t GetPrevFree() const {
-      return prev_free_;
+    AllocationHeader* GetPrevAllocationHeader() {
+      DCHECK_NE(prev_size_, 0U);
+      return reinterpret_cast<AllocationHeader*>(reinterpret_cast<uintptr_t>(this) - prev_size_);
     }
 
-    // Update the size of the free block prior to the allocation.
-    void SetPrevFree(size_t prev_free) {
-      DCHECK(IsAligned<kPageSize>(prev_free));
-      prev_free_ = prev_free;
+    // Returns the next allocation header after the block.
+    AllocationHeader* GetNextAllocationHeader() {
+      return reinterpret_cast<AllocationHeader*>(reinterpret_cast<uintptr_t>(this) +
+                                                 AllocationSize());
     }
 
-    // Finds and returns the next non free allocation header after ourself.
-    // TODO: Optimize, currently O(n) for n free following pages.
-    AllocationHeader* GetNextNonFree();
-
-    // Used to implement best fit object allocation. Each allocation has an AllocationHeader which
-    // contains the size of the previous free block preceding it. Implemented in such a way that we
-    // can also find the iterator for any allocation header pointer.
-    class SortByPrevFree {
-     public:
-      bool operator()(const AllocationHeader* a, const AllocationHeader* b) const {
-        if (a->GetPrevFree() < b->GetPrevFree()) return true;
-        if (a->GetPrevFree() > b->GetPrevFree()) return false;
-        if (a->AllocationSize() < b->AllocationSize()) return true;
-        if (a->AllocationSize() > b->AllocationSize()) return false;
-        return reinterpret_cast<uintptr_t>(a) < reinterpret_cast<uintptr_t>(b);
-      }
-    };
+    // Returns the address of the object associated with this allocation header.
+    mirror::Object* GetObjectAddress() {
+      return reinterpret_cast<mirror::Object*>(reinterpret_cast<uintptr_t>(this) + sizeof(*this));
+    }
 
    private:
-    // Contains the size of the previous free block, if 0 then the memory preceding us is an
-    // allocation.
-    size_t prev_free_;
+    // Blocks are page aligned, the lowest bit of the size is free to flag free blocks.
+    static const size_t kFreeFlag = 1;
 
-    // Allocation size of this object, 0 means that the allocation header is free memory.
-    size_t alloc_size_;
+    size_t size_;
+    size_t prev_size_;
+  };
 
-    friend class FreeListSpace;
+  // Free blocks keep their free list links after their header.
+  struct FreeBlock {
+    AllocationHeader header;
+    FreeBlock* prev;
+    FreeBlock* next;
+    // The first dirty_size bytes of the block may hold stale data and need to be cleared before
+    // they are handed out, the rest of the block only holds zeros apart from this struct.
+    size_t dirty_size;
   };
 
-  FreeListSpace(const std::string& name, MemMap* mem_map, byte* begin, byte* end);
+  FreeListSpace(const std::string& name, MemMap* mem_map, byte* begin, byte* end,
+                bool use_huge_pages);
+
+  static size_t GetFreeListIndex(size_t size) {
+    DCHECK_GE(size, kAlignment);
+    return kNumFreeLists - 1 - CLZ(static_cast<uint32_t>(size / kAlignment));
+  }
+
+  void AddFreeBlock(FreeBlock* block) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void RemoveFreeBlock(FreeBlock* block) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Returns a free block of at least size bytes, removed from its free list, NULL if none.
+  FreeBlock* FindFreeBlock(size_t size) EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
-  // Removes header from the free blocks set by finding the corresponding iterator and erasing it.
-  void RemoveFreePrev(AllocationHeader* header) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  // Release the dirty pages of a free block, whether or not it is in a free list. The block and its
+  // links stay in the first page, which is cleared rather than released.
+  void ReleaseFreeBlock(FreeBlock* block) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Release the dirty pages of all free blocks.
+  size_t ReleaseFreeBlocks() EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
   // Finds the allocation header corresponding to obj.
   AllocationHeader* GetAllocationHeader(const mirror::Object* obj);
 
-  typedef std::set<AllocationHeader*, AllocationHeader::SortByPrevFree,
-                   accounting::GCAllocator<AllocationHeader*> > FreeBlocks;
-
   byte* const begin_;
   byte* const end_;
+  const bool use_huge_pages_;
 
-  // There is not footer for any allocations at the end of the space, so we keep track of how much
-  // free space there is at the end manually.
   UniquePtr<MemMap> mem_map_;
-  Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
-  size_t free_end_ GUARDED_BY(lock_);
-  FreeBlocks free_blocks_ GUARDED_BY(lock_);
+  mutable Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
+  FreeBlock* free_lists_[kNumFreeLists] GUARDED_BY(lock_);
+  // Bit i is set if free_lists_[i] isn't empty.
+  uint32_t non_empty_free_lists_ GUARDED_BY(lock_);
+  // Sum of the dirty sizes of the free blocks.
+  size_t dirty_bytes_ GUARDED_BY(lock_);
 };
 
 }  // namespace space
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_SPACE_ROSALLOC_SPACE_H_
+#define ART_RUNTIME_GC_SPACE_ROSALLOC_SPACE_H_
+
+#include "gc/allocator/rosalloc.h"
+#include "malloc_space.h"
+
+namespace art {
+namespace gc {
+
+namespace space {
+
+// An alloc space backed by a RosAlloc runs-of-slots allocator.
+class RosAllocSpace : public MallocSpace {
+ public:
+  // Create a RosAllocSpace with the requested sizes. The requested base address is not guaranteed
+  // to be granted, if it is required, the caller should call Begin on the returned space to confirm
+  // the request was granted.
+  static RosAllocSpace* Create(const std::string& name, size_t initial_size, size_t growth_limit,
+                               size_t capacity, byte* requested_begin);
+
+  // Allocate num_bytes allowing the underlying allocator to grow.
+  virtual mirror::Object* AllocWithGrowth(Thread* self, size_t num_bytes,
+                                          size_t* bytes_allocated) LOCKS_EXCLUDED(lock_);
+
+  // Allocate num_bytes without allowing the underlying allocator to grow.
+  virtual mirror::Object* Alloc(Thread* self, size_t num_bytes, size_t* bytes_allocated);
+
+  // Return the storage space required by obj.
+  virtual size_t AllocationSize(const mirror::Object* obj);
+  virtual size_t Free(Thread* self, mirror::Object* ptr) LOCKS_EXCLUDED(lock_);
+  virtual size_t FreeList(Thread* self, size_t num_ptrs, mirror::Object** ptrs)
+      LOCKS_EXCLUDED(lock_);
+
+  mirror::Object* AllocNonvirtual(Thread* self, size_t num_bytes, size_t* bytes_allocated);
+
+  size_t AllocationSizeNonvirtual(const mirror::Object* obj) {
+    return rosalloc_->UsableSize(obj);
+  }
+
+  // Hand the thread's runs back to the allocator. Slots in the runs stay allocated, so the number
+  // of allocated bytes doesn't change and zero is returned.
+  virtual size_t RevokeThreadLocalBuffer(Thread* thread);
+
+  allocator::RosAlloc* GetRosAlloc() const {
+    return rosalloc_;
+  }
+
+  virtual size_t Trim();
+  virtual size_t TrimRange(byte* begin, byte* end);
+
+  // Calls back for every slot, free page run and large allocation of the allocator.
+  virtual void Walk(WalkCallback callback, void* arg);
+
+  virtual size_t GetFootprint();
+  virtual size_t GetFootprintLimit();
+  virtual void SetFootprintLimit(size_t limit);
+
+  virtual bool IsRosAllocSpace() const {
+    return true;
+  }
+
+  // Threads allocate from their runs without touching the space, so the current counts are found
+  // by walking the allocator. These are slow and not meant for allocation paths.
+  uint64_t GetBytesAllocated() const;
+  uint64_t GetObjectsAllocated() const;
+  uint64_t GetTotalBytesAllocated() const;
+  uint64_t GetTotalObjectsAllocated() const;
+
+  virtual ~RosAllocSpace();
+
+ protected:
+  RosAllocSpace(const std::string& name, MemMap* mem_map, allocator::RosAlloc* rosalloc,
+                byte* begin, byte* end, size_t growth_limit);
+
+  virtual void* CreateAllocator(void* begin, size_t morecore_start, size_t initial_size,
+                                size_t capacity) {
+    return CreateRosAlloc(begin, morecore_start, initial_size, capacity);
+  }
+
+  virtual MallocSpace* CreateInstance(const std::string& name, MemMap* mem_map, void* allocator,
+                                      byte* begin, byte* end, size_t growth_limit);
+
+ private:
+  static allocator::RosAlloc* CreateRosAlloc(void* begin, size_t morecore_start,
+                                             size_t initial_size, size_t capacity);
+
+  // Approximate running totals of what has been freed, updated with lock_ held. The totals
+  // allocated are derived from these and the current counts.
+  uint64_t total_bytes_freed_;
+  uint64_t total_objects_freed_;
+
+  // Underlying rosalloc, owned by the space.
+  allocator::RosAlloc* const rosalloc_;
+
+  DISALLOW_COPY_AND_ASSIGN(RosAllocSpace);
+};
+
+}  // namespace space
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_SPACE_ROSALLOC_SPACE_H_
@@ -21,6 +21,8 @@
 
 #include "dlmalloc_space.h"
 #include "image_space.h"
+#include "malloc_space.h"
+#include "rosalloc_space.h"
 
 namespace art {
 namespace gc {
@@ -31,11 +33,21 @@ inline ImageSpace* Space::AsImageSpace() {
   return down_cast<ImageSpace*>(down_cast<MemMapSpace*>(this));
 }
 
+inline MallocSpace* Space::AsMallocSpace() {
+  DCHECK(IsMallocSpace());
+  return down_cast<MallocSpace*>(down_cast<MemMapSpace*>(this));
+}
+
 inline DlMallocSpace* Space::AsDlMallocSpace() {
-  DCHECK(GetType() == kSpaceTypeAllocSpace || GetType() == kSpaceTypeZygoteSpace);
+  DCHECK(IsDlMallocSpace());
   return down_cast<DlMallocSpace*>(down_cast<MemMapSpace*>(this));
 }
 
+inline RosAllocSpace* Space::AsRosAllocSpace() {
+  DCHECK(IsRosAllocSpace());
+  return down_cast<RosAllocSpace*>(down_cast<MemMapSpace*>(this));
+}
+
 inline LargeObjectSpace* Space::AsLargeObjectSpace() {
   DCHECK_EQ(GetType(), kSpaceTypeLargeObjectSpace);
   return reinterpret_cast<LargeObjectSpace*>(this);
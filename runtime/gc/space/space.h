@@ -45,6 +45,8 @@ namespace space {
 class DlMallocSpace;
 class ImageSpace;
 class LargeObjectSpace;
+class MallocSpace;
+class RosAllocSpace;
 
 static constexpr bool kDebugSpaces = kIsDebugBuild;
 
@@ -101,13 +103,25 @@ class Space {
   }
   ImageSpace* AsImageSpace();
 
-  // Is this a dlmalloc backed allocation space?
-  bool IsDlMallocSpace() const {
+  // Is this a malloc backed allocation space?
+  bool IsMallocSpace() const {
     SpaceType type = GetType();
     return type == kSpaceTypeAllocSpace || type == kSpaceTypeZygoteSpace;
   }
+  MallocSpace* AsMallocSpace();
+
+  // Is this a malloc space backed by dlmalloc?
+  virtual bool IsDlMallocSpace() const {
+    return false;
+  }
   DlMallocSpace* AsDlMallocSpace();
 
+  // Is this a malloc space backed by the runs-of-slots allocator?
+  virtual bool IsRosAllocSpace() const {
+    return false;
+  }
+  RosAllocSpace* AsRosAllocSpace();
+
   // Is this the space allocated into by the Zygote and no-longer in use?
   bool IsZygoteSpace() const {
     return GetType() == kSpaceTypeZygoteSpace;
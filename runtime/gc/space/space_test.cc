@@ -14,8 +14,9 @@
  * limitations under the License.
  */
 
-#include "dlmalloc_space.h"
+#include "dlmalloc_space-inl.h"
 #include "large_object_space.h"
+#include "rosalloc_space.h"
 
 #include "common_test.h"
 #include "globals.h"
@@ -27,67 +28,92 @@ namespace art {
 namespace gc {
 namespace space {
 
+typedef MallocSpace* (*CreateSpaceFn)(const std::string& name, size_t initial_size,
+                                      size_t growth_limit, size_t capacity,
+                                      byte* requested_begin);
+
 class SpaceTest : public CommonTest {
  public:
-  void SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr_t object_size,
+  void InitTestBody(CreateSpaceFn create_space);
+  void ZygoteSpaceTestBody(CreateSpaceFn create_space);
+  void AllocAndFreeTestBody(CreateSpaceFn create_space);
+  void AllocAndFreeListTestBody(CreateSpaceFn create_space);
+  void TrimRangeTestBody(CreateSpaceFn create_space);
+
+  void SizeFootPrintGrowthLimitAndTrimBody(MallocSpace* space, intptr_t object_size,
                                            int round, size_t growth_limit);
-  void SizeFootPrintGrowthLimitAndTrimDriver(size_t object_size);
+  void SizeFootPrintGrowthLimitAndTrimDriver(size_t object_size, CreateSpaceFn create_space);
 
   void AddContinuousSpace(ContinuousSpace* space) {
     Runtime::Current()->GetHeap()->AddContinuousSpace(space);
   }
 };
 
-static size_t test_rand(size_t* seed) {
-  *seed = *seed * 1103515245 + 12345;
-  return *seed;
+static MallocSpace* CreateDlMallocSpace(const std::string& name, size_t initial_size,
+                                        size_t growth_limit, size_t capacity,
+                                        byte* requested_begin) {
+  return DlMallocSpace::Create(name, initial_size, growth_limit, capacity, requested_begin);
+}
+
+static MallocSpace* CreateRosAllocSpace(const std::string& name, size_t initial_size,
+                                        size_t growth_limit, size_t capacity,
+                                        byte* requested_begin) {
+  return RosAllocSpace::Create(name, initial_size, growth_limit, capacity, requested_begin);
 }
 
-TEST_F(SpaceTest, Init) {
+void SpaceTest::InitTestBody(CreateSpaceFn create_space) {
   {
     // Init < max == growth
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 16 * MB, 32 * MB, 32 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 16 * MB, 32 * MB, 32 * MB, NULL));
     EXPECT_TRUE(space.get() != NULL);
   }
   {
     // Init == max == growth
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 16 * MB, 16 * MB, 16 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 16 * MB, 16 * MB, 16 * MB, NULL));
     EXPECT_TRUE(space.get() != NULL);
   }
   {
     // Init > max == growth
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 32 * MB, 16 * MB, 16 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 32 * MB, 16 * MB, 16 * MB, NULL));
     EXPECT_TRUE(space.get() == NULL);
   }
   {
     // Growth == init < max
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 16 * MB, 16 * MB, 32 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 16 * MB, 16 * MB, 32 * MB, NULL));
     EXPECT_TRUE(space.get() != NULL);
   }
   {
     // Growth < init < max
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 16 * MB, 8 * MB, 32 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 16 * MB, 8 * MB, 32 * MB, NULL));
     EXPECT_TRUE(space.get() == NULL);
   }
   {
     // Init < growth < max
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 8 * MB, 16 * MB, 32 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 8 * MB, 16 * MB, 32 * MB, NULL));
     EXPECT_TRUE(space.get() != NULL);
   }
   {
     // Init < max < growth
-    UniquePtr<Space> space(DlMallocSpace::Create("test", 8 * MB, 32 * MB, 16 * MB, NULL));
+    UniquePtr<Space> space(create_space("test", 8 * MB, 32 * MB, 16 * MB, NULL));
     EXPECT_TRUE(space.get() == NULL);
   }
 }
 
+TEST_F(SpaceTest, Init_DlMallocSpace) {
+  InitTestBody(CreateDlMallocSpace);
+}
+
+TEST_F(SpaceTest, Init_RosAllocSpace) {
+  InitTestBody(CreateRosAllocSpace);
+}
+
 // TODO: This test is not very good, we should improve it.
 // The test should do more allocations before the creation of the ZygoteSpace, and then do
 // allocations after the ZygoteSpace is created. The test should also do some GCs to ensure that
 // the GC works with the ZygoteSpace.
-TEST_F(SpaceTest, ZygoteSpace) {
+void SpaceTest::ZygoteSpaceTestBody(CreateSpaceFn create_space) {
     size_t dummy = 0;
-    DlMallocSpace* space(DlMallocSpace::Create("test", 4 * MB, 16 * MB, 16 * MB, NULL));
+    MallocSpace* space(create_space("test", 4 * MB, 16 * MB, 16 * MB, NULL));
     ASSERT_TRUE(space != NULL);
 
     // Make space findable to the heap, will also delete space when runtime is cleaned up
@@ -157,9 +183,17 @@ TEST_F(SpaceTest, ZygoteSpace) {
     EXPECT_LE(1U * MB, free1);
 }
 
-TEST_F(SpaceTest, AllocAndFree) {
+TEST_F(SpaceTest, ZygoteSpace_DlMallocSpace) {
+  ZygoteSpaceTestBody(CreateDlMallocSpace);
+}
+
+TEST_F(SpaceTest, ZygoteSpace_RosAllocSpace) {
+  ZygoteSpaceTestBody(CreateRosAllocSpace);
+}
+
+void SpaceTest::AllocAndFreeTestBody(CreateSpaceFn create_space) {
   size_t dummy = 0;
-  DlMallocSpace* space(DlMallocSpace::Create("test", 4 * MB, 16 * MB, 16 * MB, NULL));
+  MallocSpace* space(create_space("test", 4 * MB, 16 * MB, 16 * MB, NULL));
   ASSERT_TRUE(space != NULL);
   Thread* self = Thread::Current();
 
@@ -204,6 +238,55 @@ TEST_F(SpaceTest, AllocAndFree) {
   EXPECT_LE(1U * MB, free1);
 }
 
+TEST_F(SpaceTest, AllocAndFree_DlMallocSpace) {
+  AllocAndFreeTestBody(CreateDlMallocSpace);
+}
+
+TEST_F(SpaceTest, AllocAndFree_RosAllocSpace) {
+  AllocAndFreeTestBody(CreateRosAllocSpace);
+}
+
+void SpaceTest::TrimRangeTestBody(CreateSpaceFn create_space) {
+  size_t dummy = 0;
+  MallocSpace* space(create_space("test", 4 * MB, 16 * MB, 16 * MB, NULL));
+  ASSERT_TRUE(space != NULL);
+  Thread* self = Thread::Current();
+
+  // Make space findable to the heap, will also delete space when runtime is cleaned up
+  AddContinuousSpace(space);
+
+  mirror::Object* ptr1 = space->Alloc(self, 1 * MB, &dummy);
+  ASSERT_TRUE(ptr1 != NULL);
+  mirror::Object* ptr2 = space->Alloc(self, 1 * MB, &dummy);
+  ASSERT_TRUE(ptr2 != NULL);
+  mirror::Object* ptr3 = space->Alloc(self, 1 * MB, &dummy);
+  ASSERT_TRUE(ptr3 != NULL);
+  ASSERT_LT(ptr1, ptr2);
+  ASSERT_LT(ptr2, ptr3);
+  space->Free(self, ptr2);
+
+  // Nothing is free before the hole.
+  byte* hole_begin =
+      reinterpret_cast<byte*>(RoundDown(reinterpret_cast<uintptr_t>(ptr2), kPageSize));
+  EXPECT_EQ(0U, space->TrimRange(space->Begin(), hole_begin));
+
+  // The pages of the hole are released, but not those of the following allocation.
+  size_t reclaimed = space->TrimRange(hole_begin, reinterpret_cast<byte*>(ptr3));
+  EXPECT_LE(1U * MB - 2 * kPageSize, reclaimed);
+  EXPECT_GE(1U * MB + kPageSize, reclaimed);
+
+  space->Free(self, ptr1);
+  space->Free(self, ptr3);
+}
+
+TEST_F(SpaceTest, TrimRange_DlMallocSpace) {
+  TrimRangeTestBody(CreateDlMallocSpace);
+}
+
+TEST_F(SpaceTest, TrimRange_RosAllocSpace) {
+  TrimRangeTestBody(CreateRosAllocSpace);
+}
+
 TEST_F(SpaceTest, LargeObjectTest) {
   size_t rand_seed = 0;
   for (size_t i = 0; i < 2; ++i) {
@@ -226,6 +309,11 @@ TEST_F(SpaceTest, LargeObjectTest) {
         ASSERT_TRUE(obj != NULL);
         ASSERT_EQ(allocation_size, los->AllocationSize(obj));
         ASSERT_GE(allocation_size, request_size);
+        // Memory reused from freed objects must have been cleared.
+        if (request_size != 0) {
+          ASSERT_EQ(0, reinterpret_cast<const byte*>(obj)[0]);
+          ASSERT_EQ(0, reinterpret_cast<const byte*>(obj)[request_size - 1]);
+        }
         // Fill in our magic value.
         byte magic = (request_size & 0xFF) | 1;
         memset(obj, magic, request_size);
@@ -265,8 +353,8 @@ TEST_F(SpaceTest, LargeObjectTest) {
   }
 }
 
-TEST_F(SpaceTest, AllocAndFreeList) {
-  DlMallocSpace* space(DlMallocSpace::Create("test", 4 * MB, 16 * MB, 16 * MB, NULL));
+void SpaceTest::AllocAndFreeListTestBody(CreateSpaceFn create_space) {
+  MallocSpace* space(create_space("test", 4 * MB, 16 * MB, 16 * MB, NULL));
   ASSERT_TRUE(space != NULL);
 
   // Make space findable to the heap, will also delete space when runtime is cleaned up
@@ -303,29 +391,89 @@ TEST_F(SpaceTest, AllocAndFreeList) {
   }
 }
 
-void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr_t object_size,
+TEST_F(SpaceTest, AllocAndFreeList_DlMallocSpace) {
+  AllocAndFreeListTestBody(CreateDlMallocSpace);
+}
+
+TEST_F(SpaceTest, AllocAndFreeList_RosAllocSpace) {
+  AllocAndFreeListTestBody(CreateRosAllocSpace);
+}
+
+TEST_F(SpaceTest, ThreadLocalBuffer) {
+  DlMallocSpace* space(DlMallocSpace::Create("test", 4 * MB, 16 * MB, 16 * MB, NULL));
+  ASSERT_TRUE(space != NULL);
+  Thread* self = Thread::Current();
+
+  // Make space findable to the heap, will also delete space when runtime is cleaned up
+  AddContinuousSpace(space);
+
+  // The thread may still have a buffer carved from the heap's own alloc space.
+  Runtime::Current()->GetHeap()->RevokeThreadLocalBuffer(self);
+  const size_t bytes_before = space->GetBytesAllocated();
+  const size_t objects_before = space->GetObjectsAllocated();
+
+  // A new buffer is carved from the mspace and counts as allocated as a whole, its objects only
+  // count once it is revoked.
+  size_t bytes_allocated;
+  size_t buffer_bytes_allocated;
+  mirror::Object* ptr1 = space->AllocWithNewThreadLocalBuffer(self, 16, 32 * KB, &bytes_allocated,
+                                                              &buffer_bytes_allocated);
+  ASSERT_TRUE(ptr1 != NULL);
+  byte* start = self->GetThreadLocalStart();
+  EXPECT_LE(32 * KB, buffer_bytes_allocated);
+  EXPECT_EQ(start + buffer_bytes_allocated, self->GetThreadLocalEnd());
+  EXPECT_EQ(DlMallocChunkToMem(start), ptr1);
+  EXPECT_EQ(DlMallocChunkSize(16), bytes_allocated);
+  EXPECT_EQ(start + bytes_allocated, self->GetThreadLocalPos());
+  EXPECT_EQ(bytes_before + buffer_bytes_allocated, space->GetBytesAllocated());
+  EXPECT_EQ(objects_before, space->GetObjectsAllocated());
+
+  // Later allocations bump the position, each object is a chunk of its own right after the last.
+  mirror::Object* ptr2 = space->AllocThreadLocal(self, 100, &bytes_allocated);
+  ASSERT_TRUE(ptr2 != NULL);
+  EXPECT_EQ(reinterpret_cast<byte*>(ptr1) + space->AllocationSizeNonvirtual(ptr1),
+            reinterpret_cast<byte*>(ptr2));
+  EXPECT_EQ(DlMallocChunkSize(100), bytes_allocated);
+  EXPECT_EQ(bytes_allocated, space->AllocationSizeNonvirtual(ptr2));
+  EXPECT_EQ(2U, self->GetThreadLocalObjectsAllocated());
+  EXPECT_TRUE(space->AllocThreadLocal(self, 64 * KB, &bytes_allocated) == NULL);
+  EXPECT_EQ(bytes_before + buffer_bytes_allocated, space->GetBytesAllocated());
+
+  // Revoking gives the unused tail back to the mspace and counts the objects.
+  const size_t unused = self->GetThreadLocalEnd() - self->GetThreadLocalPos();
+  EXPECT_EQ(unused, space->RevokeThreadLocalBuffer(self));
+  EXPECT_TRUE(self->GetThreadLocalEnd() == NULL);
+  EXPECT_EQ(bytes_before + buffer_bytes_allocated - unused, space->GetBytesAllocated());
+  EXPECT_EQ(objects_before + 2, space->GetObjectsAllocated());
+  EXPECT_EQ(0U, space->RevokeThreadLocalBuffer(self));
+
+  // The objects are freed like any other allocation.
+  space->Free(self, ptr1);
+  space->Free(self, ptr2);
+  EXPECT_EQ(bytes_before, space->GetBytesAllocated());
+  EXPECT_EQ(objects_before, space->GetObjectsAllocated());
+}
+
+void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(MallocSpace* space, intptr_t object_size,
                                                     int round, size_t growth_limit) {
   if (((object_size > 0 && object_size >= static_cast<intptr_t>(growth_limit))) ||
       ((object_size < 0 && -object_size >= static_cast<intptr_t>(growth_limit)))) {
     // No allocation can succeed
     return;
   }
-  // Mspace for raw dlmalloc operations
-  void* mspace = space->GetMspace();
-
-  // mspace's footprint equals amount of resources requested from system
-  size_t footprint = mspace_footprint(mspace);
+  // The allocator's footprint equals amount of resources requested from system
+  size_t footprint = space->GetFootprint();
 
-  // mspace must at least have its book keeping allocated
+  // The allocator must at least have its book keeping allocated
   EXPECT_GT(footprint, 0u);
 
-  // mspace but it shouldn't exceed the initial size
+  // The allocator but it shouldn't exceed the initial size
   EXPECT_LE(footprint, growth_limit);
 
   // space's size shouldn't exceed the initial size
   EXPECT_LE(space->Size(), growth_limit);
 
-  // this invariant should always hold or else the mspace has grown to be larger than what the
+  // this invariant should always hold or else the allocator has grown to be larger than what the
   // space believes its size is (which will break invariants)
   EXPECT_GE(space->Size(), footprint);
 
@@ -356,7 +504,7 @@ void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr
       } else {
         object = space->AllocWithGrowth(self, alloc_size, &bytes_allocated);
       }
-      footprint = mspace_footprint(mspace);
+      footprint = space->GetFootprint();
       EXPECT_GE(space->Size(), footprint);  // invariant
       if (object != NULL) {  // allocation succeeded
         lots_of_objects.get()[i] = object;
@@ -395,7 +543,7 @@ void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr
     space->Trim();
 
     // Bounds sanity
-    footprint = mspace_footprint(mspace);
+    footprint = space->GetFootprint();
     EXPECT_LE(amount_allocated, growth_limit);
     EXPECT_GE(footprint, amount_allocated);
     EXPECT_LE(footprint, growth_limit);
@@ -421,14 +569,18 @@ void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr
       space->Free(self, object);
       lots_of_objects.get()[i] = NULL;
       amount_allocated -= allocation_size;
-      footprint = mspace_footprint(mspace);
+      footprint = space->GetFootprint();
       EXPECT_GE(space->Size(), footprint);  // invariant
     }
 
     free_increment >>= 1;
   }
 
-  // All memory was released, try a large allocation to check freed memory is being coalesced
+  // All memory was released, try a large allocation to check freed memory is being coalesced.
+  // RosAlloc keeps the runs the thread allocated from until they are revoked.
+  if (space->IsRosAllocSpace()) {
+    space->RevokeThreadLocalBuffer(self);
+  }
   mirror::Object* large_object;
   size_t three_quarters_space = (growth_limit / 2) + (growth_limit / 4);
   size_t bytes_allocated = 0;
@@ -440,7 +592,7 @@ void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr
   EXPECT_TRUE(large_object != NULL);
 
   // Sanity check footprint
-  footprint = mspace_footprint(mspace);
+  footprint = space->GetFootprint();
   EXPECT_LE(footprint, growth_limit);
   EXPECT_GE(space->Size(), footprint);
   EXPECT_LE(space->Size(), growth_limit);
@@ -449,17 +601,18 @@ void SpaceTest::SizeFootPrintGrowthLimitAndTrimBody(DlMallocSpace* space, intptr
   space->Free(self, large_object);
 
   // Sanity check footprint
-  footprint = mspace_footprint(mspace);
+  footprint = space->GetFootprint();
   EXPECT_LE(footprint, growth_limit);
   EXPECT_GE(space->Size(), footprint);
   EXPECT_LE(space->Size(), growth_limit);
 }
 
-void SpaceTest::SizeFootPrintGrowthLimitAndTrimDriver(size_t object_size) {
+void SpaceTest::SizeFootPrintGrowthLimitAndTrimDriver(size_t object_size,
+                                                      CreateSpaceFn create_space) {
   size_t initial_size = 4 * MB;
   size_t growth_limit = 8 * MB;
   size_t capacity = 16 * MB;
-  DlMallocSpace* space(DlMallocSpace::Create("test", initial_size, growth_limit, capacity, NULL));
+  MallocSpace* space(create_space("test", initial_size, growth_limit, capacity, NULL));
   ASSERT_TRUE(space != NULL);
 
   // Basic sanity
@@ -479,28 +632,33 @@ void SpaceTest::SizeFootPrintGrowthLimitAndTrimDriver(size_t object_size) {
   SizeFootPrintGrowthLimitAndTrimBody(space, object_size, 3, capacity);
 }
 
-#define TEST_SizeFootPrintGrowthLimitAndTrim(name, size) \
-  TEST_F(SpaceTest, SizeFootPrintGrowthLimitAndTrim_AllocationsOf_##name) { \
-    SizeFootPrintGrowthLimitAndTrimDriver(size); \
+#define TEST_SizeFootPrintGrowthLimitAndTrim(name, size, spaceName, spaceFn) \
+  TEST_F(SpaceTest, SizeFootPrintGrowthLimitAndTrim_AllocationsOf_##name##_##spaceName) { \
+    SizeFootPrintGrowthLimitAndTrimDriver(size, spaceFn); \
   } \
-  TEST_F(SpaceTest, SizeFootPrintGrowthLimitAndTrim_RandomAllocationsWithMax_##name) { \
-    SizeFootPrintGrowthLimitAndTrimDriver(-size); \
+  TEST_F(SpaceTest, \
+         SizeFootPrintGrowthLimitAndTrim_RandomAllocationsWithMax_##name##_##spaceName) { \
+    SizeFootPrintGrowthLimitAndTrimDriver(-size, spaceFn); \
   }
 
+#define TEST_SPACE_CREATE_FN(spaceName, spaceFn) \
+  TEST_F(SpaceTest, SizeFootPrintGrowthLimitAndTrim_AllocationsOf_8B_##spaceName) { \
+    SizeFootPrintGrowthLimitAndTrimDriver(8, spaceFn); \
+  } \
+  TEST_SizeFootPrintGrowthLimitAndTrim(16B, 16, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(24B, 24, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(32B, 32, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(64B, 64, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(128B, 128, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(1KB, 1 * KB, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(4KB, 4 * KB, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(1MB, 1 * MB, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(4MB, 4 * MB, spaceName, spaceFn) \
+  TEST_SizeFootPrintGrowthLimitAndTrim(8MB, 8 * MB, spaceName, spaceFn)
+
 // Each size test is its own test so that we get a fresh heap each time
-TEST_F(SpaceTest, SizeFootPrintGrowthLimitAndTrim_AllocationsOf_8B) {
-  SizeFootPrintGrowthLimitAndTrimDriver(8);
-}
-TEST_SizeFootPrintGrowthLimitAndTrim(16B, 16)
-TEST_SizeFootPrintGrowthLimitAndTrim(24B, 24)
-TEST_SizeFootPrintGrowthLimitAndTrim(32B, 32)
-TEST_SizeFootPrintGrowthLimitAndTrim(64B, 64)
-TEST_SizeFootPrintGrowthLimitAndTrim(128B, 128)
-TEST_SizeFootPrintGrowthLimitAndTrim(1KB, 1 * KB)
-TEST_SizeFootPrintGrowthLimitAndTrim(4KB, 4 * KB)
-TEST_SizeFootPrintGrowthLimitAndTrim(1MB, 1 * MB)
-TEST_SizeFootPrintGrowthLimitAndTrim(4MB, 4 * MB)
-TEST_SizeFootPrintGrowthLimitAndTrim(8MB, 8 * MB)
+TEST_SPACE_CREATE_FN(DlMallocSpace, CreateDlMallocSpace)
+TEST_SPACE_CREATE_FN(RosAllocSpace, CreateRosAllocSpace)
 
 }  // namespace space
 }  // namespace gc
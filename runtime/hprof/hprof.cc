@@ -24,7 +24,6 @@
 
 #include "hprof.h"
 
-#include <cutils/open_memstream.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -35,7 +34,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <set>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/stringprintf.h"
@@ -57,6 +58,7 @@
 #include "safe_map.h"
 #include "scoped_thread_state_change.h"
 #include "thread_list.h"
+#include "UniquePtr.h"
 
 namespace art {
 
@@ -146,7 +148,7 @@ enum HprofHeapTag {
   HPROF_ROOT_VM_INTERNAL = 0x8d,
   HPROF_ROOT_JNI_MONITOR = 0x8e,
   HPROF_UNREACHABLE = 0x90,  // Obsolete.
-  HPROF_PRIMITIVE_ARRAY_NODATA_DUMP = 0xc3,  // Obsolete.
+  HPROF_PRIMITIVE_ARRAY_NODATA_DUMP = 0xc3,  // When primitive array contents are omitted.
 };
 
 enum HprofHeapId {
@@ -176,6 +178,90 @@ typedef std::set<mirror::Class*>::iterator ClassSetIterator;
 typedef SafeMap<std::string, size_t> StringMap;
 typedef SafeMap<std::string, size_t>::iterator StringMapIterator;
 
+// Where the records of a dump go. The dump is made in two passes over the heap, the first one
+// writes to an output which only counts the bytes, collecting the strings and classes the string
+// and class tables need without keeping any of the records. The second one writes to the file
+// through a buffer of kBufferSize bytes, or to memory when the dump is sent to DDMS.
+class HprofOutput {
+ public:
+  static constexpr size_t kBufferSize = 64 * KB;
+
+  // Writes to file if it is not NULL, to memory if it is not NULL, and only counts otherwise.
+  HprofOutput(File* file, std::vector<uint8_t>* memory)
+      : file_(file),
+        memory_(memory),
+        length_(0),
+        error_(0) {
+    if (file_ != NULL) {
+      buffer_.reserve(kBufferSize);
+    }
+  }
+
+  ~HprofOutput() {
+    Flush();
+  }
+
+  bool Write(const void* data, size_t count) {
+    length_ += count;
+    if (error_ != 0) {
+      return false;
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    if (memory_ != NULL) {
+      memory_->insert(memory_->end(), bytes, bytes + count);
+    } else if (file_ != NULL) {
+      if (buffer_.size() + count > kBufferSize && !Flush()) {
+        return false;
+      }
+      if (count >= kBufferSize) {
+        // Too large to be worth copying.
+        return WriteFile(bytes, count);
+      }
+      buffer_.insert(buffer_.end(), bytes, bytes + count);
+    }
+    return true;
+  }
+
+  bool Flush() {
+    if (error_ != 0) {
+      return false;
+    }
+    if (file_ == NULL || buffer_.empty()) {
+      return true;
+    }
+    bool okay = WriteFile(&buffer_[0], buffer_.size());
+    buffer_.clear();
+    return okay;
+  }
+
+  // Number of bytes written so far, including those still in the buffer.
+  size_t GetLength() const {
+    return length_;
+  }
+
+  // The errno of the first write which failed, or 0.
+  int GetError() const {
+    return error_;
+  }
+
+ private:
+  bool WriteFile(const uint8_t* data, size_t count) {
+    if (!file_->WriteFully(data, count)) {
+      error_ = (errno != 0) ? errno : EIO;
+      return false;
+    }
+    return true;
+  }
+
+  File* const file_;
+  std::vector<uint8_t>* const memory_;
+  std::vector<uint8_t> buffer_;
+  size_t length_;
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(HprofOutput);
+};
+
 // Represents a top-level hprof record, whose serialized format is:
 // U1  TAG: denoting the type of the record
 // U4  TIME: number of microseconds since the time stamp in the header
@@ -187,20 +273,20 @@ class HprofRecord {
     dirty_ = false;
     alloc_length_ = 128;
     body_ = reinterpret_cast<unsigned char*>(malloc(alloc_length_));
-    fp_ = NULL;
+    output_ = NULL;
   }
 
   ~HprofRecord() {
     free(body_);
   }
 
-  int StartNewRecord(FILE* fp, uint8_t tag, uint32_t time) {
+  int StartNewRecord(HprofOutput* output, uint8_t tag, uint32_t time) {
     int rc = Flush();
     if (rc != 0) {
       return rc;
     }
 
-    fp_ = fp;
+    output_ = output;
     tag_ = tag;
     time_ = time;
     length_ = 0;
@@ -210,24 +296,46 @@ class HprofRecord {
 
   int Flush() {
     if (dirty_) {
-      unsigned char headBuf[sizeof(uint8_t) + 2 * sizeof(uint32_t)];
-
-      headBuf[0] = tag_;
-      U4_TO_BUF_BE(headBuf, 1, time_);
-      U4_TO_BUF_BE(headBuf, 5, length_);
+      int err = WriteHead(length_);
+      if (err != 0) {
+        return err;
+      }
+      dirty_ = false;
+    }
+    // TODO if we used less than half (or whatever) of allocLen, shrink the buffer.
+    return 0;
+  }
 
-      int nb = fwrite(headBuf, 1, sizeof(headBuf), fp_);
-      if (nb != sizeof(headBuf)) {
-        return UNIQUE_ERROR;
+  // Flushes the record with values appended, converted to big endian as the Add*List methods do.
+  // The values are written straight to the output so that large arrays are never copied into the
+  // body of the record.
+  int FlushWithList(const void* values, size_t numValues, size_t valueSize) {
+    CHECK(dirty_);
+    int err = WriteHead(length_ + numValues * valueSize);
+    if (err != 0) {
+      return err;
+    }
+    dirty_ = false;
+    if (valueSize == 1) {
+      return output_->Write(values, numValues) ? 0 : UNIQUE_ERROR;
+    }
+    unsigned char buf[4 * KB];
+    const size_t valuesPerBuf = sizeof(buf) / valueSize;
+    for (size_t i = 0; i < numValues; i += valuesPerBuf) {
+      const size_t count = std::min(valuesPerBuf, numValues - i);
+      for (size_t j = 0; j < count; ++j) {
+        if (valueSize == 2) {
+          U2_TO_BUF_BE(buf, j * 2, reinterpret_cast<const uint16_t*>(values)[i + j]);
+        } else if (valueSize == 4) {
+          U4_TO_BUF_BE(buf, j * 4, reinterpret_cast<const uint32_t*>(values)[i + j]);
+        } else {
+          U8_TO_BUF_BE(buf, j * 8, reinterpret_cast<const uint64_t*>(values)[i + j]);
+        }
       }
-      nb = fwrite(body_, 1, length_, fp_);
-      if (nb != static_cast<int>(length_)) {
+      if (!output_->Write(buf, count * valueSize)) {
         return UNIQUE_ERROR;
       }
-
-      dirty_ = false;
     }
-    // TODO if we used less than half (or whatever) of allocLen, shrink the buffer.
     return 0;
   }
 
@@ -331,6 +439,20 @@ class HprofRecord {
   }
 
  private:
+  // Writes the tag, time and length, followed by the body.
+  int WriteHead(size_t length) {
+    unsigned char headBuf[sizeof(uint8_t) + 2 * sizeof(uint32_t)];
+
+    headBuf[0] = tag_;
+    U4_TO_BUF_BE(headBuf, 1, time_);
+    U4_TO_BUF_BE(headBuf, 5, length);
+
+    if (!output_->Write(headBuf, sizeof(headBuf)) || !output_->Write(body_, length_)) {
+      return UNIQUE_ERROR;
+    }
+    return 0;
+  }
+
   int GuaranteeRecordAppend(size_t nmore) {
     size_t minSize = length_ + nmore;
     if (minSize > alloc_length_) {
@@ -355,7 +477,7 @@ class HprofRecord {
   size_t alloc_length_;
   unsigned char* body_;
 
-  FILE* fp_;
+  HprofOutput* output_;
   uint8_t tag_;
   uint32_t time_;
   size_t length_;
@@ -366,87 +488,29 @@ class HprofRecord {
 
 class Hprof {
  public:
-  Hprof(const char* output_filename, int fd, bool direct_to_ddms)
+  Hprof(const char* output_filename, int fd, bool direct_to_ddms, bool omit_primitive_arrays)
       : filename_(output_filename),
         fd_(fd),
         direct_to_ddms_(direct_to_ddms),
+        omit_primitive_arrays_(omit_primitive_arrays),
         start_ns_(NanoTime()),
         current_record_(),
         gc_thread_serial_number_(0),
         gc_scan_state_(0),
         current_heap_(HPROF_HEAP_DEFAULT),
         objects_in_segment_(0),
-        header_fp_(NULL),
-        header_data_ptr_(NULL),
-        header_data_size_(0),
-        body_fp_(NULL),
-        body_data_ptr_(NULL),
-        body_data_size_(0),
+        output_(NULL),
         next_string_id_(0x400000) {
     LOG(INFO) << "hprof: heap dump \"" << filename_ << "\" starting...";
-
-    header_fp_ = open_memstream(&header_data_ptr_, &header_data_size_);
-    if (header_fp_ == NULL) {
-      PLOG(FATAL) << "header open_memstream failed";
-    }
-
-    body_fp_ = open_memstream(&body_data_ptr_, &body_data_size_);
-    if (body_fp_ == NULL) {
-      PLOG(FATAL) << "body open_memstream failed";
-    }
-  }
-
-  ~Hprof() {
-    if (header_fp_ != NULL) {
-      fclose(header_fp_);
-    }
-    if (body_fp_ != NULL) {
-      fclose(body_fp_);
-    }
-    free(header_data_ptr_);
-    free(body_data_ptr_);
   }
 
   void Dump()
       EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_)
       LOCKS_EXCLUDED(Locks::heap_bitmap_lock_) {
-    // Walk the roots and the heap.
-    current_record_.StartNewRecord(body_fp_, HPROF_TAG_HEAP_DUMP_SEGMENT, HPROF_TIME);
-    Runtime::Current()->VisitRoots(RootVisitor, this, false, false);
-    Thread* self = Thread::Current();
-    {
-      WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
-      Runtime::Current()->GetHeap()->FlushAllocStack();
-    }
-    {
-      ReaderMutexLock mu(self, *Locks::heap_bitmap_lock_);
-      Runtime::Current()->GetHeap()->GetLiveBitmap()->Walk(HeapBitmapCallback, this);
-    }
-    current_record_.StartNewRecord(body_fp_, HPROF_TAG_HEAP_DUMP_END, HPROF_TIME);
-    current_record_.Flush();
-    fflush(body_fp_);
-
-    // Write the header.
-    WriteFixedHeader();
-    // Write the string and class tables, and any stack traces, to the header.
-    // (jhat requires that these appear before any of the data in the body that refers to them.)
-    WriteStringTable();
-    WriteClassTable();
-    WriteStackTraces();
-    current_record_.Flush();
-    fflush(header_fp_);
-
-    bool okay = true;
-    if (direct_to_ddms_) {
-      // Send the data off to DDMS.
-      iovec iov[2];
-      iov[0].iov_base = header_data_ptr_;
-      iov[0].iov_len = header_data_size_;
-      iov[1].iov_base = body_data_ptr_;
-      iov[1].iov_len = body_data_size_;
-      Dbg::DdmSendChunkV(CHUNK_TYPE("HPDS"), iov, 2);
-    } else {
-      // Where exactly are we writing to?
+    // Where exactly are we writing to? Find out before walking the heap so that a bad file fails
+    // fast.
+    UniquePtr<File> file;
+    if (!direct_to_ddms_) {
       int out_fd;
       if (fd_ >= 0) {
         out_fd = dup(fd_);
@@ -462,23 +526,66 @@ class Hprof {
           return;
         }
       }
+      file.reset(new File(out_fd, filename_));
+    }
 
-      UniquePtr<File> file(new File(out_fd, filename_));
-      okay = file->WriteFully(header_data_ptr_, header_data_size_) &&
-          file->WriteFully(body_data_ptr_, body_data_size_);
+    // Both passes have to see the same objects.
+    Thread* self = Thread::Current();
+    {
+      WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
+      Runtime::Current()->GetHeap()->FlushAllocStack();
+    }
+
+    // The first pass only collects the strings and classes, along with the size of the dump.
+    // (jhat requires that the string and class tables appear before any of the data in the body
+    // that refers to them.)
+    size_t dump_size;
+    {
+      HprofOutput counting_output(NULL, NULL);
+      ProcessBody(&counting_output);
+      ProcessHeader(&counting_output);
+      dump_size = counting_output.GetLength();
+    }
+    const size_t string_count = strings_.size();
+    const size_t class_count = classes_.size();
+
+    bool okay = true;
+    if (direct_to_ddms_) {
+      // A chunk is sent in one piece, so the dump is kept in memory, though without the copies
+      // growing separate header and body buffers would make.
+      std::vector<uint8_t> data;
+      data.reserve(dump_size);
+      {
+        HprofOutput output(NULL, &data);
+        ProcessHeader(&output);
+        ProcessBody(&output);
+      }
+      DCHECK_EQ(data.size(), dump_size);
+      iovec iov[1];
+      iov[0].iov_base = &data[0];
+      iov[0].iov_len = data.size();
+      Dbg::DdmSendChunkV(CHUNK_TYPE("HPDS"), iov, 1);
+    } else {
+      HprofOutput output(file.get(), NULL);
+      ProcessHeader(&output);
+      ProcessBody(&output);
+      okay = output.Flush();
+      DCHECK_EQ(output.GetLength(), dump_size);
       if (!okay) {
         std::string msg(StringPrintf("Couldn't dump heap; writing \"%s\" failed: %s",
-                                     filename_.c_str(), strerror(errno)));
+                                     filename_.c_str(), strerror(output.GetError())));
         ThrowRuntimeException("%s", msg.c_str());
         LOG(ERROR) << msg;
       }
     }
+    // The second pass must not have found anything the first one missed, the tables are written.
+    DCHECK_EQ(strings_.size(), string_count);
+    DCHECK_EQ(classes_.size(), class_count);
 
     // Throw out a log message for the benefit of "runhat".
     if (okay) {
       uint64_t duration = NanoTime() - start_ns_;
-      LOG(INFO) << "hprof: heap dump completed ("
-          << PrettySize(header_data_size_ + body_data_size_ + 1023)
+      LOG(INFO) << "hprof: heap dump completed (" << PrettySize(dump_size + 1023)
           << ") in " << PrettyDuration(duration);
     }
   }
@@ -503,7 +610,29 @@ class Hprof {
 
   int DumpHeapObject(mirror::Object* obj) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
-  void Finish() {
+  // Writes the header, the string and class tables, and any stack traces.
+  void ProcessHeader(HprofOutput* output) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    output_ = output;
+    WriteFixedHeader();
+    WriteStringTable();
+    WriteClassTable();
+    WriteStackTraces();
+    current_record_.Flush();
+  }
+
+  // Walks the roots and the heap.
+  void ProcessBody(HprofOutput* output)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_)
+      LOCKS_EXCLUDED(Locks::heap_bitmap_lock_) {
+    output_ = output;
+    StartNewHeapDumpSegment();
+    Runtime::Current()->VisitRoots(RootVisitor, this, false, false);
+    {
+      ReaderMutexLock mu(Thread::Current(), *Locks::heap_bitmap_lock_);
+      Runtime::Current()->GetHeap()->GetLiveBitmap()->Walk(HeapBitmapCallback, this);
+    }
+    current_record_.StartNewRecord(output_, HPROF_TAG_HEAP_DUMP_END, HPROF_TIME);
+    current_record_.Flush();
   }
 
   int WriteClassTable() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
@@ -514,7 +643,7 @@ class Hprof {
       const mirror::Class* c = *it;
       CHECK(c != NULL);
 
-      int err = current_record_.StartNewRecord(header_fp_, HPROF_TAG_LOAD_CLASS, HPROF_TIME);
+      int err = current_record_.StartNewRecord(output_, HPROF_TAG_LOAD_CLASS, HPROF_TIME);
       if (err != 0) {
         return err;
       }
@@ -540,7 +669,7 @@ class Hprof {
       std::string string((*it).first);
       size_t id = (*it).second;
 
-      int err = current_record_.StartNewRecord(header_fp_, HPROF_TAG_STRING, HPROF_TIME);
+      int err = current_record_.StartNewRecord(output_, HPROF_TAG_STRING, HPROF_TIME);
       if (err != 0) {
         return err;
       }
@@ -564,7 +693,7 @@ class Hprof {
 
   void StartNewHeapDumpSegment() {
     // This flushes the old segment and starts a new one.
-    current_record_.StartNewRecord(body_fp_, HPROF_TAG_HEAP_DUMP_SEGMENT, HPROF_TIME);
+    current_record_.StartNewRecord(output_, HPROF_TAG_HEAP_DUMP_SEGMENT, HPROF_TIME);
     objects_in_segment_ = 0;
 
     // Starting a new HEAP_DUMP resets the heap to default.
@@ -573,6 +702,10 @@ class Hprof {
 
   int MarkRootObject(const mirror::Object* obj, jobject jniObj);
 
+  // Adds the elements of an array to the current segment, unless there are too many of them to
+  // be worth buffering, in which case they end the segment.
+  void AddArrayData(const void* values, size_t length, size_t size);
+
   HprofClassObjectId LookupClassId(mirror::Class* c)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
     if (c == NULL) {
@@ -619,11 +752,11 @@ class Hprof {
 
     // Write the file header.
     // U1: NUL-terminated magic string.
-    fwrite(magic, 1, sizeof(magic), header_fp_);
+    output_->Write(magic, sizeof(magic));
 
     // U4: size of identifiers.  We're using addresses as IDs, so make sure a pointer fits.
     U4_TO_BUF_BE(buf, 0, sizeof(void*));
-    fwrite(buf, 1, sizeof(uint32_t), header_fp_);
+    output_->Write(buf, sizeof(uint32_t));
 
     // The current time, in milliseconds since 0:00 GMT, 1/1/70.
     timeval now;
@@ -636,16 +769,16 @@ class Hprof {
 
     // U4: high word of the 64-bit time.
     U4_TO_BUF_BE(buf, 0, (uint32_t)(nowMs >> 32));
-    fwrite(buf, 1, sizeof(uint32_t), header_fp_);
+    output_->Write(buf, sizeof(uint32_t));
 
     // U4: low word of the 64-bit time.
     U4_TO_BUF_BE(buf, 0, (uint32_t)(nowMs & 0xffffffffULL));
-    fwrite(buf, 1, sizeof(uint32_t), header_fp_);  // xxx fix the time
+    output_->Write(buf, sizeof(uint32_t));  // xxx fix the time
   }
 
   void WriteStackTraces() {
     // Write a dummy stack trace record so the analysis tools don't freak out.
-    current_record_.StartNewRecord(header_fp_, HPROF_TAG_STACK_TRACE, HPROF_TIME);
+    current_record_.StartNewRecord(output_, HPROF_TAG_STACK_TRACE, HPROF_TIME);
     current_record_.AddU4(HPROF_NULL_STACK_TRACE);
     current_record_.AddU4(HPROF_NULL_THREAD);
     current_record_.AddU4(0);    // no frames
@@ -657,6 +790,8 @@ class Hprof {
   std::string filename_;
   int fd_;
   bool direct_to_ddms_;
+  // Write primitive arrays as PRIMITIVE_ARRAY_NODATA_DUMP, which keeps their length only.
+  bool omit_primitive_arrays_;
 
   uint64_t start_ns_;
 
@@ -667,13 +802,8 @@ class Hprof {
   HprofHeapId current_heap_;  // Which heap we're currently dumping.
   size_t objects_in_segment_;
 
-  FILE* header_fp_;
-  char* header_data_ptr_;
-  size_t header_data_size_;
-
-  FILE* body_fp_;
-  char* body_data_ptr_;
-  size_t body_data_size_;
+  // The output of the pass in progress.
+  HprofOutput* output_;
 
   ClassSet classes_;
   size_t next_string_id_;
@@ -827,6 +957,22 @@ int Hprof::MarkRootObject(const mirror::Object* obj, jobject jniObj) {
   return 0;
 }
 
+void Hprof::AddArrayData(const void* values, size_t length, size_t size) {
+  HprofRecord* rec = &current_record_;
+  if (length * size > BYTES_PER_SEGMENT) {
+    rec->FlushWithList(values, length, size);
+    StartNewHeapDumpSegment();
+  } else if (size == 1) {
+    rec->AddU1List(reinterpret_cast<const uint8_t*>(values), length);
+  } else if (size == 2) {
+    rec->AddU2List(reinterpret_cast<const uint16_t*>(values), length);
+  } else if (size == 4) {
+    rec->AddU4List(reinterpret_cast<const uint32_t*>(values), length);
+  } else if (size == 8) {
+    rec->AddU8List(reinterpret_cast<const uint64_t*>(values), length);
+  }
+}
+
 static int StackTraceSerialNumber(const mirror::Object* /*obj*/) {
   return HPROF_NULL_STACK_TRACE;
 }
@@ -966,13 +1112,14 @@ int Hprof::DumpHeapObject(mirror::Object* obj) {
         rec->AddId(LookupClassId(c));
 
         // Dump the elements, which are always objects or NULL.
-        rec->AddIdList((const HprofObjectId*)aobj->GetRawData(sizeof(mirror::Object*)), length);
+        AddArrayData(aobj->GetRawData(sizeof(mirror::Object*)), length, sizeof(HprofObjectId));
       } else {
         size_t size;
         HprofBasicType t = PrimitiveToBasicTypeAndSize(c->GetComponentType()->GetPrimitiveType(), &size);
 
         // obj is a primitive array.
-        rec->AddU1(HPROF_PRIMITIVE_ARRAY_DUMP);
+        rec->AddU1(omit_primitive_arrays_ ? HPROF_PRIMITIVE_ARRAY_NODATA_DUMP
+                                          : HPROF_PRIMITIVE_ARRAY_DUMP);
 
         rec->AddId((HprofObjectId)obj);
         rec->AddU4(StackTraceSerialNumber(obj));
@@ -980,14 +1127,8 @@ int Hprof::DumpHeapObject(mirror::Object* obj) {
         rec->AddU1(t);
 
         // Dump the raw, packed element values.
-        if (size == 1) {
-          rec->AddU1List((const uint8_t*)aobj->GetRawData(sizeof(uint8_t)), length);
-        } else if (size == 2) {
-          rec->AddU2List((const uint16_t*)aobj->GetRawData(sizeof(uint16_t)), length);
-        } else if (size == 4) {
-          rec->AddU4List((const uint32_t*)aobj->GetRawData(sizeof(uint32_t)), length);
-        } else if (size == 8) {
-          rec->AddU8List((const uint64_t*)aobj->GetRawData(sizeof(uint64_t)), length);
+        if (!omit_primitive_arrays_) {
+          AddArrayData(aobj->GetRawData(size), length, size);
         }
       }
     } else {
@@ -1075,11 +1216,12 @@ void Hprof::VisitRoot(const mirror::Object* obj) {
 // sent directly to DDMS.
 // If "fd" is >= 0, the output will be written to that file descriptor.
 // Otherwise, "filename" is used to create an output file.
-void DumpHeap(const char* filename, int fd, bool direct_to_ddms) {
+// If "omit_primitive_arrays" is true, only the lengths of primitive arrays are dumped.
+void DumpHeap(const char* filename, int fd, bool direct_to_ddms, bool omit_primitive_arrays) {
   CHECK(filename != NULL);
 
   Runtime::Current()->GetThreadList()->SuspendAll();
-  Hprof hprof(filename, fd, direct_to_ddms);
+  Hprof hprof(filename, fd, direct_to_ddms, omit_primitive_arrays);
   hprof.Dump();
   Runtime::Current()->GetThreadList()->ResumeAll();
 }
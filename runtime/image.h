@@ -96,6 +96,8 @@ class PACKED(4) ImageHeader {
     kOatLocation,
     kDexCaches,
     kClassRoots,
+    kInternedStrings,
+    kClassTable,
     kImageRootsMax,
   };
 
@@ -16,40 +16,179 @@
 
 #include "intern_table.h"
 
-#include "gc/space/image_space.h"
-#include "mirror/dex_cache.h"
+#include <algorithm>
+
+#include "base/stl_util.h"
+#include "class_linker.h"
+#include "cutils/atomic-inline.h"
 #include "mirror/object_array-inl.h"
 #include "mirror/object-inl.h"
 #include "mirror/string.h"
+#include "runtime.h"
 #include "thread.h"
-#include "UniquePtr.h"
-#include "utf.h"
+#include "utils.h"
 
 namespace art {
 
+// Capacity of an empty table.
+static constexpr size_t kMinTableCapacity = 16;
+
+InternTable::Table::Table() : slots_(new Slots(kMinTableCapacity)), num_strings_(0) {
+}
+
+InternTable::Table::~Table() {
+  delete slots_;
+  STLDeleteElements(&retired_slots_);
+}
+
+mirror::String* InternTable::Table::Lookup(mirror::String* s, int32_t hash_code) const {
+  const Slots& slots = *slots_;
+  const size_t mask = slots.size() - 1;
+  for (size_t i = FirstSlot(hash_code, mask); ; i = (i + 1) & mask) {
+    const int32_t existing_hash_code = slots[i].hash_code;
+    mirror::String* existing_string = slots[i].string;
+    if (existing_string == NULL) {
+      return NULL;
+    }
+    if (existing_hash_code == hash_code && existing_string->Equals(s)) {
+      return existing_string;
+    }
+  }
+}
+
+void InternTable::Table::Put(Slots* slots, mirror::String* s, int32_t hash_code) {
+  const size_t mask = slots->size() - 1;
+  size_t i = FirstSlot(hash_code, mask);
+  while ((*slots)[i].string != NULL) {
+    i = (i + 1) & mask;
+  }
+  (*slots)[i].hash_code = hash_code;
+  // Lock free readers which find the string must see its hash code and its contents.
+  ANDROID_MEMBAR_STORE();
+  (*slots)[i].string = s;
+}
+
+void InternTable::Table::Insert(mirror::String* s, int32_t hash_code) {
+  if ((num_strings_ + 1) * 2 > slots_->size()) {
+    Resize(slots_->size() * 2);
+  }
+  Put(slots_, s, hash_code);
+  ++num_strings_;
+}
+
+void InternTable::Table::Resize(size_t capacity) {
+  Slots* old_slots = slots_;
+  Slots* new_slots = new Slots(capacity);
+  for (const Slot& slot : *old_slots) {
+    if (slot.string != NULL) {
+      Put(new_slots, slot.string, slot.hash_code);
+    }
+  }
+  ANDROID_MEMBAR_STORE();
+  slots_ = new_slots;
+  // Readers may still be probing the old slots.
+  retired_slots_.push_back(old_slots);
+}
+
+void InternTable::Table::Remove(const mirror::String* s, int32_t hash_code) {
+  Slots& slots = *slots_;
+  const size_t mask = slots.size() - 1;
+  size_t i = FirstSlot(hash_code, mask);
+  while (slots[i].string != s) {
+    if (slots[i].string == NULL) {
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  // Move back the strings after the hole which can't be reached from their first slot anymore.
+  for (size_t j = (i + 1) & mask; slots[j].string != NULL; j = (j + 1) & mask) {
+    const size_t first = FirstSlot(slots[j].hash_code, mask);
+    const bool reachable = (i < j) ? (i < first && first <= j) : (i < first || first <= j);
+    if (!reachable) {
+      slots[i].hash_code = slots[j].hash_code;
+      slots[i].string = slots[j].string;
+      i = j;
+    }
+  }
+  slots[i].hash_code = 0;
+  slots[i].string = NULL;
+  --num_strings_;
+}
+
+void InternTable::Table::VisitRoots(RootVisitor* visitor, void* arg) const {
+  for (const Slot& slot : *slots_) {
+    if (slot.string != NULL) {
+      visitor(slot.string, arg);
+    }
+  }
+}
+
+void InternTable::Table::SweepWeaks(IsMarkedTester is_marked, void* arg) {
+  Slots* old_slots = slots_;
+  size_t num_marked = 0;
+  for (Slot& slot : *old_slots) {
+    if (slot.string != NULL) {
+      if (is_marked(slot.string, arg)) {
+        ++num_marked;
+      } else {
+        slot.string = NULL;
+      }
+    }
+  }
+  // Rehash the survivors, which also closes the holes left in the probe sequences.
+  size_t capacity = kMinTableCapacity;
+  while (capacity < num_marked * 4) {
+    capacity *= 2;
+  }
+  capacity = std::min(capacity, old_slots->size());
+  Slots* new_slots = new Slots(capacity);
+  for (const Slot& slot : *old_slots) {
+    if (slot.string != NULL) {
+      Put(new_slots, slot.string, slot.hash_code);
+    }
+  }
+  slots_ = new_slots;
+  num_strings_ = num_marked;
+  delete old_slots;
+}
+
+void InternTable::Table::GetStrings(std::vector<mirror::String*>* strings) const {
+  for (const Slot& slot : *slots_) {
+    if (slot.string != NULL) {
+      strings->push_back(slot.string);
+    }
+  }
+}
+
+void InternTable::Table::FreeRetiredSlots() {
+  STLDeleteElements(&retired_slots_);
+}
+
 InternTable::InternTable()
     : intern_table_lock_("InternTable lock"), is_dirty_(false), allow_new_interns_(true),
-      new_intern_condition_("New intern condition", intern_table_lock_) {
+      new_intern_condition_("New intern condition", intern_table_lock_), image_interns_(NULL) {
 }
 
 size_t InternTable::Size() const {
   MutexLock mu(Thread::Current(), intern_table_lock_);
-  return strong_interns_.size() + weak_interns_.size();
+  return strong_interns_.Size() + weak_interns_.Size();
 }
 
 void InternTable::DumpForSigQuit(std::ostream& os) const {
   MutexLock mu(Thread::Current(), intern_table_lock_);
-  os << "Intern table: " << strong_interns_.size() << " strong; "
-     << weak_interns_.size() << " weak\n";
+  os << "Intern table: " << strong_interns_.Size() << " strong; "
+     << weak_interns_.Size() << " weak";
+  if (image_interns_ != NULL) {
+    os << "; " << image_interns_->GetLength() << " image slots";
+  }
+  os << "\n";
 }
 
 void InternTable::VisitRoots(RootVisitor* visitor, void* arg,
                              bool only_dirty, bool clean_dirty) {
   MutexLock mu(Thread::Current(), intern_table_lock_);
   if (!only_dirty || is_dirty_) {
-    for (const auto& strong_intern : strong_interns_) {
-      visitor(strong_intern.second, arg);
-    }
+    strong_interns_.VisitRoots(visitor, arg);
     if (clean_dirty) {
       is_dirty_ = false;
     }
@@ -58,59 +197,60 @@ void InternTable::VisitRoots(RootVisitor* visitor, void* arg,
   // image roots.
 }
 
-mirror::String* InternTable::Lookup(Table& table, mirror::String* s,
-                                    uint32_t hash_code) {
-  intern_table_lock_.AssertHeld(Thread::Current());
-  for (auto it = table.find(hash_code), end = table.end(); it != end; ++it) {
-    mirror::String* existing_string = it->second;
-    if (existing_string->Equals(s)) {
-      return existing_string;
-    }
+mirror::String* InternTable::LookupImage(mirror::String* s, int32_t hash_code) const {
+  if (image_interns_ == NULL) {
+    return NULL;  // No image present.
   }
-  return NULL;
-}
-
-mirror::String* InternTable::Insert(Table& table, mirror::String* s,
-                                    uint32_t hash_code) {
-  intern_table_lock_.AssertHeld(Thread::Current());
-  table.insert(std::make_pair(hash_code, s));
-  return s;
-}
-
-void InternTable::Remove(Table& table, const mirror::String* s,
-                         uint32_t hash_code) {
-  intern_table_lock_.AssertHeld(Thread::Current());
-  for (auto it = table.find(hash_code), end = table.end(); it != end; ++it) {
-    if (it->second == s) {
-      table.erase(it);
-      return;
+  const size_t mask = image_interns_->GetLength() - 1;
+  for (size_t i = FirstSlot(hash_code, mask); ; i = (i + 1) & mask) {
+    mirror::String* image = image_interns_->GetWithoutChecks(i);
+    if (image == NULL) {
+      return NULL;
+    }
+    if (image->GetHashCode() == hash_code && image->Equals(s)) {
+      return image;
     }
   }
 }
 
-static mirror::String* LookupStringFromImage(mirror::String* s)
-    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  gc::space::ImageSpace* image = Runtime::Current()->GetHeap()->GetImageSpace();
-  if (image == NULL) {
-    return NULL;  // No image present.
+mirror::ObjectArray<mirror::String>* InternTable::CreateImageTable(Thread* self) {
+  std::vector<mirror::String*> strings;
+  {
+    MutexLock mu(self, intern_table_lock_);
+    strong_interns_.GetStrings(&strings);
   }
-  mirror::Object* root = image->GetImageHeader().GetImageRoot(ImageHeader::kDexCaches);
-  mirror::ObjectArray<mirror::DexCache>* dex_caches = root->AsObjectArray<mirror::DexCache>();
-  const std::string utf8 = s->ToModifiedUtf8();
-  for (int32_t i = 0; i < dex_caches->GetLength(); ++i) {
-    mirror::DexCache* dex_cache = dex_caches->Get(i);
-    const DexFile* dex_file = dex_cache->GetDexFile();
-    // Binary search the dex file for the string index.
-    const DexFile::StringId* string_id = dex_file->FindStringId(utf8.c_str());
-    if (string_id != NULL) {
-      uint32_t string_idx = dex_file->GetIndexForStringId(*string_id);
-      mirror::String* image = dex_cache->GetResolvedString(string_idx);
-      if (image != NULL) {
-        return image;
+  if (image_interns_ != NULL) {
+    for (int32_t i = 0; i < image_interns_->GetLength(); ++i) {
+      if (image_interns_->GetWithoutChecks(i) != NULL) {
+        strings.push_back(image_interns_->GetWithoutChecks(i));
       }
     }
   }
-  return NULL;
+  size_t capacity = kMinTableCapacity;
+  while (capacity < strings.size() * 2) {
+    capacity *= 2;
+  }
+  mirror::Class* array_class =
+      Runtime::Current()->GetClassLinker()->FindSystemClass("[Ljava/lang/String;");
+  CHECK(array_class != NULL);
+  mirror::ObjectArray<mirror::String>* image_table =
+      mirror::ObjectArray<mirror::String>::Alloc(self, array_class, capacity);
+  CHECK(image_table != NULL);
+  const size_t mask = capacity - 1;
+  for (mirror::String* s : strings) {
+    size_t i = FirstSlot(s->GetHashCode(), mask);
+    while (image_table->GetWithoutChecks(i) != NULL) {
+      i = (i + 1) & mask;
+    }
+    image_table->SetWithoutChecks(i, s);
+  }
+  return image_table;
+}
+
+void InternTable::SetImageTable(mirror::ObjectArray<mirror::String>* image_table) {
+  DCHECK(image_interns_ == NULL);
+  CHECK(IsPowerOfTwo(image_table->GetLength())) << image_table->GetLength();
+  image_interns_ = image_table;
 }
 
 void InternTable::AllowNewInterns() {
@@ -124,65 +264,62 @@ void InternTable::DisallowNewInterns() {
   Thread* self = Thread::Current();
   MutexLock mu(self, intern_table_lock_);
   allow_new_interns_ = false;
+  // The mutators are suspended, so none of them is reading the old slots.
+  strong_interns_.FreeRetiredSlots();
+  weak_interns_.FreeRetiredSlots();
 }
 
 mirror::String* InternTable::Insert(mirror::String* s, bool is_strong) {
+  DCHECK(s != NULL);
+  const int32_t hash_code = s->GetHashCode();
+
+  // Check the image and the strong table for a match, neither needs the lock.
+  mirror::String* image = LookupImage(s, hash_code);
+  if (image != NULL) {
+    return image;
+  }
+  mirror::String* strong = strong_interns_.Lookup(s, hash_code);
+  if (strong != NULL) {
+    return strong;
+  }
+
   Thread* self = Thread::Current();
   MutexLock mu(self, intern_table_lock_);
 
-  DCHECK(s != NULL);
-  uint32_t hash_code = s->GetHashCode();
-
   while (UNLIKELY(!allow_new_interns_)) {
     new_intern_condition_.WaitHoldingLocks(self);
   }
 
-  if (is_strong) {
-    // Check the strong table for a match.
-    mirror::String* strong = Lookup(strong_interns_, s, hash_code);
-    if (strong != NULL) {
-      return strong;
-    }
+  // Another thread may have inserted the string since the lookup.
+  strong = strong_interns_.Lookup(s, hash_code);
+  if (strong != NULL) {
+    return strong;
+  }
 
+  mirror::String* weak = weak_interns_.Lookup(s, hash_code);
+  if (is_strong) {
     // Mark as dirty so that we rescan the roots.
     is_dirty_ = true;
 
-    // Check the image for a match.
-    mirror::String* image = LookupStringFromImage(s);
-    if (image != NULL) {
-      return Insert(strong_interns_, image, hash_code);
-    }
-
-    // There is no match in the strong table, check the weak table.
-    mirror::String* weak = Lookup(weak_interns_, s, hash_code);
     if (weak != NULL) {
       // A match was found in the weak table. Promote to the strong table.
-      Remove(weak_interns_, weak, hash_code);
-      return Insert(strong_interns_, weak, hash_code);
+      weak_interns_.Remove(weak, hash_code);
+      strong_interns_.Insert(weak, hash_code);
+      return weak;
     }
 
     // No match in the strong table or the weak table. Insert into the strong
     // table.
-    return Insert(strong_interns_, s, hash_code);
+    strong_interns_.Insert(s, hash_code);
+    return s;
   }
 
-  // Check the strong table for a match.
-  mirror::String* strong = Lookup(strong_interns_, s, hash_code);
-  if (strong != NULL) {
-    return strong;
-  }
-  // Check the image for a match.
-  mirror::String* image = LookupStringFromImage(s);
-  if (image != NULL) {
-    return Insert(weak_interns_, image, hash_code);
-  }
-  // Check the weak table for a match.
-  mirror::String* weak = Lookup(weak_interns_, s, hash_code);
   if (weak != NULL) {
     return weak;
   }
   // Insert into the weak table.
-  return Insert(weak_interns_, s, hash_code);
+  weak_interns_.Insert(s, hash_code);
+  return s;
 }
 
 mirror::String* InternTable::InternStrong(int32_t utf16_length,
@@ -212,21 +349,13 @@ mirror::String* InternTable::InternWeak(mirror::String* s) {
 
 bool InternTable::ContainsWeak(mirror::String* s) {
   MutexLock mu(Thread::Current(), intern_table_lock_);
-  const mirror::String* found = Lookup(weak_interns_, s, s->GetHashCode());
+  const mirror::String* found = weak_interns_.Lookup(s, s->GetHashCode());
   return found == s;
 }
 
 void InternTable::SweepInternTableWeaks(IsMarkedTester is_marked, void* arg) {
   MutexLock mu(Thread::Current(), intern_table_lock_);
-  // TODO: std::remove_if + lambda.
-  for (auto it = weak_interns_.begin(), end = weak_interns_.end(); it != end;) {
-    mirror::Object* object = it->second;
-    if (!is_marked(object, arg)) {
-      weak_interns_.erase(it++);
-    } else {
-      ++it;
-    }
-  }
+  weak_interns_.SweepWeaks(is_marked, arg);
 }
 
 }  // namespace art
@@ -20,10 +20,11 @@
 #include "base/mutex.h"
 #include "root_visitor.h"
 
-#include <map>
+#include <vector>
 
 namespace art {
 namespace mirror {
+template<class T> class ObjectArray;
 class String;
 }  // namespace mirror
 
@@ -36,6 +37,10 @@ class String;
  * String.intern. Some code (XML parsers being a prime example) relies on being able to intern
  * arbitrarily many strings for the duration of a parse without permanently increasing the memory
  * footprint.
+ *
+ * Both tables are open addressed hash tables keyed by the string hash code. Lookups in the strong
+ * table don't take the lock, since strong interns are never removed, and so do lookups in the
+ * immutable table of the strings interned when the boot image was written.
  */
 class InternTable {
  public:
@@ -69,23 +74,86 @@ class InternTable {
   void DisallowNewInterns() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
   void AllowNewInterns() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Allocates the table of the strong interns written to the boot image, laid out the same way
+  // as the open addressed tables with NULL for the free slots.
+  mirror::ObjectArray<mirror::String>* CreateImageTable(Thread* self)
+      LOCKS_EXCLUDED(intern_table_lock_)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // Sets the table written by CreateImageTable, which must be set before any string is interned.
+  void SetImageTable(mirror::ObjectArray<mirror::String>* image_table)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
  private:
-  typedef std::multimap<int32_t, mirror::String*> Table;
+  // Linear probing on the hash code. The capacity is a power of two and the table is grown to
+  // keep it at most half full. Removing strings shifts the following ones back, so only the
+  // tables which are never removed from may be read without the lock.
+  class Table {
+   public:
+    Table();
+    ~Table();
+
+    size_t Size() const {
+      return num_strings_;
+    }
+
+    mirror::String* Lookup(mirror::String* s, int32_t hash_code) const
+        SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+    void Insert(mirror::String* s, int32_t hash_code);
+    void Remove(const mirror::String* s, int32_t hash_code);
+    void VisitRoots(RootVisitor* visitor, void* arg) const;
+    // Removes the strings which aren't marked, shrinking the table once it is mostly empty. The
+    // old slots are freed right away, so the table must not be read without the lock.
+    void SweepWeaks(IsMarkedTester is_marked, void* arg);
+    void GetStrings(std::vector<mirror::String*>* strings) const;
+
+    // Frees the slots replaced by growing the table, lock free readers must be excluded.
+    void FreeRetiredSlots() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+   private:
+    // The hash code is written before the string, a reader which reads a stale hash code for a
+    // string being inserted just misses it.
+    struct Slot {
+      Slot() : hash_code(0), string(NULL) {}
+
+      volatile int32_t hash_code;
+      mirror::String* volatile string;
+    };
+    typedef std::vector<Slot> Slots;
+
+    void Resize(size_t capacity);
+    static void Put(Slots* slots, mirror::String* s, int32_t hash_code);
+
+    // Replaced as a whole when the table grows, so that a reader sees either the old or the new
+    // slots.
+    Slots* volatile slots_;
+    size_t num_strings_;
+    std::vector<Slots*> retired_slots_;
+
+    DISALLOW_COPY_AND_ASSIGN(Table);
+  };
+
+  // Index of the first slot to probe for hash_code in a table of capacity mask + 1.
+  static size_t FirstSlot(int32_t hash_code, size_t mask) {
+    uint32_t hash = static_cast<uint32_t>(hash_code);
+    return (hash ^ (hash >> 16)) & mask;
+  }
 
   mirror::String* Insert(mirror::String* s, bool is_strong)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
-  mirror::String* Lookup(Table& table, mirror::String* s, uint32_t hash_code)
+  mirror::String* LookupImage(mirror::String* s, int32_t hash_code) const
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
-  mirror::String* Insert(Table& table, mirror::String* s, uint32_t hash_code);
-  void Remove(Table& table, const mirror::String* s, uint32_t hash_code);
 
   mutable Mutex intern_table_lock_;
   bool is_dirty_ GUARDED_BY(intern_table_lock_);
   bool allow_new_interns_ GUARDED_BY(intern_table_lock_);
   ConditionVariable new_intern_condition_ GUARDED_BY(intern_table_lock_);
-  Table strong_interns_ GUARDED_BY(intern_table_lock_);
+  // Written with the lock held, read without it.
+  Table strong_interns_;
   Table weak_interns_ GUARDED_BY(intern_table_lock_);
+  // Immutable once set, NULL without an image.
+  mirror::ObjectArray<mirror::String>* image_interns_;
 };
 
 }  // namespace art
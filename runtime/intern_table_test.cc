@@ -16,8 +16,10 @@
 
 #include "intern_table.h"
 
+#include "base/stringprintf.h"
 #include "common_test.h"
 #include "mirror/object.h"
+#include "mirror/object_array-inl.h"
 #include "sirt_ref.h"
 
 namespace art {
@@ -54,6 +56,36 @@ TEST_F(InternTableTest, Size) {
   EXPECT_EQ(2U, t.Size());
 }
 
+TEST_F(InternTableTest, Grow) {
+  ScopedObjectAccess soa(Thread::Current());
+  InternTable t;
+  static const size_t kNumStrings = 1000;
+  SirtRef<mirror::ObjectArray<mirror::Object> > strings(soa.Self(),
+      class_linker_->AllocObjectArray<mirror::Object>(soa.Self(), 2 * kNumStrings));
+  // Interleave strong and weak interns so that both tables grow several times.
+  for (size_t i = 0; i < kNumStrings; ++i) {
+    strings->Set(2 * i, t.InternStrong(StringPrintf("strong %zd", i).c_str()));
+    mirror::String* weak =
+        mirror::String::AllocFromModifiedUtf8(soa.Self(), StringPrintf("weak %zd", i).c_str());
+    strings->Set(2 * i + 1, t.InternWeak(weak));
+  }
+  EXPECT_EQ(2 * kNumStrings, t.Size());
+  // Promoting every other weak removes it from the middle of the probe sequences.
+  for (size_t i = 0; i < kNumStrings; i += 2) {
+    EXPECT_EQ(strings->Get(2 * i + 1), t.InternStrong(StringPrintf("weak %zd", i).c_str()));
+  }
+  for (size_t i = 0; i < kNumStrings; ++i) {
+    mirror::String* strong = t.InternStrong(StringPrintf("strong %zd", i).c_str());
+    EXPECT_EQ(strings->Get(2 * i), strong);
+    EXPECT_FALSE(t.ContainsWeak(strong));
+    mirror::String* weak = strings->Get(2 * i + 1)->AsString();
+    EXPECT_EQ(weak, t.InternWeak(mirror::String::AllocFromModifiedUtf8(
+        soa.Self(), StringPrintf("weak %zd", i).c_str())));
+    EXPECT_EQ(i % 2 != 0, t.ContainsWeak(weak));
+  }
+  EXPECT_EQ(2 * kNumStrings, t.Size());
+}
+
 class TestPredicate {
  public:
   bool IsMarked(const mirror::Object* s) const {
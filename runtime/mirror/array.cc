@@ -34,6 +34,11 @@ namespace mirror {
 
 Array* Array::Alloc(Thread* self, Class* array_class, int32_t component_count,
                     size_t component_size) {
+  return Alloc(self, array_class, component_count, component_size, false);
+}
+
+Array* Array::Alloc(Thread* self, Class* array_class, int32_t component_count,
+                    size_t component_size, bool tenured) {
   DCHECK(array_class != NULL);
   DCHECK_GE(component_count, 0);
   DCHECK(array_class->IsArrayClass());
@@ -52,7 +57,8 @@ Array* Array::Alloc(Thread* self, Class* array_class, int32_t component_count,
   }
 
   gc::Heap* heap = Runtime::Current()->GetHeap();
-  Array* array = down_cast<Array*>(heap->AllocObject(self, array_class, size));
+  Array* array = down_cast<Array*>(tenured ? heap->AllocTenuredObject(self, array_class, size)
+                                           : heap->AllocObject(self, array_class, size));
   if (array != NULL) {
     DCHECK(array->IsArrayInstance());
     array->SetLength(component_count);
@@ -65,6 +71,11 @@ Array* Array::Alloc(Thread* self, Class* array_class, int32_t component_count) {
   return Alloc(self, array_class, component_count, array_class->GetComponentSize());
 }
 
+Array* Array::AllocTenured(Thread* self, Class* array_class, int32_t component_count) {
+  DCHECK(array_class->IsArrayClass());
+  return Alloc(self, array_class, component_count, array_class->GetComponentSize(), true);
+}
+
 // Create a multi-dimensional array of Objects or primitive types.
 //
 // We have to generate the names for X[], X[][], X[][][], and so on.  The
@@ -33,6 +33,10 @@ class MANAGED Array : public Object {
                       size_t component_size)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Allocate the array for a tenured allocation site, see Heap::AllocTenuredObject.
+  static Array* AllocTenured(Thread* self, Class* array_class, int32_t component_count)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
   static Array* CreateMultiArray(Thread* self, Class* element_class, IntArray* dimensions)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
@@ -86,6 +90,10 @@ class MANAGED Array : public Object {
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
  private:
+  static Array* Alloc(Thread* self, Class* array_class, int32_t component_count,
+                      size_t component_size, bool tenured)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
   // The number of array elements.
   int32_t length_;
   // Marker for the data (used by generated code)
@@ -198,6 +198,18 @@ inline bool Class::IsAssignableFromArray(const Class* src) const {
 inline bool Class::IsSubClass(const Class* klass) const {
   DCHECK(!IsInterface()) << PrettyClass(this);
   DCHECK(!IsArrayClass()) << PrettyClass(this);
+  const MemberOffset status_offset = OFFSET_OF_OBJECT_MEMBER(Class, status_);
+  const uint32_t klass_status = klass->GetField32(status_offset, false);
+  const uint32_t status = GetField32(status_offset, false);
+  if ((klass_status & kPathAssignedBit) != 0 && (status & kPathInitializedBit) != 0) {
+    // A shallower class, which keeps its children count where klass has its index, can't be a
+    // subclass of klass. The path of java.lang.Object is empty.
+    const size_t klass_depth = GetPathDepth(klass_status);
+    if (GetPathDepth(status) < klass_depth) {
+      return false;
+    }
+    return ((status ^ klass_status) & GetPathMask(klass_depth)) == 0;
+  }
   const Class* current = this;
   do {
     if (current == klass) {
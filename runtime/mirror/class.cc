@@ -105,7 +105,14 @@ void Class::SetStatus(Status new_status, Thread* self) {
     self->SetException(gc_safe_throw_location, old_exception.get());
   }
   CHECK(sizeof(Status) == sizeof(uint32_t)) << PrettyClass(this);
-  SetField32(OFFSET_OF_OBJECT_MEMBER(Class, status_), new_status, false);
+  // The path of the class shares the field, and is changed by its subclasses being linked.
+  const MemberOffset status_offset = OFFSET_OF_OBJECT_MEMBER(Class, status_);
+  uint32_t old_field;
+  uint32_t new_field;
+  do {
+    old_field = GetField32(status_offset, true);
+    new_field = (old_field & ~kStatusMask) | (static_cast<uint32_t>(new_status) << kStatusShift);
+  } while (!CasField32(status_offset, old_field, new_field));
   // Classes that are being resolved or initialized need to notify waiters that the class status
   // changed. See ClassLinker::EnsureResolved and ClassLinker::WaitForInitializeClass.
   if ((old_status >= kStatusResolved || new_status >= kStatusResolved) &&
@@ -268,6 +275,45 @@ void Class::SetReferenceStaticOffsets(uint32_t new_reference_offsets) {
              new_reference_offsets, false);
 }
 
+void Class::SetSubtypeCheckPath() {
+  DCHECK(!IsInterface()) << PrettyClass(this);
+  const MemberOffset status_offset = OFFSET_OF_OBJECT_MEMBER(Class, status_);
+  Class* super_class = GetSuperClass();
+  uint32_t path = kPathInitializedBit;
+  if (super_class == NULL) {
+    // java.lang.Object, at depth 0.
+    path |= kPathAssignedBit;
+  } else {
+    uint32_t super_status = super_class->GetField32(status_offset, true);
+    if ((super_status & kPathInitializedBit) == 0) {
+      return;
+    }
+    const size_t super_depth = GetPathDepth(super_status);
+    const uint32_t super_path_mask = GetPathMask(super_depth);
+    const size_t depth = super_depth < kMaxPathDepth ? super_depth + 1 : super_depth;
+    path |= (super_status & super_path_mask) | (depth << kPathDepthShift);
+    if ((super_status & kPathAssignedBit) != 0 && super_depth < kMaxPathDepth) {
+      // Take the next index among the children of the super class, indices start at 1 so that
+      // the unassigned subclasses never match.
+      const uint32_t index_unit = super_path_mask + 1;
+      const uint32_t level_mask = GetPathMask(super_depth + 1) & ~super_path_mask;
+      while ((super_status & level_mask) != level_mask) {
+        const uint32_t new_super_status = super_status + index_unit;
+        if (super_class->CasField32(status_offset, super_status, new_super_status)) {
+          path |= (new_super_status & level_mask) | kPathAssignedBit;
+          break;
+        }
+        super_status = super_class->GetField32(status_offset, true);
+      }
+    }
+  }
+  uint32_t old_status;
+  do {
+    old_status = GetField32(status_offset, true);
+    DCHECK_EQ(old_status & ~kStatusMask, 0U) << PrettyClass(this);
+  } while (!CasField32(status_offset, old_status, (old_status & kStatusMask) | path));
+}
+
 bool Class::IsInSamePackage(const StringPiece& descriptor1, const StringPiece& descriptor2) {
   size_t i = 0;
   while (descriptor1[i] != '\0' && descriptor1[i] == descriptor2[i]) {
@@ -125,7 +125,8 @@ class MANAGED Class : public StaticStorageBase {
 
   Status GetStatus() const {
     DCHECK_EQ(sizeof(Status), sizeof(uint32_t));
-    return static_cast<Status>(GetField32(OFFSET_OF_OBJECT_MEMBER(Class, status_), true));
+    uint32_t status = GetField32(OFFSET_OF_OBJECT_MEMBER(Class, status_), true) >> kStatusShift;
+    return status == (kStatusMask >> kStatusShift) ? kStatusError : static_cast<Status>(status);
   }
 
   void SetStatus(Status new_status, Thread* self) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
@@ -441,6 +442,10 @@ class MANAGED Class : public StaticStorageBase {
   bool IsSubClass(const Class* klass) const
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Sets the path of the class in the hierarchy used by IsSubClass, once the super class is
+  // linked. Interfaces have no path.
+  void SetSubtypeCheckPath() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
   // Can src be assigned to this class? For example, String can be assigned to Object (by an
   // upcast), however, an Object cannot be assigned to a String as a potentially exception throwing
   // downcast would be necessary. Similarly for interfaces, a class that implements (or an interface
@@ -755,6 +760,35 @@ class MANAGED Class : public StaticStorageBase {
   void SetPreverifiedFlagOnAllMethods() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
  private:
+  // Besides the status, in its top bits, status_ holds the path of the class from
+  // java.lang.Object: the index of each of its first kMaxPathDepth ancestors (and itself) among
+  // the children of their super class, one level of bits per depth. A class whose path is
+  // assigned has a unique path, which is the prefix of the paths of all its subclasses, so that
+  // IsSubClass only compares the levels of the path up to its depth. An assigned class below
+  // kMaxPathDepth counts the children it assigned in the level after its depth, where they have
+  // their index, so IsSubClass never compares a class shallower than the one it checks against.
+  // Classes beyond kMaxPathDepth, or whose super class ran out of indices, only have the path of
+  // their ancestors and fall back on walking the super classes.
+  static const uint32_t kStatusShift = 28;
+  static const uint32_t kStatusMask = 0xF0000000;
+  static const uint32_t kPathInitializedBit = 1 << 27;
+  static const uint32_t kPathAssignedBit = 1 << 26;
+  static const uint32_t kPathDepthShift = 24;
+  static const uint32_t kPathDepthMask = 3 << kPathDepthShift;
+  static const size_t kMaxPathDepth = 3;
+
+  static size_t GetPathDepth(uint32_t status) {
+    return (status & kPathDepthMask) >> kPathDepthShift;
+  }
+
+  // Mask of the levels of the path of a class at the given depth, the levels having 11, 7 and 6
+  // bits.
+  static uint32_t GetPathMask(size_t depth) {
+    static const uint32_t kPathMasks[kMaxPathDepth + 1] = { 0, 0x7FF, 0x3FFFF, 0xFFFFFF };
+    DCHECK_LE(depth, kMaxPathDepth);
+    return kPathMasks[depth];
+  }
+
   void SetVerifyErrorClass(Class* klass) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
   bool Implements(const Class* klass) const
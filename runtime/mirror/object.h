@@ -221,6 +221,14 @@ class MANAGED Object {
     }
   }
 
+  // Sets the field to new_value if it holds old_value, returns whether it did.
+  bool CasField32(MemberOffset field_offset, uint32_t old_value, uint32_t new_value) {
+    VerifyObject(this);
+    byte* raw_addr = reinterpret_cast<byte*>(this) + field_offset.Int32Value();
+    volatile int32_t* word_addr = reinterpret_cast<volatile int32_t*>(raw_addr);
+    return android_atomic_release_cas(old_value, new_value, word_addr) == 0;
+  }
+
   uint64_t GetField64(MemberOffset field_offset, bool is_volatile) const;
 
   void SetField64(MemberOffset field_offset, uint64_t new_value, bool is_volatile);
@@ -17,15 +17,23 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <sstream>
+
+#include "base/stringprintf.h"
 #include "class_linker.h"
 #include "common_throws.h"
 #include "debugger.h"
-#include "gc/space/dlmalloc_space.h"
+#include "gc/allocation_profiler.h"
+#include "gc/gc_event_log.h"
+#include "gc/heap.h"
 #include "gc/space/large_object_space.h"
+#include "gc/space/malloc_space.h"
 #include "gc/space/space-inl.h"
 #include "hprof/hprof.h"
 #include "jni_internal.h"
 #include "mirror/class.h"
+#include "ScopedLocalRef.h"
 #include "ScopedUtfChars.h"
 #include "scoped_thread_state_change.h"
 #include "toStringArray.h"
@@ -33,6 +41,10 @@
 
 namespace art {
 
+// Whether the optional natives of these features were registered.
+static bool gGcEventLogRegistered = false;
+static bool gAllocationProfilingRegistered = false;
+
 static jobjectArray VMDebug_getVmFeatureList(JNIEnv* env, jclass) {
   std::vector<std::string> features;
   features.push_back("method-trace-profiling");
@@ -40,6 +52,12 @@ static jobjectArray VMDebug_getVmFeatureList(JNIEnv* env, jclass) {
   features.push_back("method-sample-profiling");
   features.push_back("hprof-heap-dump");
   features.push_back("hprof-heap-dump-streaming");
+  if (gGcEventLogRegistered) {
+    features.push_back("gc-event-log");
+  }
+  if (gAllocationProfilingRegistered) {
+    features.push_back("allocation-profiling");
+  }
   return toStringArray(env, features);
 }
 
@@ -172,7 +190,8 @@ static jlong VMDebug_threadCpuTimeNanos(JNIEnv*, jclass) {
  * Cause "hprof" data to be dumped.  We can throw an IOException if an
  * error occurs during file handling.
  */
-static void VMDebug_dumpHprofData(JNIEnv* env, jclass, jstring javaFilename, jobject javaFd) {
+static void DumpHprofData(JNIEnv* env, jstring javaFilename, jobject javaFd,
+                          bool omit_primitive_arrays) {
   // Only one of these may be NULL.
   if (javaFilename == NULL && javaFd == NULL) {
     ScopedObjectAccess soa(env);
@@ -201,11 +220,22 @@ static void VMDebug_dumpHprofData(JNIEnv* env, jclass, jstring javaFilename, job
     }
   }
 
-  hprof::DumpHeap(filename.c_str(), fd, false);
+  hprof::DumpHeap(filename.c_str(), fd, false, omit_primitive_arrays);
+}
+
+static void VMDebug_dumpHprofData(JNIEnv* env, jclass, jstring javaFilename, jobject javaFd) {
+  DumpHprofData(env, javaFilename, javaFd, false);
+}
+
+// Same as above, but primitive arrays are dumped without their contents if omitPrimitiveArrays
+// is true.
+static void VMDebug_dumpHprofDataOmittingArrays(JNIEnv* env, jclass, jstring javaFilename,
+                                                jobject javaFd, jboolean omitPrimitiveArrays) {
+  DumpHprofData(env, javaFilename, javaFd, omitPrimitiveArrays);
 }
 
 static void VMDebug_dumpHprofDataDdms(JNIEnv*, jclass) {
-  hprof::DumpHeap("[DDMS]", -1, true);
+  hprof::DumpHeap("[DDMS]", -1, true, false);
 }
 
 static void VMDebug_dumpReferenceTables(JNIEnv* env, jclass) {
@@ -267,14 +297,14 @@ static void VMDebug_getHeapSpaceStats(JNIEnv* env, jclass, jlongArray data) {
     if (space->IsImageSpace()) {
       // Currently don't include the image space.
     } else if (space->IsZygoteSpace()) {
-      gc::space::DlMallocSpace* dlmalloc_space = space->AsDlMallocSpace();
-      zygoteSize += dlmalloc_space->GetFootprint();
-      zygoteUsed += dlmalloc_space->GetBytesAllocated();
+      gc::space::MallocSpace* malloc_space = space->AsMallocSpace();
+      zygoteSize += malloc_space->GetFootprint();
+      zygoteUsed += malloc_space->GetBytesAllocated();
     } else {
       // This is the alloc space.
-      gc::space::DlMallocSpace* dlmalloc_space = space->AsDlMallocSpace();
-      allocSize += dlmalloc_space->GetFootprint();
-      allocUsed += dlmalloc_space->GetBytesAllocated();
+      gc::space::MallocSpace* malloc_space = space->AsMallocSpace();
+      allocSize += malloc_space->GetFootprint();
+      allocUsed += malloc_space->GetBytesAllocated();
     }
   }
   typedef std::vector<gc::space::DiscontinuousSpace*>::const_iterator It2;
@@ -303,6 +333,64 @@ static void VMDebug_getHeapSpaceStats(JNIEnv* env, jclass, jlongArray data) {
   env->ReleasePrimitiveArrayCritical(data, arr, 0);
 }
 
+static jlong VMDebug_getGcEventCount(JNIEnv*, jclass) {
+  return Runtime::Current()->GetHeap()->GetGcEventLog()->GetEventCount();
+}
+
+// Returns the events still in the log from firstSequence on, each flattened into
+// GcEventLog::kFlattenedEventSize longs.
+static jlongArray VMDebug_getGcEvents(JNIEnv* env, jclass, jlong firstSequence) {
+  std::vector<int64_t> events;
+  Runtime::Current()->GetHeap()->GetGcEventLog()->GetEvents(std::max<jlong>(firstSequence, 0),
+                                                            &events);
+  jlongArray result = env->NewLongArray(events.size());
+  if (result != NULL && !events.empty()) {
+    env->SetLongArrayRegion(result, 0, events.size(), reinterpret_cast<jlong*>(&events[0]));
+  }
+  return result;
+}
+
+// Returns the collector names and split labels the events refer to by index.
+static jobjectArray VMDebug_getGcEventNames(JNIEnv* env, jclass) {
+  return toStringArray(env, Runtime::Current()->GetHeap()->GetGcEventLog()->GetNames());
+}
+
+// Dumps the events still in the log as CSV, or JSON along with pause histograms if json is true.
+static jstring VMDebug_dumpGcEvents(JNIEnv* env, jclass, jboolean json) {
+  std::ostringstream os;
+  Runtime::Current()->GetHeap()->DumpGcEvents(os, json);
+  return env->NewStringUTF(os.str().c_str());
+}
+
+// Samples an allocation every intervalBytes allocated by each thread.
+static void VMDebug_startAllocationProfiling(JNIEnv* env, jclass, jint intervalBytes) {
+  if (intervalBytes <= 0) {
+    ScopedObjectAccess soa(env);
+    ThrowIllegalArgumentException(NULL, StringPrintf("invalid interval %d", intervalBytes).c_str());
+    return;
+  }
+  Runtime::Current()->GetHeap()->GetAllocationProfiler()->SetSampleInterval(intervalBytes);
+}
+
+// Stops sampling, the sites counted so far are kept.
+static void VMDebug_stopAllocationProfiling(JNIEnv*, jclass) {
+  Runtime::Current()->GetHeap()->GetAllocationProfiler()->SetSampleInterval(0);
+}
+
+static void VMDebug_resetAllocationProfile(JNIEnv*, jclass) {
+  Runtime::Current()->GetHeap()->GetAllocationProfiler()->Reset();
+}
+
+// Dumps the maxSites allocation sites with the most estimated bytes.
+static jstring VMDebug_dumpAllocationProfile(JNIEnv* env, jclass, jint maxSites) {
+  std::ostringstream os;
+  {
+    ScopedObjectAccess soa(env);
+    Runtime::Current()->GetHeap()->GetAllocationProfiler()->Dump(os, std::max(maxSites, 0));
+  }
+  return env->NewStringUTF(os.str().c_str());
+}
+
 static JNINativeMethod gMethods[] = {
   NATIVE_METHOD(VMDebug, countInstancesOfClass, "(Ljava/lang/Class;Z)J"),
   NATIVE_METHOD(VMDebug, crash, "()V"),
@@ -335,8 +423,52 @@ static JNINativeMethod gMethods[] = {
   NATIVE_METHOD(VMDebug, threadCpuTimeNanos, "()J"),
 };
 
+// The following are only registered if the class library declares them.
+static JNINativeMethod gHprofOmittingArraysMethods[] = {
+  { "dumpHprofData", "(Ljava/lang/String;Ljava/io/FileDescriptor;Z)V",
+    reinterpret_cast<void*>(VMDebug_dumpHprofDataOmittingArrays) },
+};
+
+static JNINativeMethod gGcEventLogMethods[] = {
+  NATIVE_METHOD(VMDebug, dumpGcEvents, "(Z)Ljava/lang/String;"),
+  NATIVE_METHOD(VMDebug, getGcEventCount, "()J"),
+  NATIVE_METHOD(VMDebug, getGcEventNames, "()[Ljava/lang/String;"),
+  NATIVE_METHOD(VMDebug, getGcEvents, "(J)[J"),
+};
+
+static JNINativeMethod gAllocationProfilingMethods[] = {
+  NATIVE_METHOD(VMDebug, dumpAllocationProfile, "(I)Ljava/lang/String;"),
+  NATIVE_METHOD(VMDebug, resetAllocationProfile, "()V"),
+  NATIVE_METHOD(VMDebug, startAllocationProfiling, "(I)V"),
+  NATIVE_METHOD(VMDebug, stopAllocationProfiling, "()V"),
+};
+
+// Registers methods if c declares all of them, returns whether they were registered.
+static bool RegisterOptionalNatives(JNIEnv* env, jclass c, const JNINativeMethod* methods,
+                                    size_t method_count) {
+  for (size_t i = 0; i < method_count; ++i) {
+    if (env->GetStaticMethodID(c, methods[i].name, methods[i].signature) == NULL) {
+      env->ExceptionClear();
+      return false;
+    }
+  }
+  if (env->RegisterNatives(c, methods, method_count) < 0 || env->ExceptionCheck()) {
+    env->ExceptionClear();
+    return false;
+  }
+  return true;
+}
+
 void register_dalvik_system_VMDebug(JNIEnv* env) {
   REGISTER_NATIVE_METHODS("dalvik/system/VMDebug");
+  ScopedLocalRef<jclass> c(env, env->FindClass("dalvik/system/VMDebug"));
+  RegisterOptionalNatives(env, c.get(), gHprofOmittingArraysMethods,
+                          arraysize(gHprofOmittingArraysMethods));
+  gGcEventLogRegistered = RegisterOptionalNatives(env, c.get(), gGcEventLogMethods,
+                                                  arraysize(gGcEventLogMethods));
+  gAllocationProfilingRegistered =
+      RegisterOptionalNatives(env, c.get(), gAllocationProfilingMethods,
+                              arraysize(gAllocationProfilingMethods));
 }
 
 }  // namespace art
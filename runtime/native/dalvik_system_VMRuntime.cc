@@ -22,7 +22,7 @@
 #include "dex_file-inl.h"
 #include "gc/allocator/dlmalloc.h"
 #include "gc/heap.h"
-#include "gc/space/dlmalloc_space.h"
+#include "gc/space/malloc_space.h"
 #include "jni_internal.h"
 #include "mirror/class-inl.h"
 #include "mirror/object.h"
@@ -181,7 +181,7 @@ static void VMRuntime_trimHeap(JNIEnv*, jobject) {
 
   // Trim the managed heap.
   gc::Heap* heap = Runtime::Current()->GetHeap();
-  gc::space::DlMallocSpace* alloc_space = heap->GetAllocSpace();
+  gc::space::MallocSpace* alloc_space = heap->GetAllocSpace();
   size_t alloc_space_size = alloc_space->Size();
   float managed_utilization =
       static_cast<float>(alloc_space->GetBytesAllocated()) / alloc_space_size;
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "class_linker.h"
+#include "gc/heap.h"
+#include "jni_internal.h"
+#include "mirror/art_field-inl.h"
+#include "mirror/art_method-inl.h"
+#include "mirror/class-inl.h"
+#include "mirror/object-inl.h"
+#include "runtime.h"
+#include "scoped_thread_state_change.h"
+
+namespace art {
+
+static jobject Reference_getReferent(JNIEnv* env, jobject javaThis) {
+  ScopedObjectAccess soa(env);
+  mirror::Object* const ref = soa.Decode<mirror::Object*>(javaThis);
+  mirror::Object* const referent = Runtime::Current()->GetHeap()->GetReferent(soa.Self(), ref);
+  return soa.AddLocalReference<jobject>(referent);
+}
+
+static JNINativeMethod gMethods[] = {
+  NATIVE_METHOD(Reference, getReferent, "()Ljava/lang/Object;"),
+};
+
+void register_java_lang_ref_Reference(JNIEnv* env) {
+  gc::Heap* heap = Runtime::Current()->GetHeap();
+  // Older libcores read the referent field directly from Reference.get, the referents can't be
+  // cleared while mutators run with them.
+  {
+    ScopedObjectAccess soa(env);
+    mirror::Class* c =
+        Runtime::Current()->GetClassLinker()->FindSystemClass("Ljava/lang/ref/Reference;");
+    CHECK(c != NULL);
+    mirror::ArtMethod* m = c->FindDirectMethod("getReferent", "()Ljava/lang/Object;");
+    if (m == NULL) {
+      m = c->FindVirtualMethod("getReferent", "()Ljava/lang/Object;");
+    }
+    if (m == NULL || !m->IsNative()) {
+      VLOG(heap) << "Reference.getReferent isn't native, references are processed in the pause";
+      if (heap->IsSoftReferenceLruPolicyRequested()) {
+        LOG(WARNING) << "Ignoring -XX:SoftRefLRUPolicyMSPerMB, Reference.getReferent isn't native";
+      }
+      return;
+    }
+  }
+  REGISTER_NATIVE_METHODS("java/lang/ref/Reference");
+  heap->EnableConcurrentReferenceProcessing();
+  {
+    ScopedObjectAccess soa(env);
+    mirror::Class* c =
+        Runtime::Current()->GetClassLinker()->FindSystemClass("Ljava/lang/ref/SoftReference;");
+    CHECK(c != NULL);
+    mirror::ArtField* timestamp = c->FindDeclaredInstanceField("timestamp", "J");
+    if (timestamp != NULL) {
+      heap->SetSoftReferenceTimestampOffset(timestamp->GetOffset());
+    } else if (heap->IsSoftReferenceLruPolicyRequested()) {
+      LOG(WARNING) << "Ignoring -XX:SoftRefLRUPolicyMSPerMB, SoftReference has no timestamp field";
+    }
+  }
+}
+
+}  // namespace art
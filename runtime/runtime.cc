@@ -336,6 +336,17 @@ Runtime::ParsedOptions* Runtime::ParsedOptions::Create(const Options& options, b
   parsed->heap_maximum_size_ = gc::Heap::kDefaultMaximumSize;
   parsed->heap_min_free_ = gc::Heap::kDefaultMinFree;
   parsed->heap_max_free_ = gc::Heap::kDefaultMaxFree;
+  parsed->allocation_site_pretenuring_ = false;
+  // The free list space reserves as much address space as the heap capacity up front, which
+  // 32-bit processes can't spare by default.
+  parsed->free_list_large_object_space_ = false;
+  parsed->large_object_huge_pages_ = false;
+  parsed->pause_goal_ms_ = 0;  // 0 means no pause goal.
+  parsed->gc_time_ratio_ = 0;  // 0 means no throughput goal.
+  parsed->soft_ref_lru_policy_ms_per_mb_ = 0;  // 0 means every other soft referent is kept.
+  parsed->heap_trim_step_size_ = gc::Heap::kDefaultHeapTrimStepSize;
+  parsed->heap_trim_budget_ = gc::Heap::kDefaultHeapTrimBudget;
+  parsed->allocation_profile_interval_ = 0;  // 0 means no allocation profiling.
   parsed->heap_target_utilization_ = gc::Heap::kDefaultTargetUtilization;
   parsed->heap_growth_limit_ = 0;  // 0 means no growth limit.
   // Default to number of processors minus one since the main GC thread also does work.
@@ -354,6 +365,7 @@ Runtime::ParsedOptions* Runtime::ParsedOptions::Create(const Options& options, b
   parsed->long_pause_log_threshold_ = gc::Heap::kDefaultLongPauseLogThreshold;
   parsed->long_gc_log_threshold_ = gc::Heap::kDefaultLongGCLogThreshold;
   parsed->ignore_max_footprint_ = false;
+  parsed->use_rosalloc_ = false;
 
   parsed->lock_profiling_threshold_ = 0;
   parsed->hook_is_sensitive_thread_ = NULL;
@@ -486,6 +498,76 @@ Runtime::ParsedOptions* Runtime::ParsedOptions::Create(const Options& options, b
         return NULL;
       }
       parsed->heap_target_utilization_ = value;
+    } else if (StartsWith(option, "-XX:PauseGoalMs=")) {
+      std::istringstream iss(option.substr(strlen("-XX:PauseGoalMs=")));
+      size_t value;
+      iss >> value;
+      if (iss.fail() || !iss.eof()) {
+        if (ignore_unrecognized) {
+          continue;
+        }
+        LOG(FATAL) << "Invalid option '" << option << "'";
+        return NULL;
+      }
+      parsed->pause_goal_ms_ = value;
+    } else if (StartsWith(option, "-XX:GcTimeRatio=")) {
+      std::istringstream iss(option.substr(strlen("-XX:GcTimeRatio=")));
+      size_t value;
+      iss >> value;
+      if (iss.fail() || !iss.eof()) {
+        if (ignore_unrecognized) {
+          continue;
+        }
+        LOG(FATAL) << "Invalid option '" << option << "'";
+        return NULL;
+      }
+      parsed->gc_time_ratio_ = value;
+    } else if (StartsWith(option, "-XX:SoftRefLRUPolicyMSPerMB=")) {
+      std::istringstream iss(option.substr(strlen("-XX:SoftRefLRUPolicyMSPerMB=")));
+      size_t value;
+      iss >> value;
+      if (iss.fail() || !iss.eof()) {
+        if (ignore_unrecognized) {
+          continue;
+        }
+        LOG(FATAL) << "Invalid option '" << option << "'";
+        return NULL;
+      }
+      parsed->soft_ref_lru_policy_ms_per_mb_ = value;
+    } else if (StartsWith(option, "-XX:HeapTrimStepSize=")) {
+      size_t size = ParseMemoryOption(option.substr(strlen("-XX:HeapTrimStepSize=")).c_str(), 1024);
+      if (size == 0) {
+        if (ignore_unrecognized) {
+          continue;
+        }
+        // TODO: usage
+        LOG(FATAL) << "Failed to parse " << option;
+        return NULL;
+      }
+      parsed->heap_trim_step_size_ = size;
+    } else if (StartsWith(option, "-XX:HeapTrimBudget=")) {
+      size_t size = ParseMemoryOption(option.substr(strlen("-XX:HeapTrimBudget=")).c_str(), 1024);
+      if (size == 0) {
+        if (ignore_unrecognized) {
+          continue;
+        }
+        // TODO: usage
+        LOG(FATAL) << "Failed to parse " << option;
+        return NULL;
+      }
+      parsed->heap_trim_budget_ = size;
+    } else if (StartsWith(option, "-XX:AllocationProfileInterval=")) {
+      size_t size = ParseMemoryOption(
+          option.substr(strlen("-XX:AllocationProfileInterval=")).c_str(), 1024);
+      if (size == 0) {
+        if (ignore_unrecognized) {
+          continue;
+        }
+        // TODO: usage
+        LOG(FATAL) << "Failed to parse " << option;
+        return NULL;
+      }
+      parsed->allocation_profile_interval_ = size;
     } else if (StartsWith(option, "-XX:ParallelGCThreads=")) {
       parsed->parallel_gc_threads_ =
           ParseMemoryOption(option.substr(strlen("-XX:ParallelGCThreads=")).c_str(), 1024);
@@ -513,6 +595,12 @@ Runtime::ParsedOptions* Runtime::ParsedOptions::Create(const Options& options, b
       parsed->ignore_max_footprint_ = true;
     } else if (option == "-XX:LowMemoryMode") {
       parsed->low_memory_mode_ = true;
+    } else if (option == "-XX:AllocationSitePretenuring") {
+      parsed->allocation_site_pretenuring_ = true;
+    } else if (option == "-XX:FreeListLargeObjectSpace") {
+      parsed->free_list_large_object_space_ = true;
+    } else if (option == "-XX:LargeObjectHugePages") {
+      parsed->large_object_huge_pages_ = true;
     } else if (StartsWith(option, "-D")) {
       parsed->properties_.push_back(option.substr(strlen("-D")));
     } else if (StartsWith(option, "-Xjnitrace:")) {
@@ -531,6 +619,10 @@ Runtime::ParsedOptions* Runtime::ParsedOptions::Create(const Options& options, b
           parsed->is_concurrent_gc_enabled_ = false;
         } else if (gc_options[i] == "concurrent") {
           parsed->is_concurrent_gc_enabled_ = true;
+        } else if (gc_options[i] == "rosalloc") {
+          parsed->use_rosalloc_ = true;
+        } else if (gc_options[i] == "dlmalloc") {
+          parsed->use_rosalloc_ = false;
         } else {
           LOG(WARNING) << "Ignoring unknown -Xgc option: " << gc_options[i];
         }
@@ -874,20 +966,32 @@ bool Runtime::Init(const Options& raw_options, bool ignore_unrecognized) {
     GetInstrumentation()->ForceInterpretOnly();
   }
 
-  heap_ = new gc::Heap(options->heap_initial_size_,
-                       options->heap_growth_limit_,
-                       options->heap_min_free_,
-                       options->heap_max_free_,
-                       options->heap_target_utilization_,
-                       options->heap_maximum_size_,
-                       options->image_,
-                       options->is_concurrent_gc_enabled_,
-                       options->parallel_gc_threads_,
-                       options->conc_gc_threads_,
-                       options->low_memory_mode_,
-                       options->long_pause_log_threshold_,
-                       options->long_gc_log_threshold_,
-                       options->ignore_max_footprint_);
+  gc::HeapOptions heap_options;
+  heap_options.initial_size = options->heap_initial_size_;
+  heap_options.growth_limit = options->heap_growth_limit_;
+  heap_options.min_free = options->heap_min_free_;
+  heap_options.max_free = options->heap_max_free_;
+  heap_options.target_utilization = options->heap_target_utilization_;
+  heap_options.capacity = options->heap_maximum_size_;
+  heap_options.image_file_name = options->image_;
+  heap_options.concurrent_gc = options->is_concurrent_gc_enabled_;
+  heap_options.parallel_gc_threads = options->parallel_gc_threads_;
+  heap_options.conc_gc_threads = options->conc_gc_threads_;
+  heap_options.low_memory_mode = options->low_memory_mode_;
+  heap_options.long_pause_log_threshold = options->long_pause_log_threshold_;
+  heap_options.long_gc_log_threshold = options->long_gc_log_threshold_;
+  heap_options.ignore_max_footprint = options->ignore_max_footprint_;
+  heap_options.use_rosalloc = options->use_rosalloc_;
+  heap_options.allocation_site_pretenuring = options->allocation_site_pretenuring_;
+  heap_options.free_list_large_object_space = options->free_list_large_object_space_;
+  heap_options.large_object_huge_pages = options->large_object_huge_pages_;
+  heap_options.pause_goal_ms = options->pause_goal_ms_;
+  heap_options.gc_time_ratio = options->gc_time_ratio_;
+  heap_options.soft_ref_lru_policy_ms_per_mb = options->soft_ref_lru_policy_ms_per_mb_;
+  heap_options.heap_trim_step_size = options->heap_trim_step_size_;
+  heap_options.heap_trim_budget = options->heap_trim_budget_;
+  heap_options.allocation_profile_interval = options->allocation_profile_interval_;
+  heap_ = new gc::Heap(heap_options);
 
   BlockSignals();
   InitPlatformSignalHandlers();
@@ -1019,6 +1123,7 @@ void Runtime::RegisterRuntimeNativeMethods(JNIEnv* env) {
   REGISTER(register_java_lang_System);
   REGISTER(register_java_lang_Thread);
   REGISTER(register_java_lang_VMClassLoader);
+  REGISTER(register_java_lang_ref_Reference);
   REGISTER(register_java_lang_reflect_Array);
   REGISTER(register_java_lang_reflect_Constructor);
   REGISTER(register_java_lang_reflect_Field);
@@ -1253,6 +1358,8 @@ void Runtime::DisallowNewSystemWeaks() {
   monitor_list_->DisallowNewMonitors();
   intern_table_->DisallowNewInterns();
   java_vm_->DisallowNewWeakGlobals();
+  // Called with the mutators suspended, so none of them is in a class table lookup.
+  class_linker_->FreeRetiredClassTableSlots();
 }
 
 void Runtime::AllowNewSystemWeaks() {
@@ -103,11 +103,21 @@ class Runtime {
     size_t long_pause_log_threshold_;
     size_t long_gc_log_threshold_;
     bool ignore_max_footprint_;
+    bool use_rosalloc_;
     size_t heap_initial_size_;
     size_t heap_maximum_size_;
     size_t heap_growth_limit_;
     size_t heap_min_free_;
     size_t heap_max_free_;
+    bool allocation_site_pretenuring_;
+    bool free_list_large_object_space_;
+    bool large_object_huge_pages_;
+    size_t pause_goal_ms_;
+    size_t gc_time_ratio_;
+    size_t soft_ref_lru_policy_ms_per_mb_;
+    size_t heap_trim_step_size_;
+    size_t heap_trim_budget_;
+    size_t allocation_profile_interval_;
     double heap_target_utilization_;
     size_t parallel_gc_threads_;
     size_t conc_gc_threads_;
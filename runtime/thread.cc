@@ -987,11 +987,20 @@ Thread::Thread(bool daemon)
       no_thread_suspension_(0),
       last_no_thread_suspension_cause_(NULL),
       checkpoint_function_(0),
-      thread_exit_check_count_(0) {
+      thread_exit_check_count_(0),
+      thread_local_start_(NULL),
+      thread_local_pos_(NULL),
+      thread_local_end_(NULL),
+      thread_local_objects_(0),
+      allocation_sample_bytes_(0),
+      native_allocation_delta_(0),
+      thread_local_alloc_stack_top_(NULL),
+      thread_local_alloc_stack_end_(NULL) {
   CHECK_EQ((sizeof(Thread) % 4), 0U) << sizeof(Thread);
   state_and_flags_.as_struct.flags = 0;
   state_and_flags_.as_struct.state = kNative;
   memset(&held_mutexes_[0], 0, sizeof(held_mutexes_));
+  memset(&rosalloc_runs_[0], 0, sizeof(rosalloc_runs_));
 }
 
 bool Thread::IsStillStarting() const {
@@ -1053,6 +1062,15 @@ void Thread::Destroy() {
   if (jni_env_ != NULL) {
     jni_env_->monitors.VisitRoots(MonitorExitVisitor, self);
   }
+
+  // Return our allocation buffer and runs to the heap. Done while runnable so that we can't race
+  // with the GC revoking them while mutators are suspended.
+  {
+    ScopedObjectAccess soa(self);
+    Runtime::Current()->GetHeap()->RevokeThreadLocalBuffer(self);
+    self->RevokeThreadLocalAllocationStack();
+    Runtime::Current()->GetHeap()->FlushNativeAllocationDelta(self);
+  }
 }
 
 Thread::~Thread() {
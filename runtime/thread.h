@@ -92,6 +92,10 @@ class PACKED(4) Thread {
   // Space to throw a StackOverflowError in.
   static const size_t kStackOverflowReservedBytes = 16 * KB;
 
+  // Number of size brackets of the runs-of-slots allocator that threads allocate from without
+  // locking, see RosAlloc.
+  static const size_t kRosAllocNumThreadLocalSizeBrackets = 11;
+
   // Creates a new native thread corresponding to the given managed peer.
   // Used to implement Thread.start.
   static void CreateNativeThread(JNIEnv* env, jobject peer, size_t stack_size, bool daemon);
@@ -590,6 +594,90 @@ class PACKED(4) Thread {
 
   void AtomicClearFlag(ThreadFlag flag);
 
+  // Thread local allocation buffer, see DlMallocSpace::AllocThreadLocal. The position is the start
+  // of the unused tail of the buffer.
+  byte* GetThreadLocalStart() const {
+    return thread_local_start_;
+  }
+
+  byte* GetThreadLocalPos() const {
+    return thread_local_pos_;
+  }
+
+  byte* GetThreadLocalEnd() const {
+    return thread_local_end_;
+  }
+
+  size_t GetThreadLocalObjectsAllocated() const {
+    return thread_local_objects_;
+  }
+
+  void SetThreadLocalAllocationBuffer(byte* start, byte* end) {
+    thread_local_start_ = start;
+    thread_local_pos_ = start;
+    thread_local_end_ = end;
+    thread_local_objects_ = 0;
+  }
+
+  void RecordThreadLocalAllocation(byte* new_pos) {
+    DCHECK_GT(new_pos, thread_local_pos_);
+    DCHECK_LE(new_pos, thread_local_end_);
+    thread_local_pos_ = new_pos;
+    ++thread_local_objects_;
+  }
+
+  void* GetRosAllocRun(size_t index) const {
+    DCHECK_LT(index, kRosAllocNumThreadLocalSizeBrackets);
+    return rosalloc_runs_[index];
+  }
+
+  void SetRosAllocRun(size_t index, void* run) {
+    DCHECK_LT(index, kRosAllocNumThreadLocalSizeBrackets);
+    rosalloc_runs_[index] = run;
+  }
+
+  // Push obj onto the thread's segment of the allocation stack. Returns false if the segment is
+  // full or the thread doesn't have one.
+  bool PushOnThreadLocalAllocationStack(mirror::Object* obj) {
+    if (UNLIKELY(thread_local_alloc_stack_top_ >= thread_local_alloc_stack_end_)) {
+      return false;
+    }
+    *thread_local_alloc_stack_top_++ = obj;
+    return true;
+  }
+
+  void SetThreadLocalAllocationStack(mirror::Object** start, mirror::Object** end) {
+    DCHECK_LE(start, end);
+    thread_local_alloc_stack_top_ = start;
+    thread_local_alloc_stack_end_ = end;
+  }
+
+  // Stop pushing onto the current segment, its unused slots stay NULL.
+  void RevokeThreadLocalAllocationStack() {
+    thread_local_alloc_stack_top_ = NULL;
+    thread_local_alloc_stack_end_ = NULL;
+  }
+
+  // Number of bytes left to allocate before the next sample of the allocation profiler and the
+  // allocation site table, 0 until the thread first allocates while either samples.
+  size_t GetAllocationSampleBytes() const {
+    return allocation_sample_bytes_;
+  }
+
+  void SetAllocationSampleBytes(size_t bytes) {
+    allocation_sample_bytes_ = bytes;
+  }
+
+  // Native bytes registered by this thread which haven't been added to the heap's total yet,
+  // negative if it freed more than it allocated.
+  int GetNativeAllocationDelta() const {
+    return native_allocation_delta_;
+  }
+
+  void SetNativeAllocationDelta(int bytes) {
+    native_allocation_delta_ = bytes;
+  }
+
  private:
   // We have no control over the size of 'bool', but want our boolean fields
   // to be 4-byte quantities.
@@ -812,6 +900,26 @@ class PACKED(4) Thread {
   // How many times has our pthread key's destructor been called?
   uint32_t thread_exit_check_count_;
 
+  // Thread local allocation buffer carved out of the alloc space, kept after the entrypoints so
+  // that it doesn't move their offsets.
+  byte* thread_local_start_;
+  byte* thread_local_pos_;
+  byte* thread_local_end_;
+  size_t thread_local_objects_;
+
+  // Runs of the runs-of-slots allocator owned by this thread, one per small size bracket.
+  void* rosalloc_runs_[kRosAllocNumThreadLocalSizeBrackets];
+
+  // See GetAllocationSampleBytes.
+  size_t allocation_sample_bytes_;
+
+  // See GetNativeAllocationDelta.
+  int native_allocation_delta_;
+
+  // Segment of the heap's allocation stack owned by this thread, objects are pushed at the top.
+  mirror::Object** thread_local_alloc_stack_top_;
+  mirror::Object** thread_local_alloc_stack_end_;
+
   friend class ScopedThreadStateChange;
 
   DISALLOW_COPY_AND_ASSIGN(Thread);